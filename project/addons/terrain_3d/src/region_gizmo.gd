@@ -44,7 +44,7 @@ func _redraw() -> void:
 			
 		draw_rect(Vector2(region_size,region_size)*.5 + grid_tile_position, region_size, material, grid_color)
 		
-	draw_rect(Vector2.ZERO, region_size * 16.0, material, border_color)
+	draw_rect(Vector2.ZERO, region_size * Terrain3DStorage.REGION_MAP_SIZE, material, border_color)
 
 
 func draw_rect(p_pos: Vector2, p_size: float, p_material: StandardMaterial3D, p_modulate: Color) -> void:
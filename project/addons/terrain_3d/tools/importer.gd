@@ -49,6 +49,13 @@ func start_import(p_value: bool) -> void:
 		if not storage:
 			storage = Terrain3DStorage.new()
 
+		# A lone r16 height map is streamed from disk a row of regions at a time
+		var height_ext: String = height_file_name.get_extension().to_lower()
+		if (height_ext == "r16" or height_ext == "raw") and not control_file_name and not color_file_name:
+			storage.import_r16(height_file_name, import_position, import_offset, import_scale, r16_range, r16_size)
+			print("Terrain3DImporter: Import finished")
+			return
+
 		var imported_images: Array[Image]
 		imported_images.resize(Terrain3DStorage.TYPE_MAX)
 		var min_max := Vector2(0, 1)
@@ -0,0 +1,193 @@
+extends Node
+
+# Builds a synthetic terrain and times the hot paths of Terrain3D, printing the latency and
+# throughput of each operation. Compare the output of two builds to catch regressions.
+#
+# Run it from the editor, or headless from the project folder:
+#   godot --headless res://demo/Benchmark.tscn -- region_count=16 results_file=user://bench.json
+# Any exported variable can be set after the --.
+
+@export_range(1, 1024) var region_count: int = 4
+@export_enum("64:64", "128:128", "256:256", "512:512", "1024:1024", "2048:2048") var region_size: int = 1024
+@export var noise_seed: int = 0
+@export var iterations: int = 20
+@export var height_queries: int = 100000
+@export var bake_lod: int = 4
+@export var results_file: String = ""
+@export var quit_when_done: bool = true
+
+var terrain: Terrain3D
+var _results: Array[Dictionary]
+var _query_positions: PackedVector3Array
+
+
+func _ready() -> void:
+	_parse_arguments()
+	region_count = clampi(region_count, 1, Terrain3DStorage.REGION_MAP_SIZE * Terrain3DStorage.REGION_MAP_SIZE)
+	height_queries = maxi(1, height_queries)
+	_build_world()
+	print("Terrain3DBenchmark: %s, %d regions of %d, %d iterations" % [ terrain.get_version(),
+		region_count, region_size, iterations ])
+	# Let the terrain finish setting up before timing anything
+	await get_tree().process_frame
+	_run_benchmarks()
+	_save_results()
+
+	if quit_when_done:
+		get_tree().quit()
+
+
+func _parse_arguments() -> void:
+	for arg in OS.get_cmdline_user_args():
+		var parts: PackedStringArray = arg.trim_prefix("--").split("=", false, 1)
+		if parts.size() != 2 or not parts[0] in self:
+			push_warning("Terrain3DBenchmark: Ignoring unknown argument: ", arg)
+			continue
+		var value: Variant = str_to_var(parts[1])
+		set(parts[0], value if value != null else parts[1])
+
+
+# Adds regions in a square grid around the origin, each filled with its part of a noise field
+func _build_world() -> void:
+	var start := Time.get_ticks_usec()
+	terrain = Terrain3D.new()
+	terrain.name = "Terrain3D"
+	terrain.storage = Terrain3DStorage.new()
+	terrain.storage.region_size = region_size
+	terrain.texture_list = Terrain3DTextureList.new()
+	terrain.collision_enabled = false
+	add_child(terrain, true)
+
+	var noise := FastNoiseLite.new()
+	noise.seed = noise_seed
+	noise.frequency = 0.0005
+	var side: int = ceili(sqrt(region_count))
+	var corner := -Vector2i(side, side) / 2
+	for i in region_count:
+		var location := corner + Vector2i(i % side, floori(float(i) / side))
+		noise.offset = Vector3(location.x, location.y, 0) * region_size
+		var img: Image = noise.get_image(region_size, region_size, false, false, false)
+		img.convert(Image.FORMAT_RF)
+		var position := Vector3(location.x, 0, location.y) * region_size * terrain.get_mesh_vertex_spacing()
+		terrain.storage.add_region(position, [ img, null, null ], i == region_count - 1)
+
+	# Query positions spread over the regions, with some past their edges
+	var rng := RandomNumberGenerator.new()
+	rng.seed = noise_seed
+	var region_length: float = region_size * terrain.get_mesh_vertex_spacing()
+	var origin := Vector3(corner.x, 0, corner.y) * region_length
+	_query_positions.resize(height_queries)
+	for i in height_queries:
+		_query_positions[i] = origin + Vector3(rng.randf(), 0, rng.randf()) * side * region_length * 1.125
+	print("Terrain3DBenchmark: Built world in %.1f ms" % [ (Time.get_ticks_usec() - start) / 1000.0 ])
+
+
+func _run_benchmarks() -> void:
+	var storage: Terrain3DStorage = terrain.storage
+
+	var batch: int = mini(1000, height_queries)
+	_measure("get_height", batch, func(_i: int) -> void:
+		for j in batch:
+			storage.get_height(_query_positions[j]))
+
+	_measure("get_heights", height_queries, func(_i: int) -> void:
+		storage.get_heights(_query_positions))
+
+	_measure("get_ray_intersection", batch, func(_i: int) -> void:
+		for j in batch:
+			storage.get_ray_intersection(_query_positions[j] + Vector3(0, 1000, 0), Vector3(0.3, -1, 0.2).normalized()))
+
+	_measure("snap", 100, func(p_i: int) -> void:
+		for j in 100:
+			terrain.snap(_query_positions[(p_i * 100 + j) % height_queries]))
+
+	_measure("update_regions", region_count, func(_i: int) -> void:
+		storage.force_update_maps())
+
+	terrain.collision_enabled = true
+	_measure("update_collision", region_count, func(_i: int) -> void:
+		terrain.update_collision())
+	terrain.collision_enabled = false
+
+	var editor := Terrain3DEditor.new()
+	editor.set_terrain(terrain)
+	editor.set_tool(Terrain3DEditor.HEIGHT)
+	editor.set_operation(Terrain3DEditor.ADD)
+	editor.set_brush_data(_get_brush_data())
+	editor.start_operation(Vector3.ZERO)
+	_measure("operate", 1, func(p_i: int) -> void:
+		editor.operate(Vector3(p_i, 0, p_i), 0.0))
+	editor.stop_operation()
+	editor.free()
+
+	_measure("bake_mesh", region_count, func(_i: int) -> void:
+		terrain.bake_mesh(bake_lod, Terrain3DStorage.HEIGHT_FILTER_NEAREST), maxi(1, iterations / 4))
+
+
+# Calls p_callable with the iteration number and records its timing. p_items is the work done per
+# call, for throughput.
+func _measure(p_name: String, p_items: int, p_callable: Callable, p_iterations: int = iterations) -> void:
+	var times: PackedFloat64Array
+	var total: float = 0.0
+	for i in p_iterations:
+		var start := Time.get_ticks_usec()
+		p_callable.call(i)
+		var time: float = Time.get_ticks_usec() - start
+		times.append(time)
+		total += time
+	times.sort()
+
+	var result := {
+		"name": p_name,
+		"iterations": p_iterations,
+		"items": p_items,
+		"min_ms": times[0] / 1000.0,
+		"median_ms": times[times.size() / 2] / 1000.0,
+		"max_ms": times[-1] / 1000.0,
+		"mean_ms": total / p_iterations / 1000.0,
+		"items_per_sec": p_items * p_iterations / (total / 1000000.0) if total > 0 else 0.0,
+	}
+	_results.append(result)
+	print("%-22s median %10.3f ms   min %10.3f ms   max %10.3f ms   %14.1f items/s" % [ p_name,
+		result["median_ms"], result["min_ms"], result["max_ms"], result["items_per_sec"] ])
+
+
+func _get_brush_data() -> Dictionary:
+	var img: Image = Image.load_from_file("res://addons/terrain_3d/brushes/circle0.exr")
+	return {
+		"brush": [ img, ImageTexture.create_from_image(img) ],
+		"size": 100,
+		"strength": 0.1,
+		"height": 0.0,
+		"texture_index": 0,
+		"color": Color.WHITE,
+		"roughness": 0.0,
+		"gradient_points": PackedVector3Array(),
+		"enable": true,
+		"enable_texture": true,
+		"enable_angle": false,
+		"dynamic_angle": false,
+		"angle": 0.0,
+		"enable_scale": false,
+		"scale": 0.0,
+		"automatic_regions": false,
+		"align_to_view": false,
+		"gamma": 1.0,
+		"jitter": 0.0,
+	}
+
+
+func _save_results() -> void:
+	if results_file.is_empty():
+		return
+	var file := FileAccess.open(results_file, FileAccess.WRITE)
+	if not file:
+		push_error("Terrain3DBenchmark: Could not open ", results_file, ": ", error_string(FileAccess.get_open_error()))
+		return
+	file.store_string(JSON.stringify({
+		"version": terrain.get_version(),
+		"region_count": region_count,
+		"region_size": region_size,
+		"results": _results,
+	}, "\t"))
+	print("Terrain3DBenchmark: Saved results to ", ProjectSettings.globalize_path(results_file))
@@ -19,6 +19,13 @@ RID GeneratedTexture::create(const TypedArray<Image> &p_layers) {
 			}
 		}
 		_rid = RS->texture_2d_layered_create(p_layers, RenderingServer::TEXTURE_LAYERED_2D_ARRAY);
+		_layer_count = p_layers.size();
+		_memory = 0;
+		for (int i = 0; i < p_layers.size(); i++) {
+			Ref<Image> img = p_layers[i];
+			_memory += img.is_valid() ? img->get_data_size() : 0;
+		}
+		uploaded_bytes += _memory;
 		_dirty = false;
 	} else {
 		clear();
@@ -30,10 +37,31 @@ RID GeneratedTexture::create(const Ref<Image> &p_image) {
 	LOG(DEBUG, "RenderingServer creating Texture2D");
 	_image = p_image;
 	_rid = RS->texture_2d_create(_image);
+	_memory = _image.is_valid() ? _image->get_data_size() : 0;
+	uploaded_bytes += _memory;
 	_dirty = false;
 	return _rid;
 }
 
+/**
+ * Replaces one layer of the texture with p_image, which must match the size, format and mipmaps of
+ * the images the texture was created with. A Texture2D has a single layer 0, and keeps p_image.
+ * The RID stays the same, so materials needn't be updated.
+ */
+void GeneratedTexture::update(const Ref<Image> &p_image, int p_layer) {
+	int layer_count = _image.is_valid() ? 1 : _layer_count;
+	if (!_rid.is_valid() || p_image.is_null() || p_layer < 0 || p_layer >= layer_count) {
+		LOG(ERROR, "Cannot update layer ", p_layer, " of ", layer_count, " on texture ", _rid);
+		return;
+	}
+	LOG(DEBUG_CONT, "RenderingServer updating texture ", _rid, " layer ", p_layer);
+	if (_image.is_valid()) {
+		_image = p_image;
+	}
+	RS->texture_2d_update(_rid, p_image, p_layer);
+	uploaded_bytes += p_image->get_data_size();
+}
+
 void GeneratedTexture::clear() {
 	if (_rid.is_valid()) {
 		LOG(DEBUG, "GeneratedTexture freeing ", _rid);
@@ -44,5 +72,13 @@ void GeneratedTexture::clear() {
 		_image.unref();
 	}
 	_rid = RID();
+	_layer_count = 0;
+	_memory = 0;
 	_dirty = true;
-}
\ No newline at end of file
+}
+
+// Frees the texture and marks it up to date without creating it, when nothing will draw it
+void GeneratedTexture::skip() {
+	clear();
+	_dirty = false;
+}
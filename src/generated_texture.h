@@ -15,13 +15,21 @@ class GeneratedTexture {
 private:
 	RID _rid = RID();
 	Ref<Image> _image;
+	int _layer_count = 0;
+	uint64_t _memory = 0; // Bytes of image data held by the texture
 	bool _dirty = false;
 
 public:
+	static inline uint64_t uploaded_bytes = 0; // Image data sent to the RenderingServer by all instances
+
 	void clear();
 	bool is_dirty() { return _dirty; }
 	RID create(const TypedArray<Image> &p_layers);
 	RID create(const Ref<Image> &p_image);
+	void update(const Ref<Image> &p_image, int p_layer);
+	void skip();
+	int get_layer_count() const { return _layer_count; }
+	uint64_t get_memory() const { return _memory; }
 	Ref<Image> get_image() const { return _image; }
 	RID get_rid() { return _rid; }
 };
@@ -9,6 +9,11 @@
 // Private Functions
 ///////////////////////////
 
+/**
+ * Creates a mesh with compressed attributes: 16 bit positions within the mesh bounds, and the
+ * normal and tangent packed together, 12 bytes a vertex instead of 40. Vertices are on a half
+ * unit grid, which the shader snaps them back to, see vertex() in main.glsl.
+ */
 RID GeoClipMap::_create_mesh(PackedVector3Array p_vertices, PackedInt32Array p_indices, AABB p_aabb) {
 	Array arrays;
 	arrays.resize(RenderingServer::ARRAY_MAX);
@@ -20,14 +25,22 @@ RID GeoClipMap::_create_mesh(PackedVector3Array p_vertices, PackedInt32Array p_i
 	normals.fill(Vector3(0, 1, 0));
 	arrays[RenderingServer::ARRAY_NORMAL] = normals;
 
+	// Compression packs the tangent relative to the normal, so it must be a valid direction
 	PackedFloat32Array tangents;
 	tangents.resize(p_vertices.size() * 4);
-	tangents.fill(0.0f);
+	float *tangent = tangents.ptrw();
+	for (int i = 0; i < p_vertices.size(); i++) {
+		tangent[i * 4 + 0] = 1.0f;
+		tangent[i * 4 + 1] = 0.0f;
+		tangent[i * 4 + 2] = 0.0f;
+		tangent[i * 4 + 3] = 1.0f;
+	}
 	arrays[RenderingServer::ARRAY_TANGENT] = tangents;
 
 	LOG(DEBUG, "Creating mesh via the Rendering server");
 	RID mesh = RS->mesh_create();
-	RS->mesh_add_surface_from_arrays(mesh, RenderingServer::PRIMITIVE_TRIANGLES, arrays);
+	RS->mesh_add_surface_from_arrays(mesh, RenderingServer::PRIMITIVE_TRIANGLES, arrays, Array(), Dictionary(),
+			RenderingServer::ARRAY_FLAG_COMPRESS_ATTRIBUTES);
 
 	LOG(DEBUG, "Setting custom aabb: ", p_aabb.position, ", ", p_aabb.size);
 	RS->mesh_set_custom_aabb(mesh, p_aabb);
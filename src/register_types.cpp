@@ -8,6 +8,7 @@
 #include "register_types.h"
 #include "terrain_3d.h"
 #include "terrain_3d_editor.h"
+#include "terrain_3d_region.h"
 
 using namespace godot;
 
@@ -18,6 +19,7 @@ void initialize_terrain_3d(ModuleInitializationLevel p_level) {
 	ClassDB::register_class<Terrain3D>();
 	ClassDB::register_class<Terrain3DEditor>();
 	ClassDB::register_class<Terrain3DMaterial>();
+	ClassDB::register_class<Terrain3DRegion>();
 	ClassDB::register_class<Terrain3DStorage>();
 	ClassDB::register_class<Terrain3DTexture>();
 	ClassDB::register_class<Terrain3DTextureList>();
@@ -0,0 +1,25 @@
+// Copyright © 2023 Cory Petkovsek, Roope Palmroos, and Contributors.
+
+R"(
+//INSERT: HEIGHT_FULL
+		height = texture(_height_maps, region).r;
+
+//INSERT: HEIGHT_16_BIT
+		// 16 bit integer over _height_map_range, high byte in red. The bytes can't be filtered, so the 4
+		// nearest texels are fetched, decoded and blended bilinearly, as texture() does for full heights.
+		vec2 height_texel = region.xy * _region_size - 0.5;
+		ivec2 height_pos = ivec2(floor(height_texel));
+		ivec2 height_max = ivec2(int(_region_size) - 1);
+		int height_layer = int(region.z);
+		vec2 height_00 = texelFetch(_height_maps, ivec3(clamp(height_pos, ivec2(0), height_max), height_layer), 0).rg;
+		vec2 height_10 = texelFetch(_height_maps, ivec3(clamp(height_pos + ivec2(1, 0), ivec2(0), height_max), height_layer), 0).rg;
+		vec2 height_01 = texelFetch(_height_maps, ivec3(clamp(height_pos + ivec2(0, 1), ivec2(0), height_max), height_layer), 0).rg;
+		vec2 height_11 = texelFetch(_height_maps, ivec3(clamp(height_pos + ivec2(1, 1), ivec2(0), height_max), height_layer), 0).rg;
+		vec4 height_values = vec4(height_00.r, height_10.r, height_01.r, height_11.r) * 65280. +
+				vec4(height_00.g, height_10.g, height_01.g, height_11.g) * 255.;
+		vec2 height_weight = fract(height_texel);
+		float height_value = mix(mix(height_values.x, height_values.y, height_weight.x),
+				mix(height_values.z, height_values.w, height_weight.x), height_weight.y);
+		height = mix(_height_map_range.x, _height_map_range.y, height_value / 65535.);
+
+)"
\ No newline at end of file
@@ -26,10 +26,10 @@ uniform float _region_size = 1024.0;
 uniform float _region_texel_size = 0.0009765625; // = 1/1024
 uniform float _mesh_vertex_spacing = 1.0;
 uniform float _mesh_vertex_density = 1.0; // = 1/_mesh_vertex_spacing
-uniform int _region_map_size = 16;
-uniform int _region_map[256];
-uniform vec2 _region_offsets[256];
+uniform int _region_map_size = 32;
+uniform sampler2D _region_map : filter_nearest, repeat_disable; // 1 based layer index, 0 = no region
 uniform sampler2DArray _height_maps : repeat_disable;
+uniform vec2 _height_map_range = vec2(0.); // Min and max heights of 16 bit height maps
 uniform usampler2DArray _control_maps : repeat_disable;
 //INSERT: TEXTURE_SAMPLERS_NEAREST
 //INSERT: TEXTURE_SAMPLERS_LINEAR
@@ -84,8 +84,8 @@ ivec3 get_region_uv(vec2 uv) {
 	uv *= _region_texel_size;
 	ivec2 pos = ivec2(floor(uv)) + (_region_map_size / 2);
 	int bounds = int(pos.x>=0 && pos.x<_region_map_size && pos.y>=0 && pos.y<_region_map_size);
-	int layer_index = _region_map[ pos.y * _region_map_size + pos.x ] * bounds - 1;
-	return ivec3(ivec2((uv - _region_offsets[layer_index]) * _region_size), layer_index);
+	int layer_index = int(texelFetch(_region_map, pos * bounds, 0).r) * bounds - 1;
+	return ivec3(ivec2((uv - vec2(pos - _region_map_size / 2)) * _region_size), layer_index);
 }
 
 // Takes in UV2 region space coordinates, returns vec3 with:
@@ -97,9 +97,9 @@ vec3 get_region_uv2(vec2 uv) {
 	// window, take back the half pixel before the floor(). 
 	ivec2 pos = ivec2(floor(uv - vec2(_region_texel_size * 0.5))) + (_region_map_size / 2);
 	int bounds = int(pos.x>=0 && pos.x<_region_map_size && pos.y>=0 && pos.y<_region_map_size);
-	int layer_index = _region_map[ pos.y * _region_map_size + pos.x ] * bounds - 1;
+	int layer_index = int(texelFetch(_region_map, pos * bounds, 0).r) * bounds - 1;
 	// The return value is still texel-centered.
-	return vec3(uv - _region_offsets[layer_index], float(layer_index));
+	return vec3(uv - vec2(pos - _region_map_size / 2), float(layer_index));
 }
 
 //INSERT: WORLD_NOISE1
@@ -108,7 +108,8 @@ float get_height(vec2 uv) {
 	highp float height = 0.0;
 	vec3 region = get_region_uv2(uv);
 	if (region.z >= 0.) {
-		height = texture(_height_maps, region).r;
+//INSERT: HEIGHT_FULL
+//INSERT: HEIGHT_16_BIT
 	}
 //INSERT: WORLD_NOISE2
  	return height;
@@ -118,6 +119,9 @@ void vertex() {
 	// Get camera pos in world vertex coords
 	v_camera_pos = INV_VIEW_MATRIX[3].xyz;
 
+	// Mesh positions are compressed to 16 bits. Restore the half unit grid they were built on
+	VERTEX.xz = round(VERTEX.xz * 2.0) * 0.5;
+
 	// Get vertex of flat plane in world coordinates and set world UV
 	v_vertex = (MODEL_MATRIX * vec4(VERTEX, 1.0)).xyz;
 
@@ -240,7 +244,8 @@ void get_material(vec2 base_uv, uint control, ivec3 iuv_center, vec3 normal, out
 	// Control map scale & rotation, apply to both base and center uv.
 	// To correctly rotate & scale around each control map pixel we must 
 	// translate uv center from "control map space" to "uv space".
-	uv_center += _region_offsets[region] * _region_size;
+	// base_uv is within a texel of the vertex, so the difference rounds to its region offset.
+	uv_center += round((base_uv - uv_center) * _region_texel_size) * _region_size;
 	// Define and apply base scale from control map value as array index. 0.5 as baseline.
 	float[8] scale_array = { 0.5, 0.4, 0.3, 0.2, 0.1, 0.8, 0.7, 0.6};
 	float control_scale = scale_array[(control >>7u & 0x7u)];
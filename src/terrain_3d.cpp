@@ -1,11 +1,13 @@
 // Copyright © 2023 Cory Petkovsek, Roope Palmroos, and Contributors.
 
 #include <godot_cpp/classes/collision_shape3d.hpp>
+#include <godot_cpp/classes/display_server.hpp>
 #include <godot_cpp/classes/editor_interface.hpp>
 #include <godot_cpp/classes/engine.hpp>
 #include <godot_cpp/classes/environment.hpp>
 #include <godot_cpp/classes/height_map_shape3d.hpp>
 #include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/performance.hpp>
 #include <godot_cpp/classes/project_settings.hpp>
 #include <godot_cpp/classes/quad_mesh.hpp>
 #include <godot_cpp/classes/rendering_server.hpp>
@@ -14,11 +16,13 @@
 #include <godot_cpp/classes/time.hpp>
 #include <godot_cpp/classes/viewport.hpp>
 #include <godot_cpp/classes/viewport_texture.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
 #include <godot_cpp/classes/world3d.hpp>
 
 #include "geoclipmap.h"
 #include "logger.h"
 #include "terrain_3d.h"
+#include "terrain_3d_editor.h"
 #include "terrain_3d_util.h"
 
 ///////////////////////////
@@ -46,16 +50,17 @@ void Terrain3D::_initialize() {
 		_texture_list.instantiate();
 	}
 
-	// Connect signals
-	if (!_texture_list->is_connected("textures_changed", callable_mp(_material.ptr(), &Terrain3DMaterial::_update_texture_arrays))) {
+	// Connect signals. The material isn't used in server mode.
+	bool server_mode = is_server_mode();
+	if (!server_mode && !_texture_list->is_connected("textures_changed", callable_mp(_material.ptr(), &Terrain3DMaterial::_update_texture_arrays))) {
 		LOG(DEBUG, "Connecting texture_list.textures_changed to _material->_update_texture_arrays()");
 		_texture_list->connect("textures_changed", callable_mp(_material.ptr(), &Terrain3DMaterial::_update_texture_arrays));
 	}
-	if (!_storage->is_connected("region_size_changed", callable_mp(_material.ptr(), &Terrain3DMaterial::_update_regions))) {
+	if (!server_mode && !_storage->is_connected("region_size_changed", callable_mp(_material.ptr(), &Terrain3DMaterial::_update_regions))) {
 		LOG(DEBUG, "Connecting region_size_changed signal to _material->_update_regions()");
 		_storage->connect("region_size_changed", callable_mp(_material.ptr(), &Terrain3DMaterial::_update_regions));
 	}
-	if (!_storage->is_connected("regions_changed", callable_mp(_material.ptr(), &Terrain3DMaterial::_update_regions))) {
+	if (!server_mode && !_storage->is_connected("regions_changed", callable_mp(_material.ptr(), &Terrain3DMaterial::_update_regions))) {
 		LOG(DEBUG, "Connecting regions_changed signal to _material->_update_regions()");
 		_storage->connect("regions_changed", callable_mp(_material.ptr(), &Terrain3DMaterial::_update_regions));
 	}
@@ -63,15 +68,31 @@ void Terrain3D::_initialize() {
 		LOG(DEBUG, "Connecting height_maps_changed signal to update_aabbs()");
 		_storage->connect("height_maps_changed", callable_mp(this, &Terrain3D::update_aabbs));
 	}
+	if (!_storage->is_connected("regions_changed", callable_mp(this, &Terrain3D::_queue_collision_update))) {
+		LOG(DEBUG, "Connecting regions_changed signal to _queue_collision_update()");
+		_storage->connect("regions_changed", callable_mp(this, &Terrain3D::_queue_collision_update));
+	}
+	if (!_storage->is_connected("maps_edited", callable_mp(this, &Terrain3D::_mark_collision_dirty))) {
+		LOG(DEBUG, "Connecting maps_edited signal to _mark_collision_dirty()");
+		_storage->connect("maps_edited", callable_mp(this, &Terrain3D::_mark_collision_dirty));
+	}
 
 	// Initialize the system
 	if (!_initialized && _is_inside_world && is_inside_tree()) {
 		_storage->initialize(this);
-		_material->initialize(this);
-		_material->_update_regions();
-		_texture_list->update_list(); // generate texture arrays
-		_setup_mouse_picking();
-		_build(_mesh_lods, _mesh_size);
+		_texture_list->_set_server_mode(server_mode);
+		if (server_mode) {
+			// Only the maps and collision are needed, nothing is drawn
+			LOG(INFO, "Server mode, skipping the material, meshes and mouse picking");
+			_storage->_skip_gpu_maps(); // Created if the storage loaded before it knew
+			_texture_list->update_list();
+		} else {
+			_material->initialize(this);
+			_material->_update_regions();
+			_texture_list->update_list(); // generate texture arrays
+			_setup_mouse_picking();
+			_build(_mesh_lods, _mesh_size);
+		}
 		_build_collision();
 		_initialized = true;
 	}
@@ -91,21 +112,53 @@ void Terrain3D::__process(double delta) {
 	if (!_initialized)
 		return;
 
+	_update_monitors(delta);
+
 	// If the game/editor camera is not set, find it
 	if (!UtilityFunctions::is_instance_valid(_camera)) {
 		LOG(DEBUG, "camera is null, getting the current one");
 		_grab_camera();
 	}
 
-	// If camera has moved enough, re-center the terrain on it.
-	if (UtilityFunctions::is_instance_valid(_camera) && _camera->is_inside_tree()) {
-		Vector3 cam_pos = _camera->get_global_position();
+	// If a view's camera has moved enough, re-center the view on it.
+	for (int i = _views.size() - 1; i >= 0; i--) {
+		View &view = _views.write[i];
+		Camera3D *camera = _camera;
+		if (i > 0) {
+			camera = Object::cast_to<Camera3D>(ObjectDB::get_instance(view.camera));
+			if (camera == nullptr) {
+				LOG(DEBUG, "Camera of view ", i, " was freed, removing the view");
+				_free_view_instances(view);
+				_views.remove_at(i);
+				continue;
+			}
+		} else if (!UtilityFunctions::is_instance_valid(_camera)) {
+			continue;
+		}
+		if (!camera->is_inside_tree()) {
+			continue;
+		}
+		Vector3 cam_pos = camera->get_global_position();
+		if (i == 0) {
+			// Load and unload region files around the camera, if the storage uses them
+			_storage->update_streaming(cam_pos);
+		}
 		Vector2 cam_pos_2d = Vector2(cam_pos.x, cam_pos.z);
-		if (_camera_last_position.distance_to(cam_pos_2d) > 0.2f) {
-			snap(cam_pos);
-			_camera_last_position = cam_pos_2d;
+		if (view.camera_last_position.distance_to(cam_pos_2d) > 0.2f) {
+			_snap_view(view, cam_pos);
+			view.camera_last_position = cam_pos_2d;
 		}
 	}
+
+	// Apply region changes and edits received since the last frame, or stream tiles around targets
+	if (_collision_update_queued || _collision_mode == COLLISION_DYNAMIC) {
+		_update_collision();
+	}
+
+	// Hand finished nav mesh tiles to their listeners
+	if (_nav_task >= 0 || !_nav_requests.is_empty()) {
+		_update_nav_tiles();
+	}
 }
 
 void Terrain3D::_setup_mouse_picking() {
@@ -181,7 +234,9 @@ void Terrain3D::_grab_camera() {
 		LOG(DEBUG, "Grabbing the in-game viewport camera");
 		_camera = get_viewport()->get_camera_3d();
 	}
-	if (!_camera) {
+	if (!_camera && is_server_mode()) {
+		LOG(DEBUG, "No camera in server mode, collision targets still update");
+	} else if (!_camera) {
 		set_process(false); // disable snapping
 		LOG(ERROR, "Cannot find the active camera. Set it manually with Terrain3D.set_camera(). Stopping _process()");
 	}
@@ -190,28 +245,14 @@ void Terrain3D::_grab_camera() {
 void Terrain3D::_clear(bool p_clear_meshes, bool p_clear_collision) {
 	LOG(INFO, "Clearing the terrain");
 	if (p_clear_meshes) {
-		for (const RID rid : _meshes) {
-			RS->free_rid(rid);
-		}
-		RS->free_rid(_data.cross);
-		for (const RID rid : _data.tiles) {
-			RS->free_rid(rid);
-		}
-		for (const RID rid : _data.fillers) {
-			RS->free_rid(rid);
-		}
-		for (const RID rid : _data.trims) {
-			RS->free_rid(rid);
+		for (int i = 0; i < _views.size(); i++) {
+			_free_view_instances(_views.write[i]);
 		}
-		for (const RID rid : _data.seams) {
+		for (const RID rid : _meshes) {
 			RS->free_rid(rid);
 		}
-
 		_meshes.clear();
-		_data.tiles.clear();
-		_data.fillers.clear();
-		_data.trims.clear();
-		_data.seams.clear();
+		_mesh_aabbs.clear();
 		_initialized = false;
 	}
 
@@ -235,52 +276,87 @@ void Terrain3D::_build(int p_mesh_lods, int p_mesh_size) {
 	RID material_rid = _material->get_material_rid();
 	for (const RID rid : _meshes) {
 		RS->mesh_surface_set_material(rid, 0, material_rid);
+		_mesh_aabbs.push_back(RS->mesh_get_custom_aabb(rid));
 	}
 
-	LOG(DEBUG, "Creating mesh instances");
+	LOG(DEBUG, "Creating mesh instances for ", _views.size(), " views");
 
 	// Get current visual scenario so the instances appear in the scene
 	RID scenario = get_world_3d()->get_scenario();
+	_views.write[0].layers = _render_layers;
+	for (int i = 0; i < _views.size(); i++) {
+		_create_view_instances(_views.write[i], scenario);
+	}
+
+	update_aabbs();
+}
 
-	_data.cross = RS->instance_create2(_meshes[GeoClipMap::CROSS], scenario);
-	RS->instance_geometry_set_cast_shadows_setting(_data.cross, RenderingServer::ShadowCastingSetting(_shadow_casting));
-	RS->instance_set_layer_mask(_data.cross, _render_layers);
+/**
+ * Creates the mesh instances of a view, which are left at the origin until its next snap.
+ */
+void Terrain3D::_create_view_instances(View &r_view, RID p_scenario) {
+	Instances &instances = r_view.instances;
+	instances.cross = RS->instance_create2(_meshes[GeoClipMap::CROSS], p_scenario);
+	RS->instance_geometry_set_cast_shadows_setting(instances.cross, RenderingServer::ShadowCastingSetting(_shadow_casting));
+	RS->instance_set_layer_mask(instances.cross, r_view.layers);
 
-	for (int l = 0; l < p_mesh_lods; l++) {
+	for (int l = 0; l < _mesh_lods; l++) {
 		for (int x = 0; x < 4; x++) {
 			for (int y = 0; y < 4; y++) {
 				if (l != 0 && (x == 1 || x == 2) && (y == 1 || y == 2)) {
 					continue;
 				}
 
-				RID tile = RS->instance_create2(_meshes[GeoClipMap::TILE], scenario);
+				RID tile = RS->instance_create2(_meshes[GeoClipMap::TILE], p_scenario);
 				RS->instance_geometry_set_cast_shadows_setting(tile, RenderingServer::ShadowCastingSetting(_shadow_casting));
-				RS->instance_set_layer_mask(tile, _render_layers);
-				_data.tiles.push_back(tile);
+				RS->instance_set_layer_mask(tile, r_view.layers);
+				instances.tiles.push_back(tile);
 			}
 		}
 
-		RID filler = RS->instance_create2(_meshes[GeoClipMap::FILLER], scenario);
+		RID filler = RS->instance_create2(_meshes[GeoClipMap::FILLER], p_scenario);
 		RS->instance_geometry_set_cast_shadows_setting(filler, RenderingServer::ShadowCastingSetting(_shadow_casting));
-		RS->instance_set_layer_mask(filler, _render_layers);
-		_data.fillers.push_back(filler);
+		RS->instance_set_layer_mask(filler, r_view.layers);
+		instances.fillers.push_back(filler);
 
-		if (l != p_mesh_lods - 1) {
-			RID trim = RS->instance_create2(_meshes[GeoClipMap::TRIM], scenario);
+		if (l != _mesh_lods - 1) {
+			RID trim = RS->instance_create2(_meshes[GeoClipMap::TRIM], p_scenario);
 			RS->instance_geometry_set_cast_shadows_setting(trim, RenderingServer::ShadowCastingSetting(_shadow_casting));
-			RS->instance_set_layer_mask(trim, _render_layers);
-			_data.trims.push_back(trim);
+			RS->instance_set_layer_mask(trim, r_view.layers);
+			instances.trims.push_back(trim);
 
-			RID seam = RS->instance_create2(_meshes[GeoClipMap::SEAM], scenario);
+			RID seam = RS->instance_create2(_meshes[GeoClipMap::SEAM], p_scenario);
 			RS->instance_geometry_set_cast_shadows_setting(seam, RenderingServer::ShadowCastingSetting(_shadow_casting));
-			RS->instance_set_layer_mask(seam, _render_layers);
-			_data.seams.push_back(seam);
+			RS->instance_set_layer_mask(seam, r_view.layers);
+			instances.seams.push_back(seam);
 		}
 	}
 
-	update_aabbs();
+	r_view.snap_cells.clear();
 	// Force a snap update
-	_camera_last_position = Vector2(__FLT_MAX__, __FLT_MAX__);
+	r_view.camera_last_position = Vector2(__FLT_MAX__, __FLT_MAX__);
+}
+
+void Terrain3D::_free_view_instances(View &r_view) {
+	Instances &instances = r_view.instances;
+	if (instances.cross.is_valid()) {
+		RS->free_rid(instances.cross);
+	}
+	for (const RID rid : instances.tiles) {
+		RS->free_rid(rid);
+	}
+	for (const RID rid : instances.fillers) {
+		RS->free_rid(rid);
+	}
+	for (const RID rid : instances.trims) {
+		RS->free_rid(rid);
+	}
+	for (const RID rid : instances.seams) {
+		RS->free_rid(rid);
+	}
+	instances = Instances();
+	r_view.snap_cells.clear();
+	r_view.camera_last_position = Vector2(__FLT_MAX__, __FLT_MAX__);
 }
 
 void Terrain3D::_build_collision() {
@@ -309,15 +385,22 @@ void Terrain3D::_build_collision() {
 		_debug_static_body->set_name("StaticBody3D");
 		add_child(_debug_static_body, true);
 	}
+	_collision_shapes.clear();
+	_collision_dirty_tiles.clear();
+	_collision_centers_stale = true;
 	_update_collision();
 }
 
-/* Eventually this should be callable to update collision on changes,
- * and especially updating only the ones that have changed. However it's not there yet, so
- * destroy and recreate for now.
+/**
+ * Brings the collision shapes in line with storage.
+ * In COLLISION_FULL mode every region has a shape. Regions without one get a shape, shapes of
+ * removed regions are freed, and existing shapes are only regenerated if marked dirty by
+ * _mark_collision_dirty() or update_collision().
+ * In COLLISION_DYNAMIC mode this hands off to _update_dynamic_collision() and is called every frame.
  */
 void Terrain3D::_update_collision() {
-	if (!_collision_enabled || !is_inside_tree()) {
+	_collision_update_queued = false;
+	if (!_collision_enabled || !is_inside_tree() || _storage.is_null()) {
 		return;
 	}
 	// Create collision only in game, unless showing debug
@@ -326,135 +409,184 @@ void Terrain3D::_update_collision() {
 	}
 	if ((!_show_debug_collision && !_static_body.is_valid()) ||
 			(_show_debug_collision && _debug_static_body == nullptr)) {
-		_build_collision();
+		_build_collision(); // Calls this function once the body exists
+		return;
+	}
+	if (_collision_mode == COLLISION_DYNAMIC) {
+		_update_dynamic_collision();
+		return;
 	}
 
-	int time = Time::get_singleton()->get_ticks_msec();
+	uint64_t time = Time::get_singleton()->get_ticks_usec();
 	int region_size = _storage->get_region_size();
-	int shape_size = region_size + 1;
-	float hole_const = NAN;
-	// DEPRECATED - Jolt v0.12 supports NAN. Remove check when it's old.
-	if (ProjectSettings::get_singleton()->get_setting("physics/3d/physics_engine") == "JoltPhysics3D") {
-		hole_const = __FLT_MAX__;
-	}
-
-	for (int i = 0; i < _storage->get_region_count(); i++) {
-		PackedRealArray map_data = PackedRealArray();
-		map_data.resize(shape_size * shape_size);
-
-		Vector2i global_offset = Vector2i(_storage->get_region_offsets()[i]) * region_size;
-		Vector3 global_pos = Vector3(global_offset.x, 0.f, global_offset.y);
-
-		Ref<Image> map, map_x, map_z, map_xz;
-		Ref<Image> cmap, cmap_x, cmap_z, cmap_xz;
-		map = _storage->get_map_region(Terrain3DStorage::TYPE_HEIGHT, i);
-		cmap = _storage->get_map_region(Terrain3DStorage::TYPE_CONTROL, i);
-		int region = _storage->get_region_index(Vector3(global_pos.x + region_size, 0.f, global_pos.z) * _mesh_vertex_spacing);
-		if (region >= 0) {
-			map_x = _storage->get_map_region(Terrain3DStorage::TYPE_HEIGHT, region);
-			cmap_x = _storage->get_map_region(Terrain3DStorage::TYPE_CONTROL, region);
-		}
-		region = _storage->get_region_index(Vector3(global_pos.x, 0.f, global_pos.z + region_size) * _mesh_vertex_spacing);
-		if (region >= 0) {
-			map_z = _storage->get_map_region(Terrain3DStorage::TYPE_HEIGHT, region);
-			cmap_z = _storage->get_map_region(Terrain3DStorage::TYPE_CONTROL, region);
-		}
-		region = _storage->get_region_index(Vector3(global_pos.x + region_size, 0.f, global_pos.z + region_size) * _mesh_vertex_spacing);
-		if (region >= 0) {
-			map_xz = _storage->get_map_region(Terrain3DStorage::TYPE_HEIGHT, region);
-			cmap_xz = _storage->get_map_region(Terrain3DStorage::TYPE_CONTROL, region);
-		}
-
-		for (int z = 0; z < shape_size; z++) {
-			for (int x = 0; x < shape_size; x++) {
-				// Choose array indexing to match triangulation of heightmapshape with the mesh
-				// https://stackoverflow.com/questions/16684856/rotating-a-2d-pixel-array-by-90-degrees
-				// Normal array index rotated Y=0 - shape rotation Y=0 (xform below)
-				// int index = z * shape_size + x;
-				// Array Index Rotated Y=-90 - must rotate shape Y=+90 (xform below)
-				int index = shape_size - 1 - z + x * shape_size;
-
-				// Set heights on local map, or adjacent maps if on the last row/col
-				if (x < region_size && z < region_size) {
-					map_data[index] = (is_hole(cmap->get_pixel(x, z).r)) ? hole_const : map->get_pixel(x, z).r;
-				} else if (x == region_size && z < region_size) {
-					if (map_x.is_valid()) {
-						map_data[index] = (is_hole(cmap_x->get_pixel(0, z).r)) ? hole_const : map_x->get_pixel(0, z).r;
-					} else {
-						map_data[index] = 0.0f;
-					}
-				} else if (z == region_size && x < region_size) {
-					if (map_z.is_valid()) {
-						map_data[index] = (is_hole(cmap_z->get_pixel(x, 0).r)) ? hole_const : map_z->get_pixel(x, 0).r;
-					} else {
-						map_data[index] = 0.0f;
-					}
-				} else if (x == region_size && z == region_size) {
-					if (map_xz.is_valid()) {
-						map_data[index] = (is_hole(cmap_xz->get_pixel(0, 0).r)) ? hole_const : map_xz->get_pixel(0, 0).r;
-					} else {
-						map_data[index] = 0.0f;
-					}
+	float hole_value = _get_collision_hole_value();
+
+	// Free shapes belonging to regions that have been removed
+	Array shape_tiles = _collision_shapes.keys();
+	for (int i = 0; i < shape_tiles.size(); i++) {
+		Vector2i tile = shape_tiles[i];
+		Vector2i global_offset = tile * region_size;
+		if (!_storage->has_region(Vector3(global_offset.x, 0.f, global_offset.y) * _mesh_vertex_spacing)) {
+			LOG(DEBUG, "Freeing collision shape for removed region ", tile);
+			_free_collision_shape(tile);
+		}
+	}
+
+	// Create shapes for new regions and regenerate the dirty ones
+	TypedArray<Vector2i> region_offsets = _storage->get_region_offsets();
+	int updated = 0;
+	for (int i = 0; i < region_offsets.size(); i++) {
+		Vector2i region_offset = region_offsets[i];
+		if (_collision_shapes.has(region_offset) && !_collision_dirty_tiles.has(region_offset)) {
+			continue;
+		}
+		CollisionTile tile;
+		if (_prepare_collision_tile(region_offset, region_size, hole_value, tile)) {
+			_generate_collision_tile(tile);
+			_apply_collision_tile(tile);
+			updated++;
+		}
+	}
+	_collision_dirty_tiles.clear();
+	_update_collision_settings();
+	if (updated > 0) {
+		_collision_build_usec = Time::get_singleton()->get_ticks_usec() - time;
+		LOG(DEBUG, "Collision updated ", updated, " of ", region_offsets.size(), " regions in ", _collision_build_usec / 1000, " ms");
+	}
+}
+
+/**
+ * Keeps shapes only for tiles within collision_radius of the camera and the collision targets.
+ * Tile heights are generated on the WorkerThreadPool from snapshots of the region maps, then
+ * handed to the physics server here on the main thread once the task has finished.
+ * Wanted tiles are only recomputed when a center changes tile, tiles are edited or regions change.
+ */
+void Terrain3D::_update_dynamic_collision() {
+	if (_collision_task >= 0) {
+		if (!WorkerThreadPool::get_singleton()->is_task_completed(_collision_task)) {
+			return;
+		}
+		WorkerThreadPool::get_singleton()->wait_for_task_completion(_collision_task);
+		_collision_task = -1;
+		uint64_t time = Time::get_singleton()->get_ticks_usec();
+		for (int i = 0; i < _collision_jobs.size(); i++) {
+			_apply_collision_tile(_collision_jobs[i]);
+		}
+		LOG(DEBUG_CONT, "Applied ", _collision_jobs.size(), " dynamic collision tiles");
+		_collision_jobs.clear();
+		_update_collision_settings();
+		_collision_build_usec = _collision_jobs_usec + Time::get_singleton()->get_ticks_usec() - time;
+	}
+
+	// Find the tiles wanted around each target
+	PackedVector3Array positions;
+	if (UtilityFunctions::is_instance_valid(_camera) && _camera->is_inside_tree()) {
+		positions.push_back(_camera->get_global_position());
+	}
+	for (int i = _collision_targets.size() - 1; i >= 0; i--) {
+		Node3D *target = Object::cast_to<Node3D>(ObjectDB::get_instance(_collision_targets[i]));
+		if (target == nullptr) {
+			_collision_targets.remove_at(i); // Freed
+		} else if (target->is_inside_tree()) {
+			positions.push_back(target->get_global_position());
+		}
+	}
+
+	int tile_size = _get_collision_tile_size();
+	real_t tile_length = real_t(tile_size) * _mesh_vertex_spacing;
+	int tile_radius = int(Math::ceil(_collision_radius / tile_length));
+	Vector<Vector2i> centers;
+	centers.resize(positions.size());
+	bool moved = _collision_centers_stale || centers.size() != _collision_centers.size();
+	for (int i = 0; i < positions.size(); i++) {
+		centers.write[i] = Vector2i((Vector2(positions[i].x, positions[i].z) / tile_length).floor());
+		moved = moved || centers[i] != _collision_centers[i];
+	}
+	// Skip the scan while every center stays in its tile and nothing was edited
+	if (!moved && _collision_dirty_tiles.is_empty()) {
+		return;
+	}
+	_collision_centers = centers;
+	_collision_centers_stale = false;
+
+	Dictionary wanted;
+	for (int i = 0; i < positions.size(); i++) {
+		Vector2 pos = Vector2(positions[i].x, positions[i].z);
+		Vector2i center = centers[i];
+		for (int y = center.y - tile_radius; y <= center.y + tile_radius; y++) {
+			for (int x = center.x - tile_radius; x <= center.x + tile_radius; x++) {
+				Vector2i tile = Vector2i(x, y);
+				Rect2 tile_rect = Rect2(Vector2(tile) * tile_length, Vector2(tile_length, tile_length));
+				Vector2 closest = pos.clamp(tile_rect.position, tile_rect.get_end());
+				if (closest.distance_to(pos) > _collision_radius || wanted.has(tile)) {
+					continue;
+				}
+				Vector2i global_offset = tile * tile_size;
+				if (_storage->has_region(Vector3(global_offset.x, 0.f, global_offset.y) * _mesh_vertex_spacing)) {
+					wanted[tile] = true;
 				}
 			}
 		}
+	}
 
-		// Non rotated shape for normal array index above
-		//Transform3D xform = Transform3D(Basis(), global_pos);
-		// Rotated shape Y=90 for -90 rotated array index
-		Transform3D xform = Transform3D(Basis(Vector3(0.f, 1.f, 0.f), Math_PI * .5f),
-				global_pos + Vector3(region_size, 0.f, region_size) * .5f);
-		xform.scale(Vector3(_mesh_vertex_spacing, 1.f, _mesh_vertex_spacing));
-
-		if (!_show_debug_collision) {
-			RID shape = PhysicsServer3D::get_singleton()->heightmap_shape_create();
-			Dictionary shape_data;
-			shape_data["width"] = shape_size;
-			shape_data["depth"] = shape_size;
-			shape_data["heights"] = map_data;
-			Vector2 min_max = _storage->get_height_range();
-			shape_data["min_height"] = min_max.x;
-			shape_data["max_height"] = min_max.y;
-			PhysicsServer3D::get_singleton()->shape_set_data(shape, shape_data);
-			PhysicsServer3D::get_singleton()->body_add_shape(_static_body, shape);
-			PhysicsServer3D::get_singleton()->body_set_shape_transform(_static_body, i, xform);
-			PhysicsServer3D::get_singleton()->body_set_collision_mask(_static_body, _collision_mask);
-			PhysicsServer3D::get_singleton()->body_set_collision_layer(_static_body, _collision_layer);
-			PhysicsServer3D::get_singleton()->body_set_collision_priority(_static_body, _collision_priority);
-		} else {
-			CollisionShape3D *debug_col_shape;
-			debug_col_shape = memnew(CollisionShape3D);
-			debug_col_shape->set_name("CollisionShape3D");
-			_debug_static_body->add_child(debug_col_shape, true);
-			debug_col_shape->set_owner(_debug_static_body);
-
-			Ref<HeightMapShape3D> hshape;
-			hshape.instantiate();
-			hshape->set_map_width(shape_size);
-			hshape->set_map_depth(shape_size);
-			hshape->set_map_data(map_data);
-			debug_col_shape->set_shape(hshape);
-			debug_col_shape->set_global_transform(xform);
-			_debug_static_body->set_collision_mask(_collision_mask);
-			_debug_static_body->set_collision_layer(_collision_layer);
-			_debug_static_body->set_collision_priority(_collision_priority);
+	// Release tiles out of range and queue tiles that are new or edited
+	Array shape_tiles = _collision_shapes.keys();
+	for (int i = 0; i < shape_tiles.size(); i++) {
+		if (!wanted.has(shape_tiles[i])) {
+			_free_collision_shape(shape_tiles[i]);
+		}
+	}
+	Array wanted_tiles = wanted.keys();
+	float hole_value = _get_collision_hole_value();
+	for (int i = 0; i < wanted_tiles.size(); i++) {
+		Vector2i tile = wanted_tiles[i];
+		if (_collision_shapes.has(tile) && !_collision_dirty_tiles.has(tile)) {
+			continue;
+		}
+		CollisionTile job;
+		if (_prepare_collision_tile(tile, tile_size, hole_value, job)) {
+			_collision_jobs.push_back(job);
 		}
 	}
-	LOG(DEBUG, "Collision creation time: ", Time::get_singleton()->get_ticks_msec() - time, " ms");
+	_collision_dirty_tiles.clear();
+
+	if (!_collision_jobs.is_empty()) {
+		LOG(DEBUG_CONT, "Queueing ", _collision_jobs.size(), " dynamic collision tiles");
+		_collision_task = WorkerThreadPool::get_singleton()->add_task(
+				callable_mp(this, &Terrain3D::_generate_collision_jobs), false, "Terrain3D dynamic collision");
+	}
+}
+
+// Runs on the WorkerThreadPool. The main thread leaves _collision_jobs alone until the task is done.
+void Terrain3D::_generate_collision_jobs() {
+	uint64_t time = Time::get_singleton()->get_ticks_usec();
+	for (int i = 0; i < _collision_jobs.size(); i++) {
+		_generate_collision_tile(_collision_jobs.write[i]);
+	}
+	_collision_jobs_usec = Time::get_singleton()->get_ticks_usec() - time;
 }
 
 void Terrain3D::_destroy_collision() {
+	if (_collision_task >= 0) {
+		WorkerThreadPool::get_singleton()->wait_for_task_completion(_collision_task);
+		_collision_task = -1;
+	}
+	_collision_jobs.clear();
+
 	if (_static_body.is_valid()) {
 		LOG(INFO, "Freeing physics body");
-		RID shape = PhysicsServer3D::get_singleton()->body_get_shape(_static_body, 0);
-		PhysicsServer3D::get_singleton()->free_rid(shape);
+		int shape_count = PhysicsServer3D::get_singleton()->body_get_shape_count(_static_body);
+		for (int i = 0; i < shape_count; i++) {
+			RID shape = PhysicsServer3D::get_singleton()->body_get_shape(_static_body, i);
+			PhysicsServer3D::get_singleton()->free_rid(shape);
+		}
 		PhysicsServer3D::get_singleton()->free_rid(_static_body);
 		_static_body = RID();
 	}
 
 	if (_debug_static_body != nullptr) {
 		LOG(INFO, "Freeing debug static body");
-		for (int i = 0; i < _debug_static_body->get_child_count(); i++) {
+		for (int i = _debug_static_body->get_child_count() - 1; i >= 0; i--) {
 			Node *child = _debug_static_body->get_child(i);
 			LOG(DEBUG, "Freeing dsb child ", i, " ", child->get_name());
 			_debug_static_body->remove_child(child);
@@ -466,6 +598,293 @@ void Terrain3D::_destroy_collision() {
 		memdelete(_debug_static_body);
 		_debug_static_body = nullptr;
 	}
+	_collision_shapes.clear();
+	_collision_dirty_tiles.clear();
+}
+
+void Terrain3D::_update_collision_settings() {
+	if (_static_body.is_valid()) {
+		PhysicsServer3D::get_singleton()->body_set_collision_mask(_static_body, _collision_mask);
+		PhysicsServer3D::get_singleton()->body_set_collision_layer(_static_body, _collision_layer);
+		PhysicsServer3D::get_singleton()->body_set_collision_priority(_static_body, _collision_priority);
+	}
+	if (_debug_static_body != nullptr) {
+		_debug_static_body->set_collision_mask(_collision_mask);
+		_debug_static_body->set_collision_layer(_collision_layer);
+		_debug_static_body->set_collision_priority(_collision_priority);
+	}
+}
+
+/**
+ * Marks the collision shapes of all tiles overlapping p_global_aabb for regeneration on the next
+ * _update_collision(). Connected to Terrain3DStorage::maps_edited.
+ */
+void Terrain3D::_mark_collision_dirty(AABB p_global_aabb) {
+	if (_storage.is_null() || (!_static_body.is_valid() && _debug_static_body == nullptr)) {
+		return;
+	}
+	// Expand by one vertex as each shape also holds the first row and column of its +X, +Z neighbors
+	real_t tile_length = real_t(_get_collision_tile_size()) * _mesh_vertex_spacing;
+	Vector3 start = p_global_aabb.position - Vector3(_mesh_vertex_spacing, 0.f, _mesh_vertex_spacing);
+	Vector3 end = p_global_aabb.get_end() + Vector3(_mesh_vertex_spacing, 0.f, _mesh_vertex_spacing);
+	Vector2i start_tile = Vector2i((Vector2(start.x, start.z) / tile_length).floor());
+	Vector2i end_tile = Vector2i((Vector2(end.x, end.z) / tile_length).floor());
+	for (int y = start_tile.y; y <= end_tile.y; y++) {
+		for (int x = start_tile.x; x <= end_tile.x; x++) {
+			_collision_dirty_tiles[Vector2i(x, y)] = true;
+		}
+	}
+	_collision_update_queued = true;
+}
+
+int Terrain3D::_get_collision_tile_size() const {
+	int region_size = _storage.is_valid() ? int(_storage->get_region_size()) : int(Terrain3DStorage::SIZE_1024);
+	if (_collision_mode == COLLISION_FULL) {
+		return region_size;
+	}
+	return MIN(_collision_shape_size, region_size);
+}
+
+float Terrain3D::_get_collision_hole_value() const {
+	// DEPRECATED - Jolt v0.12 supports NAN. Remove check when it's old.
+	if (ProjectSettings::get_singleton()->get_setting("physics/3d/physics_engine") == "JoltPhysics3D") {
+		return __FLT_MAX__;
+	}
+	return NAN;
+}
+
+/**
+ * Fills in a CollisionTile with what _generate_collision_tile() needs, so that it can run without
+ * touching storage. The map data are copy-on-write snapshots, so later edits don't affect them.
+ * Returns false if the tile is not within a region.
+ */
+bool Terrain3D::_prepare_collision_tile(Vector2i p_tile, int p_tile_size, float p_hole_value, CollisionTile &r_tile) const {
+	int region_size = _storage->get_region_size();
+	Vector2i global_offset = p_tile * p_tile_size;
+	int region = _storage->get_region_index(Vector3(global_offset.x, 0.f, global_offset.y) * _mesh_vertex_spacing);
+	if (region < 0) {
+		return false;
+	}
+	Vector2i region_offset = Vector2i(_storage->get_region_offsets()[region]) * region_size;
+	r_tile.coord = p_tile;
+	r_tile.size = p_tile_size;
+	r_tile.region_size = region_size;
+	r_tile.local = global_offset - region_offset;
+	r_tile.hole_value = p_hole_value;
+
+	// The last row and column come from the regions on +X (1), +Z (2) and +XZ (3)
+	bool edge_x = r_tile.local.x + p_tile_size >= region_size;
+	bool edge_z = r_tile.local.y + p_tile_size >= region_size;
+	int data_size = region_size * region_size * sizeof(float);
+	for (int n = 0; n < 4; n++) {
+		if (((n & 1) && !edge_x) || ((n & 2) && !edge_z)) {
+			continue;
+		}
+		int index = region;
+		if (n > 0) {
+			Vector2i neighbor = region_offset + Vector2i((n & 1) ? region_size : 0, (n & 2) ? region_size : 0);
+			index = _storage->get_region_index(Vector3(neighbor.x, 0.f, neighbor.y) * _mesh_vertex_spacing);
+			if (index < 0) {
+				continue;
+			}
+		}
+		Ref<Image> map = _storage->get_map_region(Terrain3DStorage::TYPE_HEIGHT, index);
+		Ref<Image> cmap = _storage->get_map_region(Terrain3DStorage::TYPE_CONTROL, index);
+		if (map.is_null() || cmap.is_null()) {
+			continue;
+		}
+		r_tile.heights[n] = map->get_data();
+		// Use the hole mask if the storage has one, which most regions leave empty as they have no holes
+		const Terrain3DStorage::ControlMasks *masks = (index < _storage->_region_cache.size()) ? &_storage->_region_cache[index].masks : nullptr;
+		if (masks != nullptr && !masks->holes.is_empty()) {
+			r_tile.holes[n] = (masks->hole_count > 0) ? masks->holes : PackedByteArray();
+		} else {
+			r_tile.controls[n] = cmap->get_data();
+		}
+		if (r_tile.heights[n].size() < data_size || (!r_tile.controls[n].is_empty() && r_tile.controls[n].size() < data_size)) {
+			r_tile.heights[n].clear();
+			r_tile.holes[n].clear();
+			r_tile.controls[n].clear();
+		}
+	}
+	return !r_tile.heights[0].is_empty();
+}
+
+/**
+ * Builds the heights of a tile's HeightMapShape from the data in p_tile. Only touches p_tile, so it
+ * is safe to call from worker threads.
+ */
+void Terrain3D::_generate_collision_tile(CollisionTile &p_tile) {
+	int region_size = p_tile.region_size;
+	int shape_size = p_tile.size + 1;
+	const float *heights[4];
+	const uint8_t *holes[4];
+	const float *controls[4];
+	for (int n = 0; n < 4; n++) {
+		heights[n] = p_tile.heights[n].is_empty() ? nullptr : reinterpret_cast<const float *>(p_tile.heights[n].ptr());
+		holes[n] = p_tile.holes[n].is_empty() ? nullptr : p_tile.holes[n].ptr();
+		controls[n] = p_tile.controls[n].is_empty() ? nullptr : reinterpret_cast<const float *>(p_tile.controls[n].ptr());
+	}
+
+	p_tile.map_data.resize(shape_size * shape_size);
+	real_t *data = p_tile.map_data.ptrw();
+	real_t min_height = __FLT_MAX__;
+	real_t max_height = -__FLT_MAX__;
+
+	for (int z = 0; z < shape_size; z++) {
+		for (int x = 0; x < shape_size; x++) {
+			// Choose array indexing to match triangulation of heightmapshape with the mesh
+			// https://stackoverflow.com/questions/16684856/rotating-a-2d-pixel-array-by-90-degrees
+			// Normal array index rotated Y=0 - shape rotation Y=0 (xform in _apply_collision_tile)
+			// int index = z * shape_size + x;
+			// Array Index Rotated Y=-90 - must rotate shape Y=+90 (xform in _apply_collision_tile)
+			int index = shape_size - 1 - z + x * shape_size;
+
+			// Read heights from the local map, or adjacent maps if past the last row/col
+			int px = p_tile.local.x + x;
+			int pz = p_tile.local.y + z;
+			int n = 0;
+			if (px >= region_size) {
+				px -= region_size;
+				n |= 1;
+			}
+			if (pz >= region_size) {
+				pz -= region_size;
+				n |= 2;
+			}
+			real_t height = 0.f;
+			if (heights[n] != nullptr) {
+				int ofs = pz * region_size + px;
+				if ((holes[n] != nullptr && get_mask_bit(holes[n], ofs)) ||
+						(controls[n] != nullptr && is_hole(controls[n][ofs]))) {
+					data[index] = p_tile.hole_value;
+					continue;
+				}
+				height = heights[n][ofs];
+			}
+			data[index] = height;
+			min_height = MIN(min_height, height);
+			max_height = MAX(max_height, height);
+		}
+	}
+	p_tile.height_range = (min_height <= max_height) ? Vector2(min_height, max_height) : Vector2();
+
+	// Release the snapshots so edits on the main thread don't need to copy the maps
+	for (int n = 0; n < 4; n++) {
+		p_tile.heights[n] = PackedByteArray();
+		p_tile.holes[n] = PackedByteArray();
+		p_tile.controls[n] = PackedByteArray();
+	}
+}
+
+// Creates the shape for a generated tile, or updates it if it exists
+void Terrain3D::_apply_collision_tile(const CollisionTile &p_tile) {
+	int shape_size = p_tile.size + 1;
+	Vector2i global_offset = p_tile.coord * p_tile.size;
+	Vector3 global_pos = Vector3(global_offset.x, 0.f, global_offset.y);
+
+	// Non rotated shape for normal array index
+	//Transform3D xform = Transform3D(Basis(), global_pos);
+	// Rotated shape Y=90 for -90 rotated array index
+	Transform3D xform = Transform3D(Basis(Vector3(0.f, 1.f, 0.f), Math_PI * .5f),
+			global_pos + Vector3(p_tile.size, 0.f, p_tile.size) * .5f);
+	xform.scale(Vector3(_mesh_vertex_spacing, 1.f, _mesh_vertex_spacing));
+
+	bool has_shape = _collision_shapes.has(p_tile.coord);
+	if (!_show_debug_collision) {
+		if (!_static_body.is_valid()) {
+			return;
+		}
+		RID shape;
+		if (has_shape) {
+			shape = _collision_shapes[p_tile.coord];
+		} else {
+			shape = PhysicsServer3D::get_singleton()->heightmap_shape_create();
+		}
+		Dictionary shape_data;
+		shape_data["width"] = shape_size;
+		shape_data["depth"] = shape_size;
+		shape_data["heights"] = p_tile.map_data;
+		shape_data["min_height"] = p_tile.height_range.x;
+		shape_data["max_height"] = p_tile.height_range.y;
+		PhysicsServer3D::get_singleton()->shape_set_data(shape, shape_data);
+		if (!has_shape) {
+			PhysicsServer3D::get_singleton()->body_add_shape(_static_body, shape, xform);
+			_collision_shapes[p_tile.coord] = shape;
+		}
+	} else {
+		if (_debug_static_body == nullptr) {
+			return;
+		}
+		CollisionShape3D *debug_col_shape = nullptr;
+		Ref<HeightMapShape3D> hshape;
+		if (has_shape) {
+			Object *shape_obj = _collision_shapes[p_tile.coord];
+			debug_col_shape = Object::cast_to<CollisionShape3D>(shape_obj);
+			if (debug_col_shape != nullptr) {
+				hshape = debug_col_shape->get_shape();
+			}
+		}
+		if (debug_col_shape == nullptr || hshape.is_null()) {
+			debug_col_shape = memnew(CollisionShape3D);
+			debug_col_shape->set_name("CollisionShape3D");
+			_debug_static_body->add_child(debug_col_shape, true);
+			debug_col_shape->set_owner(_debug_static_body);
+
+			hshape.instantiate();
+			hshape->set_map_width(shape_size);
+			hshape->set_map_depth(shape_size);
+			debug_col_shape->set_shape(hshape);
+			debug_col_shape->set_global_transform(xform);
+			_collision_shapes[p_tile.coord] = debug_col_shape;
+		}
+		hshape->set_map_data(p_tile.map_data);
+	}
+}
+
+void Terrain3D::_free_collision_shape(Vector2i p_tile) {
+	if (!_collision_shapes.has(p_tile)) {
+		return;
+	}
+	if (!_show_debug_collision) {
+		RID shape = _collision_shapes[p_tile];
+		if (_static_body.is_valid()) {
+			for (int s = PhysicsServer3D::get_singleton()->body_get_shape_count(_static_body) - 1; s >= 0; s--) {
+				if (PhysicsServer3D::get_singleton()->body_get_shape(_static_body, s) == shape) {
+					PhysicsServer3D::get_singleton()->body_remove_shape(_static_body, s);
+					break;
+				}
+			}
+		}
+		PhysicsServer3D::get_singleton()->free_rid(shape);
+	} else {
+		Object *shape_obj = _collision_shapes[p_tile];
+		CollisionShape3D *debug_col_shape = Object::cast_to<CollisionShape3D>(shape_obj);
+		if (debug_col_shape != nullptr && _debug_static_body != nullptr) {
+			_debug_static_body->remove_child(debug_col_shape);
+			memdelete(debug_col_shape);
+		}
+	}
+	_collision_shapes.erase(p_tile);
+}
+
+/**
+ * Fits the custom AABB of a mesh instance to the height range of the terrain under its footprint
+ * at the given transform. The height range comes from the storage height pyramids, so is only
+ * padded by a few vertices. The cull margin is applied on top as a visibility margin.
+ */
+void Terrain3D::_update_instance_aabb(RID p_instance, GeoClipMap::MeshType p_type, const Transform3D &p_xform) {
+	if (_storage.is_null() || p_type >= _mesh_aabbs.size()) {
+		return;
+	}
+	AABB aabb = _mesh_aabbs[p_type];
+	AABB global_aabb = p_xform.xform(aabb);
+	Vector2 height_range = _storage->get_height_range_in_rect(
+			Rect2(global_aabb.position.x, global_aabb.position.z, global_aabb.size.x, global_aabb.size.z));
+	// Instances are only scaled and rotated around Y, so local heights are global heights
+	aabb.position.y = height_range.x;
+	aabb.size.y = height_range.y - height_range.x;
+	RS->instance_set_custom_aabb(p_instance, aabb);
 }
 
 /**
@@ -484,119 +903,618 @@ void Terrain3D::_update_instances() {
 	RID _scenario = get_world_3d()->get_scenario();
 
 	bool v = is_visible_in_tree();
-	RS->instance_set_visible(_data.cross, v);
-	RS->instance_set_scenario(_data.cross, _scenario);
-	RS->instance_geometry_set_cast_shadows_setting(_data.cross, RenderingServer::ShadowCastingSetting(_shadow_casting));
-	RS->instance_set_layer_mask(_data.cross, _render_layers);
-
-	for (const RID rid : _data.tiles) {
-		RS->instance_set_visible(rid, v);
-		RS->instance_set_scenario(rid, _scenario);
+	for (int i = 0; i < _views.size(); i++) {
+		_update_view_instances(_views.write[i], _scenario, v);
+	}
+}
+
+void Terrain3D::_update_view_instances(View &r_view, RID p_scenario, bool p_visible) {
+	Instances &instances = r_view.instances;
+	if (instances.cross.is_null()) {
+		return;
+	}
+	RS->instance_set_visible(instances.cross, p_visible);
+	RS->instance_set_scenario(instances.cross, p_scenario);
+	RS->instance_geometry_set_cast_shadows_setting(instances.cross, RenderingServer::ShadowCastingSetting(_shadow_casting));
+	RS->instance_set_layer_mask(instances.cross, r_view.layers);
+
+	for (const RID rid : instances.tiles) {
+		RS->instance_set_visible(rid, p_visible);
+		RS->instance_set_scenario(rid, p_scenario);
 		RS->instance_geometry_set_cast_shadows_setting(rid, RenderingServer::ShadowCastingSetting(_shadow_casting));
-		RS->instance_set_layer_mask(rid, _render_layers);
+		RS->instance_set_layer_mask(rid, r_view.layers);
 	}
 
-	for (const RID rid : _data.fillers) {
-		RS->instance_set_visible(rid, v);
-		RS->instance_set_scenario(rid, _scenario);
+	for (const RID rid : instances.fillers) {
+		RS->instance_set_visible(rid, p_visible);
+		RS->instance_set_scenario(rid, p_scenario);
 		RS->instance_geometry_set_cast_shadows_setting(rid, RenderingServer::ShadowCastingSetting(_shadow_casting));
-		RS->instance_set_layer_mask(rid, _render_layers);
+		RS->instance_set_layer_mask(rid, r_view.layers);
 	}
 
-	for (const RID rid : _data.trims) {
-		RS->instance_set_visible(rid, v);
-		RS->instance_set_scenario(rid, _scenario);
+	for (const RID rid : instances.trims) {
+		RS->instance_set_visible(rid, p_visible);
+		RS->instance_set_scenario(rid, p_scenario);
 		RS->instance_geometry_set_cast_shadows_setting(rid, RenderingServer::ShadowCastingSetting(_shadow_casting));
-		RS->instance_set_layer_mask(rid, _render_layers);
+		RS->instance_set_layer_mask(rid, r_view.layers);
 	}
 
-	for (const RID rid : _data.seams) {
-		RS->instance_set_visible(rid, v);
-		RS->instance_set_scenario(rid, _scenario);
+	for (const RID rid : instances.seams) {
+		RS->instance_set_visible(rid, p_visible);
+		RS->instance_set_scenario(rid, p_scenario);
 		RS->instance_geometry_set_cast_shadows_setting(rid, RenderingServer::ShadowCastingSetting(_shadow_casting));
-		RS->instance_set_layer_mask(rid, _render_layers);
+		RS->instance_set_layer_mask(rid, r_view.layers);
 	}
 }
 
-void Terrain3D::_generate_triangles(PackedVector3Array &p_vertices, PackedVector2Array *p_uvs, int32_t p_lod, Terrain3DStorage::HeightFilter p_filter, bool p_require_nav, AABB const &p_global_aabb) const {
+/**
+ * Triangulates the terrain into p_vertices and p_uvs, on worker threads in chunks of up to
+ * BAKE_CHUNK_CELLS cells per side. Vertices are shared within each chunk. With p_indices, the
+ * triangles are indexed, otherwise p_vertices is a list of triangle corners.
+ * p_global_aabb: If non-empty, only cells with a first vertex within it are included. Otherwise
+ *  all of p_region_offsets, or all regions if that is empty.
+ * p_max_error: If above 0, flatter areas are covered by fewer, larger triangles, with vertex heights
+ *  off by up to this much. When simplified, triangles need all vertices within p_global_aabb.
+ */
+void Terrain3D::_generate_triangles(PackedVector3Array &p_vertices, PackedVector2Array *p_uvs, PackedInt32Array *p_indices,
+		int32_t p_lod, Terrain3DStorage::HeightFilter p_filter, bool p_require_nav, AABB const &p_global_aabb,
+		const TypedArray<Vector2i> &p_region_offsets, real_t p_max_error) const {
 	ERR_FAIL_COND(!_storage.is_valid());
-	int32_t step = 1 << CLAMP(p_lod, 0, 8);
-
+	TriangleChunk settings;
+	settings.storage = _storage.ptr();
+	settings.lod = p_lod;
+	settings.filter = p_filter;
+	settings.require_nav = p_require_nav;
+	settings.generate_uvs = p_uvs != nullptr;
+	settings.max_error = p_max_error;
+	Vector<Rect2i> areas;
 	if (!p_global_aabb.has_volume()) {
 		int32_t region_size = (int)_storage->get_region_size();
-
-		TypedArray<Vector2i> region_offsets = _storage->get_region_offsets();
+		TypedArray<Vector2i> region_offsets = p_region_offsets.is_empty() ? _storage->get_region_offsets() : p_region_offsets;
 		for (int r = 0; r < region_offsets.size(); ++r) {
-			Vector2i region_offset = (Vector2i)region_offsets[r] * region_size;
-
-			for (int32_t z = region_offset.y; z < region_offset.y + region_size; z += step) {
-				for (int32_t x = region_offset.x; x < region_offset.x + region_size; x += step) {
-					_generate_triangle_pair(p_vertices, p_uvs, p_lod, p_filter, p_require_nav, x, z);
-				}
-			}
+			areas.push_back(Rect2i((Vector2i)region_offsets[r] * region_size, Vector2i(region_size, region_size)));
 		}
 	} else {
 		int32_t z_start = (int32_t)Math::ceil(p_global_aabb.position.z / _mesh_vertex_spacing);
 		int32_t z_end = (int32_t)Math::floor(p_global_aabb.get_end().z / _mesh_vertex_spacing) + 1;
 		int32_t x_start = (int32_t)Math::ceil(p_global_aabb.position.x / _mesh_vertex_spacing);
 		int32_t x_end = (int32_t)Math::floor(p_global_aabb.get_end().x / _mesh_vertex_spacing) + 1;
+		areas.push_back(Rect2i(x_start, z_start, x_end - x_start, z_end - z_start));
+		settings.filter_height = true;
+		settings.height_range = Vector2(p_global_aabb.position.y, p_global_aabb.get_end().y);
+	}
+
+	Vector<TriangleChunk> chunks;
+	_get_triangle_chunks(settings, areas, chunks);
+	if (chunks.is_empty()) {
+		return;
+	}
+
+	LOG(DEBUG, "Generating triangles in ", chunks.size(), " chunks");
+	if (chunks.size() == 1) {
+		_triangulate_chunk(chunks.write[0]);
+	} else {
+		// The chunks are passed by address, as they are local to this call
+		TriangleChunk *chunks_w = chunks.ptrw();
+		int64_t group_id = WorkerThreadPool::get_singleton()->add_group_task(
+				callable_mp(const_cast<Terrain3D *>(this), &Terrain3D::_generate_triangle_chunk).bind(reinterpret_cast<uint64_t>(chunks_w)), chunks.size(), -1, true, "Terrain3D bake");
+		WorkerThreadPool::get_singleton()->wait_for_group_task_completion(group_id);
+	}
+	_merge_triangle_chunks(chunks, p_vertices, p_uvs, p_indices);
+}
+
+/**
+ * Splits p_areas of vertex coordinates into chunks of p_settings, skipping those entirely above or
+ * below its height range if filtered.
+ */
+void Terrain3D::_get_triangle_chunks(const TriangleChunk &p_settings, const Vector<Rect2i> &p_areas, Vector<TriangleChunk> &r_chunks) const {
+	int32_t step = 1 << CLAMP(p_settings.lod, 0, 8);
+	int32_t chunk_size = BAKE_CHUNK_CELLS * step;
+	for (const Rect2i &area : p_areas) {
+		for (int32_t z = area.position.y; z < area.get_end().y; z += chunk_size) {
+			for (int32_t x = area.position.x; x < area.get_end().x; x += chunk_size) {
+				TriangleChunk chunk = p_settings;
+				chunk.area = Rect2i(x, z, MIN(chunk_size, area.get_end().x - x), MIN(chunk_size, area.get_end().y - z));
+				if (chunk.filter_height) {
+					// Skip chunks entirely above or below the AABB, and the per cell test in those within it
+					Rect2 rect = Rect2(Vector2(chunk.area.position) * _mesh_vertex_spacing, Vector2(chunk.area.size - Vector2i(1, 1)) * _mesh_vertex_spacing);
+					Vector2 range = chunk.storage->get_height_range_in_rect(rect);
+					if (range.y < chunk.height_range.x || range.x > chunk.height_range.y) {
+						continue;
+					}
+					chunk.filter_height = range.x < chunk.height_range.x || range.y > chunk.height_range.y;
+				}
+				r_chunks.push_back(chunk);
+			}
+		}
+	}
+}
 
-		for (int32_t z = z_start; z < z_end; ++z) {
-			for (int32_t x = x_start; x < x_end; ++x) {
-				real_t height = _storage->get_height(Vector3(x, 0.f, z));
-				if (height >= p_global_aabb.position.y && height <= p_global_aabb.get_end().y) {
-					_generate_triangle_pair(p_vertices, p_uvs, p_lod, p_filter, p_require_nav, x, z);
+// Appends the triangles of p_chunks, indexed if p_indices is given, otherwise as triangle corners
+void Terrain3D::_merge_triangle_chunks(const Vector<TriangleChunk> &p_chunks, PackedVector3Array &p_vertices,
+		PackedVector2Array *p_uvs, PackedInt32Array *p_indices) {
+	int vertex_count = p_vertices.size();
+	int index_count = (p_indices != nullptr) ? p_indices->size() : 0;
+	int total_vertices = vertex_count;
+	int total_indices = index_count;
+	for (const TriangleChunk &chunk : p_chunks) {
+		total_vertices += (p_indices != nullptr) ? chunk.vertices.size() : chunk.indices.size();
+		total_indices += chunk.indices.size();
+	}
+	p_vertices.resize(total_vertices);
+	if (p_uvs != nullptr) {
+		p_uvs->resize(total_vertices);
+	}
+	if (p_indices != nullptr) {
+		p_indices->resize(total_indices);
+	}
+	Vector3 *vertices_w = p_vertices.ptrw();
+	Vector2 *uvs_w = (p_uvs != nullptr) ? p_uvs->ptrw() : nullptr;
+	int32_t *indices_w = (p_indices != nullptr) ? p_indices->ptrw() : nullptr;
+	for (const TriangleChunk &chunk : p_chunks) {
+		const Vector3 *vertices = chunk.vertices.ptr();
+		const Vector2 *uvs = chunk.uvs.ptr();
+		const int32_t *indices = chunk.indices.ptr();
+		if (p_indices != nullptr) {
+			memcpy(vertices_w + vertex_count, vertices, chunk.vertices.size() * sizeof(Vector3));
+			if (uvs_w != nullptr) {
+				memcpy(uvs_w + vertex_count, uvs, chunk.uvs.size() * sizeof(Vector2));
+			}
+			for (int i = 0; i < chunk.indices.size(); i++) {
+				indices_w[index_count++] = vertex_count + indices[i];
+			}
+			vertex_count += chunk.vertices.size();
+		} else {
+			for (int i = 0; i < chunk.indices.size(); i++) {
+				vertices_w[vertex_count] = vertices[indices[i]];
+				if (uvs_w != nullptr) {
+					uvs_w[vertex_count] = uvs[indices[i]];
 				}
+				vertex_count++;
 			}
 		}
 	}
 }
 
-void Terrain3D::_generate_triangle_pair(PackedVector3Array &p_vertices, PackedVector2Array *p_uvs, int32_t p_lod, Terrain3DStorage::HeightFilter p_filter, bool p_require_nav, int32_t x, int32_t z) const {
-	int32_t step = 1 << CLAMP(p_lod, 0, 8);
+/**
+ * Triangulates a chunk as a right-triangulated irregular network (RTIN), where each triangle is
+ * split at the middle of its long edge until the height there is within max_error of the edge.
+ * The chunk is padded to a square of 2^n + 1 vertices, as needed by the splits. Errors are
+ * accumulated from the smallest triangles up, so neighbouring triangles split together and leave no
+ * cracks. Triangles covering an unusable vertex, and those along the chunk edges, are split down to
+ * cells so that adjacent chunks match.
+ */
+void Terrain3D::_simplify_triangle_chunk(TriangleChunk &r_chunk, Vector2i p_cells, const Vector3 *p_vertices, const uint8_t *p_nav) const {
+	int row = p_cells.x + 1;
+	int tile = 1;
+	while (tile < MAX(p_cells.x, p_cells.y)) {
+		tile <<= 1;
+	}
+	int size = tile + 1;
+
+	// Heights of the padded grid, which is invalid outside of the chunk
+	PackedFloat32Array heights;
+	heights.resize(size * size);
+	float *heights_w = heights.ptrw();
+	PackedByteArray valid;
+	valid.resize(size * size);
+	uint8_t *valid_w = valid.ptrw();
+	for (int z = 0; z < size; z++) {
+		for (int x = 0; x < size; x++) {
+			int i = z * size + x;
+			valid_w[i] = 0;
+			heights_w[i] = 0.f;
+			if (x > p_cells.x || z > p_cells.y) {
+				continue;
+			}
+			int g = z * row + x;
+			real_t height = p_vertices[g].y;
+			if (Math::is_nan(height) || (p_nav != nullptr && p_nav[g] == 0) ||
+					(r_chunk.filter_height && !(height >= r_chunk.height_range.x && height <= r_chunk.height_range.y))) {
+				continue;
+			}
+			valid_w[i] = 1;
+			heights_w[i] = height;
+		}
+	}
 
-	Vector3 xz = Vector3(x, 0.0f, z) * _mesh_vertex_spacing;
-	Vector3 xsz = Vector3(x + step, 0.0f, z) * _mesh_vertex_spacing;
-	Vector3 xzs = Vector3(x, 0.0f, z + step) * _mesh_vertex_spacing;
-	Vector3 xszs = Vector3(x + step, 0.0f, z + step) * _mesh_vertex_spacing;
+	// Error of each triangle's long edge midpoint, from the smallest triangles to the largest.
+	// Triangle ids form a binary tree, with the two halves of the square at 2 and 3.
+	int triangle_count = tile * tile * 2 - 2;
+	int parent_count = triangle_count - tile * tile;
+	PackedFloat32Array errors;
+	errors.resize(size * size);
+	errors.fill(0.f);
+	float *errors_w = errors.ptrw();
+	for (int i = triangle_count - 1; i >= 0; i--) {
+		int id = i + 2;
+		int ax = 0, ay = 0, bx = 0, by = 0, cx = 0, cy = 0;
+		if (id & 1) {
+			bx = by = cx = tile;
+		} else {
+			ax = ay = cy = tile;
+		}
+		while ((id >>= 1) > 1) {
+			int mx = (ax + bx) >> 1;
+			int my = (ay + by) >> 1;
+			if (id & 1) {
+				bx = ax;
+				by = ay;
+				ax = cx;
+				ay = cy;
+			} else {
+				ax = bx;
+				ay = by;
+				bx = cx;
+				by = cy;
+			}
+			cx = mx;
+			cy = my;
+		}
+		int mx = (ax + bx) >> 1;
+		int my = (ay + by) >> 1;
+		int middle = my * size + mx;
+		int a = ay * size + ax;
+		int b = by * size + bx;
+		int c = cy * size + cx;
+		float error = Math::abs((heights_w[a] + heights_w[b]) * 0.5f - heights_w[middle]);
+		bool on_edge = (mx == 0 || my == 0 || mx >= p_cells.x || my >= p_cells.y);
+		if (!valid_w[a] || !valid_w[b] || !valid_w[c] || !valid_w[middle] || on_edge) {
+			error = __FLT_MAX__;
+		}
+		errors_w[middle] = MAX(errors_w[middle], error);
+		if (i < parent_count) {
+			int left = ((ay + cy) >> 1) * size + ((ax + cx) >> 1);
+			int right = ((by + cy) >> 1) * size + ((bx + cx) >> 1);
+			errors_w[middle] = MAX(errors_w[middle], MAX(errors_w[left], errors_w[right]));
+		}
+	}
 
-	uint32_t control1 = _storage->get_control(xz);
-	uint32_t control2 = _storage->get_control(xszs);
-	uint32_t control3 = _storage->get_control(xzs);
-	if (!p_require_nav || (is_nav(control1) && is_nav(control2) && is_nav(control3))) {
-		Vector3 v1 = _storage->get_mesh_vertex(p_lod, p_filter, xz);
-		Vector3 v2 = _storage->get_mesh_vertex(p_lod, p_filter, xszs);
-		Vector3 v3 = _storage->get_mesh_vertex(p_lod, p_filter, xzs);
-		if (!UtilityFunctions::is_nan(v1.y) && !UtilityFunctions::is_nan(v2.y) && !UtilityFunctions::is_nan(v3.y)) {
-			p_vertices.push_back(v1);
-			p_vertices.push_back(v2);
-			p_vertices.push_back(v3);
-			if (p_uvs != nullptr) {
-				p_uvs->push_back(Vector2(v1.x, v1.z));
-				p_uvs->push_back(Vector2(v2.x, v2.z));
-				p_uvs->push_back(Vector2(v3.x, v3.z));
+	// Allocate for every vertex and triangle, then shrink to those used
+	int grid_size = row * (p_cells.y + 1);
+	r_chunk.vertices.resize(grid_size);
+	r_chunk.indices.resize(p_cells.x * p_cells.y * 6);
+	if (r_chunk.generate_uvs) {
+		r_chunk.uvs.resize(grid_size);
+	}
+	Vector3 *chunk_vertices = r_chunk.vertices.ptrw();
+	Vector2 *chunk_uvs = r_chunk.uvs.ptrw();
+	int32_t *chunk_indices = r_chunk.indices.ptrw();
+	int vertex_count = 0;
+	int index_count = 0;
+
+	// Split the two halves of the square until within the error. Each split replaces a triangle
+	// with two smaller ones, so the stack holds at most two per level.
+	PackedInt32Array remap; // Padded grid index -> chunk vertex index, or -1 if not used yet
+	remap.resize(size * size);
+	remap.fill(-1);
+	int32_t *remap_w = remap.ptrw();
+	int stack[64][6] = {
+		{ 0, 0, tile, tile, tile, 0 },
+		{ tile, tile, 0, 0, 0, tile },
+	};
+	int stack_size = 2;
+	while (stack_size > 0) {
+		stack_size--;
+		int ax = stack[stack_size][0], ay = stack[stack_size][1];
+		int bx = stack[stack_size][2], by = stack[stack_size][3];
+		int cx = stack[stack_size][4], cy = stack[stack_size][5];
+		int mx = (ax + bx) >> 1;
+		int my = (ay + by) >> 1;
+		if (Math::abs(ax - cx) + Math::abs(ay - cy) > 1 && errors_w[my * size + mx] > r_chunk.max_error) {
+			int children[2][6] = {
+				{ cx, cy, ax, ay, mx, my },
+				{ bx, by, cx, cy, mx, my },
+			};
+			memcpy(stack[stack_size], children, sizeof(children));
+			stack_size += 2;
+			continue;
+		}
+		// Same winding as the regular grid
+		int corners[3] = { ay * size + ax, cy * size + cx, by * size + bx };
+		if (!valid_w[corners[0]] || !valid_w[corners[1]] || !valid_w[corners[2]]) {
+			continue;
+		}
+		for (int c = 0; c < 3; c++) {
+			int i = corners[c];
+			if (remap_w[i] < 0) {
+				remap_w[i] = vertex_count;
+				Vector3 vertex = p_vertices[(i / size) * row + (i % size)];
+				chunk_vertices[vertex_count] = vertex;
+				if (r_chunk.generate_uvs) {
+					chunk_uvs[vertex_count] = Vector2(vertex.x, vertex.z);
+				}
+				vertex_count++;
 			}
+			chunk_indices[index_count++] = remap_w[i];
+		}
+	}
+	r_chunk.vertices.resize(vertex_count);
+	r_chunk.indices.resize(index_count);
+	if (r_chunk.generate_uvs) {
+		r_chunk.uvs.resize(vertex_count);
+	}
+}
+
+// WorkerThreadPool group task triangulating one of the chunks of _generate_triangles(), bound by address
+void Terrain3D::_generate_triangle_chunk(uint32_t p_index, uint64_t p_chunks) const {
+	_triangulate_chunk(reinterpret_cast<TriangleChunk *>(p_chunks)[p_index]);
+}
+
+/**
+ * Triangulates r_chunk from its storage. Each vertex of the chunk is looked up once, then each cell
+ * is split into two triangles, leaving out those with a hole or missing height, or a corner not
+ * marked navigable if required.
+ */
+void Terrain3D::_triangulate_chunk(TriangleChunk &r_chunk) const {
+	int32_t step = 1 << CLAMP(r_chunk.lod, 0, 8);
+	// Skip chunks entirely over regions without navigable pixels
+	if (r_chunk.require_nav && !r_chunk.storage->_has_nav(r_chunk.area.grow(step))) {
+		return;
+	}
+	Vector2i cells = Vector2i((r_chunk.area.size.x + step - 1) / step, (r_chunk.area.size.y + step - 1) / step);
+	int row = cells.x + 1;
+	int grid_size = row * (cells.y + 1);
+
+	PackedVector3Array positions;
+	positions.resize(grid_size);
+	Vector3 *positions_w = positions.ptrw();
+	for (int z = 0; z <= cells.y; z++) {
+		for (int x = 0; x <= cells.x; x++) {
+			positions_w[z * row + x] = Vector3(r_chunk.area.position.x + x * step, 0.f, r_chunk.area.position.y + z * step) * _mesh_vertex_spacing;
+		}
+	}
+	PackedVector3Array grid = r_chunk.storage->get_mesh_vertices(r_chunk.lod, r_chunk.filter, positions);
+	const Vector3 *vertices = grid.ptr();
+	PackedByteArray nav;
+	if (r_chunk.require_nav) {
+		nav.resize(grid_size);
+		uint8_t *nav_w = nav.ptrw();
+		Terrain3DStorage::RegionTable regions = r_chunk.storage->_get_region_data();
+		for (int i = 0; i < grid_size; i++) {
+			nav_w[i] = r_chunk.storage->_read_nav(regions, positions_w[i], _mesh_vertex_spacing) ? 1 : 0;
 		}
 	}
+	if (r_chunk.max_error > 0.f) {
+		_simplify_triangle_chunk(r_chunk, cells, vertices, r_chunk.require_nav ? nav.ptr() : nullptr);
+		return;
+	}
 
-	control1 = _storage->get_control(xz);
-	control2 = _storage->get_control(xsz);
-	control3 = _storage->get_control(xszs);
-	if (!p_require_nav || (is_nav(control1) && is_nav(control2) && is_nav(control3))) {
-		Vector3 v1 = _storage->get_mesh_vertex(p_lod, p_filter, xz);
-		Vector3 v2 = _storage->get_mesh_vertex(p_lod, p_filter, xsz);
-		Vector3 v3 = _storage->get_mesh_vertex(p_lod, p_filter, xszs);
-		if (!UtilityFunctions::is_nan(v1.y) && !UtilityFunctions::is_nan(v2.y) && !UtilityFunctions::is_nan(v3.y)) {
-			p_vertices.push_back(v1);
-			p_vertices.push_back(v2);
-			p_vertices.push_back(v3);
-			if (p_uvs != nullptr) {
-				p_uvs->push_back(Vector2(v1.x, v1.z));
-				p_uvs->push_back(Vector2(v2.x, v2.z));
-				p_uvs->push_back(Vector2(v3.x, v3.z));
+	// Allocate for every vertex and triangle, then shrink to those used
+	r_chunk.vertices.resize(grid_size);
+	r_chunk.indices.resize(cells.x * cells.y * 6);
+	if (r_chunk.generate_uvs) {
+		r_chunk.uvs.resize(grid_size);
+	}
+	Vector3 *chunk_vertices = r_chunk.vertices.ptrw();
+	Vector2 *chunk_uvs = r_chunk.uvs.ptrw();
+	int32_t *chunk_indices = r_chunk.indices.ptrw();
+	int vertex_count = 0;
+	int index_count = 0;
+
+	PackedInt32Array remap; // Grid index -> chunk vertex index, or -1 if not used yet
+	remap.resize(grid_size);
+	remap.fill(-1);
+	int32_t *remap_w = remap.ptrw();
+	for (int z = 0; z < cells.y; z++) {
+		for (int x = 0; x < cells.x; x++) {
+			int i00 = z * row + x;
+			if (r_chunk.filter_height && !(vertices[i00].y >= r_chunk.height_range.x && vertices[i00].y <= r_chunk.height_range.y)) {
+				continue;
+			}
+			int triangles[2][3] = {
+				{ i00, i00 + row + 1, i00 + row },
+				{ i00, i00 + 1, i00 + row + 1 },
+			};
+			for (int t = 0; t < 2; t++) {
+				bool valid = true;
+				for (int c = 0; c < 3; c++) {
+					int i = triangles[t][c];
+					if (Math::is_nan(vertices[i].y) || (r_chunk.require_nav && nav[i] == 0)) {
+						valid = false;
+						break;
+					}
+				}
+				if (!valid) {
+					continue;
+				}
+				for (int c = 0; c < 3; c++) {
+					int i = triangles[t][c];
+					if (remap_w[i] < 0) {
+						remap_w[i] = vertex_count;
+						chunk_vertices[vertex_count] = vertices[i];
+						if (r_chunk.generate_uvs) {
+							chunk_uvs[vertex_count] = Vector2(vertices[i].x, vertices[i].z);
+						}
+						vertex_count++;
+					}
+					chunk_indices[index_count++] = remap_w[i];
+				}
 			}
 		}
 	}
+	r_chunk.vertices.resize(vertex_count);
+	r_chunk.indices.resize(index_count);
+	if (r_chunk.generate_uvs) {
+		r_chunk.uvs.resize(vertex_count);
+	}
+}
+
+/**
+ * Emits the tiles of a finished nav mesh task, then starts the next queued request. Called from
+ * __process() while there is work. See generate_nav_mesh_source_tiles().
+ */
+void Terrain3D::_update_nav_tiles() {
+	if (_nav_task >= 0) {
+		if (!WorkerThreadPool::get_singleton()->is_task_completed(_nav_task)) {
+			return;
+		}
+		_finish_nav_task();
+		// Handlers may request more tiles, which reuses _nav_jobs
+		Vector<NavTile> tiles = _nav_jobs;
+		_nav_jobs.clear();
+		LOG(DEBUG_CONT, "Generated nav mesh source geometry for ", tiles.size(), " tiles");
+		for (const NavTile &tile : tiles) {
+			emit_signal("nav_mesh_source_tile_generated", tile.coord, tile.faces);
+		}
+	}
+	if (_nav_task < 0 && !_nav_requests.is_empty()) {
+		Array request = _nav_requests.pop_front();
+		_start_nav_task(TypedArray<Vector2i>(Array(request[0])), real_t(request[1]), bool(request[2]), real_t(request[3]));
+	}
+}
+
+/**
+ * Snapshots the storage under p_tiles and queues their triangulation on the WorkerThreadPool. Edits
+ * made while the task runs are left for the next request.
+ */
+void Terrain3D::_start_nav_task(const TypedArray<Vector2i> &p_tiles, real_t p_tile_size, bool p_require_nav, real_t p_max_error) {
+	_nav_jobs.clear();
+	Rect2 bounds;
+	for (int i = 0; i < p_tiles.size(); i++) {
+		NavTile job;
+		job.coord = p_tiles[i];
+		job.rect = Rect2(Vector2(job.coord) * p_tile_size, Vector2(p_tile_size, p_tile_size));
+		bounds = (i == 0) ? job.rect : bounds.merge(job.rect);
+		_nav_jobs.push_back(job);
+	}
+	if (_nav_jobs.is_empty()) {
+		return;
+	}
+	// Cells along the far edges reach a vertex into the next tile
+	_nav_snapshot = _storage->_create_read_snapshot(bounds.grow(_mesh_vertex_spacing));
+	_nav_settings = TriangleChunk();
+	_nav_settings.storage = _nav_snapshot.ptr();
+	_nav_settings.require_nav = p_require_nav;
+	_nav_settings.max_error = p_max_error;
+	LOG(DEBUG_CONT, "Queueing nav mesh source geometry for ", _nav_jobs.size(), " tiles");
+	_nav_task = WorkerThreadPool::get_singleton()->add_task(
+			callable_mp(this, &Terrain3D::_generate_nav_tiles), false, "Terrain3D nav mesh tiles");
+}
+
+// Runs on the WorkerThreadPool. The main thread leaves _nav_jobs and _nav_snapshot alone until the task is done.
+void Terrain3D::_generate_nav_tiles() {
+	Vector<Rect2i> areas;
+	areas.resize(1);
+	Vector<TriangleChunk> chunks;
+	for (int i = 0; i < _nav_jobs.size(); i++) {
+		NavTile &tile = _nav_jobs.write[i];
+		// Each tile has the cells with a first vertex within it, so vertices on the far edges belong to the next
+		Vector2i start = Vector2i((tile.rect.position / _mesh_vertex_spacing).ceil());
+		Vector2i end = Vector2i((tile.rect.get_end() / _mesh_vertex_spacing).ceil());
+		areas.write[0] = Rect2i(start, end - start);
+		chunks.clear();
+		_get_triangle_chunks(_nav_settings, areas, chunks);
+		for (int c = 0; c < chunks.size(); c++) {
+			_triangulate_chunk(chunks.write[c]);
+		}
+		_merge_triangle_chunks(chunks, tile.faces, nullptr, nullptr);
+	}
+}
+
+void Terrain3D::_finish_nav_task() {
+	if (_nav_task >= 0) {
+		WorkerThreadPool::get_singleton()->wait_for_task_completion(_nav_task);
+		_nav_task = -1;
+	}
+	_nav_settings.storage = nullptr;
+	_nav_snapshot.unref();
+}
+
+/**
+ * Registers the custom monitors shown in the debugger's Monitors tab under Terrain3D. They report
+ * on the first Terrain3D to enter the tree, until it leaves.
+ */
+void Terrain3D::_add_monitors() {
+	if (_monitored_terrain != nullptr) {
+		return;
+	}
+	Performance *performance = Performance::get_singleton();
+	for (int i = 0; i < MONITOR_MAX; i++) {
+		if (performance->has_custom_monitor(MONITOR_NAMES[i])) {
+			LOG(WARN, "Custom monitor ", MONITOR_NAMES[i], " already exists");
+			continue;
+		}
+		Array args;
+		args.push_back(i);
+		performance->add_custom_monitor(MONITOR_NAMES[i], callable_mp(this, &Terrain3D::_get_monitor), args);
+	}
+	_monitored_terrain = this;
+	_last_uploaded_bytes = GeneratedTexture::uploaded_bytes;
+}
+
+void Terrain3D::_remove_monitors() {
+	if (_monitored_terrain != this) {
+		return;
+	}
+	Performance *performance = Performance::get_singleton();
+	for (int i = 0; i < MONITOR_MAX; i++) {
+		if (performance->has_custom_monitor(MONITOR_NAMES[i])) {
+			performance->remove_custom_monitor(MONITOR_NAMES[i]);
+		}
+	}
+	_monitored_terrain = nullptr;
+}
+
+// Rolls the per frame and per second counters, once a frame
+void Terrain3D::_update_monitors(double p_delta) {
+	_frame_uploaded_bytes = GeneratedTexture::uploaded_bytes - _last_uploaded_bytes;
+	_last_uploaded_bytes = GeneratedTexture::uploaded_bytes;
+	_snap_time += p_delta;
+	if (_snap_time >= 1.0) {
+		_snaps_per_second = double(_snap_count) / _snap_time;
+		_snap_count = 0;
+		_snap_time = 0.0;
+	}
+}
+
+// Called by the Performance singleton for each monitor, from the main thread
+double Terrain3D::_get_monitor(int p_monitor) {
+	const double MIB = 1024.0 * 1024.0;
+	switch (p_monitor) {
+		case MONITOR_COLLISION_BUILD_TIME:
+			return double(_collision_build_usec) / 1000.0;
+		case MONITOR_TEXTURE_UPLOADS:
+			return double(_frame_uploaded_bytes) / 1024.0;
+		case MONITOR_REGION_COUNT:
+			return _storage.is_valid() ? _storage->get_region_count() : 0;
+		case MONITOR_MAP_MEMORY: {
+			if (_storage.is_null()) {
+				return 0.0;
+			}
+			uint64_t bytes = 0;
+			TypedArray<Image> maps[] = { _storage->_height_maps, _storage->_control_maps, _storage->_color_maps };
+			for (const TypedArray<Image> &map_array : maps) {
+				for (int i = 0; i < map_array.size(); i++) {
+					Ref<Image> img = map_array[i];
+					bytes += img.is_valid() ? img->get_data_size() : 0;
+				}
+			}
+			return double(bytes) / MIB;
+		}
+		case MONITOR_TEXTURE_VRAM: {
+			uint64_t bytes = 0;
+			if (_storage.is_valid()) {
+				bytes += _storage->_generated_height_maps.get_memory() + _storage->_generated_control_maps.get_memory() +
+						_storage->_generated_color_maps.get_memory();
+			}
+			if (_material.is_valid()) {
+				bytes += _material->_generated_region_map.get_memory() + _material->_generated_region_blend_map.get_memory();
+			}
+			if (_texture_list.is_valid()) {
+				bytes += _texture_list->get_texture_memory();
+			}
+			return double(bytes) / MIB;
+		}
+		case MONITOR_SNAPS:
+			return _snaps_per_second;
+		case MONITOR_SHADER_COMPILES:
+			return _material.is_valid() ? _material->_shader_compile_count : 0;
+		case MONITOR_UNDO_MEMORY:
+			return double(Terrain3DEditor::undo_memory) / MIB;
+		default:
+			return 0.0;
+	}
 }
 
 ///////////////////////////
@@ -626,6 +1544,8 @@ Terrain3D::Terrain3D() {
 
 Terrain3D::~Terrain3D() {
 	_destroy_collision();
+	_nav_requests.clear();
+	_finish_nav_task();
 }
 
 void Terrain3D::set_debug_level(int p_level) {
@@ -633,6 +1553,49 @@ void Terrain3D::set_debug_level(int p_level) {
 	debug_level = CLAMP(p_level, 0, DEBUG_MAX);
 }
 
+/**
+ * Server mode leaves out everything used only for drawing: the clipmap meshes, mouse picking,
+ * shaders, and the map and texture arrays on the GPU. The maps, height queries, collision and
+ * navigation work as usual. It's always on under the headless display server, eg. dedicated servers.
+ */
+void Terrain3D::set_server_mode(bool p_enabled) {
+	if (_server_mode != p_enabled) {
+		LOG(INFO, "Setting server mode: ", p_enabled);
+		bool was_server_mode = is_server_mode();
+		_server_mode = p_enabled;
+		if (was_server_mode == is_server_mode()) {
+			return;
+		}
+		_clear();
+		_destroy_mouse_picking();
+		if (is_server_mode() && _material.is_valid()) {
+			// Stop the material following storage changes, and free what it has on the GPU
+			Callable update_textures = callable_mp(_material.ptr(), &Terrain3DMaterial::_update_texture_arrays);
+			Callable update_regions = callable_mp(_material.ptr(), &Terrain3DMaterial::_update_regions);
+			if (_texture_list.is_valid() && _texture_list->is_connected("textures_changed", update_textures)) {
+				_texture_list->disconnect("textures_changed", update_textures);
+			}
+			if (_storage.is_valid() && _storage->is_connected("region_size_changed", update_regions)) {
+				_storage->disconnect("region_size_changed", update_regions);
+			}
+			if (_storage.is_valid() && _storage->is_connected("regions_changed", update_regions)) {
+				_storage->disconnect("regions_changed", update_regions);
+			}
+			_material->_clear();
+		}
+		if (!is_server_mode() && _storage.is_valid()) {
+			_storage->force_update_maps(); // Upload the maps again
+		}
+		_initialize();
+	}
+}
+
+// True under the headless display server, where nothing can be drawn
+bool Terrain3D::is_headless() {
+	DisplayServer *ds = DisplayServer::get_singleton();
+	return ds != nullptr && ds->get_name() == "headless";
+}
+
 void Terrain3D::set_mesh_lods(int p_count) {
 	if (_mesh_lods != p_count) {
 		LOG(INFO, "Setting mesh levels: ", p_count);
@@ -717,9 +1680,57 @@ void Terrain3D::set_camera(Camera3D *p_camera) {
 	}
 }
 
+/**
+ * Adds a clipmap centered on p_camera, for split screen or other viewpoints. It shares the
+ * storage, material and collision with the main view, but has its own mesh instances, on
+ * p_render_layers. Give each camera a cull mask that sees only its own view's layers.
+ * Adding a camera again changes its layers. The view is removed when the camera is freed.
+ */
+void Terrain3D::add_view(Camera3D *p_camera, uint32_t p_render_layers) {
+	ERR_FAIL_COND_MSG(p_camera == nullptr, "Camera is null");
+	LOG(INFO, "Adding view for camera ", p_camera, " on render layers ", p_render_layers);
+	remove_view(p_camera);
+	View view;
+	view.camera = ObjectID(p_camera->get_instance_id());
+	view.layers = p_render_layers;
+	_views.push_back(view);
+	if (!_meshes.is_empty() && is_inside_tree()) {
+		View &added = _views.write[_views.size() - 1];
+		RID scenario = get_world_3d()->get_scenario();
+		_create_view_instances(added, scenario);
+		_update_view_instances(added, scenario, is_visible_in_tree());
+		update_aabbs();
+	}
+}
+
+void Terrain3D::remove_view(Camera3D *p_camera) {
+	ERR_FAIL_COND_MSG(p_camera == nullptr, "Camera is null");
+	ObjectID id = ObjectID(p_camera->get_instance_id());
+	for (int i = _views.size() - 1; i > 0; i--) {
+		if (_views[i].camera == id) {
+			LOG(INFO, "Removing view for camera ", p_camera);
+			_free_view_instances(_views.write[i]);
+			_views.remove_at(i);
+		}
+	}
+}
+
+// Returns the cameras of the views added with add_view()
+TypedArray<Camera3D> Terrain3D::get_views() const {
+	TypedArray<Camera3D> cameras;
+	for (int i = 1; i < _views.size(); i++) {
+		Camera3D *camera = Object::cast_to<Camera3D>(ObjectDB::get_instance(_views[i].camera));
+		if (camera != nullptr) {
+			cameras.push_back(camera);
+		}
+	}
+	return cameras;
+}
+
 void Terrain3D::set_render_layers(uint32_t p_layers) {
 	LOG(INFO, "Setting terrain render layers to: ", p_layers);
 	_render_layers = p_layers;
+	_views.write[0].layers = p_layers;
 	_update_instances();
 }
 
@@ -818,24 +1829,140 @@ void Terrain3D::set_collision_priority(real_t p_priority) {
 	}
 }
 
+void Terrain3D::set_collision_mode(CollisionMode p_mode) {
+	LOG(INFO, "Setting collision mode: ", p_mode);
+	if (_collision_mode == p_mode) {
+		return;
+	}
+	_destroy_collision();
+	_collision_mode = p_mode;
+	if (_collision_enabled) {
+		_build_collision();
+	}
+}
+
+void Terrain3D::set_collision_radius(real_t p_radius) {
+	LOG(INFO, "Setting collision radius: ", p_radius);
+	_collision_radius = CLAMP(p_radius, 1.f, 16384.f);
+	_collision_centers_stale = true;
+}
+
+/**
+ * Sets the vertex width of the tiles used in COLLISION_DYNAMIC mode. Rounded down to a power of
+ * two so the tiles line up with region borders.
+ */
+void Terrain3D::set_collision_shape_size(int p_size) {
+	int size = 8;
+	while (size * 2 <= MIN(p_size, int(Terrain3DStorage::SIZE_2048))) {
+		size *= 2;
+	}
+	LOG(INFO, "Setting collision shape size: ", size);
+	if (_collision_shape_size == size) {
+		return;
+	}
+	_collision_shape_size = size;
+	if (_collision_mode == COLLISION_DYNAMIC) {
+		_destroy_collision();
+		if (_collision_enabled) {
+			_build_collision();
+		}
+	}
+}
+
+void Terrain3D::add_collision_target(Node3D *p_node) {
+	ERR_FAIL_NULL(p_node);
+	int64_t id = int64_t(p_node->get_instance_id());
+	if (!_collision_targets.has(id)) {
+		LOG(INFO, "Adding collision target: ", p_node->get_name());
+		_collision_targets.push_back(id);
+	}
+}
+
+void Terrain3D::remove_collision_target(Node3D *p_node) {
+	ERR_FAIL_NULL(p_node);
+	int index = _collision_targets.find(int64_t(p_node->get_instance_id()));
+	if (index >= 0) {
+		LOG(INFO, "Removing collision target: ", p_node->get_name());
+		_collision_targets.remove_at(index);
+	}
+}
+
+TypedArray<Node3D> Terrain3D::get_collision_targets() const {
+	TypedArray<Node3D> targets;
+	for (int i = 0; i < _collision_targets.size(); i++) {
+		Node3D *target = Object::cast_to<Node3D>(ObjectDB::get_instance(_collision_targets[i]));
+		if (target != nullptr) {
+			targets.push_back(target);
+		}
+	}
+	return targets;
+}
+
+/**
+ * Regenerates the collision shapes overlapping p_global_aabb, or all shapes if it is empty.
+ * Shapes for added or removed regions are updated as well.
+ */
+void Terrain3D::update_collision(AABB p_global_aabb) {
+	if (_storage.is_null()) {
+		return;
+	}
+	if (p_global_aabb.has_surface()) {
+		_mark_collision_dirty(p_global_aabb);
+	} else {
+		Array shape_tiles = _collision_shapes.keys();
+		for (int i = 0; i < shape_tiles.size(); i++) {
+			_collision_dirty_tiles[shape_tiles[i]] = true;
+		}
+	}
+	_update_collision();
+}
+
 /**
  * Centers the terrain and LODs on a provided position. Y height is ignored.
+ * The placement of each LOD depends only on the grid cell of that LOD the position is in, so
+ * LODs whose cell hasn't changed since the last snap are left alone. Moving a cell at LOD 0
+ * moves only LOD 0 most of the time, LOD 1 half as often, and so on.
  */
 void Terrain3D::snap(Vector3 p_cam_pos) {
-	p_cam_pos.y = 0;
-	LOG(DEBUG_CONT, "Snapping terrain to: ", String(p_cam_pos));
+	_snap_view(_views.write[0], p_cam_pos);
+}
 
-	Vector3 snapped_pos = (p_cam_pos / _mesh_vertex_spacing).floor() * _mesh_vertex_spacing;
-	Transform3D t = Transform3D().scaled(Vector3(_mesh_vertex_spacing, 1, _mesh_vertex_spacing));
-	t.origin = snapped_pos;
-	RS->instance_set_transform(_data.cross, t);
+void Terrain3D::_snap_view(View &r_view, Vector3 p_cam_pos) {
+	Instances &instances = r_view.instances;
+	if (instances.cross.is_null()) {
+		return; // Not built
+	}
+	_snap_count++;
+	p_cam_pos.y = 0;
+	r_view.snap_position = p_cam_pos;
+	if (r_view.snap_cells.size() != _mesh_lods) {
+		r_view.snap_cells.resize(_mesh_lods);
+		r_view.snap_cells.fill(Vector2i(INT32_MAX, INT32_MAX));
+	}
 
 	int edge = 0;
 	int tile = 0;
+	int moved = 0;
 
 	for (int l = 0; l < _mesh_lods; l++) {
 		real_t scale = real_t(1 << l) * _mesh_vertex_spacing;
-		Vector3 snapped_pos = (p_cam_pos / scale).floor() * scale;
+		Vector2i cell = Vector2i((Vector2(p_cam_pos.x, p_cam_pos.z) / scale).floor());
+		if (cell == r_view.snap_cells[l]) {
+			tile += (l == 0) ? 16 : 12;
+			edge += (l != _mesh_lods - 1) ? 1 : 0;
+			continue;
+		}
+		r_view.snap_cells.write[l] = cell;
+		moved++;
+		Vector3 snapped_pos = Vector3(cell.x, 0.f, cell.y) * scale;
+
+		// The cross fills the center of LOD 0
+		if (l == 0) {
+			Transform3D t = Transform3D().scaled(Vector3(_mesh_vertex_spacing, 1, _mesh_vertex_spacing));
+			t.origin = snapped_pos;
+			RS->instance_set_transform(instances.cross, t);
+			_update_instance_aabb(instances.cross, GeoClipMap::CROSS, t);
+		}
 		Vector3 tile_size = Vector3(real_t(_mesh_size << l), 0, real_t(_mesh_size << l)) * _mesh_vertex_spacing;
 		Vector3 base = snapped_pos - Vector3(real_t(_mesh_size << (l + 1)), 0.f, real_t(_mesh_size << (l + 1))) * _mesh_vertex_spacing;
 
@@ -853,7 +1980,8 @@ void Terrain3D::snap(Vector3 p_cam_pos) {
 				Transform3D t = Transform3D().scaled(Vector3(scale, 1.f, scale));
 				t.origin = tile_tl;
 
-				RS->instance_set_transform(_data.tiles[tile], t);
+				RS->instance_set_transform(instances.tiles[tile], t);
+				_update_instance_aabb(instances.tiles[tile], GeoClipMap::TILE, t);
 
 				tile++;
 			}
@@ -861,7 +1989,8 @@ void Terrain3D::snap(Vector3 p_cam_pos) {
 		{
 			Transform3D t = Transform3D().scaled(Vector3(scale, 1.f, scale));
 			t.origin = snapped_pos;
-			RS->instance_set_transform(_data.fillers[l], t);
+			RS->instance_set_transform(instances.fillers[l], t);
+			_update_instance_aabb(instances.fillers[l], GeoClipMap::FILLER, t);
 		}
 
 		if (l != _mesh_lods - 1) {
@@ -883,7 +2012,8 @@ void Terrain3D::snap(Vector3 p_cam_pos) {
 				Transform3D t = Transform3D().rotated(Vector3(0.f, 1.f, 0.f), -angle);
 				t = t.scaled(Vector3(scale, 1.f, scale));
 				t.origin = tile_center;
-				RS->instance_set_transform(_data.trims[edge], t);
+				RS->instance_set_transform(instances.trims[edge], t);
+				_update_instance_aabb(instances.trims[edge], GeoClipMap::TRIM, t);
 			}
 
 			// Position seams
@@ -891,69 +2021,81 @@ void Terrain3D::snap(Vector3 p_cam_pos) {
 				Vector3 next_base = next_snapped_pos - Vector3(real_t(_mesh_size << (l + 1)), 0.f, real_t(_mesh_size << (l + 1))) * _mesh_vertex_spacing;
 				Transform3D t = Transform3D().scaled(Vector3(scale, 1.f, scale));
 				t.origin = next_base;
-				RS->instance_set_transform(_data.seams[edge], t);
+				RS->instance_set_transform(instances.seams[edge], t);
+				_update_instance_aabb(instances.seams[edge], GeoClipMap::SEAM, t);
 			}
 			edge++;
 		}
 	}
+	LOG(DEBUG_CONT, "Snapped view to: ", String(p_cam_pos), ", moved ", moved, " of ", _mesh_lods, " LODs");
 }
 
+/**
+ * Refits the AABBs of the mesh instances to the heights under them, and applies the cull margin.
+ * Each instance is bounded by the terrain heights within its own footprint, see snap().
+ */
 void Terrain3D::update_aabbs() {
 	if (_meshes.is_empty() || _storage.is_null()) {
 		LOG(DEBUG, "Update AABB called before terrain meshes built. Returning.");
 		return;
 	}
 
-	Vector2 height_range = _storage->get_height_range();
-	LOG(DEBUG_CONT, "Updating AABBs. Total height range: ", height_range, ", extra cull margin: ", _cull_margin);
-	height_range.y += abs(height_range.x); // Add below zero to total size
-
-	AABB aabb = RS->mesh_get_custom_aabb(_meshes[GeoClipMap::CROSS]);
-	aabb.position.y = height_range.x;
-	aabb.size.y = height_range.y;
-	RS->instance_set_custom_aabb(_data.cross, aabb);
-	RS->instance_set_extra_visibility_margin(_data.cross, _cull_margin);
-
-	aabb = RS->mesh_get_custom_aabb(_meshes[GeoClipMap::TILE]);
-	aabb.position.y = height_range.x;
-	aabb.size.y = height_range.y;
-	for (int i = 0; i < _data.tiles.size(); i++) {
-		RS->instance_set_custom_aabb(_data.tiles[i], aabb);
-		RS->instance_set_extra_visibility_margin(_data.tiles[i], _cull_margin);
-	}
-
-	aabb = RS->mesh_get_custom_aabb(_meshes[GeoClipMap::FILLER]);
-	aabb.position.y = height_range.x;
-	aabb.size.y = height_range.y;
-	for (int i = 0; i < _data.fillers.size(); i++) {
-		RS->instance_set_custom_aabb(_data.fillers[i], aabb);
-		RS->instance_set_extra_visibility_margin(_data.fillers[i], _cull_margin);
-	}
-
-	aabb = RS->mesh_get_custom_aabb(_meshes[GeoClipMap::TRIM]);
-	aabb.position.y = height_range.x;
-	aabb.size.y = height_range.y;
-	for (int i = 0; i < _data.trims.size(); i++) {
-		RS->instance_set_custom_aabb(_data.trims[i], aabb);
-		RS->instance_set_extra_visibility_margin(_data.trims[i], _cull_margin);
-	}
-
-	aabb = RS->mesh_get_custom_aabb(_meshes[GeoClipMap::SEAM]);
-	aabb.position.y = height_range.x;
-	aabb.size.y = height_range.y;
-	for (int i = 0; i < _data.seams.size(); i++) {
-		RS->instance_set_custom_aabb(_data.seams[i], aabb);
-		RS->instance_set_extra_visibility_margin(_data.seams[i], _cull_margin);
+	LOG(DEBUG_CONT, "Updating AABBs. Total height range: ", _storage->get_height_range(), ", extra cull margin: ", _cull_margin);
+	for (int v = 0; v < _views.size(); v++) {
+		View &view = _views.write[v];
+		Instances &instances = view.instances;
+		if (instances.cross.is_null()) {
+			continue;
+		}
+		RS->instance_set_extra_visibility_margin(instances.cross, _cull_margin);
+		for (int i = 0; i < instances.tiles.size(); i++) {
+			RS->instance_set_extra_visibility_margin(instances.tiles[i], _cull_margin);
+		}
+		for (int i = 0; i < instances.fillers.size(); i++) {
+			RS->instance_set_extra_visibility_margin(instances.fillers[i], _cull_margin);
+		}
+		for (int i = 0; i < instances.trims.size(); i++) {
+			RS->instance_set_extra_visibility_margin(instances.trims[i], _cull_margin);
+		}
+		for (int i = 0; i < instances.seams.size(); i++) {
+			RS->instance_set_extra_visibility_margin(instances.seams[i], _cull_margin);
+		}
+		view.snap_cells.clear(); // Refit every LOD
+		_snap_view(view, view.snap_position);
 	}
 }
 
-/* Iterate over ground to find intersection point between two rays:
+/* Finds the intersection point of a ray with the terrain:
  *	p_src_pos (camera position)
  *	p_direction (camera direction looking at the terrain)
- *	test_dir (camera direction 0 Y, traversing terrain along height
+ *	p_gpu_mode: Renders the terrain depth from a camera placed at p_src_pos and reads it back, which
+ *	 stalls the renderer. Otherwise the height maps are ray marched on the CPU, see
+ *	 Terrain3DStorage::get_ray_intersection(), with the flat world background at height 0.
  * Returns vec3(Double max 3.402823466e+38F) on no intersection. Test w/ if (var.x < 3.4e38)
  */
-Vector3 Terrain3D::get_intersection(Vector3 p_src_pos, Vector3 p_direction) {
+Vector3 Terrain3D::get_intersection(Vector3 p_src_pos, Vector3 p_direction, bool p_gpu_mode) {
+	if (!p_gpu_mode) {
+		if (_storage.is_null()) {
+			LOG(ERROR, "Invalid storage");
+			return Vector3(NAN, NAN, NAN);
+		}
+		p_direction.normalize();
+		real_t max_distance = 100000.f;
+		Vector3 point = _storage->get_ray_intersection(p_src_pos, p_direction, max_distance);
+		if (_material.is_valid() && _material->get_world_background() == Terrain3DMaterial::FLAT && p_direction.y < -CMP_EPSILON) {
+			real_t t = -p_src_pos.y / p_direction.y;
+			Vector3 ground = p_src_pos + p_direction * t;
+			if (t >= 0.f && t <= max_distance && !_storage->has_region(ground) &&
+					(Math::is_nan(point.y) || t < p_src_pos.distance_to(point))) {
+				point = ground;
+			}
+		}
+		if (Math::is_nan(point.y)) {
+			return Vector3(__FLT_MAX__, __FLT_MAX__, __FLT_MAX__);
+		}
+		return point;
+	}
+
 	if (_camera == nullptr) {
 		LOG(ERROR, "Invalid camera");
 		return Vector3(NAN, NAN, NAN);
@@ -1014,27 +2156,34 @@ Vector3 Terrain3D::get_intersection(Vector3 p_src_pos, Vector3 p_direction) {
  *  HEIGHT_FILTER_MINIMUM: Samples a range of heights around each vertex and returns the lowest.
  *   This takes longer than ..._NEAREST, but can be used to create occluders, since it can guarantee the
  *   generated mesh will not extend above or outside the clipmap at any LOD.
+ * p_region_offsets: Regions to bake, or all regions if empty. Lets one edited region be rebaked.
+ * p_max_error: If above 0, merges triangles where the height is within this distance of the
+ *  merged surface, so flat areas use far fewer triangles.
  */
-Ref<Mesh> Terrain3D::bake_mesh(int p_lod, Terrain3DStorage::HeightFilter p_filter) const {
+Ref<Mesh> Terrain3D::bake_mesh(int p_lod, Terrain3DStorage::HeightFilter p_filter, const TypedArray<Vector2i> &p_region_offsets,
+		real_t p_max_error) const {
 	LOG(INFO, "Baking mesh at lod: ", p_lod, " with filter: ", p_filter);
 	Ref<Mesh> result;
 	ERR_FAIL_COND_V(!_storage.is_valid(), result);
 
-	Ref<SurfaceTool> st;
-	st.instantiate();
-	st->begin(Mesh::PRIMITIVE_TRIANGLES);
-
 	PackedVector3Array vertices;
 	PackedVector2Array uvs;
-	_generate_triangles(vertices, &uvs, p_lod, p_filter, false, AABB());
-
+	PackedInt32Array indices;
+	_generate_triangles(vertices, &uvs, &indices, p_lod, p_filter, false, AABB(), p_region_offsets, p_max_error);
 	ERR_FAIL_COND_V(vertices.size() != uvs.size(), result);
-	for (int i = 0; i < vertices.size(); ++i) {
-		st->set_uv(uvs[i]);
-		st->add_vertex(vertices[i]);
+	if (indices.is_empty()) {
+		LOG(WARN, "No terrain to bake");
+		return result;
 	}
 
-	st->index();
+	Array arrays;
+	arrays.resize(Mesh::ARRAY_MAX);
+	arrays[Mesh::ARRAY_VERTEX] = vertices;
+	arrays[Mesh::ARRAY_TEX_UV] = uvs;
+	arrays[Mesh::ARRAY_INDEX] = indices;
+	Ref<SurfaceTool> st;
+	st.instantiate();
+	st->create_from_arrays(arrays, Mesh::PRIMITIVE_TRIANGLES);
 	st->generate_normals();
 	st->generate_tangents();
 	st->optimize_indices_for_cache();
@@ -1050,14 +2199,43 @@ Ref<Mesh> Terrain3D::bake_mesh(int p_lod, Terrain3DStorage::HeightFilter p_filte
  * p_require_nav: If true, this function will only generate geometry for terrain marked navigable.
  *  Otherwise, geometry is generated for the entire terrain within the AABB (which can be useful for
  *  dynamic and/or runtime nav mesh baking).
+ * p_max_error: If above 0, simplifies the geometry, see bake_mesh().
  */
-PackedVector3Array Terrain3D::generate_nav_mesh_source_geometry(AABB const &p_global_aabb, bool p_require_nav) const {
+PackedVector3Array Terrain3D::generate_nav_mesh_source_geometry(AABB const &p_global_aabb, bool p_require_nav, real_t p_max_error) const {
 	LOG(INFO, "Generating NavMesh source geometry from terrain");
 	PackedVector3Array faces;
-	_generate_triangles(faces, nullptr, 0, Terrain3DStorage::HEIGHT_FILTER_NEAREST, p_require_nav, p_global_aabb);
+	_generate_triangles(faces, nullptr, nullptr, 0, Terrain3DStorage::HEIGHT_FILTER_NEAREST, p_require_nav, p_global_aabb,
+			TypedArray<Vector2i>(), p_max_error);
 	return faces;
 }
 
+/**
+ * Generates navigation source geometry for square tiles of p_tile_size world units, starting at the
+ * origin, on a worker thread, then emits nav_mesh_source_tile_generated for each tile. Each tile
+ * holds the cells with a first vertex within it, so its triangles reach one vertex into the next.
+ * Requests made while one is running are queued. Pass Terrain3DStorage.get_changed_tiles() to only
+ * regenerate what was edited.
+ * p_require_nav, p_max_error: See generate_nav_mesh_source_geometry().
+ */
+void Terrain3D::generate_nav_mesh_source_tiles(const TypedArray<Vector2i> &p_tiles, real_t p_tile_size, bool p_require_nav,
+		real_t p_max_error) {
+	ERR_FAIL_COND(!_storage.is_valid());
+	ERR_FAIL_COND_MSG(p_tile_size <= 0.f, "Tile size must be above 0");
+	if (p_tiles.is_empty()) {
+		return;
+	}
+	if (_nav_task >= 0 || !_nav_requests.is_empty()) {
+		Array request;
+		request.push_back(p_tiles.duplicate());
+		request.push_back(p_tile_size);
+		request.push_back(p_require_nav);
+		request.push_back(p_max_error);
+		_nav_requests.push_back(request);
+		return;
+	}
+	_start_nav_task(p_tiles, p_tile_size, p_require_nav, p_max_error);
+}
+
 PackedStringArray Terrain3D::_get_configuration_warnings() const {
 	PackedStringArray psa;
 	if (_storage.is_valid()) {
@@ -1098,11 +2276,13 @@ void Terrain3D::_notification(int p_what) {
 		case NOTIFICATION_ENTER_TREE: {
 			LOG(INFO, "NOTIFICATION_ENTER_TREE");
 			_initialize();
+			_add_monitors();
 			break;
 		}
 
 		case NOTIFICATION_EXIT_TREE: {
 			LOG(INFO, "NOTIFICATION_EXIT_TREE");
+			_remove_monitors();
 			_clear();
 			_destroy_mouse_picking();
 			break;
@@ -1137,7 +2317,8 @@ void Terrain3D::_notification(int p_what) {
 			if (!_storage.is_valid()) {
 				LOG(DEBUG, "Save requested, but no valid storage. Skipping");
 			} else {
-				_storage->save();
+				// The storage is an external file, so it doesn't need to be written before the scene
+				_storage->save(true);
 			}
 			if (!_material.is_valid()) {
 				LOG(DEBUG, "Save requested, but no valid material. Skipping");
@@ -1159,9 +2340,16 @@ void Terrain3D::_notification(int p_what) {
 }
 
 void Terrain3D::_bind_methods() {
+	BIND_ENUM_CONSTANT(COLLISION_FULL);
+	BIND_ENUM_CONSTANT(COLLISION_DYNAMIC);
+
 	ClassDB::bind_method(D_METHOD("get_version"), &Terrain3D::get_version);
 	ClassDB::bind_method(D_METHOD("set_debug_level", "level"), &Terrain3D::set_debug_level);
 	ClassDB::bind_method(D_METHOD("get_debug_level"), &Terrain3D::get_debug_level);
+	ClassDB::bind_method(D_METHOD("set_server_mode", "enabled"), &Terrain3D::set_server_mode);
+	ClassDB::bind_method(D_METHOD("get_server_mode"), &Terrain3D::get_server_mode);
+	ClassDB::bind_method(D_METHOD("is_server_mode"), &Terrain3D::is_server_mode);
+	ClassDB::bind_static_method("Terrain3D", D_METHOD("is_headless"), &Terrain3D::is_headless);
 	ClassDB::bind_method(D_METHOD("set_mesh_lods", "count"), &Terrain3D::set_mesh_lods);
 	ClassDB::bind_method(D_METHOD("get_mesh_lods"), &Terrain3D::get_mesh_lods);
 	ClassDB::bind_method(D_METHOD("set_mesh_size", "size"), &Terrain3D::set_mesh_size);
@@ -1181,6 +2369,10 @@ void Terrain3D::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("set_camera", "camera"), &Terrain3D::set_camera);
 	ClassDB::bind_method(D_METHOD("get_camera"), &Terrain3D::get_camera);
 
+	ClassDB::bind_method(D_METHOD("add_view", "camera", "render_layers"), &Terrain3D::add_view);
+	ClassDB::bind_method(D_METHOD("remove_view", "camera"), &Terrain3D::remove_view);
+	ClassDB::bind_method(D_METHOD("get_views"), &Terrain3D::get_views);
+
 	ClassDB::bind_method(D_METHOD("set_render_layers", "layers"), &Terrain3D::set_render_layers);
 	ClassDB::bind_method(D_METHOD("get_render_layers"), &Terrain3D::get_render_layers);
 	ClassDB::bind_method(D_METHOD("set_mouse_layer", "layer"), &Terrain3D::set_mouse_layer);
@@ -1200,15 +2392,29 @@ void Terrain3D::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("get_collision_mask"), &Terrain3D::get_collision_mask);
 	ClassDB::bind_method(D_METHOD("set_collision_priority", "priority"), &Terrain3D::set_collision_priority);
 	ClassDB::bind_method(D_METHOD("get_collision_priority"), &Terrain3D::get_collision_priority);
-
-	ClassDB::bind_method(D_METHOD("get_intersection", "src_pos", "direction"), &Terrain3D::get_intersection);
-	ClassDB::bind_method(D_METHOD("bake_mesh", "lod", "filter"), &Terrain3D::bake_mesh);
-	ClassDB::bind_method(D_METHOD("generate_nav_mesh_source_geometry", "global_aabb", "require_nav"), &Terrain3D::generate_nav_mesh_source_geometry, DEFVAL(true));
+	ClassDB::bind_method(D_METHOD("set_collision_mode", "mode"), &Terrain3D::set_collision_mode);
+	ClassDB::bind_method(D_METHOD("get_collision_mode"), &Terrain3D::get_collision_mode);
+	ClassDB::bind_method(D_METHOD("set_collision_radius", "radius"), &Terrain3D::set_collision_radius);
+	ClassDB::bind_method(D_METHOD("get_collision_radius"), &Terrain3D::get_collision_radius);
+	ClassDB::bind_method(D_METHOD("set_collision_shape_size", "size"), &Terrain3D::set_collision_shape_size);
+	ClassDB::bind_method(D_METHOD("get_collision_shape_size"), &Terrain3D::get_collision_shape_size);
+	ClassDB::bind_method(D_METHOD("add_collision_target", "node"), &Terrain3D::add_collision_target);
+	ClassDB::bind_method(D_METHOD("remove_collision_target", "node"), &Terrain3D::remove_collision_target);
+	ClassDB::bind_method(D_METHOD("get_collision_targets"), &Terrain3D::get_collision_targets);
+	ClassDB::bind_method(D_METHOD("update_collision", "global_aabb"), &Terrain3D::update_collision, DEFVAL(AABB()));
+
+	ClassDB::bind_method(D_METHOD("snap", "cam_pos"), &Terrain3D::snap);
+	ClassDB::bind_method(D_METHOD("get_intersection", "src_pos", "direction", "gpu_mode"), &Terrain3D::get_intersection, DEFVAL(false));
+	ClassDB::bind_method(D_METHOD("bake_mesh", "lod", "filter", "region_offsets", "max_error"), &Terrain3D::bake_mesh, DEFVAL(TypedArray<Vector2i>()), DEFVAL(0.f));
+	ClassDB::bind_method(D_METHOD("generate_nav_mesh_source_geometry", "global_aabb", "require_nav", "max_error"), &Terrain3D::generate_nav_mesh_source_geometry, DEFVAL(true), DEFVAL(0.f));
+	ClassDB::bind_method(D_METHOD("generate_nav_mesh_source_tiles", "tiles", "tile_size", "require_nav", "max_error"), &Terrain3D::generate_nav_mesh_source_tiles, DEFVAL(true), DEFVAL(0.f));
+	ClassDB::bind_method(D_METHOD("is_generating_nav_mesh_source_tiles"), &Terrain3D::is_generating_nav_mesh_source_tiles);
 
 	ADD_PROPERTY(PropertyInfo(Variant::STRING, "version", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_EDITOR | PROPERTY_USAGE_READ_ONLY), "", "get_version");
 	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "storage", PROPERTY_HINT_RESOURCE_TYPE, "Terrain3DStorage"), "set_storage", "get_storage");
 	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "material", PROPERTY_HINT_RESOURCE_TYPE, "Terrain3DMaterial"), "set_material", "get_material");
 	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "texture_list", PROPERTY_HINT_RESOURCE_TYPE, "Terrain3DTextureList"), "set_texture_list", "get_texture_list");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "server_mode"), "set_server_mode", "get_server_mode");
 
 	ADD_GROUP("Renderer", "render_");
 	ADD_PROPERTY(PropertyInfo(Variant::INT, "render_layers", PROPERTY_HINT_LAYERS_3D_RENDER), "set_render_layers", "get_render_layers");
@@ -1221,6 +2427,9 @@ void Terrain3D::_bind_methods() {
 	ADD_PROPERTY(PropertyInfo(Variant::INT, "collision_layer", PROPERTY_HINT_LAYERS_3D_PHYSICS), "set_collision_layer", "get_collision_layer");
 	ADD_PROPERTY(PropertyInfo(Variant::INT, "collision_mask", PROPERTY_HINT_LAYERS_3D_PHYSICS), "set_collision_mask", "get_collision_mask");
 	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "collision_priority"), "set_collision_priority", "get_collision_priority");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "collision_mode", PROPERTY_HINT_ENUM, "Full,Dynamic"), "set_collision_mode", "get_collision_mode");
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "collision_radius", PROPERTY_HINT_RANGE, "1.0,1024.0,1.0,or_greater"), "set_collision_radius", "get_collision_radius");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "collision_shape_size", PROPERTY_HINT_ENUM, "8:8,16:16,32:32,64:64,128:128,256:256,512:512,1024:1024,2048:2048"), "set_collision_shape_size", "get_collision_shape_size");
 
 	ADD_GROUP("Mesh", "mesh_");
 	ADD_PROPERTY(PropertyInfo(Variant::INT, "mesh_lods", PROPERTY_HINT_RANGE, "1,10,1"), "set_mesh_lods", "get_mesh_lods");
@@ -1232,6 +2441,7 @@ void Terrain3D::_bind_methods() {
 	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "debug_show_collision"), "set_show_debug_collision", "get_show_debug_collision");
 
 	ADD_SIGNAL(MethodInfo("material_changed"));
+	ADD_SIGNAL(MethodInfo("nav_mesh_source_tile_generated", PropertyInfo(Variant::VECTOR2I, "tile"), PropertyInfo(Variant::PACKED_VECTOR3_ARRAY, "faces")));
 	ADD_SIGNAL(MethodInfo("storage_changed"));
 	ADD_SIGNAL(MethodInfo("texture_list_changed"));
 }
@@ -12,6 +12,7 @@
 #include <godot_cpp/classes/sub_viewport.hpp>
 
 #include "constants.h"
+#include "geoclipmap.h"
 #include "terrain_3d_material.h"
 #include "terrain_3d_storage.h"
 #include "terrain_3d_texture_list.h"
@@ -22,10 +23,43 @@ class Terrain3D : public Node3D {
 	GDCLASS(Terrain3D, Node3D);
 	CLASS_NAME();
 
+public: // Constants
+	enum CollisionMode {
+		COLLISION_FULL, // A shape for every region, built on the main thread
+		COLLISION_DYNAMIC, // Shapes for tiles near the camera and targets, built on worker threads
+	};
+
+private:
+	// Custom monitors shown in the debugger, see _get_monitor()
+	enum Monitor {
+		MONITOR_COLLISION_BUILD_TIME,
+		MONITOR_TEXTURE_UPLOADS,
+		MONITOR_REGION_COUNT,
+		MONITOR_MAP_MEMORY,
+		MONITOR_TEXTURE_VRAM,
+		MONITOR_SNAPS,
+		MONITOR_SHADER_COMPILES,
+		MONITOR_UNDO_MEMORY,
+		MONITOR_MAX,
+	};
+	static inline const char *MONITOR_NAMES[] = {
+		"Terrain3D/Collision Build Time (ms)",
+		"Terrain3D/Texture Uploads (KiB per frame)",
+		"Terrain3D/Regions",
+		"Terrain3D/Map Memory (MiB)",
+		"Terrain3D/Texture VRAM (MiB)",
+		"Terrain3D/Snaps per Second",
+		"Terrain3D/Shader Compiles",
+		"Terrain3D/Undo Memory (MiB)",
+	};
+	static inline Terrain3D *_monitored_terrain = nullptr; // The instance the monitors report on
+
+private:
 	// Terrain state
 	String _version = "0.9.2-dev";
 	bool _is_inside_world = false;
 	bool _initialized = false;
+	bool _server_mode = false; // Set explicitly, see is_server_mode()
 
 	// Terrain settings
 	int _mesh_size = 48;
@@ -40,18 +74,32 @@ class Terrain3D : public Node3D {
 	EditorPlugin *_plugin = nullptr;
 	// Current editor or gameplay camera we are centering the terrain on.
 	Camera3D *_camera = nullptr;
-	// X,Z Position of the camera during the previous snapping. Set to max real_t value to force a snap update.
-	Vector2 _camera_last_position = Vector2(__FLT_MAX__, __FLT_MAX__);
 
 	// Meshes and Mesh instances
 	Vector<RID> _meshes;
+	Vector<AABB> _mesh_aabbs; // Custom AABB of each mesh in _meshes
 	struct Instances {
 		RID cross;
 		Vector<RID> tiles;
 		Vector<RID> fillers;
 		Vector<RID> trims;
 		Vector<RID> seams;
-	} _data;
+	};
+
+	// A clipmap of instances of _meshes centered on a camera. View 0 follows _camera on
+	// render_layers. Others are added by add_view(), all share the storage and material.
+	struct View {
+		ObjectID camera; // Unused by view 0
+		uint32_t layers = 0; // Render layers of the instances
+		Instances instances;
+		// X,Z Position of the camera during the previous snapping. Set to max real_t value to force a snap update.
+		Vector2 camera_last_position = Vector2(__FLT_MAX__, __FLT_MAX__);
+		// Position of the last snap, which update_aabbs() refits the instances at
+		Vector3 snap_position;
+		// Grid cell of each LOD at the last snap, only LODs leaving their cell are moved. Empty to move all.
+		Vector<Vector2i> snap_cells;
+	};
+	Vector<View> _views = { View() };
 
 	// Renderer settings
 	uint32_t _render_layers = 1 | (1 << 31); // Bit 1 and 32 for the cursor
@@ -72,6 +120,69 @@ class Terrain3D : public Node3D {
 	uint32_t _collision_layer = 1;
 	uint32_t _collision_mask = 1;
 	real_t _collision_priority = 1.0f;
+	CollisionMode _collision_mode = COLLISION_FULL;
+	real_t _collision_radius = 64.f;
+	int _collision_shape_size = 16;
+	PackedInt64Array _collision_targets; // Instance ids of Node3Ds to build dynamic collision around
+	Dictionary _collision_shapes; // Tile coordinate -> shape RID, or CollisionShape3D* in debug mode
+	Dictionary _collision_dirty_tiles; // Tile coordinates whose shapes need new heights
+	Vector<Vector2i> _collision_centers; // Tile of the camera and each target at the last dynamic update
+	bool _collision_centers_stale = true; // Recompute wanted tiles even if no center moved
+	bool _collision_update_queued = false;
+
+	// A shape to generate. Tiles are regions in COLLISION_FULL mode.
+	struct CollisionTile {
+		Vector2i coord; // Tile grid coordinate, in units of size
+		int size = 0; // Vertex width of the tile, the shape has one more
+		int region_size = 0;
+		Vector2i local; // Tile position within its region
+		PackedByteArray heights[4]; // Snapshots of this region, +X, +Z, +XZ. Empty if not needed
+		PackedByteArray holes[4]; // Hole masks, empty if the region has no holes
+		PackedByteArray controls[4]; // Only for regions without masks
+		float hole_value = NAN;
+		PackedRealArray map_data;
+		Vector2 height_range;
+	};
+	Vector<CollisionTile> _collision_jobs; // Owned by the worker task while _collision_task is valid
+	int64_t _collision_task = -1;
+
+	// Baking, see _generate_triangles()
+	static inline const int BAKE_CHUNK_CELLS = 256;
+	struct TriangleChunk {
+		Terrain3DStorage *storage = nullptr; // _storage, or a snapshot of it on worker threads
+		Rect2i area; // Region of vertex coordinates to triangulate, in cells of 1 << lod
+		int32_t lod = 0;
+		Terrain3DStorage::HeightFilter filter = Terrain3DStorage::HEIGHT_FILTER_NEAREST;
+		bool require_nav = false;
+		bool generate_uvs = false;
+		bool filter_height = false; // Only include cells with a first vertex within height_range
+		Vector2 height_range;
+		real_t max_error = 0.f; // Simplify if above 0, see _simplify_triangle_chunk()
+		PackedVector3Array vertices;
+		PackedVector2Array uvs;
+		PackedInt32Array indices;
+	};
+
+	// Navigation source geometry generated in the background, see generate_nav_mesh_source_tiles()
+	struct NavTile {
+		Vector2i coord; // Tile grid coordinate, in units of the tile size
+		Rect2 rect;
+		PackedVector3Array faces;
+	};
+	Ref<Terrain3DStorage> _nav_snapshot; // Read by the worker task while _nav_task is valid
+	Vector<NavTile> _nav_jobs; // Owned by the worker task while _nav_task is valid
+	TriangleChunk _nav_settings;
+	Array _nav_requests; // Queued [ tiles, tile_size, require_nav, max_error ] while a task runs
+	int64_t _nav_task = -1;
+
+	// Monitor counters
+	uint64_t _collision_build_usec = 0; // Last full update, or dynamic tile batch
+	uint64_t _collision_jobs_usec = 0; // Written by the dynamic collision task
+	uint64_t _last_uploaded_bytes = 0; // GeneratedTexture::uploaded_bytes at the previous frame
+	uint64_t _frame_uploaded_bytes = 0;
+	int _snap_count = 0;
+	double _snap_time = 0.0;
+	double _snaps_per_second = 0.0;
 
 	void _initialize();
 	void __ready();
@@ -87,11 +198,46 @@ class Terrain3D : public Node3D {
 	void _build_collision();
 	void _update_collision();
 	void _destroy_collision();
+	void _queue_collision_update() {
+		_collision_update_queued = true;
+		_collision_centers_stale = true;
+	}
+	void _update_dynamic_collision();
+	void _generate_collision_jobs();
+	void _update_collision_settings();
+	void _mark_collision_dirty(AABB p_global_aabb);
+	int _get_collision_tile_size() const;
+	float _get_collision_hole_value() const;
+	bool _prepare_collision_tile(Vector2i p_tile, int p_tile_size, float p_hole_value, CollisionTile &r_tile) const;
+	static void _generate_collision_tile(CollisionTile &p_tile);
+	void _apply_collision_tile(const CollisionTile &p_tile);
+	void _free_collision_shape(Vector2i p_tile);
 
+	void _create_view_instances(View &r_view, RID p_scenario);
+	void _free_view_instances(View &r_view);
+	void _update_view_instances(View &r_view, RID p_scenario, bool p_visible);
+	void _snap_view(View &r_view, Vector3 p_cam_pos);
 	void _update_instances();
+	void _update_instance_aabb(RID p_instance, GeoClipMap::MeshType p_type, const Transform3D &p_xform);
+
+	void _generate_triangles(PackedVector3Array &p_vertices, PackedVector2Array *p_uvs, PackedInt32Array *p_indices,
+			int32_t p_lod, Terrain3DStorage::HeightFilter p_filter, bool p_require_nav, AABB const &p_global_aabb,
+			const TypedArray<Vector2i> &p_region_offsets = TypedArray<Vector2i>(), real_t p_max_error = 0.f) const;
+	void _get_triangle_chunks(const TriangleChunk &p_settings, const Vector<Rect2i> &p_areas, Vector<TriangleChunk> &r_chunks) const;
+	static void _merge_triangle_chunks(const Vector<TriangleChunk> &p_chunks, PackedVector3Array &p_vertices,
+			PackedVector2Array *p_uvs, PackedInt32Array *p_indices);
+	void _generate_triangle_chunk(uint32_t p_index, uint64_t p_chunks) const;
+	void _triangulate_chunk(TriangleChunk &r_chunk) const;
+	void _simplify_triangle_chunk(TriangleChunk &r_chunk, Vector2i p_cells, const Vector3 *p_vertices, const uint8_t *p_nav) const;
+	void _update_nav_tiles();
+	void _start_nav_task(const TypedArray<Vector2i> &p_tiles, real_t p_tile_size, bool p_require_nav, real_t p_max_error);
+	void _generate_nav_tiles();
+	void _finish_nav_task();
 
-	void _generate_triangles(PackedVector3Array &p_vertices, PackedVector2Array *p_uvs, int32_t p_lod, Terrain3DStorage::HeightFilter p_filter, bool require_nav, AABB const &p_global_aabb) const;
-	void _generate_triangle_pair(PackedVector3Array &p_vertices, PackedVector2Array *p_uvs, int32_t p_lod, Terrain3DStorage::HeightFilter p_filter, bool require_nav, int32_t x, int32_t z) const;
+	void _add_monitors();
+	void _remove_monitors();
+	void _update_monitors(double p_delta);
+	double _get_monitor(int p_monitor);
 
 public:
 	static int debug_level;
@@ -103,6 +249,10 @@ public:
 	String get_version() const { return _version; }
 	void set_debug_level(int p_level);
 	int get_debug_level() const { return debug_level; }
+	void set_server_mode(bool p_enabled);
+	bool get_server_mode() const { return _server_mode; }
+	bool is_server_mode() const { return _server_mode || is_headless(); }
+	static bool is_headless();
 	void set_mesh_lods(int p_count);
 	int get_mesh_lods() const { return _mesh_lods; }
 	void set_mesh_size(int p_size);
@@ -144,15 +294,34 @@ public:
 	uint32_t get_collision_mask() const { return _collision_mask; };
 	void set_collision_priority(real_t p_priority);
 	real_t get_collision_priority() const { return _collision_priority; }
+	void set_collision_mode(CollisionMode p_mode);
+	CollisionMode get_collision_mode() const { return _collision_mode; }
+	void set_collision_radius(real_t p_radius);
+	real_t get_collision_radius() const { return _collision_radius; }
+	void set_collision_shape_size(int p_size);
+	int get_collision_shape_size() const { return _collision_shape_size; }
+	void add_collision_target(Node3D *p_node);
+	void remove_collision_target(Node3D *p_node);
+	TypedArray<Node3D> get_collision_targets() const;
+	void update_collision(AABB p_global_aabb = AABB());
+
+	// Views
+	void add_view(Camera3D *p_camera, uint32_t p_render_layers);
+	void remove_view(Camera3D *p_camera);
+	TypedArray<Camera3D> get_views() const;
 
 	// Terrain methods
 	void snap(Vector3 p_cam_pos);
 	void update_aabbs();
-	Vector3 get_intersection(Vector3 p_src_pos, Vector3 p_direction);
+	Vector3 get_intersection(Vector3 p_src_pos, Vector3 p_direction, bool p_gpu_mode = false);
 
 	// Baking methods
-	Ref<Mesh> bake_mesh(int p_lod, Terrain3DStorage::HeightFilter p_filter = Terrain3DStorage::HEIGHT_FILTER_NEAREST) const;
-	PackedVector3Array generate_nav_mesh_source_geometry(AABB const &p_global_aabb, bool p_require_nav = true) const;
+	Ref<Mesh> bake_mesh(int p_lod, Terrain3DStorage::HeightFilter p_filter = Terrain3DStorage::HEIGHT_FILTER_NEAREST,
+			const TypedArray<Vector2i> &p_region_offsets = TypedArray<Vector2i>(), real_t p_max_error = 0.f) const;
+	PackedVector3Array generate_nav_mesh_source_geometry(AABB const &p_global_aabb, bool p_require_nav = true, real_t p_max_error = 0.f) const;
+	void generate_nav_mesh_source_tiles(const TypedArray<Vector2i> &p_tiles, real_t p_tile_size, bool p_require_nav = true,
+			real_t p_max_error = 0.f);
+	bool is_generating_nav_mesh_source_tiles() const { return _nav_task != -1 || !_nav_requests.is_empty(); }
 
 	PackedStringArray _get_configuration_warnings() const override;
 
@@ -161,4 +330,6 @@ protected:
 	static void _bind_methods();
 };
 
+VARIANT_ENUM_CAST(Terrain3D::CollisionMode);
+
 #endif // TERRAIN3D_CLASS_H
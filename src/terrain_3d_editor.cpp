@@ -1,6 +1,9 @@
 // Copyright © 2023 Cory Petkovsek, Roope Palmroos, and Contributors.
 
 #include <godot_cpp/classes/editor_undo_redo_manager.hpp>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
 #include <godot_cpp/core/class_db.hpp>
 
 #include "logger.h"
@@ -18,8 +21,11 @@ void Terrain3DEditor::Brush::set_data(Dictionary p_data) {
 		LOG(DEBUG, ks[i], ": ", p_data[ks[i]]);
 	}
 	Array brush = p_data["brush"];
+	bool alpha_dirty = false;
 	if (brush.size() == 2) {
-		_image = brush[0];
+		Ref<Image> image = brush[0];
+		alpha_dirty = image != _image;
+		_image = image;
 		if (_image.is_valid()) {
 			_img_size = _image->get_size();
 		} else {
@@ -43,8 +49,38 @@ void Terrain3DEditor::Brush::set_data(Dictionary p_data) {
 	_scale = p_data["scale"];
 	_auto_regions = p_data["automatic_regions"];
 	_align_to_view = p_data["align_to_view"];
-	_gamma = CLAMP(real_t(p_data["gamma"]), 0.1f, 2.f);
+	real_t gamma = CLAMP(real_t(p_data["gamma"]), 0.1f, 2.f);
+	alpha_dirty = alpha_dirty || gamma != _gamma;
+	_gamma = gamma;
 	_jitter = CLAMP(real_t(p_data["jitter"]), 0.f, 1.f);
+	if (alpha_dirty) {
+		_update_alpha();
+	}
+}
+
+// Samples the brush image into _alpha with gamma applied, so strokes don't need to call into Image
+void Terrain3DEditor::Brush::_update_alpha() {
+	_alpha.clear();
+	if (_image.is_null() || _image->is_empty()) {
+		return;
+	}
+	Ref<Image> img;
+	img.instantiate();
+	img->copy_from(_image);
+	img->convert(Image::FORMAT_RF);
+	PackedByteArray data = img->get_data();
+	int count = _img_size.x * _img_size.y;
+	if (data.size() < count * int(sizeof(float))) {
+		LOG(ERROR, "Unexpected brush image data size: ", data.size());
+		return;
+	}
+	_alpha.resize(count);
+	const float *src = reinterpret_cast<const float *>(data.ptr());
+	float *alpha = _alpha.ptrw();
+	for (int i = 0; i < count; i++) {
+		alpha[i] = float(Math::pow(double(src[i]), double(_gamma)));
+	}
+	LOG(DEBUG, "Sampled brush alpha, size: ", _img_size, ", gamma: ", _gamma);
 }
 
 ///////////////////////////
@@ -95,7 +131,6 @@ void Terrain3DEditor::_operate_region(Vector3 p_global_position) {
 void Terrain3DEditor::_operate_map(Vector3 p_global_position, real_t p_camera_direction) {
 	Ref<Terrain3DStorage> storage = _terrain->get_storage();
 	int region_size = storage->get_region_size();
-	Vector2i region_vsize = Vector2i(region_size, region_size);
 
 	int region_index = storage->get_region_index(p_global_position);
 	if (region_index == -1) {
@@ -139,312 +174,452 @@ void Terrain3DEditor::_operate_map(Vector3 p_global_position, real_t p_camera_di
 			return;
 	}
 
-	Ref<Image> map = storage->get_map_region(map_type, region_index);
 	int brush_size = _brush.get_size();
-	int texture_id = _brush.get_texture_index();
 	Vector2i img_size = _brush.get_image_size();
-	real_t strength = _brush.get_strength();
-	real_t height = _brush.get_height();
-	Color color = _brush.get_color();
-	real_t roughness = _brush.get_roughness();
-	PackedVector3Array gradient_points = _brush.get_gradient_points();
-	bool enable = _brush.get_enable();
-	bool enable_texture = _brush.get_enable_texture();
-	bool enable_angle = _brush.get_enable_angle();
-	bool dynamic_angle = _brush.get_dynamic_angle();
-	real_t angle = _brush.get_angle();
-	bool enable_scale = _brush.get_enable_scale();
-	real_t scale = _brush.get_scale();
-
-	real_t gamma = _brush.get_gamma();
+	PackedFloat32Array alpha = _brush.get_alpha();
+	if (brush_size <= 0 || img_size.x <= 0 || img_size.y <= 0 || alpha.size() < img_size.x * img_size.y) {
+		LOG(DEBUG, "Brush is empty, nothing to do");
+		return;
+	}
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
 
 	real_t randf = UtilityFunctions::randf();
 	real_t rot = randf * Math_PI * _brush.get_jitter();
 	if (_brush.is_aligned_to_view()) {
 		rot += p_camera_direction;
 	}
-	Object::cast_to<Node>(_terrain->get_plugin()->get("ui"))->call("set_decal_rotation", rot);
+	if (_terrain->get_plugin() != nullptr) {
+		Object::cast_to<Node>(_terrain->get_plugin()->get("ui"))->call("set_decal_rotation", rot);
+	}
 
+	// Gather everything the brush kernel needs, so it can run on worker threads without calling
+	// into Godot. See _operate_band().
+	_stroke = BrushStroke();
+	BrushStroke &stroke = _stroke;
+	stroke.map_type = map_type;
+	stroke.region_size = region_size;
+	stroke.vertex_spacing = vertex_spacing;
+	stroke.global_position = p_global_position;
+	stroke.brush_size = brush_size;
+	stroke.sample_count = int(Math::ceil(real_t(brush_size) / vertex_spacing));
+	stroke.rot = rot;
+	stroke.img_size = img_size;
+	stroke.alpha = alpha.ptr();
+	stroke.strength = _brush.get_strength();
+	stroke.height = _brush.get_height();
+	stroke.texture_id = _brush.get_texture_index();
+	stroke.color = _brush.get_color();
+	stroke.roughness = _brush.get_roughness();
+	stroke.enable = _brush.get_enable();
+	stroke.enable_texture = _brush.get_enable_texture();
+	stroke.enable_angle = _brush.get_enable_angle();
+	stroke.enable_scale = _brush.get_enable_scale();
+	PackedVector3Array gradient_points = _brush.get_gradient_points();
+	stroke.has_gradient = gradient_points.size() == 2;
+	if (stroke.has_gradient) {
+		stroke.gradient_points[0] = gradient_points[0];
+		stroke.gradient_points[1] = gradient_points[1];
+	}
+	// Ramp gradients up/down only in the direction of movement
+	stroke.has_movement = _operation_movement.length_squared() > 0.f;
+	stroke.movement_xz = Vector2(_operation_movement.x, _operation_movement.z).normalized();
+
+	// Texture angle and scale are the same across the brush
+	real_t angle = _brush.get_angle();
+	if (_brush.get_dynamic_angle()) {
+		// Angle from mouse movement.
+		angle = Vector2(-_operation_movement.x, _operation_movement.z).angle();
+		// Avoid negative, align texture "up" with mouse direction.
+		angle = real_t(Math::fmod(Math::rad_to_deg(angle) + 450.f, 360.f));
+	}
+	// Convert from degrees to 0 - 15 value range
+	stroke.uv_rotation = uint32_t(CLAMP(Math::round(angle / 22.5f), 0.f, 15.f));
+	// Lookup to shift values saved to control map so that 0 (default) is the first entry
+	// Shader scale array is aligned to match this.
+	std::array<uint32_t, 8> scale_align = { 5, 6, 7, 0, 1, 2, 3, 4 };
+	// Offset negative and convert from percentage to 0 - 7 bit value range
+	// Maintain 0 = 0, remap negatives to end.
+	stroke.uv_scale = scale_align[uint8_t(CLAMP(Math::round((_brush.get_scale() + 60.f) / 20.f), 0.f, 7.f))];
+
+	// Descaled positions of the first and last samples, and the region cells they cover.
+	// The cell grid includes one more vertex around the brush for AVERAGE.
+	Vector2 first_sample = (Vector2(p_global_position.x, p_global_position.z) -
+								   Vector2(brush_size, brush_size) / 2.f + Vector2(.5f, .5f)) /
+			vertex_spacing;
+	Vector2 last_sample = first_sample + Vector2(stroke.sample_count - 1, stroke.sample_count - 1);
+	Vector2i sample_start = Vector2i((first_sample / real_t(region_size)).floor());
+	Vector2i sample_end = Vector2i((last_sample / real_t(region_size)).floor());
+	stroke.cell_origin = Vector2i(((first_sample - Vector2(1.f, 1.f)) / real_t(region_size)).floor());
+	stroke.cell_grid = Vector2i(((last_sample + Vector2(1.f, 1.f)) / real_t(region_size)).floor()) - stroke.cell_origin + Vector2i(1, 1);
+
+	// If we're brushing across region boundaries, possibly add regions. Done up front since
+	// adding regions can't happen on the worker threads.
+	if (_brush.auto_regions_enabled() && _tool == HEIGHT) {
+		for (int y = sample_start.y; y <= sample_end.y; y++) {
+			for (int x = sample_start.x; x <= sample_end.x; x++) {
+				Vector3 cell_position = Vector3(x * region_size, 0.f, y * region_size) * vertex_spacing;
+				if (!storage->has_region(cell_position) && storage->add_region(cell_position) == OK) {
+					_region_modified(cell_position);
+				}
+			}
+		}
+	}
+
+	// Look up the map data of each cell. Sources are taken before any writable pointers, so they
+	// keep the data before this operation.
+	int cell_count = stroke.cell_grid.x * stroke.cell_grid.y;
+	stroke.maps.resize(cell_count);
+	stroke.heights.resize(cell_count);
+	stroke.sources.resize(cell_count);
+	stroke.source_heights.resize(cell_count);
+	Vector<Ref<Image>> cell_maps;
+	Vector<Ref<Image>> cell_height_maps;
+	cell_maps.resize(cell_count);
+	cell_height_maps.resize(cell_count);
+	PackedInt32Array edited_regions;
+	for (int i = 0; i < cell_count; i++) {
+		stroke.maps.write[i] = nullptr;
+		stroke.heights.write[i] = nullptr;
+		stroke.source_heights.write[i] = nullptr;
+		Vector2i cell = stroke.cell_origin + Vector2i(i % stroke.cell_grid.x, i / stroke.cell_grid.x);
+		int index = storage->get_region_index(Vector3(cell.x * region_size, 0.f, cell.y * region_size) * vertex_spacing);
+		if (index < 0) {
+			continue;
+		}
+		Ref<Image> map = storage->get_map_region(map_type, index);
+		Ref<Image> height_map = storage->get_map_region(Terrain3DStorage::TYPE_HEIGHT, index);
+		if (map.is_null() || map->get_format() != Terrain3DStorage::FORMAT[map_type] ||
+				map->get_width() != region_size || map->get_height() != region_size ||
+				height_map.is_null() || height_map->get_format() != Terrain3DStorage::FORMAT[Terrain3DStorage::TYPE_HEIGHT] ||
+				height_map->get_width() != region_size || height_map->get_height() != region_size) {
+			LOG(ERROR, "Region ", index, " has invalid maps, skipping");
+			continue;
+		}
+		if (map_type == Terrain3DStorage::TYPE_HEIGHT && _operation == AVERAGE) {
+			stroke.sources.write[i] = height_map->get_data();
+			stroke.source_heights.write[i] = reinterpret_cast<const float *>(stroke.sources[i].ptr());
+		}
+		if (cell.x >= sample_start.x && cell.x <= sample_end.x && cell.y >= sample_start.y && cell.y <= sample_end.y) {
+			cell_maps.write[i] = map;
+			cell_height_maps.write[i] = height_map;
+			edited_regions.push_back(index);
+		}
+	}
+	for (int i = 0; i < cell_count; i++) {
+		if (cell_maps[i].is_null()) {
+			continue;
+		}
+		stroke.maps.write[i] = cell_maps[i]->ptrw();
+		if (map_type == Terrain3DStorage::TYPE_HEIGHT) {
+			stroke.heights.write[i] = reinterpret_cast<const float *>(stroke.maps[i]);
+		} else {
+			stroke.heights.write[i] = reinterpret_cast<const float *>(cell_height_maps[i]->ptr());
+		}
+	}
+
+	// Split the brush into bands of columns, processed in parallel
+	int band_count = (stroke.sample_count + stroke.band_size - 1) / stroke.band_size;
+	Vector<BandResult> results;
+	results.resize(band_count);
+	stroke.results = results.ptrw();
+	if (band_count == 1) {
+		_operate_band(0);
+	} else {
+		int64_t group_id = WorkerThreadPool::get_singleton()->add_group_task(
+				callable_mp(this, &Terrain3DEditor::_operate_band), band_count, -1, true, "Terrain3D brush");
+		WorkerThreadPool::get_singleton()->wait_for_group_task_completion(group_id);
+	}
+
+	// Combine the results of the bands
 	AABB edited_area;
 	edited_area.position = p_global_position - Vector3(brush_size, 0.f, brush_size) / 2.f;
 	edited_area.size = Vector3(brush_size, 0.f, brush_size);
+	for (int i = 0; i < band_count; i++) {
+		const BandResult &result = results[i];
+		if (result.height_range.x <= result.height_range.y) {
+			storage->update_heights(result.height_range);
+		}
+		if (result.edited_range.x <= result.edited_range.y) {
+			edited_area = edited_area.expand(Vector3(p_global_position.x, result.edited_range.x, p_global_position.z));
+			edited_area = edited_area.expand(Vector3(p_global_position.x, result.edited_range.y, p_global_position.z));
+		}
+	}
+	stroke.results = nullptr;
 
-	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
-	for (real_t x = 0.f; x < brush_size; x += vertex_spacing) {
-		for (real_t y = 0.f; y < brush_size; y += vertex_spacing) {
+	_modified = true;
+	// Refits the height pyramids before height_maps_changed updates the mesh AABBs
+	storage->add_edited_area(edited_area);
+	// Added regions were uploaded by add_region(), so this only encodes the edited ones
+	storage->update_map_regions(map_type, edited_regions);
+}
+
+/**
+ * Returns the cell in _stroke and pixel index within its maps of a descaled vertex position, or
+ * false if the position is outside of the cells.
+ */
+bool Terrain3DEditor::_get_stroke_pixel(Vector2i p_vertex, int &r_cell, int &r_index) const {
+	int region_size = _stroke.region_size;
+	// Floor division for negative coordinates
+	Vector2i region_loc = Vector2i(
+			p_vertex.x >= 0 ? p_vertex.x / region_size : (p_vertex.x + 1) / region_size - 1,
+			p_vertex.y >= 0 ? p_vertex.y / region_size : (p_vertex.y + 1) / region_size - 1);
+	Vector2i cell = region_loc - _stroke.cell_origin;
+	if (cell.x < 0 || cell.y < 0 || cell.x >= _stroke.cell_grid.x || cell.y >= _stroke.cell_grid.y) {
+		return false;
+	}
+	r_cell = cell.y * _stroke.cell_grid.x + cell.x;
+	Vector2i img_pos = p_vertex - region_loc * region_size;
+	r_index = img_pos.y * region_size + img_pos.x;
+	return true;
+}
+
+// Returns the height before this operation at a descaled vertex position, or 0 outside of regions
+real_t Terrain3DEditor::_get_stroke_source_height(Vector2i p_vertex) const {
+	int cell, index;
+	if (!_get_stroke_pixel(p_vertex, cell, index) || _stroke.source_heights[cell] == nullptr) {
+		return 0.f;
+	}
+	real_t height = _stroke.source_heights[cell][index];
+	return std::isnan(height) ? 0.f : height;
+}
+
+/**
+ * Applies the brush in _stroke to one band of columns. Runs on the WorkerThreadPool, so must only
+ * touch the raw buffers in _stroke and its own BandResult. Bands never write the same pixels.
+ */
+void Terrain3DEditor::_operate_band(uint32_t p_band) {
+	const BrushStroke &stroke = _stroke;
+	BandResult &result = stroke.results[p_band];
+	Terrain3DStorage::MapType map_type = stroke.map_type;
+	int brush_size = stroke.brush_size;
+	real_t vertex_spacing = stroke.vertex_spacing;
+	real_t strength = stroke.strength;
+	Vector3 p_global_position = stroke.global_position;
+	int column_end = MIN(stroke.sample_count, int(p_band + 1) * stroke.band_size);
+
+	for (int column = int(p_band) * stroke.band_size; column < column_end; column++) {
+		real_t x = real_t(column) * vertex_spacing;
+		for (int row = 0; row < stroke.sample_count; row++) {
+			real_t y = real_t(row) * vertex_spacing;
 			Vector2 brush_offset = Vector2(x, y) - (Vector2(brush_size, brush_size) / 2.f);
 			Vector3 brush_global_position =
 					Vector3(p_global_position.x + brush_offset.x + .5f, p_global_position.y,
 							p_global_position.z + brush_offset.y + .5f);
 
-			// If we're brushing across a region boundary, possibly add a region, and get the other map
-			int new_region_index = storage->get_region_index(brush_global_position);
-			if (new_region_index == -1) {
-				if (!_brush.auto_regions_enabled() || _tool != HEIGHT) {
-					continue;
-				}
-				Error err = storage->add_region(brush_global_position);
-				if (err) {
-					continue;
-				}
-				new_region_index = storage->get_region_index(brush_global_position);
-				_region_modified(brush_global_position);
+			// Identify position on map image
+			Vector2i vertex = Vector2i((Vector2(brush_global_position.x, brush_global_position.z) / vertex_spacing).floor());
+			int cell, index;
+			if (!_get_stroke_pixel(vertex, cell, index) || stroke.maps[cell] == nullptr) {
+				continue;
 			}
 
-			if (new_region_index != region_index) {
-				region_index = new_region_index;
-				map = storage->get_map_region(map_type, region_index);
+			Vector2 brush_uv = Vector2(x, y) / real_t(brush_size);
+			Vector2i brush_pixel_position = Vector2i(_rotate_uv(brush_uv, stroke.rot) * stroke.img_size);
+			if (!_is_in_bounds(brush_pixel_position, stroke.img_size)) {
+				continue;
 			}
 
-			// Identify position on map image
-			Vector2 uv_position = _get_uv_position(brush_global_position, region_size);
-			Vector2i map_pixel_position = Vector2i(uv_position * region_size);
-
-			if (_is_in_bounds(map_pixel_position, region_vsize)) {
-				Vector2 brush_uv = Vector2(x, y) / real_t(brush_size);
-				Vector2i brush_pixel_position = Vector2i(_rotate_uv(brush_uv, rot) * img_size);
-
-				if (!_is_in_bounds(brush_pixel_position, img_size)) {
-					continue;
-				}
-
-				Vector3 edited_position = brush_global_position;
-				edited_position.y = storage->get_height(edited_position);
-				edited_area = edited_area.expand(edited_position);
-
-				// Start brushing on the map
-				real_t brush_alpha = real_t(Math::pow(double(_brush.get_alpha(brush_pixel_position)), double(gamma)));
-				Color src = map->get_pixelv(map_pixel_position);
-				Color dest = src;
+			real_t edited_height = stroke.heights[cell][index];
+			if (!std::isnan(edited_height)) {
+				result.edited_range = Vector2(MIN(result.edited_range.x, edited_height), MAX(result.edited_range.y, edited_height));
+			}
 
-				if (map_type == Terrain3DStorage::TYPE_HEIGHT) {
-					real_t srcf = src.r;
-					real_t destf = dest.r;
-
-					switch (_operation) {
-						case ADD:
-							destf = srcf + (brush_alpha * strength * 10.f);
-							break;
-						case SUBTRACT:
-							destf = srcf - (brush_alpha * strength * 10.f);
-							break;
-						case MULTIPLY:
-							destf = srcf * (brush_alpha * strength * .01f + 1.0f);
-							break;
-						case DIVIDE:
-							destf = srcf * (-brush_alpha * strength * .01f + 1.0f);
-							break;
-						case REPLACE:
-							destf = Math::lerp(srcf, height, brush_alpha * strength);
-							break;
-						case AVERAGE: {
-							Vector3 left_position = brush_global_position - Vector3(vertex_spacing, 0.f, 0.f);
-							Vector3 right_position = brush_global_position + Vector3(vertex_spacing, 0.f, 0.f);
-							Vector3 down_position = brush_global_position - Vector3(0.f, 0.f, vertex_spacing);
-							Vector3 up_position = brush_global_position + Vector3(0.f, 0.f, vertex_spacing);
-
-							real_t left = srcf, right = srcf, up = srcf, down = srcf;
-
-							left = storage->get_pixel(map_type, left_position).r;
-							if (std::isnan(left)) {
-								left = 0.f;
-							}
-							right = storage->get_pixel(map_type, right_position).r;
-							if (std::isnan(right)) {
-								right = 0.f;
-							}
-							up = storage->get_pixel(map_type, up_position).r;
-							if (std::isnan(up)) {
-								up = 0.f;
-							}
-							down = storage->get_pixel(map_type, down_position).r;
-							if (std::isnan(down)) {
-								down = 0.f;
+			// Start brushing on the map
+			real_t brush_alpha = stroke.alpha[brush_pixel_position.y * stroke.img_size.x + brush_pixel_position.x];
+
+			if (map_type == Terrain3DStorage::TYPE_HEIGHT) {
+				float *heights = reinterpret_cast<float *>(stroke.maps[cell]);
+				real_t srcf = heights[index];
+				real_t destf = srcf;
+
+				switch (_operation) {
+					case ADD:
+						destf = srcf + (brush_alpha * strength * 10.f);
+						break;
+					case SUBTRACT:
+						destf = srcf - (brush_alpha * strength * 10.f);
+						break;
+					case MULTIPLY:
+						destf = srcf * (brush_alpha * strength * .01f + 1.0f);
+						break;
+					case DIVIDE:
+						destf = srcf * (-brush_alpha * strength * .01f + 1.0f);
+						break;
+					case REPLACE:
+						destf = Math::lerp(srcf, stroke.height, brush_alpha * strength);
+						break;
+					case AVERAGE: {
+						// Neighbors are read from before this operation, so the result doesn't depend on
+						// the order the bands run in
+						real_t left = _get_stroke_source_height(vertex - Vector2i(1, 0));
+						real_t right = _get_stroke_source_height(vertex + Vector2i(1, 0));
+						real_t up = _get_stroke_source_height(vertex + Vector2i(0, 1));
+						real_t down = _get_stroke_source_height(vertex - Vector2i(0, 1));
+
+						real_t avg = (srcf + left + right + up + down) * 0.2f;
+						destf = Math::lerp(srcf, avg, brush_alpha * strength);
+						break;
+					}
+					case GRADIENT: {
+						if (stroke.has_gradient) {
+							Vector3 point_1 = stroke.gradient_points[0];
+							Vector3 point_2 = stroke.gradient_points[1];
+
+							Vector2 point_1_xz = Vector2(point_1.x, point_1.z);
+							Vector2 point_2_xz = Vector2(point_2.x, point_2.z);
+							Vector2 brush_xz = Vector2(brush_global_position.x, brush_global_position.z);
+
+							if (stroke.has_movement) {
+								// Ramp up/down only in the direction of movement, to avoid giving winding
+								// paths one edge higher than the other.
+								Vector2 offset = stroke.movement_xz * Vector2(brush_offset).dot(stroke.movement_xz);
+								brush_xz = Vector2(p_global_position.x + offset.x, p_global_position.z + offset.y);
 							}
 
-							real_t avg = (srcf + left + right + up + down) * 0.2f;
-							destf = Math::lerp(srcf, avg, brush_alpha * strength);
-							break;
-						}
-						case GRADIENT: {
-							if (gradient_points.size() == 2) {
-								Vector3 point_1 = gradient_points[0];
-								Vector3 point_2 = gradient_points[1];
-
-								Vector2 point_1_xz = Vector2(point_1.x, point_1.z);
-								Vector2 point_2_xz = Vector2(point_2.x, point_2.z);
-								Vector2 brush_xz = Vector2(brush_global_position.x, brush_global_position.z);
-
-								if (_operation_movement.length_squared() > 0.f) {
-									// Ramp up/down only in the direction of movement, to avoid giving winding
-									// paths one edge higher than the other.
-									Vector2 movement_xz = Vector2(_operation_movement.x, _operation_movement.z).normalized();
-									Vector2 offset = movement_xz * Vector2(brush_offset).dot(movement_xz);
-									brush_xz = Vector2(p_global_position.x + offset.x, p_global_position.z + offset.y);
-								}
+							Vector2 dir = point_2_xz - point_1_xz;
+							real_t weight = dir.normalized().dot(brush_xz - point_1_xz) / dir.length();
+							weight = Math::clamp(weight, (real_t)0.0f, (real_t)1.0f);
+							real_t height = Math::lerp(point_1.y, point_2.y, weight);
 
-								Vector2 dir = point_2_xz - point_1_xz;
-								real_t weight = dir.normalized().dot(brush_xz - point_1_xz) / dir.length();
-								weight = Math::clamp(weight, (real_t)0.0f, (real_t)1.0f);
-								real_t height = Math::lerp(point_1.y, point_2.y, weight);
-
-								destf = Math::lerp(srcf, height, brush_alpha * strength);
-							}
-							break;
+							destf = Math::lerp(srcf, height, brush_alpha * strength);
 						}
-						default:
-							break;
+						break;
 					}
-					dest = Color(destf, 0.f, 0.f, 1.f);
-					storage->update_heights(destf);
-
-					edited_position.y = destf;
-					edited_area = edited_area.expand(edited_position);
-
-				} else if (map_type == Terrain3DStorage::TYPE_CONTROL) {
-					// Get bit field from pixel
-					uint32_t base_id = get_base(src.r);
-					uint32_t overlay_id = get_overlay(src.r);
-					real_t blend = real_t(get_blend(src.r)) / 255.f;
-					uint32_t uvrotation = get_uv_rotation(src.r);
-					uint32_t uvscale = get_uv_scale(src.r);
-					bool hole = is_hole(src.r);
-					bool navigation = is_nav(src.r);
-					bool autoshader = is_auto(src.r);
-
-					real_t alpha_clip = (brush_alpha > 0.1f) ? 1.f : 0.f;
-					uint32_t dest_id = uint32_t(Math::lerp(base_id, texture_id, alpha_clip));
-					// Lookup to shift values saved to control map so that 0 (default) is the first entry
-					// Shader scale array is aligned to match this.
-					std::array<uint32_t, 8> scale_align = { 5, 6, 7, 0, 1, 2, 3, 4 };
-
-					switch (_tool) {
-						case TEXTURE:
-							switch (_operation) {
-								// Base Paint
-								case REPLACE: {
-									if (brush_alpha > 0.1f) {
-										if (enable_texture) {
-											// Set base texture
-											base_id = dest_id;
-											// Erase blend value
-											blend = Math::lerp(blend, real_t(0.f), alpha_clip);
-											autoshader = false;
-										}
-										// Set angle & scale
-										if (enable_angle) {
-											if (dynamic_angle) {
-												// Angle from mouse movement.
-												angle = Vector2(-_operation_movement.x, _operation_movement.z).angle();
-												// Avoid negative, align texture "up" with mouse direction.
-												angle = real_t(Math::fmod(Math::rad_to_deg(angle) + 450.f, 360.f));
-											}
-											// Convert from degrees to 0 - 15 value range
-											uvrotation = uint32_t(CLAMP(Math::round(angle / 22.5f), 0.f, 15.f));
-										}
-										if (enable_scale) {
-											// Offset negative and convert from percentage to 0 - 7 bit value range
-											// Maintain 0 = 0, remap negatives to end.
-											uvscale = scale_align[uint8_t(CLAMP(Math::round((scale + 60.f) / 20.f), 0.f, 7.f))];
-										}
-									}
-								} break;
-
-								// Overlay Spray
-								case ADD: {
-									real_t spray_strength = CLAMP(strength * 0.025f, 0.003f, 0.025f);
-									real_t brush_value = CLAMP(brush_alpha * spray_strength, 0.f, 1.f);
-									if (enable_texture) {
-										// If overlay and base texture are the same, reduce blend value
-										if (dest_id == base_id) {
-											blend = CLAMP(blend - brush_value, 0.f, 1.f);
-										} else {
-											// Else overlay and base are separate, set overlay texture and increase blend value
-											overlay_id = dest_id;
-											blend = CLAMP(blend + brush_value, 0.f, 1.f);
-										}
+					default:
+						break;
+				}
+				heights[index] = float(destf);
+				result.height_range = Vector2(MIN(result.height_range.x, destf), MAX(result.height_range.y, destf));
+				result.edited_range = Vector2(MIN(result.edited_range.x, destf), MAX(result.edited_range.y, destf));
+
+			} else if (map_type == Terrain3DStorage::TYPE_CONTROL) {
+				float *controls = reinterpret_cast<float *>(stroke.maps[cell]);
+				float src = controls[index]; // Must be 32-bit float, not double/real
+
+				// Get bit field from pixel
+				uint32_t base_id = get_base(src);
+				uint32_t overlay_id = get_overlay(src);
+				real_t blend = real_t(get_blend(src)) / 255.f;
+				uint32_t uvrotation = get_uv_rotation(src);
+				uint32_t uvscale = get_uv_scale(src);
+				bool hole = is_hole(src);
+				bool navigation = is_nav(src);
+				bool autoshader = is_auto(src);
+
+				real_t alpha_clip = (brush_alpha > 0.1f) ? 1.f : 0.f;
+				uint32_t dest_id = uint32_t(Math::lerp(base_id, stroke.texture_id, alpha_clip));
+
+				switch (_tool) {
+					case TEXTURE:
+						switch (_operation) {
+							// Base Paint
+							case REPLACE: {
+								if (brush_alpha > 0.1f) {
+									if (stroke.enable_texture) {
+										// Set base texture
+										base_id = dest_id;
+										// Erase blend value
+										blend = Math::lerp(blend, real_t(0.f), alpha_clip);
 										autoshader = false;
 									}
-									if (brush_alpha * strength * 11.f > 0.1f) {
-										// Set angle & scale
-										if (enable_angle) {
-											if (dynamic_angle) {
-												// Angle from mouse movement.
-												angle = Vector2(-_operation_movement.x, _operation_movement.z).angle();
-												// Avoid negative, align texture "up" with mouse direction.
-												angle = real_t(Math::fmod(Math::rad_to_deg(angle) + 450.f, 360.f));
-											}
-											// Convert from degrees to 0 - 15 value range
-											uvrotation = uint32_t(CLAMP(Math::round(angle / 22.5f), 0.f, 15.f));
-										}
-										if (enable_scale) {
-											// Offset negative and convert from percentage to 0 - 7 bit value range
-											// Maintain 0 = 0, remap negatives to end.
-											uvscale = scale_align[uint8_t(CLAMP(Math::round((scale + 60.f) / 20.f), 0.f, 7.f))];
-										}
+									// Set angle & scale
+									if (stroke.enable_angle) {
+										uvrotation = stroke.uv_rotation;
 									}
-								} break;
-
-								default: {
-								} break;
-							}
-							break;
-						case AUTOSHADER:
-							if (brush_alpha > 0.1f) {
-								autoshader = enable;
-							}
-							break;
-						case HOLES:
-							if (brush_alpha > 0.1f) {
-								hole = enable;
-							}
-							break;
-						case NAVIGATION:
-							if (brush_alpha > 0.1f) {
-								navigation = enable;
-							}
-							break;
-						default:
-							break;
-					}
+									if (stroke.enable_scale) {
+										uvscale = stroke.uv_scale;
+									}
+								}
+							} break;
+
+							// Overlay Spray
+							case ADD: {
+								real_t spray_strength = CLAMP(strength * 0.025f, 0.003f, 0.025f);
+								real_t brush_value = CLAMP(brush_alpha * spray_strength, 0.f, 1.f);
+								if (stroke.enable_texture) {
+									// If overlay and base texture are the same, reduce blend value
+									if (dest_id == base_id) {
+										blend = CLAMP(blend - brush_value, 0.f, 1.f);
+									} else {
+										// Else overlay and base are separate, set overlay texture and increase blend value
+										overlay_id = dest_id;
+										blend = CLAMP(blend + brush_value, 0.f, 1.f);
+									}
+									autoshader = false;
+								}
+								if (brush_alpha * strength * 11.f > 0.1f) {
+									// Set angle & scale
+									if (stroke.enable_angle) {
+										uvrotation = stroke.uv_rotation;
+									}
+									if (stroke.enable_scale) {
+										uvscale = stroke.uv_scale;
+									}
+								}
+							} break;
 
-					// Convert back to bitfield
-					uint32_t blend_int = uint32_t(CLAMP(Math::round(blend * 255.f), 0.f, 255.f));
-					uint32_t bits = enc_base(base_id) | enc_overlay(overlay_id) |
-							enc_blend(blend_int) | enc_uv_rotation(uvrotation) |
-							enc_uv_scale(uvscale) | enc_hole(hole) |
-							enc_nav(navigation) | enc_auto(autoshader);
-
-					// Write back to pixel in FORMAT_RF. Must be a 32-bit float
-					dest = Color(as_float(bits), 0.f, 0.f, 1.f);
-
-				} else if (map_type == Terrain3DStorage::TYPE_COLOR) {
-					switch (_tool) {
-						case COLOR:
-							dest = src.lerp(color, brush_alpha * strength);
-							dest.a = src.a;
-							break;
-						case ROUGHNESS:
-							/* Roughness received from UI is -100 to 100. Changed to 0,1 before storing.
-							 * To convert 0,1 back to -100,100 use: 200 * (color.a - 0.5)
-							 * However Godot stores values as 8-bit ints. Roundtrip is = int(a*255)/255.0
-							 * Roughness 0 is saved as 0.5, but retreived is 0.498, or -0.4 roughness
-							 * We round the final amount in tool_settings.gd:_on_picked().
-							 */
-							dest.a = Math::lerp(real_t(src.a), real_t(.5f) + real_t(.5f * .01f) * roughness, brush_alpha * strength);
-							break;
-						default:
-							break;
-					}
+							default: {
+							} break;
+						}
+						break;
+					case AUTOSHADER:
+						if (brush_alpha > 0.1f) {
+							autoshader = stroke.enable;
+						}
+						break;
+					case HOLES:
+						if (brush_alpha > 0.1f) {
+							hole = stroke.enable;
+						}
+						break;
+					case NAVIGATION:
+						if (brush_alpha > 0.1f) {
+							navigation = stroke.enable;
+						}
+						break;
+					default:
+						break;
 				}
 
-				map->set_pixelv(map_pixel_position, dest);
+				// Convert back to bitfield
+				uint32_t blend_int = uint32_t(CLAMP(Math::round(blend * 255.f), 0.f, 255.f));
+				uint32_t bits = enc_base(base_id) | enc_overlay(overlay_id) |
+						enc_blend(blend_int) | enc_uv_rotation(uvrotation) |
+						enc_uv_scale(uvscale) | enc_hole(hole) |
+						enc_nav(navigation) | enc_auto(autoshader);
+
+				// Write back to pixel in FORMAT_RF. Must be a 32-bit float
+				controls[index] = as_float(bits);
+
+			} else if (map_type == Terrain3DStorage::TYPE_COLOR) {
+				uint8_t *pixel = stroke.maps[cell] + index * 4; // FORMAT_RGBA8
+				Color src = Color(pixel[0] / 255.f, pixel[1] / 255.f, pixel[2] / 255.f, pixel[3] / 255.f);
+				Color dest = src;
+				switch (_tool) {
+					case COLOR:
+						dest = src.lerp(stroke.color, brush_alpha * strength);
+						dest.a = src.a;
+						break;
+					case ROUGHNESS:
+						/* Roughness received from UI is -100 to 100. Changed to 0,1 before storing.
+						 * To convert 0,1 back to -100,100 use: 200 * (color.a - 0.5)
+						 * However Godot stores values as 8-bit ints. Roundtrip is = int(a*255)/255.0
+						 * Roughness 0 is saved as 0.5, but retreived is 0.498, or -0.4 roughness
+						 * We round the final amount in tool_settings.gd:_on_picked().
+						 */
+						dest.a = Math::lerp(real_t(src.a), real_t(.5f) + real_t(.5f * .01f) * stroke.roughness, brush_alpha * strength);
+						break;
+					default:
+						break;
+				}
+				// Same conversion as Image::set_pixel
+				pixel[0] = uint8_t(CLAMP(dest.r * 255.f, 0.f, 255.f));
+				pixel[1] = uint8_t(CLAMP(dest.g * 255.f, 0.f, 255.f));
+				pixel[2] = uint8_t(CLAMP(dest.b * 255.f, 0.f, 255.f));
+				pixel[3] = uint8_t(CLAMP(dest.a * 255.f, 0.f, 255.f));
 			}
 		}
 	}
-	_modified = true;
-	storage->force_update_maps(map_type);
-	storage->add_edited_area(edited_area);
 }
 
 bool Terrain3DEditor::_is_in_bounds(Vector2i p_position, Vector2i p_max_position) {
@@ -453,100 +628,301 @@ bool Terrain3DEditor::_is_in_bounds(Vector2i p_position, Vector2i p_max_position
 	return more_than_min && less_than_max;
 }
 
-Vector2 Terrain3DEditor::_get_uv_position(Vector3 p_global_position, int p_region_size) {
-	Vector2 descaled_position_2d = Vector2(p_global_position.x, p_global_position.z) / _terrain->get_mesh_vertex_spacing();
-	Vector2 region_position = descaled_position_2d / real_t(p_region_size);
-	region_position = region_position.floor();
-	Vector2 uv_position = (descaled_position_2d / real_t(p_region_size)) - region_position;
-	return uv_position;
-}
-
 Vector2 Terrain3DEditor::_rotate_uv(Vector2 p_uv, real_t p_angle) {
 	Vector2 rotation_offset = Vector2(0.5f, 0.5f);
 	p_uv = (p_uv - rotation_offset).rotated(p_angle) + rotation_offset;
 	return p_uv.clamp(Vector2(0.f, 0.f), Vector2(1.f, 1.f));
 }
 
-/* Stored in the _undo_set is:
- * 0-2: map 0,1,2
- * 3: Region offsets
- * 4: height range
- * 5: edited AABB
+/**
+ * Keeps a copy-on-write copy of every region's maps at the start of an operation. Nothing is
+ * actually duplicated until the operation writes to a map, and only its edited tiles are kept.
  */
 void Terrain3DEditor::_setup_undo() {
 	ERR_FAIL_COND_MSG(_terrain == nullptr, "terrain is null, returning");
-	ERR_FAIL_COND_MSG(_terrain->get_plugin() == nullptr, "terrain->plugin is null, returning");
+	if (_terrain->get_plugin() == nullptr) {
+		LOG(DEBUG, "No editor plugin to hold undo, as when editing at runtime. Skipping undo");
+		return;
+	}
 	if (_tool < 0 || _tool >= TOOL_MAX) {
 		return;
 	}
 	LOG(INFO, "Setting up undo snapshot...");
-	_undo_set.clear();
-	_undo_set.resize(Terrain3DStorage::TYPE_MAX + 3);
-	for (int i = 0; i < Terrain3DStorage::TYPE_MAX; i++) {
-		_undo_set[i] = _terrain->get_storage()->get_maps_copy(static_cast<Terrain3DStorage::MapType>(i));
-		LOG(DEBUG, "maps ", i, "(", static_cast<TypedArray<Image>>(_undo_set[i]).size(), "): ", _undo_set[i]);
+	Ref<Terrain3DStorage> storage = _terrain->get_storage();
+	_undo_snapshot.clear();
+	TypedArray<Vector2i> region_offsets = storage->get_region_offsets();
+	for (int i = 0; i < region_offsets.size(); i++) {
+		Array maps;
+		maps.resize(Terrain3DStorage::TYPE_MAX);
+		for (int t = 0; t < Terrain3DStorage::TYPE_MAX; t++) {
+			maps[t] = Util::get_shared_copy(storage->get_map_region(static_cast<Terrain3DStorage::MapType>(t), i));
+		}
+		_undo_snapshot[region_offsets[i]] = maps;
 	}
-	_undo_set[Terrain3DStorage::TYPE_MAX] = _terrain->get_storage()->get_region_offsets().duplicate();
-	LOG(DEBUG, "region_offsets(", static_cast<TypedArray<Vector2i>>(_undo_set[Terrain3DStorage::TYPE_MAX]).size(), "): ", _undo_set[Terrain3DStorage::TYPE_MAX]);
-	_undo_set[Terrain3DStorage::TYPE_MAX + 1] = _terrain->get_storage()->get_height_range();
+	LOG(DEBUG, "Snapshot of ", _undo_snapshot.size(), " regions");
+	_undo_height_range = storage->get_height_range();
+}
 
-	_undo_set[Terrain3DStorage::TYPE_MAX + 2] = _terrain->get_storage()->get_edited_area();
+// Bytes of image data in an Array of maps
+uint64_t Terrain3DEditor::_get_maps_size(const Array &p_maps) const {
+	uint64_t bytes = 0;
+	for (int i = 0; i < p_maps.size(); i++) {
+		Ref<Image> img = p_maps[i];
+		bytes += img.is_valid() ? img->get_data_size() : 0;
+	}
+	return bytes;
 }
 
+/**
+ * Compares the maps within the edited area against the snapshot from _setup_undo() in tiles of
+ * UNDO_TILE_SIZE, and stores the changed tiles before and after, compressed.
+ * Regions added or removed during the operation are stored whole.
+ * The undo and redo sets are Dictionaries of:
+ *  tiles: Array of [map type, region offset, Rect2i of pixels in the region, compressed data, data size]
+ *  add_regions: Array of [region offset, Array of maps]
+ *  remove_regions: Array of region offsets
+ *  height_range: Vector2
+ *  edited_area: AABB
+ */
 void Terrain3DEditor::_store_undo() {
 	ERR_FAIL_COND_MSG(_terrain == nullptr, "terrain is null, returning");
-	ERR_FAIL_COND_MSG(_terrain->get_plugin() == nullptr, "terrain->plugin is null, returning");
+	if (_terrain->get_plugin() == nullptr) {
+		return;
+	}
 	if (_tool < 0 || _tool >= TOOL_MAX) {
 		return;
 	}
 	LOG(INFO, "Storing undo snapshot...");
+	uint64_t time = Time::get_singleton()->get_ticks_msec();
 	EditorUndoRedoManager *undo_redo = _terrain->get_plugin()->get_undo_redo();
 
 	String action_name = String("Terrain3D ") + OPNAME[_operation] + String(" ") + TOOLNAME[_tool];
 	LOG(DEBUG, "Creating undo action: '", action_name, "'");
 	undo_redo->create_action(action_name);
 
-	AABB edited_area = _terrain->get_storage()->get_edited_area();
-	LOG(DEBUG, "Updating undo snapshot edited area: ", edited_area);
-	_undo_set[Terrain3DStorage::TYPE_MAX + 2] = edited_area;
-
-	LOG(DEBUG, "Storing undo snapshot: ", _undo_set);
-	undo_redo->add_undo_method(this, "apply_undo", _undo_set.duplicate()); // Must be duplicated
+	Ref<Terrain3DStorage> storage = _terrain->get_storage();
+	int region_size = storage->get_region_size();
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	AABB edited_area = storage->get_edited_area();
+	LOG(DEBUG, "Edited area: ", edited_area);
+
+	// Edited pixels in descaled global coordinates, with a margin for rounding
+	Vector2 edited_start = Vector2(edited_area.position.x, edited_area.position.z) / vertex_spacing;
+	Vector2 edited_end = Vector2(edited_area.get_end().x, edited_area.get_end().z) / vertex_spacing;
+	Rect2i edited_rect = Rect2i(Vector2i(edited_start.floor()) - Vector2i(1, 1),
+			Vector2i(edited_end.ceil() - edited_start.floor()) + Vector2i(2, 2));
+
+	Array undo_tiles, redo_tiles;
+	Array undo_add, redo_add;
+	Array undo_remove, redo_remove;
+	uint64_t stored_bytes = 0;
+	Dictionary current_regions;
+	TypedArray<Vector2i> region_offsets = storage->get_region_offsets();
+	for (int i = 0; i < region_offsets.size(); i++) {
+		current_regions[region_offsets[i]] = i;
+	}
 
-	LOG(DEBUG, "Setting up redo snapshot...");
-	Array redo_set;
-	redo_set.resize(Terrain3DStorage::TYPE_MAX + 3);
-	for (int i = 0; i < Terrain3DStorage::TYPE_MAX; i++) {
-		redo_set[i] = _terrain->get_storage()->get_maps_copy(static_cast<Terrain3DStorage::MapType>(i));
-		LOG(DEBUG, "maps ", i, "(", static_cast<TypedArray<Image>>(redo_set[i]).size(), "): ", redo_set[i]);
+	// Regions removed during the operation are restored on undo
+	Array snapshot_offsets = _undo_snapshot.keys();
+	for (int i = 0; i < snapshot_offsets.size(); i++) {
+		if (!current_regions.has(snapshot_offsets[i])) {
+			Array entry;
+			entry.push_back(snapshot_offsets[i]);
+			entry.push_back(_undo_snapshot[snapshot_offsets[i]]);
+			undo_add.push_back(entry);
+			stored_bytes += _get_maps_size(_undo_snapshot[snapshot_offsets[i]]);
+			redo_remove.push_back(snapshot_offsets[i]);
+		}
 	}
-	redo_set[Terrain3DStorage::TYPE_MAX] = _terrain->get_storage()->get_region_offsets().duplicate();
-	LOG(DEBUG, "region_offsets(", static_cast<TypedArray<Vector2i>>(redo_set[Terrain3DStorage::TYPE_MAX]).size(), "): ", redo_set[Terrain3DStorage::TYPE_MAX]);
-	redo_set[Terrain3DStorage::TYPE_MAX + 1] = _terrain->get_storage()->get_height_range();
 
-	edited_area = _terrain->get_storage()->get_edited_area();
-	LOG(DEBUG, "Storing edited area: ", edited_area);
-	redo_set[Terrain3DStorage::TYPE_MAX + 2] = edited_area;
+	int tile_bytes = UNDO_TILE_SIZE * UNDO_TILE_SIZE * 4;
+	for (int i = 0; i < region_offsets.size(); i++) {
+		Vector2i region_offset = region_offsets[i];
+
+		// Regions added during the operation are removed on undo
+		if (!_undo_snapshot.has(region_offset)) {
+			Array maps;
+			maps.resize(Terrain3DStorage::TYPE_MAX);
+			for (int t = 0; t < Terrain3DStorage::TYPE_MAX; t++) {
+				maps[t] = Util::get_shared_copy(storage->get_map_region(static_cast<Terrain3DStorage::MapType>(t), i));
+			}
+			Array entry;
+			entry.push_back(region_offset);
+			entry.push_back(maps);
+			redo_add.push_back(entry);
+			undo_remove.push_back(region_offset);
+			stored_bytes += _get_maps_size(maps);
+			continue;
+		}
 
-	LOG(DEBUG, "Storing redo snapshot: ", redo_set);
-	undo_redo->add_do_method(this, "apply_undo", redo_set);
+		Rect2i local_rect = edited_rect.intersection(Rect2i(region_offset * region_size, Vector2i(region_size, region_size)));
+		if (!local_rect.has_area()) {
+			continue;
+		}
+		local_rect.position -= region_offset * region_size;
+		Vector2i tile_start = local_rect.position / UNDO_TILE_SIZE;
+		Vector2i tile_end = (local_rect.get_end() - Vector2i(1, 1)) / UNDO_TILE_SIZE;
+
+		Array snapshot = _undo_snapshot[region_offset];
+		for (int t = 0; t < Terrain3DStorage::TYPE_MAX; t++) {
+			Terrain3DStorage::MapType map_type = static_cast<Terrain3DStorage::MapType>(t);
+			Ref<Image> old_map = snapshot[t];
+			Ref<Image> new_map = storage->get_map_region(map_type, i);
+			if (old_map.is_null() || new_map.is_null() ||
+					old_map->get_format() != Terrain3DStorage::FORMAT[t] || new_map->get_format() != Terrain3DStorage::FORMAT[t] ||
+					old_map->get_size() != Vector2i(region_size, region_size) || new_map->get_size() != old_map->get_size()) {
+				LOG(WARN, "Maps of region ", region_offset, " were replaced during the operation, undo not stored");
+				continue;
+			}
+			// Both are copy-on-write references, nothing is copied here
+			PackedByteArray old_data = old_map->get_data();
+			PackedByteArray new_data = new_map->get_data();
+			const uint8_t *old_ptr = old_data.ptr();
+			const uint8_t *new_ptr = new_data.ptr();
+			if (old_ptr == new_ptr) {
+				continue; // Unchanged, still sharing the same data
+			}
+
+			for (int ty = tile_start.y; ty <= tile_end.y; ty++) {
+				for (int tx = tile_start.x; tx <= tile_end.x; tx++) {
+					Rect2i tile_rect = Rect2i(Vector2i(tx, ty) * UNDO_TILE_SIZE, Vector2i(UNDO_TILE_SIZE, UNDO_TILE_SIZE));
+					int row_bytes = tile_rect.size.x * 4; // FORMAT_RF and FORMAT_RGBA8
+					bool changed = false;
+					for (int y = tile_rect.position.y; y < tile_rect.get_end().y && !changed; y++) {
+						int ofs = (y * region_size + tile_rect.position.x) * 4;
+						changed = memcmp(old_ptr + ofs, new_ptr + ofs, row_bytes) != 0;
+					}
+					if (!changed) {
+						continue;
+					}
+					PackedByteArray old_tile, new_tile;
+					old_tile.resize(tile_bytes);
+					new_tile.resize(tile_bytes);
+					uint8_t *old_tile_w = old_tile.ptrw();
+					uint8_t *new_tile_w = new_tile.ptrw();
+					for (int y = 0; y < tile_rect.size.y; y++) {
+						int ofs = ((tile_rect.position.y + y) * region_size + tile_rect.position.x) * 4;
+						memcpy(old_tile_w + y * row_bytes, old_ptr + ofs, row_bytes);
+						memcpy(new_tile_w + y * row_bytes, new_ptr + ofs, row_bytes);
+					}
+					Array undo_tile;
+					undo_tile.push_back(t);
+					undo_tile.push_back(region_offset);
+					undo_tile.push_back(tile_rect);
+					undo_tile.push_back(old_tile.compress(FileAccess::COMPRESSION_ZSTD));
+					undo_tile.push_back(tile_bytes);
+					Array redo_tile = undo_tile.duplicate();
+					redo_tile[3] = new_tile.compress(FileAccess::COMPRESSION_ZSTD);
+					stored_bytes += PackedByteArray(undo_tile[3]).size() + PackedByteArray(redo_tile[3]).size();
+					undo_tiles.push_back(undo_tile);
+					redo_tiles.push_back(redo_tile);
+				}
+			}
+		}
+	}
+
+	Dictionary undo_data;
+	undo_data["tiles"] = undo_tiles;
+	undo_data["add_regions"] = undo_add;
+	undo_data["remove_regions"] = undo_remove;
+	undo_data["height_range"] = _undo_height_range;
+	undo_data["edited_area"] = edited_area;
+	undo_redo->add_undo_method(this, "apply_undo", undo_data);
+
+	Dictionary redo_data;
+	redo_data["tiles"] = redo_tiles;
+	redo_data["add_regions"] = redo_add;
+	redo_data["remove_regions"] = redo_remove;
+	redo_data["height_range"] = storage->get_height_range();
+	redo_data["edited_area"] = edited_area;
+	undo_redo->add_do_method(this, "apply_undo", redo_data);
+
+	undo_memory += stored_bytes;
+	LOG(DEBUG, "Stored ", undo_tiles.size(), " tiles and ", undo_add.size() + redo_add.size(), " whole regions in ",
+			stored_bytes, " bytes, in ", Time::get_singleton()->get_ticks_msec() - time, " ms");
+	_undo_snapshot.clear();
 
 	LOG(DEBUG, "Committing undo action");
 	undo_redo->commit_action(false);
 }
 
-void Terrain3DEditor::_apply_undo(const Array &p_set) {
+void Terrain3DEditor::_apply_undo(const Dictionary &p_data) {
 	ERR_FAIL_COND_MSG(_terrain == nullptr, "terrain is null, returning");
 	ERR_FAIL_COND_MSG(_terrain->get_plugin() == nullptr, "terrain->plugin is null, returning");
-	LOG(INFO, "Applying Undo/Redo set. Array size: ", p_set.size());
-	LOG(DEBUG, "Apply undo received: ", p_set);
+	Ref<Terrain3DStorage> storage = _terrain->get_storage();
+	int region_size = storage->get_region_size();
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	Array add_regions = p_data["add_regions"];
+	Array tiles = p_data["tiles"];
+	Array remove_regions = p_data["remove_regions"];
+	LOG(INFO, "Applying Undo/Redo set. Tiles: ", tiles.size(), ", adding regions: ", add_regions.size(),
+			", removing regions: ", remove_regions.size());
+
+	// Add regions first, so tiles can be applied to them. The maps are copied so later edits don't
+	// change the copies held by the undo history.
+	for (int i = 0; i < add_regions.size(); i++) {
+		Array entry = add_regions[i];
+		Vector2i region_offset = entry[0];
+		Array maps = entry[1];
+		TypedArray<Image> images;
+		for (int t = 0; t < maps.size(); t++) {
+			images.push_back(Util::get_shared_copy(maps[t]));
+		}
+		storage->add_region(Vector3(region_offset.x, 0.f, region_offset.y) * region_size * vertex_spacing, images, false);
+	}
+
+	PackedInt32Array edited_regions[Terrain3DStorage::TYPE_MAX];
+	for (int i = 0; i < tiles.size(); i++) {
+		Array tile = tiles[i];
+		int map_type = tile[0];
+		Vector2i region_offset = tile[1];
+		Rect2i tile_rect = tile[2];
+		PackedByteArray data = PackedByteArray(tile[3]).decompress(int(tile[4]), FileAccess::COMPRESSION_ZSTD);
+		int region_index = storage->get_region_index(Vector3(region_offset.x, 0.f, region_offset.y) * region_size * vertex_spacing);
+		if (map_type < 0 || map_type >= Terrain3DStorage::TYPE_MAX || region_index < 0) {
+			LOG(ERROR, "Undo tile for missing region ", region_offset);
+			continue;
+		}
+		Ref<Image> map = storage->get_map_region(static_cast<Terrain3DStorage::MapType>(map_type), region_index);
+		int row_bytes = tile_rect.size.x * 4;
+		if (map.is_null() || map->get_format() != Terrain3DStorage::FORMAT[map_type] ||
+				map->get_size() != Vector2i(region_size, region_size) ||
+				!Rect2i(Vector2i(), map->get_size()).encloses(tile_rect) || data.size() != row_bytes * tile_rect.size.y) {
+			LOG(ERROR, "Undo tile doesn't match the maps of region ", region_offset);
+			continue;
+		}
+		uint8_t *map_w = map->ptrw();
+		const uint8_t *src = data.ptr();
+		for (int y = 0; y < tile_rect.size.y; y++) {
+			int ofs = ((tile_rect.position.y + y) * region_size + tile_rect.position.x) * 4;
+			memcpy(map_w + ofs, src + y * row_bytes, row_bytes);
+		}
+		if (!edited_regions[map_type].has(region_index)) {
+			edited_regions[map_type].push_back(region_index);
+		}
+	}
 
-	for (int i = 0; i < Terrain3DStorage::TYPE_MAX; i++) {
-		Terrain3DStorage::MapType map_type = static_cast<Terrain3DStorage::MapType>(i);
-		_terrain->get_storage()->set_maps(map_type, p_set[i]);
+	for (int i = 0; i < remove_regions.size(); i++) {
+		Vector2i region_offset = remove_regions[i];
+		storage->remove_region(Vector3(region_offset.x, 0.f, region_offset.y) * region_size * vertex_spacing, false);
 	}
-	_terrain->get_storage()->set_region_offsets(p_set[Terrain3DStorage::TYPE_MAX]);
-	_terrain->get_storage()->set_height_range(p_set[Terrain3DStorage::TYPE_MAX + 1]);
+
+	AABB edited_area = p_data["edited_area"];
+	storage->clear_edited_area();
+	storage->add_edited_area(edited_area);
+
+	if (!add_regions.is_empty() || !remove_regions.is_empty()) {
+		storage->force_update_maps();
+		storage->notify_property_list_changed();
+		storage->emit_changed();
+	} else {
+		for (int t = 0; t < Terrain3DStorage::TYPE_MAX; t++) {
+			if (!edited_regions[t].is_empty()) {
+				storage->update_map_regions(static_cast<Terrain3DStorage::MapType>(t), edited_regions[t]);
+			}
+		}
+	}
+	storage->set_height_range(p_data["height_range"]);
 
 	if (_terrain->get_plugin()->has_method("update_grid")) {
 		LOG(DEBUG, "Calling GDScript update_grid()");
@@ -555,10 +931,6 @@ void Terrain3DEditor::_apply_undo(const Array &p_set) {
 
 	_pending_undo = false;
 	_modified = false;
-
-	AABB edited_area = p_set[Terrain3DStorage::TYPE_MAX + 2];
-	_terrain->get_storage()->clear_edited_area();
-	_terrain->get_storage()->add_edited_area(edited_area);
 }
 
 ///////////////////////////
@@ -586,6 +958,7 @@ void Terrain3DEditor::start_operation(Vector3 p_global_position) {
 	_pending_undo = true;
 	_modified = false;
 	_terrain->get_storage()->clear_edited_area();
+	_terrain->get_storage()->set_color_compression_deferred(true);
 	_operation_position = p_global_position;
 	_operation_movement = Vector3();
 	if (_tool == REGION) {
@@ -624,6 +997,7 @@ void Terrain3DEditor::operate(Vector3 p_global_position, real_t p_camera_directi
 // Called on left mouse button released
 void Terrain3DEditor::stop_operation() {
 	IS_STORAGE_INIT_MESG("Terrain isn't initialized", NOP);
+	_terrain->get_storage()->set_color_compression_deferred(false);
 	if (_pending_undo && _modified) {
 		_store_undo();
 		_pending_undo = false;
@@ -671,5 +1045,5 @@ void Terrain3DEditor::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("stop_operation"), &Terrain3DEditor::stop_operation);
 	ClassDB::bind_method(D_METHOD("is_operating"), &Terrain3DEditor::is_operating);
 
-	ClassDB::bind_method(D_METHOD("apply_undo", "maps"), &Terrain3DEditor::_apply_undo);
+	ClassDB::bind_method(D_METHOD("apply_undo", "data"), &Terrain3DEditor::_apply_undo);
 }
@@ -65,6 +65,8 @@ public: // Constants
 		"TOOL_MAX",
 	};
 
+	static inline const int UNDO_TILE_SIZE = 64; // Pixels per side of the tiles stored for undo
+
 	class Brush {
 		CLASS_NAME_STATIC("Terrain3DEditor::Brush");
 
@@ -93,9 +95,13 @@ public: // Constants
 		real_t _gamma = 1.0f;
 		real_t _jitter = 0.0f;
 
+		PackedFloat32Array _alpha; // Red channel of _image with gamma applied
+
+		void _update_alpha();
+
 	public:
 		void set_data(Dictionary p_data);
-		real_t get_alpha(Vector2i p_position) { return _image->get_pixelv(p_position).r; }
+		PackedFloat32Array get_alpha() const { return _alpha; }
 
 		Ref<ImageTexture> get_texture() const { return _texture; }
 		Ref<Image> get_image() const { return _image; }
@@ -134,20 +140,73 @@ private:
 	bool _pending_undo = false;
 	bool _modified = false;
 	AABB _modified_area;
-	Array _undo_set; // 0-2: map 0,1,2, 3: Region offsets, 4: height range, 5: edited AABB
+	Dictionary _undo_snapshot; // Region offset -> Array of copy-on-write copies of its maps
+	Vector2 _undo_height_range;
+
+	// Per band output of _operate_band()
+	struct BandResult {
+		Vector2 height_range = Vector2(__FLT_MAX__, -__FLT_MAX__); // Heights written
+		Vector2 edited_range = Vector2(__FLT_MAX__, -__FLT_MAX__); // Heights before and after
+	};
+
+	// Current brush operation, read by the worker threads running _operate_band()
+	struct BrushStroke {
+		Terrain3DStorage::MapType map_type = Terrain3DStorage::TYPE_HEIGHT;
+		int region_size = 0;
+		real_t vertex_spacing = 1.f;
+		Vector3 global_position;
+		int brush_size = 0;
+		int sample_count = 0; // Samples along each side of the brush
+		real_t rot = 0.f;
+		Vector2i img_size;
+		const float *alpha = nullptr;
+
+		real_t strength = 0.f;
+		real_t height = 0.f;
+		int texture_id = 0;
+		Color color;
+		real_t roughness = 0.f;
+		bool enable = false;
+		bool enable_texture = false;
+		bool enable_angle = false;
+		bool enable_scale = false;
+		uint32_t uv_rotation = 0;
+		uint32_t uv_scale = 0;
+		bool has_gradient = false;
+		Vector3 gradient_points[2];
+		bool has_movement = false;
+		Vector2 movement_xz;
+
+		// Map data of the regions under the brush, in a grid of region cells from cell_origin
+		Vector2i cell_origin;
+		Vector2i cell_grid;
+		Vector<uint8_t *> maps; // Writeable, nullptr if no region or not under the brush
+		Vector<const float *> heights; // Height maps, for the edited area
+		Vector<PackedByteArray> sources; // Copies of the height maps for AVERAGE
+		Vector<const float *> source_heights;
+
+		int band_size = 16; // Columns per worker task
+		BandResult *results = nullptr;
+	} _stroke;
 
 	void _region_modified(Vector3 p_global_position, Vector2 p_height_range = Vector2());
 	void _operate_region(Vector3 p_global_position);
 	void _operate_map(Vector3 p_global_position, real_t p_camera_direction);
+	bool _get_stroke_pixel(Vector2i p_vertex, int &r_cell, int &r_index) const;
+	real_t _get_stroke_source_height(Vector2i p_vertex) const;
+	void _operate_band(uint32_t p_band);
 	bool _is_in_bounds(Vector2i p_position, Vector2i p_max_position);
-	Vector2 _get_uv_position(Vector3 p_global_position, int p_region_size);
 	Vector2 _rotate_uv(Vector2 p_uv, real_t p_angle);
 
 	void _setup_undo();
+	uint64_t _get_maps_size(const Array &p_maps) const;
 	void _store_undo();
-	void _apply_undo(const Array &p_set);
+	void _apply_undo(const Dictionary &p_data);
 
 public:
+	// Bytes of undo and redo data stored by all editors. The history may have since dropped some.
+	static inline uint64_t undo_memory = 0;
+
 	Terrain3DEditor() {}
 	~Terrain3DEditor() {}
 
@@ -22,6 +22,9 @@ void Terrain3DMaterial::_preload_shaders() {
 #include "shaders/uniforms.glsl"
 			, "uniforms");
 	_parse_shader(
+#include "shaders/height_formats.glsl"
+			, "height_formats");
+	_parse_shader(
 #include "shaders/world_noise.glsl"
 			, "world_noise");
 	_parse_shader(
@@ -116,25 +119,57 @@ String Terrain3DMaterial::_apply_inserts(String p_shader, Array p_excludes) {
 	return shader;
 }
 
-String Terrain3DMaterial::_generate_shader_code() {
+// Returns the feature bits of the shader variant for the current settings
+uint32_t Terrain3DMaterial::_get_shader_features() const {
+	uint32_t features = 0;
+	features |= (_world_background == NOISE) ? FEATURE_WORLD_NOISE : 0;
+	features |= (_texture_filtering == NEAREST) ? FEATURE_TEXTURE_NEAREST : 0;
+	features |= _auto_shader ? FEATURE_AUTO_SHADER : 0;
+	features |= _dual_scaling ? FEATURE_DUAL_SCALING : 0;
+	features |= _height_16_bit ? FEATURE_HEIGHT_16_BIT : 0;
+	// Same order as EDITOR_INSERTS
+	bool editor_views[EDITOR_INSERT_COUNT] = {
+		_debug_view_checkered,
+		_debug_view_grey,
+		_debug_view_heightmap,
+		_debug_view_colormap,
+		_debug_view_roughmap,
+		_debug_view_control_texture,
+		_debug_view_control_blend,
+		_debug_view_autoshader,
+		_debug_view_tex_height,
+		_debug_view_tex_normal,
+		_debug_view_tex_rough,
+		_debug_view_vertex_grid,
+		_show_navigation,
+	};
+	for (int i = 0; i < EDITOR_INSERT_COUNT; i++) {
+		if (editor_views[i]) {
+			features |= 1 << (FEATURE_EDITOR_SHIFT + i);
+		}
+	}
+	return features;
+}
+
+String Terrain3DMaterial::_generate_shader_code(uint32_t p_features) {
 	LOG(INFO, "Generating default shader code");
 	Array excludes;
-	if (_world_background != NOISE) {
+	if (!(p_features & FEATURE_WORLD_NOISE)) {
 		excludes.push_back("WORLD_NOISE1");
 		excludes.push_back("WORLD_NOISE2");
 	}
-	if (_texture_filtering == LINEAR) {
+	if (!(p_features & FEATURE_TEXTURE_NEAREST)) {
 		excludes.push_back("TEXTURE_SAMPLERS_NEAREST");
 	} else {
 		excludes.push_back("TEXTURE_SAMPLERS_LINEAR");
 	}
-	if (_auto_shader) {
+	if (p_features & FEATURE_AUTO_SHADER) {
 		excludes.push_back("TEXTURE_ID");
 	} else {
 		excludes.push_back("AUTO_SHADER_UNIFORMS");
 		excludes.push_back("AUTO_SHADER_TEXTURE_ID");
 	}
-	if (_dual_scaling) {
+	if (p_features & FEATURE_DUAL_SCALING) {
 		excludes.push_back("UNI_SCALING_BASE");
 	} else {
 		excludes.push_back("DUAL_SCALING_UNIFORMS");
@@ -142,71 +177,72 @@ String Terrain3DMaterial::_generate_shader_code() {
 		excludes.push_back("DUAL_SCALING_BASE");
 		excludes.push_back("DUAL_SCALING_OVERLAY");
 	}
+	if (p_features & FEATURE_HEIGHT_16_BIT) {
+		excludes.push_back("HEIGHT_FULL");
+	} else {
+		excludes.push_back("HEIGHT_16_BIT");
+	}
 	String shader = _apply_inserts(_shader_code["main"], excludes);
 	return shader;
 }
 
-String Terrain3DMaterial::_inject_editor_code(String p_shader) {
+String Terrain3DMaterial::_inject_editor_code(String p_shader, uint32_t p_features) {
 	String shader = p_shader;
 	int idx = p_shader.rfind("}");
 	if (idx < 0) {
 		return shader;
 	}
-	Array insert_names;
-	if (_debug_view_checkered) {
-		insert_names.push_back("DEBUG_CHECKERED");
-	}
-	if (_debug_view_grey) {
-		insert_names.push_back("DEBUG_GREY");
-	}
-	if (_debug_view_heightmap) {
-		insert_names.push_back("DEBUG_HEIGHTMAP");
-	}
-	if (_debug_view_colormap) {
-		insert_names.push_back("DEBUG_COLORMAP");
-	}
-	if (_debug_view_roughmap) {
-		insert_names.push_back("DEBUG_ROUGHMAP");
-	}
-	if (_debug_view_control_texture) {
-		insert_names.push_back("DEBUG_CONTROL_TEXTURE");
-	}
-	if (_debug_view_control_blend) {
-		insert_names.push_back("DEBUG_CONTROL_BLEND");
-	}
-	if (_debug_view_autoshader) {
-		insert_names.push_back("DEBUG_AUTOSHADER");
-	}
-	if (_debug_view_tex_height) {
-		insert_names.push_back("DEBUG_TEXTURE_HEIGHT");
-	}
-	if (_debug_view_tex_normal) {
-		insert_names.push_back("DEBUG_TEXTURE_NORMAL");
-	}
-	if (_debug_view_tex_rough) {
-		insert_names.push_back("DEBUG_TEXTURE_ROUGHNESS");
-	}
-	if (_debug_view_vertex_grid) {
-		insert_names.push_back("DEBUG_VERTEX_GRID");
-	}
-	if (_show_navigation) {
-		insert_names.push_back("EDITOR_NAVIGATION");
-	}
-	for (int i = 0; i < insert_names.size(); i++) {
-		String insert = _shader_code[insert_names[i]];
+	for (int i = 0; i < EDITOR_INSERT_COUNT; i++) {
+		if (!(p_features & (1 << (FEATURE_EDITOR_SHIFT + i)))) {
+			continue;
+		}
+		String insert = _shader_code[EDITOR_INSERTS[i]];
 		shader = shader.insert(idx - 1, "\n" + insert);
 		idx += insert.length();
 	}
 	return shader;
 }
 
+/**
+ * Returns the shader of a variant, generating its code and compiling it if it isn't cached. The
+ * least recently used variant is freed once there are more than SHADER_CACHE_SIZE, unless it is in use.
+ */
+RID Terrain3DMaterial::_get_shader_variant(uint32_t p_features) {
+	if (_shader_cache.has(p_features)) {
+		RID shader = _shader_cache[p_features];
+		// Move to the back of the queue
+		_shader_cache.erase(p_features);
+		_shader_cache[p_features] = shader;
+		return shader;
+	}
+	LOG(DEBUG, "Compiling shader variant: ", p_features);
+	RID shader = RS->shader_create();
+	RS->shader_set_code(shader, _inject_editor_code(_generate_shader_code(p_features), p_features));
+	_shader_cache[p_features] = shader;
+	_shader_compile_count++;
+
+	Array keys = _shader_cache.keys();
+	for (int i = 0; i < keys.size() && _shader_cache.size() > SHADER_CACHE_SIZE; i++) {
+		RID old = _shader_cache[keys[i]];
+		if (old != shader && old != _shader) {
+			LOG(DEBUG, "Freeing shader variant: ", keys[i]);
+			RS->free_rid(old);
+			_shader_cache.erase(keys[i]);
+		}
+	}
+	return shader;
+}
+
 void Terrain3DMaterial::_update_shader() {
 	IS_INIT(NOP);
 	LOG(INFO, "Updating shader");
+	uint32_t features = _get_shader_features();
 	RID shader_rid;
 	if (_shader_override_enabled && _shader_override.is_valid()) {
+		// The default variant is only kept for its parameter list if already compiled
+		_shader = _shader_cache.has(features) ? RID(_shader_cache[features]) : RID();
 		if (_shader_override->get_code().is_empty()) {
-			String code = _generate_shader_code();
+			String code = _generate_shader_code(features);
 			_shader_override->set_code(code);
 		}
 		if (!_shader_override->is_connected("changed", callable_mp(this, &Terrain3DMaterial::_update_shader))) {
@@ -214,11 +250,10 @@ void Terrain3DMaterial::_update_shader() {
 			_shader_override->connect("changed", callable_mp(this, &Terrain3DMaterial::_update_shader));
 		}
 		String code = _shader_override->get_code();
-		_shader_tmp->set_code(_inject_editor_code(code));
+		_shader_tmp->set_code(_inject_editor_code(code, features));
 		shader_rid = _shader_tmp->get_rid();
 	} else {
-		String code = _generate_shader_code();
-		RS->shader_set_code(_shader, _inject_editor_code(code));
+		_shader = _get_shader_variant(features);
 		shader_rid = _shader;
 	}
 	RS->material_set_shader(_material, shader_rid);
@@ -291,71 +326,151 @@ void Terrain3DMaterial::_update_shader() {
 	notify_property_list_changed();
 }
 
+// Sets a region uniform on the material, unless it already has that value
+void Terrain3DMaterial::_set_region_param(const StringName &p_name, const Variant &p_value) {
+	if (_region_params.has(p_name) && _region_params[p_name] == p_value) {
+		return;
+	}
+	_region_params[p_name] = p_value;
+	RS->material_set_param(_material, p_name, p_value);
+}
+
+/**
+ * Sends the region maps and layout to the shader. Called on every region change, so only uniforms
+ * that changed are sent, and only the changed area of the blend map is redrawn.
+ */
 void Terrain3DMaterial::_update_regions() {
 	IS_STORAGE_INIT(NOP);
 	LOG(INFO, "Updating region maps in shader");
 
 	Ref<Terrain3DStorage> storage = _terrain->get_storage();
-	RS->material_set_param(_material, "_height_maps", storage->get_height_rid());
-	RS->material_set_param(_material, "_control_maps", storage->get_control_rid());
-	RS->material_set_param(_material, "_color_maps", storage->get_color_rid());
+	_set_region_param("_height_maps", storage->get_height_rid());
+	_set_region_param("_control_maps", storage->get_control_rid());
+	_set_region_param("_color_maps", storage->get_color_rid());
 	LOG(DEBUG, "Height map RID: ", storage->get_height_rid());
 	LOG(DEBUG, "Control map RID: ", storage->get_control_rid());
 	LOG(DEBUG, "Color map RID: ", storage->get_color_rid());
 
-	PackedInt32Array region_map = storage->get_region_map();
-	LOG(DEBUG, "region_map.size(): ", region_map.size());
-	if (region_map.size() != Terrain3DStorage::REGION_MAP_SIZE * Terrain3DStorage::REGION_MAP_SIZE) {
-		LOG(ERROR, "Expected region_map.size() of ", Terrain3DStorage::REGION_MAP_SIZE * Terrain3DStorage::REGION_MAP_SIZE);
-	}
-	RS->material_set_param(_material, "_region_map", region_map);
-	RS->material_set_param(_material, "_region_map_size", Terrain3DStorage::REGION_MAP_SIZE);
-	if (Terrain3D::debug_level >= DEBUG) {
-		LOG(DEBUG, "Region map");
-		for (int i = 0; i < region_map.size(); i++) {
-			if (region_map[i]) {
-				LOG(DEBUG, "Region id: ", region_map[i], " array index: ", i);
-			}
-		}
-	}
+	_generate_region_map();
+	_set_region_param("_region_map_size", Terrain3DStorage::REGION_MAP_SIZE);
 
-	TypedArray<Vector2i> region_offsets = storage->get_region_offsets();
-	LOG(DEBUG, "Region_offsets size: ", region_offsets.size(), " ", region_offsets);
-	RS->material_set_param(_material, "_region_offsets", region_offsets);
+	_set_region_param("_height_map_range", storage->get_gpu_height_range());
+	bool height_16_bit = storage->get_gpu_height_format() == Terrain3DStorage::GPU_HEIGHT_16_BIT;
+	if (height_16_bit != _height_16_bit) {
+		LOG(DEBUG, "Height maps are ", height_16_bit ? "16 bit" : "floats", ", updating shader");
+		_height_16_bit = height_16_bit;
+		_update_shader();
+	}
 
 	real_t region_size = real_t(storage->get_region_size());
 	LOG(DEBUG, "Setting region size in material: ", region_size);
-	RS->material_set_param(_material, "_region_size", region_size);
-	RS->material_set_param(_material, "_region_pixel_size", 1.0f / region_size);
+	_set_region_param("_region_size", region_size);
+	_set_region_param("_region_texel_size", 1.0f / region_size);
 
 	real_t spacing = _terrain->get_mesh_vertex_spacing();
 	LOG(DEBUG, "Setting mesh vertex spacing in material: ", spacing);
-	RS->material_set_param(_material, "_mesh_vertex_spacing", spacing);
-	RS->material_set_param(_material, "_mesh_vertex_density", 1.0f / spacing);
+	_set_region_param("_mesh_vertex_spacing", spacing);
+	_set_region_param("_mesh_vertex_density", 1.0f / spacing);
 
 	_generate_region_blend_map();
 }
 
+/**
+ * Uploads the region map as a texture, so the shader isn't limited by the size of uniform arrays.
+ * Each texel holds the 1 based index of the region layer, or 0 for none. Region offsets aren't
+ * needed, as each texel's offset is its position in the map.
+ */
+void Terrain3DMaterial::_generate_region_map() {
+	PackedInt32Array region_map = _terrain->get_storage()->get_region_map();
+	int rsize = Terrain3DStorage::REGION_MAP_SIZE;
+	LOG(DEBUG, "region_map.size(): ", region_map.size());
+	if (region_map.size() != rsize * rsize) {
+		LOG(ERROR, "Expected region_map.size() of ", rsize * rsize);
+		return;
+	}
+	PackedFloat32Array texels;
+	texels.resize(region_map.size());
+	float *texel = texels.ptrw();
+	for (int i = 0; i < region_map.size(); i++) {
+		texel[i] = float(region_map[i]);
+		if (region_map[i]) {
+			LOG(DEBUG_CONT, "Region id: ", region_map[i], " array index: ", i);
+		}
+	}
+	Ref<Image> img = Image::create_from_data(rsize, rsize, false, Image::FORMAT_RF, texels.to_byte_array());
+	if (_generated_region_map.get_rid().is_valid()) {
+		_generated_region_map.update(img, 0);
+	} else {
+		_generated_region_map.create(img);
+	}
+	_set_region_param("_region_map", _generated_region_map.get_rid());
+}
+
+/**
+ * Draws the region map, scaled up bilinearly, into the blend map. Only texels near region map cells
+ * that changed since the last call are redrawn, and then uploaded to the same texture.
+ */
 void Terrain3DMaterial::_generate_region_blend_map() {
 	IS_STORAGE_INIT_MESG("Material not initialized", NOP);
 	PackedInt32Array region_map = _terrain->get_storage()->get_region_map();
 	int rsize = Terrain3DStorage::REGION_MAP_SIZE;
-	if (region_map.size() == rsize * rsize) {
-		LOG(DEBUG, "Regenerating ", Vector2i(512, 512), " region blend map");
-		Ref<Image> region_blend_img = Image::create(rsize, rsize, false, Image::FORMAT_RH);
-		for (int y = 0; y < rsize; y++) {
-			for (int x = 0; x < rsize; x++) {
-				if (region_map[y * rsize + x] > 0) {
-					region_blend_img->set_pixel(x, y, COLOR_WHITE);
-				}
-			}
+	if (region_map.size() != rsize * rsize) {
+		return;
+	}
+	Ref<Image> region_blend_img = _generated_region_blend_map.get_image();
+	bool rebuild = region_blend_img.is_null() || _region_blend_cells.size() != region_map.size();
+	_region_blend_cells.resize(region_map.size());
+	uint8_t *cells = _region_blend_cells.ptrw();
+	Rect2i changed;
+	for (int i = 0; i < region_map.size(); i++) {
+		uint8_t occupied = region_map[i] > 0 ? 1 : 0;
+		if (rebuild || cells[i] != occupied) {
+			Rect2i cell = Rect2i(i % rsize, i / rsize, 1, 1);
+			changed = changed.has_area() ? changed.merge(cell) : cell;
+			cells[i] = occupied;
+		}
+	}
+	if (!changed.has_area()) {
+		return;
+	}
+
+	LOG(DEBUG, "Redrawing ", changed, " of the ", Vector2i(REGION_BLEND_MAP_SIZE, REGION_BLEND_MAP_SIZE), " region blend map");
+	if (rebuild) {
+		region_blend_img = Image::create(REGION_BLEND_MAP_SIZE, REGION_BLEND_MAP_SIZE, false, Image::FORMAT_RH);
+	}
+	// Texel centers map to (x + 0.5) * scale - 0.5 on the region map, and blend the cells either side
+	real_t scale = real_t(rsize) / real_t(REGION_BLEND_MAP_SIZE);
+	Vector2i start = Vector2i(((Vector2(changed.position) - Vector2(0.5f, 0.5f)) / scale - Vector2(0.5f, 0.5f)).floor());
+	Vector2i end = Vector2i(((Vector2(changed.get_end()) + Vector2(0.5f, 0.5f)) / scale - Vector2(0.5f, 0.5f)).ceil());
+	start = start.clamp(Vector2i(0, 0), Vector2i(REGION_BLEND_MAP_SIZE, REGION_BLEND_MAP_SIZE));
+	end = end.clamp(Vector2i(0, 0), Vector2i(REGION_BLEND_MAP_SIZE, REGION_BLEND_MAP_SIZE));
+	for (int y = start.y; y < end.y; y++) {
+		real_t v = (real_t(y) + 0.5f) * scale - 0.5f;
+		int y0 = int(Math::floor(v));
+		real_t fy = v - real_t(y0);
+		int y1 = CLAMP(y0 + 1, 0, rsize - 1);
+		y0 = CLAMP(y0, 0, rsize - 1);
+		for (int x = start.x; x < end.x; x++) {
+			real_t u = (real_t(x) + 0.5f) * scale - 0.5f;
+			int x0 = int(Math::floor(u));
+			real_t fx = u - real_t(x0);
+			int x1 = CLAMP(x0 + 1, 0, rsize - 1);
+			x0 = CLAMP(x0, 0, rsize - 1);
+			real_t top = Math::lerp(real_t(cells[y0 * rsize + x0]), real_t(cells[y0 * rsize + x1]), fx);
+			real_t bottom = Math::lerp(real_t(cells[y1 * rsize + x0]), real_t(cells[y1 * rsize + x1]), fx);
+			real_t value = Math::lerp(top, bottom, fy);
+			region_blend_img->set_pixel(x, y, Color(value, value, value, 1.f));
 		}
-		region_blend_img->resize(512, 512, Image::INTERPOLATE_TRILINEAR);
+	}
+
+	if (rebuild) {
 		_generated_region_blend_map.clear();
 		_generated_region_blend_map.create(region_blend_img);
-		RS->material_set_param(_material, "_region_blend_map", _generated_region_blend_map.get_rid());
-		Util::dump_gen(_generated_region_blend_map, "blend_map");
+	} else {
+		_generated_region_blend_map.update(region_blend_img, 0);
 	}
+	_set_region_param("_region_blend_map", _generated_region_blend_map.get_rid());
+	Util::dump_gen(_generated_region_blend_map, "blend_map");
 }
 
 // Called from signal connected in Terrain3D, emitted by texture_list
@@ -386,9 +501,43 @@ void Terrain3DMaterial::_update_texture_arrays() {
 	}
 }
 
+/**
+ * Copies the auto shader params out of _shader_params, so CPU queries needn't look them up by
+ * name. Params that were never set have the defaults of auto_shader.glsl. Works before
+ * initialize(), eg. in server mode where there's no shader.
+ */
+void Terrain3DMaterial::_update_auto_shader_params() {
+	AutoShaderParams params;
+	_auto_shader_params.slope = real_t(_shader_params.get("auto_slope", params.slope));
+	_auto_shader_params.height_reduction = real_t(_shader_params.get("auto_height_reduction", params.height_reduction));
+	_auto_shader_params.base_texture = int(_shader_params.get("auto_base_texture", params.base_texture));
+	_auto_shader_params.overlay_texture = int(_shader_params.get("auto_overlay_texture", params.overlay_texture));
+}
+
 void Terrain3DMaterial::_set_shader_parameters(const Dictionary &p_dict) {
 	LOG(INFO, "Setting shader params dictionary: ", p_dict.size());
 	_shader_params = p_dict;
+	_update_auto_shader_params();
+}
+
+// Frees the material, shaders and generated maps on the RenderingServer. initialize() can be called again after.
+void Terrain3DMaterial::_clear() {
+	IS_INIT(NOP);
+	LOG(INFO, "Destroying material");
+	RS->free_rid(_material);
+	_material = RID();
+	Array shaders = _shader_cache.values();
+	for (int i = 0; i < shaders.size(); i++) {
+		RS->free_rid(shaders[i]);
+	}
+	_shader_cache.clear();
+	_shader = RID();
+	_shader_tmp.unref();
+	_generated_region_map.clear();
+	_generated_region_blend_map.clear();
+	_region_blend_cells.clear();
+	_region_params.clear();
+	_terrain = nullptr;
 }
 
 ///////////////////////////
@@ -408,24 +557,19 @@ void Terrain3DMaterial::initialize(Terrain3D *p_terrain) {
 	LOG(INFO, "Initializing material");
 	_preload_shaders();
 	_material = RS->material_create();
-	_shader = RS->shader_create();
 	_shader_tmp.instantiate();
-	LOG(DEBUG, "Mat RID: ", _material, ", _shader RID: ", _shader);
 	_update_shader();
+	LOG(DEBUG, "Mat RID: ", _material, ", _shader RID: ", _shader);
 	_update_regions();
 }
 
 Terrain3DMaterial::~Terrain3DMaterial() {
-	IS_INIT(NOP);
-	LOG(INFO, "Destroying material");
-	RS->free_rid(_material);
-	RS->free_rid(_shader);
-	_generated_region_blend_map.clear();
+	_clear();
 }
 
 RID Terrain3DMaterial::get_shader_rid() const {
 	if (_shader_override_enabled) {
-		return _shader_tmp->get_rid();
+		return _shader_tmp.is_valid() ? _shader_tmp->get_rid() : RID();
 	} else {
 		return _shader;
 	}
@@ -565,14 +709,17 @@ void Terrain3DMaterial::save() {
 	LOG(DEBUG, "Generating parameter list from shaders");
 	// Get shader parameters from default shader (eg world_noise)
 	Array param_list;
-	param_list = RS->get_shader_parameter_list(_shader);
+	if (_shader.is_valid()) {
+		param_list = RS->get_shader_parameter_list(_shader);
+	}
 	// Get shader parameters from custom shader if present
 	if (_shader_override.is_valid()) {
 		param_list.append_array(_shader_override->get_shader_uniform_list(true));
 	}
 
-	// Remove saved shader params that don't exist in either shader
-	Array keys = _shader_params.keys();
+	// Remove saved shader params that don't exist in either shader. The default shader isn't
+	// compiled while overridden, so then its params are all kept.
+	Array keys = _shader.is_valid() ? _shader_params.keys() : Array();
 	for (int i = 0; i < keys.size(); i++) {
 		bool has = false;
 		StringName name = keys[i];
@@ -694,6 +841,7 @@ bool Terrain3DMaterial::_set(const StringName &p_name, const Variant &p_property
 	if (p_property.get_type() == Variant::NIL) {
 		RS->material_set_param(_material, p_name, Variant());
 		_shader_params.erase(p_name);
+		_update_auto_shader_params();
 		return true;
 	}
 
@@ -710,6 +858,7 @@ bool Terrain3DMaterial::_set(const StringName &p_name, const Variant &p_property
 	} else {
 		_shader_params[p_name] = p_property;
 		RS->material_set_param(_material, p_name, p_property);
+		_update_auto_shader_params();
 	}
 	return true;
 }
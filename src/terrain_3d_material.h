@@ -30,24 +30,67 @@ public: // Constants
 		NEAREST,
 	};
 
+	// Auto shader uniforms for CPU queries such as Terrain3DStorage::get_texture_id()
+	struct AutoShaderParams {
+		real_t slope = 1.f;
+		real_t height_reduction = 0.1f;
+		int base_texture = 0;
+		int overlay_texture = 1;
+	};
+
 private:
+	// Shader variants. Each bit selects inserts in the generated code, see _get_shader_features().
+	enum ShaderFeature {
+		FEATURE_WORLD_NOISE = 1 << 0,
+		FEATURE_TEXTURE_NEAREST = 1 << 1,
+		FEATURE_AUTO_SHADER = 1 << 2,
+		FEATURE_DUAL_SCALING = 1 << 3,
+		FEATURE_HEIGHT_16_BIT = 1 << 4,
+		FEATURE_EDITOR_SHIFT = 5, // Following bits are each of EDITOR_INSERTS
+	};
+	static inline const int EDITOR_INSERT_COUNT = 13;
+	static inline const char *EDITOR_INSERTS[] = {
+		"DEBUG_CHECKERED",
+		"DEBUG_GREY",
+		"DEBUG_HEIGHTMAP",
+		"DEBUG_COLORMAP",
+		"DEBUG_ROUGHMAP",
+		"DEBUG_CONTROL_TEXTURE",
+		"DEBUG_CONTROL_BLEND",
+		"DEBUG_AUTOSHADER",
+		"DEBUG_TEXTURE_HEIGHT",
+		"DEBUG_TEXTURE_NORMAL",
+		"DEBUG_TEXTURE_ROUGHNESS",
+		"DEBUG_VERTEX_GRID",
+		"EDITOR_NAVIGATION",
+	};
+	static inline const int SHADER_CACHE_SIZE = 24;
+
 	Terrain3D *_terrain = nullptr;
 
 	RID _material;
-	RID _shader;
+	RID _shader; // Variant for the current settings, from _shader_cache. Only set with an override if cached.
+	Dictionary _shader_cache; // Feature bits -> shader RID, least recently used first
+	int _shader_compile_count = 0; // Variants compiled so far, for the monitors
 	bool _shader_override_enabled = false;
 	Ref<Shader> _shader_override;
 	Ref<Shader> _shader_tmp;
 	Dictionary _shader_code;
 	mutable TypedArray<StringName> _active_params; // All shader params in the current shader
 	mutable Dictionary _shader_params; // Public shader params saved to disk
-	GeneratedTexture _generated_region_blend_map; // 512x512 blurred image of region_map
+	GeneratedTexture _generated_region_map; // REGION_MAP_SIZE^2 FORMAT_RF image of region_map
+	static inline const int REGION_BLEND_MAP_SIZE = 1024;
+	GeneratedTexture _generated_region_blend_map; // 1024x1024 blurred image of region_map
+	PackedByteArray _region_blend_cells; // Occupied region map cells in the blend map
+	Dictionary _region_params; // Region uniforms last sent to the RenderingServer
+	AutoShaderParams _auto_shader_params; // Native copy of _shader_params, defaults from auto_shader.glsl
 
 	// Material Features
 	WorldBackground _world_background = FLAT;
 	TextureFiltering _texture_filtering = LINEAR;
 	bool _auto_shader = false;
 	bool _dual_scaling = false;
+	bool _height_16_bit = false; // Storage gpu_height_format, decoded by the shader
 
 	// Editor Functions / Debug views
 	bool _show_navigation = false;
@@ -66,15 +109,21 @@ private:
 	bool _debug_view_vertex_grid = false;
 
 	// Functions
+	void _clear();
 	void _preload_shaders();
 	void _parse_shader(String p_shader, String p_name);
 	String _apply_inserts(String p_shader, Array p_excludes = Array());
-	String _generate_shader_code();
-	String _inject_editor_code(String p_shader);
+	uint32_t _get_shader_features() const;
+	String _generate_shader_code(uint32_t p_features);
+	String _inject_editor_code(String p_shader, uint32_t p_features);
+	RID _get_shader_variant(uint32_t p_features);
 	void _update_shader();
+	void _set_region_param(const StringName &p_name, const Variant &p_value);
 	void _update_regions();
+	void _generate_region_map();
 	void _generate_region_blend_map();
 	void _update_texture_arrays();
+	void _update_auto_shader_params();
 	void _set_shader_parameters(const Dictionary &p_dict);
 	Dictionary _get_shader_parameters() const { return _shader_params; }
 
@@ -96,6 +145,7 @@ public:
 	bool get_auto_shader() const { return _auto_shader; }
 	void set_dual_scaling(bool p_enabled);
 	bool get_dual_scaling() const { return _dual_scaling; }
+	const AutoShaderParams &get_auto_shader_params() const { return _auto_shader_params; }
 
 	void enable_shader_override(bool p_enabled);
 	bool is_shader_override_enabled() const { return _shader_override_enabled; }
@@ -0,0 +1,189 @@
+// Copyright © 2023 Cory Petkovsek, Roope Palmroos, and Contributors.
+
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
+#include <godot_cpp/core/class_db.hpp>
+
+#include "logger.h"
+#include "terrain_3d_region.h"
+
+///////////////////////////
+// Public Functions
+///////////////////////////
+
+// Sets the maps from an array of [ Height, Control, Color ], as used by Terrain3DStorage
+void Terrain3DRegion::set_maps(const TypedArray<Image> &p_maps) {
+	_height_map = (p_maps.size() > 0) ? Ref<Image>(p_maps[0]) : Ref<Image>();
+	_control_map = (p_maps.size() > 1) ? Ref<Image>(p_maps[1]) : Ref<Image>();
+	_color_map = (p_maps.size() > 2) ? Ref<Image>(p_maps[2]) : Ref<Image>();
+}
+
+TypedArray<Image> Terrain3DRegion::get_maps() const {
+	TypedArray<Image> maps;
+	maps.push_back(_height_map);
+	maps.push_back(_control_map);
+	maps.push_back(_color_map);
+	return maps;
+}
+
+/**
+ * Writes the maps uncompressed, after a header, so they can be loaded by load_raw() with one read
+ * per map straight into the Image data. The layout, little endian, is:
+ *	uint32 RAW_MAGIC, uint32 RAW_VERSION, int32 region_offset x, y, float height_range x, y, uint32 map count
+ *	per map: uint32 map type (0 height, 1 control, 2 color), uint32 Image::Format, uint32 width, height, uint64 byte size
+ *	then the data of each map in the same order, without mipmaps.
+ * This is saved on the save task so must only read this object.
+ */
+Error Terrain3DRegion::save_raw(const String &p_path) const {
+	Ref<Image> maps[] = { _height_map, _control_map, _color_map };
+	Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::WRITE);
+	if (file.is_null()) {
+		LOG(ERROR, "Could not open raw region file for writing: ", p_path, ", error: ", FileAccess::get_open_error());
+		return FileAccess::get_open_error();
+	}
+	PackedByteArray data[3];
+	uint32_t map_count = 0;
+	for (int i = 0; i < 3; i++) {
+		if (maps[i].is_valid() && !maps[i]->is_empty()) {
+			data[i] = maps[i]->get_data();
+			if (maps[i]->has_mipmaps()) {
+				data[i] = data[i].slice(0, maps[i]->get_mipmap_offset(1)); // Only the first level is saved
+			}
+			map_count++;
+		}
+	}
+	file->store_32(RAW_MAGIC);
+	file->store_32(RAW_VERSION);
+	file->store_32(uint32_t(_region_offset.x));
+	file->store_32(uint32_t(_region_offset.y));
+	file->store_float(_height_range.x);
+	file->store_float(_height_range.y);
+	file->store_32(map_count);
+	for (int i = 0; i < 3; i++) {
+		if (data[i].is_empty()) {
+			continue;
+		}
+		file->store_32(i);
+		file->store_32(maps[i]->get_format());
+		file->store_32(maps[i]->get_width());
+		file->store_32(maps[i]->get_height());
+		file->store_64(data[i].size());
+	}
+	for (int i = 0; i < 3; i++) {
+		if (!data[i].is_empty()) {
+			file->store_buffer(data[i]);
+		}
+	}
+	return file->get_error();
+}
+
+/**
+ * Loads a file written by save_raw(). Each map is read in one call into a buffer the Image then
+ * uses as is, so there is no decompression or conversion. The color map can be skipped, for
+ * servers that only need heights and control data.
+ */
+Error Terrain3DRegion::load_raw(const String &p_path, bool p_load_color) {
+	Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::READ);
+	if (file.is_null()) {
+		LOG(ERROR, "Could not open raw region file: ", p_path, ", error: ", FileAccess::get_open_error());
+		return FileAccess::get_open_error();
+	}
+	if (file->get_32() != RAW_MAGIC || file->get_32() > RAW_VERSION) {
+		LOG(ERROR, "Not a supported raw region file: ", p_path);
+		return ERR_FILE_UNRECOGNIZED;
+	}
+	_region_offset.x = int32_t(file->get_32());
+	_region_offset.y = int32_t(file->get_32());
+	_height_range.x = file->get_float();
+	_height_range.y = file->get_float();
+	uint32_t map_count = file->get_32();
+	if (map_count > 3) {
+		LOG(ERROR, "Corrupt raw region file: ", p_path);
+		return ERR_FILE_CORRUPT;
+	}
+
+	struct MapHeader {
+		uint32_t type;
+		Image::Format format;
+		int width;
+		int height;
+		uint64_t size;
+	} headers[3];
+	for (uint32_t i = 0; i < map_count; i++) {
+		headers[i].type = file->get_32();
+		headers[i].format = Image::Format(file->get_32());
+		headers[i].width = file->get_32();
+		headers[i].height = file->get_32();
+		headers[i].size = file->get_64();
+	}
+
+	Ref<Image> maps[3];
+	for (uint32_t i = 0; i < map_count; i++) {
+		const MapHeader &header = headers[i];
+		if (header.type == 2 && !p_load_color) {
+			file->seek(file->get_position() + header.size);
+			continue;
+		}
+		if (header.type > 2 || header.format < 0 || header.format >= Image::FORMAT_MAX ||
+				header.width <= 0 || header.height <= 0 || header.width > 16384 || header.height > 16384) {
+			LOG(ERROR, "Corrupt raw region file: ", p_path);
+			return ERR_FILE_CORRUPT;
+		}
+		PackedByteArray data = file->get_buffer(header.size);
+		if (uint64_t(data.size()) != header.size) {
+			LOG(ERROR, "Raw region file is truncated: ", p_path);
+			return ERR_FILE_CORRUPT;
+		}
+		maps[header.type] = Image::create_from_data(header.width, header.height, false, header.format, data);
+		if (maps[header.type].is_null() || maps[header.type]->is_empty()) {
+			LOG(ERROR, "Raw region file map size doesn't match its format: ", p_path);
+			return ERR_FILE_CORRUPT;
+		}
+	}
+	_height_map = maps[0];
+	_control_map = maps[1];
+	_color_map = maps[2];
+	return OK;
+}
+
+/**
+ * Calls load_raw() on a WorkerThreadPool task and returns its id. The caller must keep a
+ * reference to this region, and wait for the task before reading it or get_load_error().
+ */
+int64_t Terrain3DRegion::start_load_task(const String &p_path, bool p_load_color) {
+	_load_path = p_path;
+	_load_color = p_load_color;
+	_load_error = OK;
+	return WorkerThreadPool::get_singleton()->add_task(callable_mp(this, &Terrain3DRegion::_run_load_task), false, "Terrain3D region load");
+}
+
+///////////////////////////
+// Protected Functions
+///////////////////////////
+
+void Terrain3DRegion::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("set_version", "version"), &Terrain3DRegion::set_version);
+	ClassDB::bind_method(D_METHOD("get_version"), &Terrain3DRegion::get_version);
+	ClassDB::bind_method(D_METHOD("set_region_offset", "offset"), &Terrain3DRegion::set_region_offset);
+	ClassDB::bind_method(D_METHOD("get_region_offset"), &Terrain3DRegion::get_region_offset);
+	ClassDB::bind_method(D_METHOD("set_height_range", "range"), &Terrain3DRegion::set_height_range);
+	ClassDB::bind_method(D_METHOD("get_height_range"), &Terrain3DRegion::get_height_range);
+	ClassDB::bind_method(D_METHOD("set_height_map", "map"), &Terrain3DRegion::set_height_map);
+	ClassDB::bind_method(D_METHOD("get_height_map"), &Terrain3DRegion::get_height_map);
+	ClassDB::bind_method(D_METHOD("set_control_map", "map"), &Terrain3DRegion::set_control_map);
+	ClassDB::bind_method(D_METHOD("get_control_map"), &Terrain3DRegion::get_control_map);
+	ClassDB::bind_method(D_METHOD("set_color_map", "map"), &Terrain3DRegion::set_color_map);
+	ClassDB::bind_method(D_METHOD("get_color_map"), &Terrain3DRegion::get_color_map);
+	ClassDB::bind_method(D_METHOD("set_maps", "maps"), &Terrain3DRegion::set_maps);
+	ClassDB::bind_method(D_METHOD("get_maps"), &Terrain3DRegion::get_maps);
+	ClassDB::bind_method(D_METHOD("save_raw", "path"), &Terrain3DRegion::save_raw);
+	ClassDB::bind_method(D_METHOD("load_raw", "path", "load_color"), &Terrain3DRegion::load_raw, DEFVAL(true));
+
+	int ro_flags = PROPERTY_USAGE_STORAGE | PROPERTY_USAGE_EDITOR | PROPERTY_USAGE_READ_ONLY;
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "version", PROPERTY_HINT_NONE, "", ro_flags), "set_version", "get_version");
+	ADD_PROPERTY(PropertyInfo(Variant::VECTOR2I, "region_offset", PROPERTY_HINT_NONE, "", ro_flags), "set_region_offset", "get_region_offset");
+	ADD_PROPERTY(PropertyInfo(Variant::VECTOR2, "height_range", PROPERTY_HINT_NONE, "", ro_flags), "set_height_range", "get_height_range");
+	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "height_map", PROPERTY_HINT_RESOURCE_TYPE, "Image", ro_flags), "set_height_map", "get_height_map");
+	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "control_map", PROPERTY_HINT_RESOURCE_TYPE, "Image", ro_flags), "set_control_map", "get_control_map");
+	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "color_map", PROPERTY_HINT_RESOURCE_TYPE, "Image", ro_flags), "set_color_map", "get_color_map");
+}
@@ -0,0 +1,65 @@
+// Copyright © 2023 Cory Petkovsek, Roope Palmroos, and Contributors.
+
+#ifndef TERRAIN3D_REGION_CLASS_H
+#define TERRAIN3D_REGION_CLASS_H
+
+#include <godot_cpp/classes/image.hpp>
+
+#include "constants.h"
+
+using namespace godot;
+
+class Terrain3DRegion : public Resource {
+	GDCLASS(Terrain3DRegion, Resource);
+	CLASS_NAME();
+
+public: // Constants
+	static inline const uint32_t RAW_MAGIC = 0x52443354; // "T3DR"
+	static inline const uint32_t RAW_VERSION = 1;
+
+private:
+	// Saved data
+	real_t _version = 0.8f;
+	Vector2i _region_offset;
+	Vector2 _height_range = Vector2(0.f, 0.f);
+	Ref<Image> _height_map;
+	Ref<Image> _control_map;
+	Ref<Image> _color_map;
+
+	// Background load, see start_load_task()
+	String _load_path;
+	bool _load_color = true;
+	Error _load_error = OK;
+	void _run_load_task() { _load_error = load_raw(_load_path, _load_color); }
+
+public:
+	Terrain3DRegion() {}
+	~Terrain3DRegion() {}
+
+	void set_version(real_t p_version) { _version = p_version; }
+	real_t get_version() const { return _version; }
+	void set_region_offset(Vector2i p_offset) { _region_offset = p_offset; }
+	Vector2i get_region_offset() const { return _region_offset; }
+	void set_height_range(Vector2 p_range) { _height_range = p_range; }
+	Vector2 get_height_range() const { return _height_range; }
+
+	void set_height_map(const Ref<Image> &p_map) { _height_map = p_map; }
+	Ref<Image> get_height_map() const { return _height_map; }
+	void set_control_map(const Ref<Image> &p_map) { _control_map = p_map; }
+	Ref<Image> get_control_map() const { return _control_map; }
+	void set_color_map(const Ref<Image> &p_map) { _color_map = p_map; }
+	Ref<Image> get_color_map() const { return _color_map; }
+	void set_maps(const TypedArray<Image> &p_maps);
+	TypedArray<Image> get_maps() const;
+
+	// Raw file format
+	Error save_raw(const String &p_path) const;
+	Error load_raw(const String &p_path, bool p_load_color = true);
+	int64_t start_load_task(const String &p_path, bool p_load_color = true);
+	Error get_load_error() const { return _load_error; }
+
+protected:
+	static void _bind_methods();
+};
+
+#endif // TERRAIN3D_REGION_CLASS_H
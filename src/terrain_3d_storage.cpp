@@ -1,9 +1,11 @@
 // Copyright © 2023 Cory Petkovsek, Roope Palmroos, and Contributors.
 
+#include <godot_cpp/classes/dir_access.hpp>
 #include <godot_cpp/classes/file_access.hpp>
 #include <godot_cpp/classes/rendering_server.hpp>
 #include <godot_cpp/classes/resource_saver.hpp>
 #include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
 #include <godot_cpp/core/class_db.hpp>
 
 #include "logger.h"
@@ -17,11 +19,932 @@ void Terrain3DStorage::_clear() {
 	LOG(INFO, "Clearing storage");
 	_region_map_dirty = true;
 	_region_map.clear();
+	_region_cache.clear();
 	_generated_height_maps.clear();
 	_generated_control_maps.clear();
 	_generated_color_maps.clear();
 }
 
+/**
+ * Mirrors the map arrays into _region_cache so the hot paths below avoid Variant conversions, and
+ * checks once per update which regions can be read and written directly through Image::ptr().
+ * Height pyramids and control masks are kept for maps that haven't been replaced, and built for
+ * the rest on worker threads.
+ */
+void Terrain3DStorage::_update_region_cache() {
+	Vector<RegionMaps> old_cache = _region_cache;
+	int region_count = _region_offsets.size();
+	_region_cache.resize(region_count);
+	RegionMaps *cache = _region_cache.ptrw();
+	_region_cache_jobs.clear();
+	for (int i = 0; i < region_count; i++) {
+		RegionMaps &region = cache[i];
+		region.direct = true;
+		for (int t = 0; t < TYPE_MAX; t++) {
+			TypedArray<Image> &maps = (t == TYPE_HEIGHT) ? _height_maps : (t == TYPE_CONTROL) ? _control_maps : _color_maps;
+			region.maps[t] = (i < maps.size()) ? Ref<Image>(maps[i]) : Ref<Image>();
+			if (region.maps[t].is_null() || region.maps[t]->get_format() != FORMAT[t] ||
+					region.maps[t]->get_width() != _region_size || region.maps[t]->get_height() != _region_size) {
+				region.direct = false;
+			}
+		}
+
+		// Keep the GPU maps of maps that weren't replaced, so only new regions are encoded again
+		for (int t = 0; t < TYPE_MAX; t++) {
+			region.gpu_maps[t].unref();
+			for (int j = 0; j < old_cache.size() && region.maps[t].is_valid(); j++) {
+				int old = (i + j) % old_cache.size();
+				if (old_cache[old].maps[t] == region.maps[t]) {
+					region.gpu_maps[t] = old_cache[old].gpu_maps[t];
+					break;
+				}
+			}
+		}
+
+		region.heights = HeightPyramid();
+		region.masks = ControlMasks();
+		if (!region.direct) {
+			continue;
+		}
+		// Regions shift down when one is removed, so look beyond the same index
+		for (int j = 0; j < old_cache.size() && !_height_pyramids_dirty; j++) {
+			int old = (i + j) % old_cache.size();
+			if (old_cache[old].maps[TYPE_HEIGHT] == region.maps[TYPE_HEIGHT]) {
+				region.heights = old_cache[old].heights;
+				break;
+			}
+		}
+		for (int j = 0; j < old_cache.size() && !_control_masks_dirty; j++) {
+			int old = (i + j) % old_cache.size();
+			if (old_cache[old].maps[TYPE_CONTROL] == region.maps[TYPE_CONTROL]) {
+				region.masks = old_cache[old].masks;
+				break;
+			}
+		}
+		if (region.heights.levels.is_empty() || region.masks.holes.is_empty()) {
+			_region_cache_jobs.push_back(&region);
+		}
+	}
+	_height_pyramids_dirty = false;
+	_control_masks_dirty = false;
+
+	if (_region_cache_jobs.size() == 1) {
+		_build_region_cache(0);
+	} else if (_region_cache_jobs.size() > 1) {
+		LOG(DEBUG, "Building height pyramids and control masks for ", _region_cache_jobs.size(), " regions");
+		int64_t group_id = WorkerThreadPool::get_singleton()->add_group_task(
+				callable_mp(this, &Terrain3DStorage::_build_region_cache), _region_cache_jobs.size(), -1, true, "Terrain3D region cache");
+		WorkerThreadPool::get_singleton()->wait_for_group_task_completion(group_id);
+	}
+	_region_cache_jobs.clear();
+}
+
+/**
+ * Recalculates the height pyramid cells over the given pixels of a direct region, inclusive of
+ * the end. The whole pyramid is built if p_pixels is empty or the pyramid doesn't exist yet.
+ */
+void Terrain3DStorage::_update_height_pyramid(RegionMaps &r_region, Rect2i p_pixels) const {
+	HeightPyramid &pyramid = r_region.heights;
+	if (!r_region.direct) {
+		pyramid = HeightPyramid();
+		return;
+	}
+	int region_size = _region_size;
+	if (pyramid.levels.is_empty()) {
+		int size = (region_size + HEIGHT_CELL_SIZE - 1) / HEIGHT_CELL_SIZE;
+		while (true) {
+			pyramid.sizes.push_back(size);
+			Vector<Vector2> cells;
+			cells.resize(size * size);
+			pyramid.levels.push_back(cells);
+			if (size == 1) {
+				break;
+			}
+			size = (size + 1) / 2;
+		}
+		p_pixels = Rect2i();
+	}
+	if (!p_pixels.has_area()) {
+		p_pixels = Rect2i(0, 0, region_size, region_size);
+	}
+	p_pixels = p_pixels.intersection(Rect2i(0, 0, region_size, region_size));
+	if (!p_pixels.has_area()) {
+		return;
+	}
+
+	// Level 0 cells containing the pixels, including those that share their first pixel
+	Vector2i start = Vector2i(MAX(p_pixels.position.x - 1, 0), MAX(p_pixels.position.y - 1, 0)) / HEIGHT_CELL_SIZE;
+	Vector2i end = (p_pixels.get_end() - Vector2i(1, 1)) / HEIGHT_CELL_SIZE;
+	end = end.min(Vector2i(pyramid.sizes[0] - 1, pyramid.sizes[0] - 1));
+	const float *heights = reinterpret_cast<const float *>(r_region.maps[TYPE_HEIGHT]->ptr());
+	Vector2 *cells = pyramid.levels.write[0].ptrw();
+	for (int cy = start.y; cy <= end.y; cy++) {
+		for (int cx = start.x; cx <= end.x; cx++) {
+			Vector2 range = Vector2(__FLT_MAX__, -__FLT_MAX__);
+			int x_end = MIN((cx + 1) * HEIGHT_CELL_SIZE, region_size - 1);
+			int y_end = MIN((cy + 1) * HEIGHT_CELL_SIZE, region_size - 1);
+			for (int y = cy * HEIGHT_CELL_SIZE; y <= y_end; y++) {
+				const float *row = heights + y * region_size;
+				for (int x = cx * HEIGHT_CELL_SIZE; x <= x_end; x++) {
+					float height = row[x];
+					if (!Math::is_nan(height)) {
+						range.x = MIN(range.x, height);
+						range.y = MAX(range.y, height);
+					}
+				}
+			}
+			cells[cy * pyramid.sizes[0] + cx] = range;
+		}
+	}
+
+	// Merge the changed cells upwards
+	for (int l = 1; l < pyramid.levels.size(); l++) {
+		start /= 2;
+		end /= 2;
+		int child_size = pyramid.sizes[l - 1];
+		const Vector2 *children = pyramid.levels[l - 1].ptr();
+		cells = pyramid.levels.write[l].ptrw();
+		for (int cy = start.y; cy <= end.y; cy++) {
+			for (int cx = start.x; cx <= end.x; cx++) {
+				Vector2 range = Vector2(__FLT_MAX__, -__FLT_MAX__);
+				for (int y = cy * 2; y <= MIN(cy * 2 + 1, child_size - 1); y++) {
+					for (int x = cx * 2; x <= MIN(cx * 2 + 1, child_size - 1); x++) {
+						Vector2 child = children[y * child_size + x];
+						range.x = MIN(range.x, child.x);
+						range.y = MAX(range.y, child.y);
+					}
+				}
+				cells[cy * pyramid.sizes[l] + cx] = range;
+			}
+		}
+	}
+}
+
+/**
+ * Reads the hole and navigation bits of the given pixels of a direct region's control map into its
+ * masks, inclusive of the end, keeping the counts of each. The whole region is read if p_pixels is
+ * empty or the masks don't exist yet.
+ */
+void Terrain3DStorage::_update_control_masks(RegionMaps &r_region, Rect2i p_pixels) const {
+	ControlMasks &masks = r_region.masks;
+	if (!r_region.direct) {
+		masks = ControlMasks();
+		return;
+	}
+	int region_size = _region_size;
+	int mask_size = (region_size * region_size + 7) / 8;
+	if (masks.holes.size() != mask_size || masks.navs.size() != mask_size || !p_pixels.has_area()) {
+		masks = ControlMasks();
+		masks.holes.resize(mask_size);
+		masks.holes.fill(0);
+		masks.navs.resize(mask_size);
+		masks.navs.fill(0);
+		p_pixels = Rect2i(0, 0, region_size, region_size);
+	}
+	p_pixels = p_pixels.intersection(Rect2i(0, 0, region_size, region_size));
+	if (!p_pixels.has_area()) {
+		return;
+	}
+
+	const uint32_t *controls = reinterpret_cast<const uint32_t *>(r_region.maps[TYPE_CONTROL]->ptr());
+	uint8_t *holes = masks.holes.ptrw();
+	uint8_t *navs = masks.navs.ptrw();
+	for (int y = p_pixels.position.y; y < p_pixels.get_end().y; y++) {
+		for (int x = p_pixels.position.x; x < p_pixels.get_end().x; x++) {
+			int index = y * region_size + x;
+			bool hole = is_hole(controls[index]);
+			bool nav = is_nav(controls[index]);
+			masks.hole_count += int(hole) - int(get_mask_bit(holes, index));
+			masks.nav_count += int(nav) - int(get_mask_bit(navs, index));
+			set_mask_bit(holes, index, hole);
+			set_mask_bit(navs, index, nav);
+		}
+	}
+}
+
+// WorkerThreadPool group task building the pyramids and masks queued by _update_region_cache()
+void Terrain3DStorage::_build_region_cache(uint32_t p_job) {
+	RegionMaps &region = *_region_cache_jobs[p_job];
+	if (region.heights.levels.is_empty()) {
+		_update_height_pyramid(region);
+	}
+	if (region.masks.holes.is_empty()) {
+		_update_control_masks(region);
+	}
+}
+
+/**
+ * Merges the height range of the pixels from p_start to p_end (inclusive) within a cell into
+ * r_range. Cells partially covered by the pixels are divided until level 0, which is merged whole,
+ * or with p_exact, by reading the covered pixels.
+ */
+void Terrain3DStorage::_merge_height_pyramid(const RegionMaps &p_region, int p_level, Vector2i p_cell,
+		Vector2i p_start, Vector2i p_end, bool p_exact, Vector2 &r_range) const {
+	const HeightPyramid &pyramid = p_region.heights;
+	int cell_size = HEIGHT_CELL_SIZE << p_level;
+	Vector2i cell_start = p_cell * cell_size;
+	Vector2i cell_end = (cell_start + Vector2i(cell_size, cell_size)).min(Vector2i(_region_size - 1, _region_size - 1));
+	if (cell_end.x < p_start.x || cell_end.y < p_start.y || cell_start.x > p_end.x || cell_start.y > p_end.y) {
+		return;
+	}
+	bool contained = cell_start.x >= p_start.x && cell_start.y >= p_start.y && cell_end.x <= p_end.x && cell_end.y <= p_end.y;
+	if (contained || (p_level == 0 && !p_exact)) {
+		Vector2 range = pyramid.levels[p_level][p_cell.y * pyramid.sizes[p_level] + p_cell.x];
+		r_range.x = MIN(r_range.x, range.x);
+		r_range.y = MAX(r_range.y, range.y);
+		return;
+	}
+	if (p_level == 0) {
+		const float *heights = reinterpret_cast<const float *>(p_region.maps[TYPE_HEIGHT]->ptr());
+		Vector2i start = cell_start.max(p_start);
+		Vector2i end = cell_end.min(p_end);
+		for (int y = start.y; y <= end.y; y++) {
+			const float *row = heights + y * _region_size;
+			for (int x = start.x; x <= end.x; x++) {
+				if (!Math::is_nan(row[x])) {
+					r_range.x = MIN(r_range.x, row[x]);
+					r_range.y = MAX(r_range.y, row[x]);
+				}
+			}
+		}
+		return;
+	}
+	int child_size = pyramid.sizes[p_level - 1];
+	for (int y = p_cell.y * 2; y <= MIN(p_cell.y * 2 + 1, child_size - 1); y++) {
+		for (int x = p_cell.x * 2; x <= MIN(p_cell.x * 2 + 1, child_size - 1); x++) {
+			_merge_height_pyramid(p_region, p_level - 1, Vector2i(x, y), p_start, p_end, p_exact, r_range);
+		}
+	}
+}
+
+/**
+ * Returns a table for batched reads of the height and control data. Entries are filled in by
+ * _load_region_data() when first used, so callers only pay for the regions they touch. Single
+ * position queries use a default constructed RegionTable instead, which doesn't allocate.
+ */
+Terrain3DStorage::RegionTable Terrain3DStorage::_get_region_data() const {
+	RegionTable table;
+	table.regions.resize(_region_cache.size());
+	return table;
+}
+
+Terrain3DStorage::RegionData Terrain3DStorage::_load_region_data(RegionTable &r_regions, int p_region) const {
+	RegionData *data;
+	if (p_region < r_regions.regions.size()) {
+		data = &r_regions.regions.write[p_region];
+	} else {
+		for (int i = 0; i < RegionTable::CACHE_SIZE; i++) {
+			if (r_regions.cache_regions[i] == p_region) {
+				return r_regions.cache[i];
+			}
+		}
+		int slot = r_regions.cache_next;
+		r_regions.cache_next = (slot + 1) % RegionTable::CACHE_SIZE;
+		r_regions.cache_regions[slot] = p_region;
+		data = &r_regions.cache[slot];
+		*data = RegionData();
+	}
+	if (!data->loaded) {
+		data->loaded = true;
+		const RegionMaps &region = _region_cache[p_region];
+		if (region.direct) {
+			data->heights = reinterpret_cast<const float *>(region.maps[TYPE_HEIGHT]->ptr());
+			data->controls = reinterpret_cast<const float *>(region.maps[TYPE_CONTROL]->ptr());
+			data->holes = (region.masks.hole_count > 0) ? region.masks.holes.ptr() : nullptr;
+			data->navs = (region.masks.nav_count > 0) ? region.masks.navs.ptr() : nullptr;
+		} else {
+			LOG(ERROR, "Region ", p_region, " has missing or invalid height or control maps");
+		}
+	}
+	return *data;
+}
+
+/**
+ * Returns the region index containing the descaled vertex position, or -1 if none.
+ * r_index is set to the pixel index of the vertex within the region maps.
+ */
+int Terrain3DStorage::_get_vertex_region(Vector2i p_vertex, int &r_index) const {
+	int region_size = _region_size;
+	// Floor division for negative coordinates
+	Vector2i region_loc = Vector2i(
+			p_vertex.x >= 0 ? p_vertex.x / region_size : (p_vertex.x + 1) / region_size - 1,
+			p_vertex.y >= 0 ? p_vertex.y / region_size : (p_vertex.y + 1) / region_size - 1);
+	Vector2i pos = region_loc + (REGION_MAP_VSIZE / 2);
+	if (pos.x < 0 || pos.y < 0 || pos.x >= REGION_MAP_SIZE || pos.y >= REGION_MAP_SIZE ||
+			_region_map.size() != REGION_MAP_SIZE * REGION_MAP_SIZE) {
+		return -1;
+	}
+	int region_id = _region_map[pos.y * REGION_MAP_SIZE + pos.x] - 1; // 0 = no region
+	if (region_id < 0 || region_id >= _region_cache.size()) {
+		return -1;
+	}
+	Vector2i img_pos = p_vertex - region_loc * region_size;
+	r_index = img_pos.y * region_size + img_pos.x;
+	return region_id;
+}
+
+// Returns the height of a descaled vertex position, or NAN outside of regions
+real_t Terrain3DStorage::_read_height(RegionTable &r_regions, Vector2i p_vertex) const {
+	int index;
+	int region = _get_vertex_region(p_vertex, index);
+	if (region < 0) {
+		return NAN;
+	}
+	RegionData data = _load_region_data(r_regions, region);
+	return (data.heights != nullptr) ? data.heights[index] : NAN;
+}
+
+// Returns if the control map is navigable under a position, as is_nav(get_control())
+bool Terrain3DStorage::_read_nav(RegionTable &r_regions, Vector3 p_global_position, real_t p_vertex_spacing) const {
+	int index;
+	int region = _get_vertex_region(Vector2i((Vector2(p_global_position.x, p_global_position.z) / p_vertex_spacing).floor()), index);
+	if (region < 0) {
+		return false;
+	}
+	if (!_region_cache[region].direct) {
+		// No masks, so read the map as it is
+		return is_nav(const_cast<Terrain3DStorage *>(this)->get_control(p_global_position));
+	}
+	RegionData data = _load_region_data(r_regions, region);
+	return data.navs != nullptr && get_mask_bit(data.navs, index);
+}
+
+/**
+ * Returns false if no pixel of the descaled vertex rectangle is navigable, using the nav counts of
+ * the regions under it, so that whole areas can be skipped. Regions without masks count as navigable.
+ */
+bool Terrain3DStorage::_has_nav(Rect2i p_vertices) const {
+	int region_size = _region_size;
+	Vector2i start = p_vertices.position;
+	Vector2i end = p_vertices.get_end() - Vector2i(1, 1);
+	for (int y = Math::floor(real_t(start.y) / region_size); y <= Math::floor(real_t(end.y) / region_size); y++) {
+		for (int x = Math::floor(real_t(start.x) / region_size); x <= Math::floor(real_t(end.x) / region_size); x++) {
+			int index;
+			int region = _get_vertex_region(Vector2i(x, y) * region_size, index);
+			if (region < 0) {
+				continue;
+			}
+			const RegionMaps &cache = _region_cache[region];
+			if (!cache.direct || cache.masks.holes.is_empty() || cache.masks.nav_count > 0) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * Returns true if any pixel of the descaled vertex rectangle is a hole or outside of the regions,
+ * where _sample_height() would return NAN, using the control masks. Hole-free regions aren't read.
+ */
+bool Terrain3DStorage::_has_hole(Rect2i p_vertices) const {
+	int region_size = _region_size;
+	Vector2i start = p_vertices.position;
+	Vector2i end = p_vertices.get_end() - Vector2i(1, 1);
+	for (int y = Math::floor(real_t(start.y) / region_size); y <= Math::floor(real_t(end.y) / region_size); y++) {
+		for (int x = Math::floor(real_t(start.x) / region_size); x <= Math::floor(real_t(end.x) / region_size); x++) {
+			Vector2i origin = Vector2i(x, y) * region_size;
+			int index;
+			int region = _get_vertex_region(origin, index);
+			if (region < 0) {
+				return true;
+			}
+			const RegionMaps &cache = _region_cache[region];
+			if (!cache.direct || cache.masks.holes.is_empty()) {
+				return true;
+			}
+			if (cache.masks.hole_count == 0) {
+				continue;
+			}
+			const uint8_t *holes = cache.masks.holes.ptr();
+			int px_end = MIN(end.x - origin.x, region_size - 1);
+			int py_end = MIN(end.y - origin.y, region_size - 1);
+			for (int py = MAX(start.y - origin.y, 0); py <= py_end; py++) {
+				for (int px = MAX(start.x - origin.x, 0); px <= px_end; px++) {
+					if (get_mask_bit(holes, py * region_size + px)) {
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+// Equivalent of get_height() on the raw map data from _get_region_data()
+real_t Terrain3DStorage::_sample_height(RegionTable &r_regions, Vector3 p_global_position, real_t p_vertex_spacing) const {
+	Vector2 pos = Vector2(p_global_position.x, p_global_position.z) / p_vertex_spacing;
+	Vector2i pos00 = Vector2i(pos.floor());
+	int index;
+	int region = _get_vertex_region(pos00, index);
+	if (region < 0) {
+		return NAN;
+	}
+	RegionData data = _load_region_data(r_regions, region);
+	if (data.controls == nullptr || (data.holes != nullptr && get_mask_bit(data.holes, index))) {
+		return NAN;
+	}
+	// If requested position is close to a vertex, return its height
+	Vector2 pos_round = pos.round();
+	if ((pos - pos_round).length() * p_vertex_spacing < 0.01f) {
+		return _read_height(r_regions, Vector2i(pos_round));
+	}
+	// Otherwise, bilinearly interpolate 4 surrounding vertices
+	real_t ht00 = _read_height(r_regions, pos00);
+	real_t ht10 = _read_height(r_regions, pos00 + Vector2i(1, 0));
+	real_t ht01 = _read_height(r_regions, pos00 + Vector2i(0, 1));
+	real_t ht11 = _read_height(r_regions, pos00 + Vector2i(1, 1));
+	Vector2 weight = pos - Vector2(pos00);
+	return Math::lerp(Math::lerp(ht00, ht10, weight.x), Math::lerp(ht01, ht11, weight.x), weight.y);
+}
+
+/**
+ * Reads the control word under each position, as get_control(). Positions outside of regions get
+ * 0 and are cleared in r_found, so callers can decode every word in a plain loop.
+ */
+void Terrain3DStorage::_read_controls(RegionTable &r_regions, const PackedVector3Array &p_global_positions,
+		real_t p_vertex_spacing, Vector<uint32_t> &r_controls, PackedByteArray &r_found) const {
+	int count = p_global_positions.size();
+	r_controls.resize(count);
+	r_found.resize(count);
+	const Vector3 *positions = p_global_positions.ptr();
+	uint32_t *controls_w = r_controls.ptrw();
+	uint8_t *found_w = r_found.ptrw();
+	for (int i = 0; i < count; i++) {
+		Vector2i vertex = Vector2i((Vector2(positions[i].x, positions[i].z) / p_vertex_spacing).floor());
+		int index;
+		int region = _get_vertex_region(vertex, index);
+		const float *controls = (region < 0) ? nullptr : _load_region_data(r_regions, region).controls;
+		controls_w[i] = (controls != nullptr) ? as_uint(controls[index]) : 0;
+		found_w[i] = controls != nullptr;
+	}
+}
+
+// Returns the texture ids the auto shader blends at a position, as get_texture_id()
+Vector3 Terrain3DStorage::_get_auto_texture_id(RegionTable &r_regions, Vector3 p_global_position, real_t p_vertex_spacing,
+		const Terrain3DMaterial::AutoShaderParams &p_params) const {
+	real_t auto_slope = p_params.slope * 2.f - 1.f;
+	real_t height = _sample_height(r_regions, p_global_position, p_vertex_spacing);
+	Vector3 normal = Vector3(NAN, NAN, NAN);
+	if (!Math::is_nan(height)) {
+		real_t u = height - _sample_height(r_regions, p_global_position + Vector3(p_vertex_spacing, 0.f, 0.f), p_vertex_spacing);
+		real_t v = height - _sample_height(r_regions, p_global_position + Vector3(0.f, 0.f, p_vertex_spacing), p_vertex_spacing);
+		normal = Vector3(u, p_vertex_spacing, v).normalized();
+	}
+	real_t blend = CLAMP(
+			vec3_dot(Vector3(0.f, 1.f, 0.f),
+					normal * auto_slope * 2.f - Vector3(auto_slope, auto_slope, auto_slope)) -
+					p_params.height_reduction * .01f * height,
+			0.f, 1.f);
+	return Vector3(real_t(p_params.base_texture), real_t(p_params.overlay_texture), blend);
+}
+
+// Returns the t range in which a ray is within an XZ box, empty if t.x > t.y
+static Vector2 _ray_box_range(Vector3 p_src_pos, Vector3 p_direction, Vector2 p_min, Vector2 p_max) {
+	Vector2 range = Vector2(-__FLT_MAX__, __FLT_MAX__);
+	for (int axis = 0; axis < 2; axis++) {
+		real_t src = (axis == 0) ? p_src_pos.x : p_src_pos.z;
+		real_t dir = (axis == 0) ? p_direction.x : p_direction.z;
+		if (Math::abs(dir) < CMP_EPSILON) {
+			if (src < p_min[axis] || src > p_max[axis]) {
+				return Vector2(__FLT_MAX__, -__FLT_MAX__);
+			}
+			continue;
+		}
+		real_t t0 = (p_min[axis] - src) / dir;
+		real_t t1 = (p_max[axis] - src) / dir;
+		range.x = MAX(range.x, MIN(t0, t1));
+		range.y = MIN(range.y, MAX(t0, t1));
+	}
+	return range;
+}
+
+// Returns the height of the ray at t above the bilinear surface of a vertex quad, heights 00, 10, 01, 11
+static real_t _ray_height_above_quad(Vector3 p_src_pos, Vector3 p_direction, real_t p_t, Vector2i p_quad,
+		const real_t *p_heights, real_t p_vertex_spacing) {
+	Vector3 pos = p_src_pos + p_direction * p_t;
+	real_t fx = CLAMP(pos.x / p_vertex_spacing - p_quad.x, 0.f, 1.f);
+	real_t fz = CLAMP(pos.z / p_vertex_spacing - p_quad.y, 0.f, 1.f);
+	real_t height = Math::lerp(Math::lerp(p_heights[0], p_heights[1], fx), Math::lerp(p_heights[2], p_heights[3], fx), fz);
+	return pos.y - height;
+}
+
+/**
+ * Tests the ray between p_t_start and p_t_end against the bilinear surface of the vertex quad at
+ * p_quad. Returns the distance where the ray first passes from above the surface to below, or -1.
+ * Quads with a hole or a missing corner have no surface.
+ */
+real_t Terrain3DStorage::_raycast_quad(RegionTable &r_regions, Vector2i p_quad, Vector3 p_src_pos,
+		Vector3 p_direction, real_t p_t_start, real_t p_t_end, real_t p_vertex_spacing) const {
+	int index;
+	int region = _get_vertex_region(p_quad, index);
+	if (region < 0) {
+		return -1.f;
+	}
+	RegionData data = _load_region_data(r_regions, region);
+	if (data.controls == nullptr || (data.holes != nullptr && get_mask_bit(data.holes, index))) {
+		return -1.f;
+	}
+	real_t heights[4] = {
+		data.heights[index],
+		_read_height(r_regions, p_quad + Vector2i(1, 0)),
+		_read_height(r_regions, p_quad + Vector2i(0, 1)),
+		_read_height(r_regions, p_quad + Vector2i(1, 1)),
+	};
+	for (int i = 0; i < 4; i++) {
+		if (Math::is_nan(heights[i])) {
+			return -1.f;
+		}
+	}
+
+	real_t t0 = p_t_start;
+	real_t t1 = p_t_end;
+	real_t f0 = _ray_height_above_quad(p_src_pos, p_direction, t0, p_quad, heights, p_vertex_spacing);
+	real_t f1 = _ray_height_above_quad(p_src_pos, p_direction, t1, p_quad, heights, p_vertex_spacing);
+	if (f0 < 0.f || f1 > 0.f) {
+		return -1.f;
+	}
+	// Regula falsi, the surface is quadratic along the ray
+	for (int i = 0; i < 6 && f0 - f1 > CMP_EPSILON; i++) {
+		real_t t = t0 + (t1 - t0) * f0 / (f0 - f1);
+		real_t f = _ray_height_above_quad(p_src_pos, p_direction, t, p_quad, heights, p_vertex_spacing);
+		if (f > 0.f) {
+			t0 = t;
+			f0 = f;
+		} else {
+			t1 = t;
+			f1 = f;
+		}
+	}
+	return (f0 - f1 > CMP_EPSILON) ? t0 + (t1 - t0) * f0 / (f0 - f1) : t0;
+}
+
+/**
+ * Marches a ray over the regions, skipping the largest height pyramid cells it passes over or
+ * under, and testing the vertex quads of the level 0 cells it might cross. Returns the distance to
+ * the first intersection, or -1.
+ */
+real_t Terrain3DStorage::_raycast(RegionTable &r_regions, Vector3 p_src_pos, Vector3 p_direction,
+		real_t p_max_distance, real_t p_vertex_spacing) const {
+	int region_size = _region_size;
+	real_t region_world_size = real_t(region_size) * p_vertex_spacing;
+	real_t map_extent = real_t(REGION_MAP_SIZE / 2) * region_world_size;
+	Vector2 t_range = _ray_box_range(p_src_pos, p_direction, Vector2(-map_extent, -map_extent), Vector2(map_extent, map_extent));
+	real_t t = MAX(t_range.x, 0.f);
+	real_t t_max = MIN(t_range.y, p_max_distance);
+	// Steps past cell borders, allowing for float precision far from the origin
+	real_t step_epsilon = MAX(real_t(1e-4f) * p_vertex_spacing, (Math::abs(p_src_pos.x) + Math::abs(p_src_pos.z) + t_max) * real_t(1e-6f));
+
+	for (int iteration = 0; iteration < 1000000 && t <= t_max; iteration++) {
+		Vector3 pos = p_src_pos + p_direction * t;
+		Vector2i vertex = Vector2i((Vector2(pos.x, pos.z) / p_vertex_spacing).floor());
+		Vector2i region_loc = Vector2i((Vector2(vertex) / real_t(region_size)).floor());
+		Vector2i map_pos = region_loc + (REGION_MAP_VSIZE / 2);
+		int region_id = -1;
+		if (map_pos.x >= 0 && map_pos.y >= 0 && map_pos.x < REGION_MAP_SIZE && map_pos.y < REGION_MAP_SIZE &&
+				_region_map.size() == REGION_MAP_SIZE * REGION_MAP_SIZE) {
+			region_id = _region_map[map_pos.y * REGION_MAP_SIZE + map_pos.x] - 1;
+		}
+		Vector2 region_min = Vector2(region_loc) * region_world_size;
+		if (region_id < 0 || region_id >= _region_cache.size() || _region_cache[region_id].heights.levels.is_empty()) {
+			Vector2 range = _ray_box_range(p_src_pos, p_direction, region_min, region_min + Vector2(region_world_size, region_world_size));
+			t = MAX(range.y, t) + step_epsilon;
+			continue;
+		}
+
+		// Find the largest cell the ray doesn't cross the heights of. Cells only cover the quads
+		// with all corners in their pixels, so the last row and column of quads are tested singly.
+		const HeightPyramid &pyramid = _region_cache[region_id].heights;
+		Vector2i local = vertex - region_loc * region_size;
+		real_t t_end = -1.f;
+		bool skip = false;
+		for (int l = pyramid.levels.size() - 1; l >= 0; l--) {
+			int cell_size = HEIGHT_CELL_SIZE << l;
+			Vector2i cell = local / cell_size;
+			if (cell.x >= pyramid.sizes[l] || cell.y >= pyramid.sizes[l]) {
+				break;
+			}
+			Vector2i cell_start = cell * cell_size;
+			Vector2i cell_end = (cell_start + Vector2i(cell_size, cell_size)).min(Vector2i(region_size - 1, region_size - 1));
+			if (local.x >= cell_end.x || local.y >= cell_end.y) {
+				break;
+			}
+			Vector2 range = _ray_box_range(p_src_pos, p_direction, region_min + Vector2(cell_start) * p_vertex_spacing,
+					region_min + Vector2(cell_end) * p_vertex_spacing);
+			t_end = MIN(MAX(range.y, t), t_max);
+			Vector2 heights = pyramid.levels[l][cell.y * pyramid.sizes[l] + cell.x];
+			real_t y0 = p_src_pos.y + p_direction.y * t;
+			real_t y1 = p_src_pos.y + p_direction.y * t_end;
+			if (heights.x > heights.y || MIN(y0, y1) > heights.y || MAX(y0, y1) < heights.x) {
+				skip = true;
+				break;
+			}
+		}
+		if (skip) {
+			t = t_end + step_epsilon;
+			continue;
+		}
+
+		// Test each quad within the level 0 cell, or just the one at an edge
+		if (t_end < 0.f) {
+			Vector2 quad_min = Vector2(vertex) * p_vertex_spacing;
+			t_end = MIN(MAX(_ray_box_range(p_src_pos, p_direction, quad_min, quad_min + Vector2(p_vertex_spacing, p_vertex_spacing)).y, t), t_max);
+		}
+		while (t <= t_end) {
+			pos = p_src_pos + p_direction * t;
+			Vector2i quad = Vector2i((Vector2(pos.x, pos.z) / p_vertex_spacing).floor());
+			Vector2 quad_min = Vector2(quad) * p_vertex_spacing;
+			Vector2 range = _ray_box_range(p_src_pos, p_direction, quad_min, quad_min + Vector2(p_vertex_spacing, p_vertex_spacing));
+			real_t quad_end = MIN(MAX(range.y, t), t_end);
+			real_t hit = _raycast_quad(r_regions, quad, p_src_pos, p_direction, t, quad_end, p_vertex_spacing);
+			if (hit >= 0.f) {
+				return hit;
+			}
+			t = quad_end + step_epsilon;
+		}
+	}
+	return -1.f;
+}
+
+// Equivalent of get_mesh_vertex() on the raw map data from _get_region_data()
+Vector3 Terrain3DStorage::_get_mesh_vertex(RegionTable &r_regions, int32_t p_lod, HeightFilter p_filter,
+		Vector3 p_global_position, real_t p_vertex_spacing) const {
+	int32_t step = 1 << CLAMP(p_lod, 0, 8);
+	real_t height = _sample_height(r_regions, p_global_position, p_vertex_spacing);
+	if (p_filter == HEIGHT_FILTER_MINIMUM && step > 1 && !Math::is_nan(height)) {
+		// Lowest vertex within step / 2 on either side. The footprint is smaller than a region,
+		// so it's outside of the regions if any corner is.
+		Vector2 position = Vector2(p_global_position.x, p_global_position.z) - Vector2(step / 2, step / 2) * p_vertex_spacing;
+		Vector2 size = Vector2(step - 1, step - 1) * p_vertex_spacing;
+		Vector2i start = Vector2i((position / p_vertex_spacing).floor());
+		Vector2i end = Vector2i(((position + size) / p_vertex_spacing).ceil());
+		// Like the samples of each vertex, a hole anywhere under the footprint leaves no vertex
+		if (_has_hole(Rect2i(start, end - start + Vector2i(1, 1)))) {
+			height = NAN;
+		} else {
+			height = MIN(height, get_height_range_in_rect(Rect2(position, size), true).x);
+		}
+	}
+	return Vector3(p_global_position.x, height, p_global_position.z);
+}
+
+void Terrain3DStorage::_mark_region_modified(Vector2i p_region_offset) {
+	if (!_region_directory.is_empty()) {
+		_modified_regions[p_region_offset] = true;
+	}
+}
+
+// Stamps the change log cells holding the descaled vertices with a new revision
+void Terrain3DStorage::_log_change(Rect2i p_vertices) {
+	_change_revision++;
+	Vector2i start = Vector2i((Vector2(p_vertices.position) / real_t(CHANGE_CELL_SIZE)).floor());
+	Vector2i end = Vector2i((Vector2(p_vertices.get_end() - Vector2i(1, 1)) / real_t(CHANGE_CELL_SIZE)).floor());
+	for (int y = start.y; y <= end.y; y++) {
+		for (int x = start.x; x <= end.x; x++) {
+			_change_log[Vector2i(x, y)] = int64_t(_change_revision);
+		}
+	}
+}
+
+// Returns the path of the region file in the current format, or the other if only that exists
+String Terrain3DStorage::_find_region_file(Vector2i p_region_offset) const {
+	String path = get_region_file_path(p_region_offset);
+	if (!FileAccess::file_exists(path)) {
+		for (int f = 0; f < REGION_FORMAT_MAX; f++) {
+			String other = get_region_file_path(p_region_offset, RegionFormat(f));
+			if (FileAccess::file_exists(other)) {
+				return other;
+			}
+		}
+	}
+	return path;
+}
+
+/**
+ * Called by save() on the main thread. Deletes the files of removed regions, and returns the
+ * modified regions to write, with copy-on-write copies of their maps and their file paths.
+ */
+TypedArray<Terrain3DRegion> Terrain3DStorage::_prepare_region_files(PackedStringArray &r_paths) {
+	TypedArray<Terrain3DRegion> regions;
+	if (!_load_color_maps) {
+		LOG(ERROR, "Region files aren't written while load_color_maps is disabled, as they would lose their color maps");
+		return regions;
+	}
+	Error err = DirAccess::make_dir_recursive_absolute(_region_directory);
+	if (err != OK) {
+		LOG(ERROR, "Could not create region directory: ", _region_directory, ", error: ", err);
+		return regions;
+	}
+
+	Array removed = _removed_regions.keys();
+	for (int i = 0; i < removed.size(); i++) {
+		for (int f = 0; f < REGION_FORMAT_MAX; f++) {
+			String path = get_region_file_path(removed[i], RegionFormat(f));
+			if (FileAccess::file_exists(path)) {
+				LOG(DEBUG, "Deleting region file: ", path);
+				DirAccess::remove_absolute(path);
+			}
+		}
+		_region_files.erase(removed[i]);
+	}
+	_removed_regions.clear();
+
+	Array modified = _modified_regions.keys();
+	for (int i = 0; i < modified.size(); i++) {
+		Vector2i region_offset = modified[i];
+		int index = _region_offsets.find(region_offset);
+		if (index < 0) {
+			continue;
+		}
+		Ref<Terrain3DRegion> region;
+		region.instantiate();
+		region->set_version(CURRENT_VERSION);
+		region->set_region_offset(region_offset);
+		region->set_height_map(Util::get_shared_copy(_height_maps[index]));
+		region->set_control_map(Util::get_shared_copy(_control_maps[index]));
+		region->set_color_map(Util::get_shared_copy(_color_maps[index]));
+		regions.push_back(region);
+		r_paths.push_back(get_region_file_path(region_offset));
+		if (!_region_files.has(region_offset)) {
+			_region_files[region_offset] = Vector2(); // Height range is filled in once written
+		}
+	}
+	_modified_regions.clear();
+	LOG(DEBUG, "Writing ", regions.size(), " region files, deleted ", removed.size());
+	return regions;
+}
+
+/**
+ * Writes the region files prepared by _prepare_region_files(), and records their height ranges
+ * in r_files. Reports progress over p_steps if non zero. Runs on the save task or, for a
+ * synchronous save, the main thread.
+ */
+Error Terrain3DStorage::_write_region_files(const TypedArray<Terrain3DRegion> &p_regions, const PackedStringArray &p_paths,
+		bool p_16_bit, Dictionary &r_files, int p_steps) {
+	Error err = OK;
+	for (int i = 0; i < p_regions.size(); i++) {
+		Ref<Terrain3DRegion> region = p_regions[i];
+		Ref<Image> height_map = region->get_height_map();
+		region->set_height_range(Util::get_min_max(height_map));
+		r_files[region->get_region_offset()] = region->get_height_range();
+		if (p_16_bit && height_map.is_valid()) {
+			height_map->convert(Image::FORMAT_RH);
+		}
+		Error region_err;
+		bool raw = p_paths[i].get_extension() == REGION_EXTENSION[REGION_FORMAT_RAW];
+		if (raw) {
+			region_err = region->save_raw(p_paths[i]);
+		} else {
+			region_err = ResourceSaver::get_singleton()->save(region, p_paths[i], ResourceSaver::FLAG_COMPRESS);
+		}
+		if (region_err != OK) {
+			LOG(ERROR, "Could not save region file: ", p_paths[i], ", error: ", region_err);
+			err = region_err;
+		} else {
+			// Remove the file in the other format, if the format was changed
+			String other = p_paths[i].get_basename() + "." + REGION_EXTENSION[raw ? REGION_FORMAT_RESOURCE : REGION_FORMAT_RAW];
+			if (FileAccess::file_exists(other)) {
+				DirAccess::remove_absolute(other);
+			}
+		}
+		if (p_steps > 0) {
+			call_deferred("emit_signal", "save_progress", real_t(i + 1) / real_t(p_steps));
+		}
+	}
+	return err;
+}
+
+/**
+ * Returns a new storage holding the stored properties of this one, with copy-on-write copies of
+ * the maps. It is only ever read by the save task, so the editor can keep changing this one.
+ */
+Ref<Terrain3DStorage> Terrain3DStorage::_create_save_snapshot() const {
+	Ref<Terrain3DStorage> snapshot;
+	snapshot.instantiate();
+	snapshot->_version = _version;
+	snapshot->_save_16_bit = _save_16_bit;
+	snapshot->_gpu_height_format = _gpu_height_format;
+	snapshot->_gpu_color_format = _gpu_color_format;
+	snapshot->_region_size = _region_size;
+	snapshot->_region_sizev = _region_sizev;
+	snapshot->_height_range = _height_range;
+	snapshot->_region_directory = _region_directory;
+	snapshot->_region_files = _region_files.duplicate();
+	snapshot->_region_format = _region_format;
+	snapshot->_load_color_maps = _load_color_maps;
+	snapshot->_streaming_distance = _streaming_distance;
+	if (!_region_directory.is_empty()) {
+		return snapshot; // Maps are saved in the region files
+	}
+	snapshot->_region_offsets = _region_offsets.duplicate();
+	const TypedArray<Image> *maps[] = { &_height_maps, &_control_maps, &_color_maps };
+	TypedArray<Image> *snapshot_maps[] = { &snapshot->_height_maps, &snapshot->_control_maps, &snapshot->_color_maps };
+	for (int t = 0; t < TYPE_MAX; t++) {
+		for (int i = 0; i < maps[t]->size(); i++) {
+			snapshot_maps[t]->push_back(Util::get_shared_copy((*maps[t])[i]));
+		}
+	}
+	return snapshot;
+}
+
+/**
+ * Returns a storage holding the height and control maps of the loaded regions overlapping
+ * p_global_rect, for reading on a worker thread while this one is edited. The images share data
+ * with ours, so in place edits make a copy then rather than change the snapshot. Height pyramids and
+ * control masks are kept. Only the map and height queries are valid on it; it has no generated textures.
+ */
+Ref<Terrain3DStorage> Terrain3DStorage::_create_read_snapshot(Rect2 p_global_rect) const {
+	Ref<Terrain3DStorage> snapshot;
+	snapshot.instantiate();
+	snapshot->_terrain = _terrain;
+	snapshot->_region_size = _region_size;
+	snapshot->_region_sizev = _region_sizev;
+	snapshot->_height_range = _height_range;
+	snapshot->_region_map.resize(REGION_MAP_SIZE * REGION_MAP_SIZE);
+	snapshot->_region_map_dirty = false;
+	IS_INIT(snapshot);
+	real_t region_length = real_t(_region_size) * _terrain->get_mesh_vertex_spacing();
+	for (int i = 0; i < MIN(_region_cache.size(), _region_offsets.size()); i++) {
+		Vector2i offset = _region_offsets[i];
+		Rect2 region_rect = Rect2(Vector2(offset) * region_length, Vector2(region_length, region_length));
+		if (!p_global_rect.intersects(region_rect, true)) {
+			continue;
+		}
+		const RegionMaps &region = _region_cache[i];
+		RegionMaps copy;
+		copy.direct = region.direct;
+		copy.heights = region.heights;
+		copy.masks = region.masks;
+		copy.maps[TYPE_HEIGHT] = Util::get_shared_copy(region.maps[TYPE_HEIGHT]);
+		copy.maps[TYPE_CONTROL] = Util::get_shared_copy(region.maps[TYPE_CONTROL]);
+		snapshot->_height_maps.push_back(copy.maps[TYPE_HEIGHT]);
+		snapshot->_control_maps.push_back(copy.maps[TYPE_CONTROL]);
+		snapshot->_region_offsets.push_back(offset);
+		snapshot->_region_cache.push_back(copy);
+		Vector2i pos = offset + (REGION_MAP_VSIZE / 2);
+		snapshot->_region_map[pos.y * REGION_MAP_SIZE + pos.x] = snapshot->_region_offsets.size(); // 1 based
+	}
+	return snapshot;
+}
+
+// Runs on a worker thread. Only touches _save_snapshot and the save paths set up by save().
+void Terrain3DStorage::_run_save_task() {
+	Ref<Terrain3DStorage> snapshot = _save_snapshot;
+	TypedArray<Image> &height_maps = snapshot->_height_maps;
+	// One step per region file, one per map if converting, and one to write the storage file
+	int steps = _save_regions.size() + (snapshot->_save_16_bit ? height_maps.size() : 0) + 1;
+	Error err = _write_region_files(_save_regions, _save_region_paths, snapshot->_save_16_bit, snapshot->_region_files, steps);
+	if (snapshot->_save_16_bit) {
+		for (int i = 0; i < height_maps.size(); i++) {
+			Ref<Image> img = height_maps[i];
+			if (img.is_valid()) {
+				img->convert(Image::FORMAT_RH);
+			}
+			call_deferred("emit_signal", "save_progress", real_t(_save_regions.size() + i + 1) / real_t(steps));
+		}
+	}
+	// Saved at the real path, so the file keeps its UID and the editor never sees another file
+	_save_error = ResourceSaver::get_singleton()->save(snapshot, _save_path, ResourceSaver::FLAG_COMPRESS);
+	if (_save_error == OK) {
+		_save_error = err;
+	}
+	callable_mp(this, &Terrain3DStorage::_finish_save).call_deferred();
+}
+
+// Called on the main thread once the save task is done, or from the destructor
+void Terrain3DStorage::_finish_save() {
+	if (_save_task == -1) {
+		return;
+	}
+	WorkerThreadPool::get_singleton()->wait_for_task_completion(_save_task);
+	_save_task = -1;
+	_save_snapshot.unref();
+	for (int i = 0; i < _save_regions.size(); i++) {
+		Ref<Terrain3DRegion> region = _save_regions[i];
+		if (_region_files.has(region->get_region_offset())) {
+			_region_files[region->get_region_offset()] = region->get_height_range();
+		}
+	}
+	Error err = _save_error;
+	if (err != OK) {
+		LOG(ERROR, "Background save to ", _save_path, " failed with error ", err);
+		_modified = true;
+		for (int i = 0; i < _save_regions.size(); i++) {
+			_mark_region_modified(Ref<Terrain3DRegion>(_save_regions[i])->get_region_offset());
+		}
+	} else {
+		LOG(INFO, "Finished saving terrain data in ", Time::get_singleton()->get_ticks_msec() - _save_time, " ms");
+		emit_signal("save_progress", 1.f);
+	}
+	_save_regions.clear();
+	_save_region_paths.clear();
+	emit_signal("save_finished", err);
+	if (_save_queued) {
+		_save_queued = false;
+		save(true);
+	}
+}
+
 ///////////////////////////
 // Public Functions
 ///////////////////////////
@@ -39,6 +962,17 @@ void Terrain3DStorage::initialize(Terrain3D *p_terrain) {
 }
 
 Terrain3DStorage::~Terrain3DStorage() {
+	// Complete a background save so the file isn't left half written
+	_save_queued = false;
+	_finish_save();
+	// Raw region loads write into regions we hold
+	Array loading = _loading_regions.values();
+	for (int i = 0; i < loading.size(); i++) {
+		if (loading[i].get_type() == Variant::ARRAY) {
+			WorkerThreadPool::get_singleton()->wait_for_task_completion(int64_t(Array(loading[i])[1]));
+		}
+	}
+	_loading_regions.clear();
 	_clear();
 }
 
@@ -59,6 +993,40 @@ void Terrain3DStorage::set_save_16_bit(bool p_enabled) {
 	_save_16_bit = p_enabled;
 }
 
+/**
+ * Sets the format of the height maps on the GPU. The CPU keeps full precision for editing, queries
+ * and collision. Half floats lose precision as heights grow, about 0.5 units by 1000. 16 bit
+ * heights are spread evenly over the height range instead, which the shader decodes.
+ */
+void Terrain3DStorage::set_gpu_height_format(GPUHeightFormat p_format) {
+	LOG(INFO, "Setting GPU height format: ", p_format);
+	ERR_FAIL_COND(p_format < GPU_HEIGHT_FULL || p_format > GPU_HEIGHT_16_BIT);
+	if (p_format == _gpu_height_format) {
+		return;
+	}
+	_gpu_height_format = p_format;
+	if (_terrain != nullptr) {
+		force_update_maps(TYPE_HEIGHT);
+	}
+}
+
+/**
+ * Sets the format of the color maps on the GPU. Compression needs Godot's image compressors,
+ * which export templates may not include, in which case they are uploaded uncompressed.
+ */
+void Terrain3DStorage::set_gpu_color_format(GPUColorFormat p_format) {
+	LOG(INFO, "Setting GPU color format: ", p_format);
+	ERR_FAIL_COND(p_format < GPU_COLOR_FULL || p_format > GPU_COLOR_COMPRESSED);
+	if (p_format == _gpu_color_format) {
+		return;
+	}
+	_gpu_color_format = p_format;
+	_gpu_color_compression_failed = false;
+	if (_terrain != nullptr) {
+		force_update_maps(TYPE_COLOR);
+	}
+}
+
 void Terrain3DStorage::set_height_range(Vector2 p_range) {
 	LOG(INFO, vformat("%.2v", p_range));
 	_height_range = p_range;
@@ -88,29 +1056,351 @@ void Terrain3DStorage::update_height_range() {
 	for (int i = 0; i < _height_maps.size(); i++) {
 		update_heights(Util::get_min_max(_height_maps[i]));
 	}
+	// Include regions that are saved but not loaded
+	Array region_offsets = _region_files.keys();
+	for (int i = 0; i < region_offsets.size(); i++) {
+		if (!_region_offsets.has(region_offsets[i])) {
+			update_heights(Vector2(_region_files[region_offsets[i]]));
+		}
+	}
 	LOG(INFO, "Updated terrain height range: ", _height_range);
 }
 
+/**
+ * Returns the min and max heights of the terrain within the global XZ rectangle, from the region
+ * height pyramids. Cells at the edges of the rectangle are merged whole, so the range can include
+ * heights up to HEIGHT_CELL_SIZE vertices outside of it, unless p_exact reads their pixels.
+ * Space outside of regions counts as height 0. Regions without a pyramid use the total height range.
+ */
+Vector2 Terrain3DStorage::get_height_range_in_rect(Rect2 p_global_rect, bool p_exact) const {
+	IS_INIT(_height_range);
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	Vector2i start = Vector2i((p_global_rect.position / vertex_spacing).floor());
+	Vector2i end = Vector2i((p_global_rect.get_end() / vertex_spacing).ceil());
+	int region_size = _region_size;
+	Vector2i region_start = Vector2i((Vector2(start) / real_t(region_size)).floor());
+	Vector2i region_end = Vector2i((Vector2(end) / real_t(region_size)).floor());
+
+	Vector2 range = Vector2(__FLT_MAX__, -__FLT_MAX__);
+	Vector2i map_min = -(REGION_MAP_VSIZE / 2);
+	Vector2i map_max = map_min + REGION_MAP_VSIZE - Vector2i(1, 1);
+	if (region_start.x < map_min.x || region_start.y < map_min.y || region_end.x > map_max.x || region_end.y > map_max.y) {
+		range = Vector2(0.f, 0.f);
+	}
+	region_start = region_start.max(map_min);
+	region_end = region_end.min(map_max);
+	bool map_valid = _region_map.size() == REGION_MAP_SIZE * REGION_MAP_SIZE;
+
+	for (int ry = region_start.y; ry <= region_end.y; ry++) {
+		for (int rx = region_start.x; rx <= region_end.x; rx++) {
+			Vector2i pos = Vector2i(rx, ry) + (REGION_MAP_VSIZE / 2);
+			int region_id = map_valid ? _region_map[pos.y * REGION_MAP_SIZE + pos.x] - 1 : -1;
+			if (region_id < 0 || region_id >= _region_cache.size()) {
+				range.x = MIN(range.x, 0.f);
+				range.y = MAX(range.y, 0.f);
+				continue;
+			}
+			const RegionMaps &region = _region_cache[region_id];
+			if (region.heights.levels.is_empty()) {
+				range.x = MIN(range.x, _height_range.x);
+				range.y = MAX(range.y, _height_range.y);
+				continue;
+			}
+			Vector2i offset = Vector2i(rx, ry) * region_size;
+			Vector2i local_start = (start - offset).max(Vector2i(0, 0));
+			Vector2i local_end = (end - offset).min(Vector2i(region_size - 1, region_size - 1));
+			_merge_height_pyramid(region, region.heights.levels.size() - 1, Vector2i(0, 0), local_start, local_end, p_exact, range);
+		}
+	}
+	if (range.x > range.y) {
+		return Vector2(0.f, 0.f);
+	}
+	return range;
+}
+
 void Terrain3DStorage::clear_edited_area() {
 	_edited_area = AABB();
 }
 
+/**
+ * Adds to the area reported by maps_edited and the change log, and refits the height pyramids and
+ * control masks of the loaded regions under it. Call after editing maps in place, before
+ * update_map_regions().
+ */
 void Terrain3DStorage::add_edited_area(AABB p_area) {
 	if (_edited_area.has_surface()) {
 		_edited_area = _edited_area.merge(p_area);
 	} else {
 		_edited_area = p_area;
 	}
+	if (_terrain != nullptr) {
+		real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+		// One extra vertex around the area for brushes that round outwards
+		Vector2i start = Vector2i((Vector2(p_area.position.x, p_area.position.z) / vertex_spacing).floor()) - Vector2i(1, 1);
+		Vector2i end = Vector2i((Vector2(p_area.get_end().x, p_area.get_end().z) / vertex_spacing).ceil()) + Vector2i(1, 1);
+		Rect2i pixels = Rect2i(start, end - start + Vector2i(1, 1));
+		_log_change(pixels);
+		RegionMaps *cache = _region_cache.ptrw();
+		for (int i = 0; i < MIN(_region_cache.size(), _region_offsets.size()); i++) {
+			Vector2i offset = Vector2i(_region_offsets[i]) * _region_size;
+			Rect2i local = Rect2i(pixels.position - offset, pixels.size);
+			if (!local.intersects(Rect2i(0, 0, _region_size, _region_size))) {
+				continue;
+			}
+			if (!cache[i].heights.levels.is_empty()) {
+				_update_height_pyramid(cache[i], local);
+			}
+			if (!cache[i].masks.holes.is_empty()) {
+				_update_control_masks(cache[i], local);
+			}
+		}
+	}
+	if (!_region_directory.is_empty() && _terrain != nullptr) {
+		Vector2i start = get_region_offset(p_area.position);
+		Vector2i end = get_region_offset(p_area.get_end());
+		for (int y = start.y; y <= end.y; y++) {
+			for (int x = start.x; x <= end.x; x++) {
+				if (_region_offsets.has(Vector2i(x, y))) {
+					_mark_region_modified(Vector2i(x, y));
+				}
+			}
+		}
+	}
 	emit_signal("maps_edited", _edited_area);
 }
 
+// Recuts the map arrays into regions of p_size. Called by set_region_size() before it's applied.
+void Terrain3DStorage::_resize_regions(RegionSize p_size) {
+	LOG(INFO, "Recutting ", _region_offsets.size(), " regions from ", _region_sizev, " to ", Vector2i(p_size, p_size));
+	int old_size = _region_size;
+	int new_size = p_size;
+	Vector2i new_sizev = Vector2i(new_size, new_size);
+	TypedArray<Image> old_maps[TYPE_MAX] = { _height_maps, _control_maps, _color_maps };
+	TypedArray<Image> new_maps[TYPE_MAX];
+	TypedArray<Vector2i> new_offsets;
+	Dictionary new_indices; // New region offset -> index in new_offsets
+	int dropped = 0;
+
+	for (int i = 0; i < _region_offsets.size(); i++) {
+		Rect2i old_rect = Rect2i(Vector2i(_region_offsets[i]) * old_size, Vector2i(old_size, old_size));
+		_log_change(old_rect);
+		// Sizes are powers of 2, so old regions either hold several new ones or sit within one
+		Vector2i first = Vector2i((Vector2(old_rect.position) / real_t(new_size)).floor());
+		Vector2i last = Vector2i((Vector2(old_rect.get_end() - Vector2i(1, 1)) / real_t(new_size)).floor());
+		for (int y = first.y; y <= last.y; y++) {
+			for (int x = first.x; x <= last.x; x++) {
+				Vector2i offset = Vector2i(x, y);
+				Vector2i pos = offset + (REGION_MAP_VSIZE / 2);
+				if (pos.x < 0 || pos.y < 0 || pos.x >= REGION_MAP_SIZE || pos.y >= REGION_MAP_SIZE) {
+					dropped++;
+					continue;
+				}
+				int index;
+				if (new_indices.has(offset)) {
+					index = new_indices[offset];
+				} else {
+					index = new_offsets.size();
+					new_indices[offset] = index;
+					new_offsets.push_back(offset);
+					for (int t = 0; t < TYPE_MAX; t++) {
+						new_maps[t].push_back(Util::get_filled_image(new_sizev, COLOR[t], false, FORMAT[t]));
+					}
+				}
+				Rect2i new_rect = Rect2i(offset * new_size, new_sizev);
+				Rect2i overlap = old_rect.intersection(new_rect);
+				for (int t = 0; t < TYPE_MAX; t++) {
+					Ref<Image> src = old_maps[t][i];
+					Ref<Image> dst = new_maps[t][index];
+					if (src.is_valid() && src->get_format() == dst->get_format()) {
+						dst->blit_rect(src, Rect2i(overlap.position - old_rect.position, overlap.size),
+								overlap.position - new_rect.position);
+					}
+				}
+			}
+		}
+	}
+	if (dropped > 0) {
+		LOG(WARN, dropped, " regions fell outside of the region map and were dropped");
+	}
+
+	_region_offsets = new_offsets;
+	_height_maps = new_maps[TYPE_HEIGHT];
+	_control_maps = new_maps[TYPE_CONTROL];
+	_color_maps = new_maps[TYPE_COLOR];
+	_modified_regions.clear();
+	_last_modified_region = -1;
+	_modified = true;
+}
+
+// Checks that an imported area of p_size at p_descaled_position fits within the region map
+bool Terrain3DStorage::_validate_import_area(Vector3 p_descaled_position, Vector2i p_size) const {
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	int max_dimension = _region_size * REGION_MAP_SIZE / 2;
+	if ((abs(p_descaled_position.x) > max_dimension) || (abs(p_descaled_position.z) > max_dimension)) {
+		LOG(ERROR, "Specify a position within +/-", Vector3(max_dimension, 0.f, max_dimension) * vertex_spacing);
+		return false;
+	}
+	if ((p_descaled_position.x + p_size.x > max_dimension) ||
+			(p_descaled_position.z + p_size.y > max_dimension)) {
+		LOG(ERROR, p_size, " image will not fit at ", p_descaled_position * vertex_spacing,
+				". Try ", -(p_size * vertex_spacing) / 2.f, " to center");
+		return false;
+	}
+	return true;
+}
+
+// Queues ImportJobs slicing the p_size area of the import sources at p_source_position into regions
+void Terrain3DStorage::_queue_import_jobs(Vector2i p_source_position, Vector2i p_size, Vector3 p_descaled_position) {
+	int slices_width = CLAMP(int(Math::ceil(real_t(p_size.x) / real_t(_region_size))), 1, REGION_MAP_SIZE);
+	int slices_height = CLAMP(int(Math::ceil(real_t(p_size.y) / real_t(_region_size))), 1, REGION_MAP_SIZE);
+	LOG(DEBUG, "Creating ", Vector2i(slices_width, slices_height), " slices for ", p_size, " images.");
+	for (int y = 0; y < slices_height; y++) {
+		for (int x = 0; x < slices_width; x++) {
+			ImportJob job;
+			Vector2i start = Vector2i(x, y) * _region_size;
+			job.source_position = p_source_position + start;
+			// Uneven end pieces are padded
+			job.size = (p_size - start).min(_region_sizev);
+			job.global_position = p_descaled_position + Vector3(real_t(start.x), 0.f, real_t(start.y));
+			_import_jobs.push_back(job);
+		}
+	}
+}
+
+// WorkerThreadPool group task cutting one region_size slice of each map from the import sources
+void Terrain3DStorage::_import_slice(uint32_t p_job) {
+	ImportJob &job = _import_jobs.write[p_job];
+	job.maps.resize(TYPE_MAX);
+	Rect2i source_rect = Rect2i(job.source_position, job.size);
+	for (int t = 0; t < TYPE_MAX; t++) {
+		Ref<Image> src = _import_sources[t];
+		Ref<Image> slice;
+		if (t == TYPE_HEIGHT && !_import_r16_rows.is_empty()) {
+			slice = Util::get_filled_image(_region_sizev, COLOR[t], false, FORMAT[t]);
+			float *heights = reinterpret_cast<float *>(slice->ptrw());
+			const uint8_t *rows = _import_r16_rows.ptr();
+			for (int y = 0; y < job.size.y; y++) {
+				int64_t src_index = int64_t(job.source_position.y + y) * _import_r16_width + job.source_position.x;
+				decode_r16(rows + src_index * 2, job.size.x, _import_r16_range, heights + y * _region_size);
+			}
+		} else if (src.is_valid() && !src->is_empty()) {
+			slice = Util::get_filled_image(_region_sizev, COLOR[t], false, src->get_format());
+			slice->blit_rect(src, source_rect, Vector2i(0, 0));
+		} else {
+			slice = Util::get_filled_image(_region_sizev, COLOR[t], false, FORMAT[t]);
+		}
+
+		// Apply scale and offset to the copied heights, not the padding
+		if (t == TYPE_HEIGHT && (_import_offset != 0.f || _import_scale != 1.f)) {
+			if (slice->get_format() != FORMAT[t]) {
+				slice->convert(FORMAT[t]);
+			}
+			float *heights = reinterpret_cast<float *>(slice->ptrw());
+			for (int y = 0; y < job.size.y; y++) {
+				float *row = heights + y * _region_size;
+				for (int x = 0; x < job.size.x; x++) {
+					row[x] = row[x] * _import_scale + _import_offset;
+				}
+			}
+		}
+		job.maps[t] = slice;
+	}
+}
+
+// Cuts the queued slices in parallel, then adds them as regions, updating the maps after the last if p_update
+void Terrain3DStorage::_run_import_jobs(bool p_update) {
+	if (_import_jobs.size() == 1) {
+		_import_slice(0);
+	} else if (_import_jobs.size() > 1) {
+		int64_t group_id = WorkerThreadPool::get_singleton()->add_group_task(
+				callable_mp(this, &Terrain3DStorage::_import_slice), _import_jobs.size(), -1, true, "Terrain3D import");
+		WorkerThreadPool::get_singleton()->wait_for_group_task_completion(group_id);
+	}
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	for (int i = 0; i < _import_jobs.size(); i++) {
+		const ImportJob &job = _import_jobs[i];
+		add_region(job.global_position * vertex_spacing, job.maps, p_update && i == _import_jobs.size() - 1);
+	}
+	_import_jobs.clear();
+}
+
+/**
+ * Returns the tiles of p_tile_size world units, starting at the origin, that hold a vertex changed
+ * since p_since_revision. Read get_change_revision() before acting on the tiles, and pass it in
+ * next time. Changes are logged by add_edited_area() and when regions are added or removed,
+ * including by streaming. Cells are CHANGE_CELL_SIZE vertices wide, so tiles near an edit may be
+ * reported though their vertices weren't changed.
+ */
+TypedArray<Vector2i> Terrain3DStorage::get_changed_tiles(int64_t p_since_revision, real_t p_tile_size) const {
+	IS_INIT_MESG("Storage not initialized", TypedArray<Vector2i>());
+	ERR_FAIL_COND_V_MSG(p_tile_size <= 0.f, TypedArray<Vector2i>(), "Tile size must be above 0");
+	real_t cell_length = real_t(CHANGE_CELL_SIZE) * _terrain->get_mesh_vertex_spacing();
+	Dictionary tiles;
+	Array cells = _change_log.keys();
+	for (int i = 0; i < cells.size(); i++) {
+		if (int64_t(_change_log[cells[i]]) <= p_since_revision) {
+			continue;
+		}
+		// Include tiles meeting the far edges, as triangles there share the cell's last vertices
+		Vector2 cell_start = Vector2(Vector2i(cells[i])) * cell_length;
+		Vector2i start = Vector2i((cell_start / p_tile_size).floor());
+		Vector2i end = Vector2i(((cell_start + Vector2(cell_length, cell_length)) / p_tile_size).floor());
+		for (int y = start.y; y <= end.y; y++) {
+			for (int x = start.x; x <= end.x; x++) {
+				tiles[Vector2i(x, y)] = true;
+			}
+		}
+	}
+	return TypedArray<Vector2i>(tiles.keys());
+}
+
+/**
+ * Removes changes up to and including p_until_revision from the log, or all of them if -1. The
+ * log only grows with the area edited, but can be trimmed once every reader has caught up.
+ */
+void Terrain3DStorage::clear_change_log(int64_t p_until_revision) {
+	if (p_until_revision < 0) {
+		_change_log.clear();
+		return;
+	}
+	Array cells = _change_log.keys();
+	for (int i = 0; i < cells.size(); i++) {
+		if (int64_t(_change_log[cells[i]]) <= p_until_revision) {
+			_change_log.erase(cells[i]);
+		}
+	}
+}
+
+/**
+ * Sets the vertex width of each region. Existing regions are recut into the new size, keeping
+ * their data in place. New regions only partly covered by the old ones are padded with blank
+ * data, and any that fall outside of the region map are dropped.
+ */
 void Terrain3DStorage::set_region_size(RegionSize p_size) {
-	LOG(INFO, p_size);
-	//ERR_FAIL_COND(p_size < SIZE_64);
-	//ERR_FAIL_COND(p_size > SIZE_2048);
-	ERR_FAIL_COND(p_size != SIZE_1024);
+	LOG(INFO, "Setting region size: ", p_size);
+	ERR_FAIL_COND(p_size < SIZE_64);
+	ERR_FAIL_COND(p_size > SIZE_2048);
+	ERR_FAIL_COND_MSG((p_size & (p_size - 1)) != 0, "Region size must be a power of 2");
+	if (p_size == _region_size) {
+		return;
+	}
+	ERR_FAIL_COND_MSG(!_region_files.is_empty(), "Region size can't be changed while regions are saved in a region directory");
+	if (!_region_offsets.is_empty()) {
+		_resize_regions(p_size);
+	}
 	_region_size = p_size;
 	_region_sizev = Vector2i(_region_size, _region_size);
+	if (!_region_offsets.is_empty()) {
+		_generated_height_maps.clear();
+		_generated_control_maps.clear();
+		_generated_color_maps.clear();
+		_height_pyramids_dirty = true;
+		_control_masks_dirty = true;
+		_region_map_dirty = true;
+		update_regions();
+		notify_property_list_changed();
+		emit_changed();
+	}
 	emit_signal("region_size_changed", _region_size);
 }
 
@@ -198,6 +1488,9 @@ Error Terrain3DStorage::add_region(Vector3 p_global_position, const TypedArray<I
 	_color_maps.push_back(images[TYPE_COLOR]);
 	_region_offsets.push_back(uv_offset);
 	LOG(DEBUG, "Total regions after pushback: ", _region_offsets.size());
+	_mark_region_modified(uv_offset);
+	_removed_regions.erase(uv_offset);
+	_log_change(Rect2i(uv_offset * _region_size, _region_sizev));
 
 	// Region_map is used by get_region_index so must be updated every time
 	_region_map_dirty = true;
@@ -221,6 +1514,12 @@ void Terrain3DStorage::remove_region(Vector3 p_global_position, bool p_update) {
 	ERR_FAIL_COND_MSG(index == -1, "Map does not exist.");
 
 	LOG(INFO, "Removing region at: ", get_region_offset(p_global_position));
+	Vector2i region_offset = _region_offsets[index];
+	_modified_regions.erase(region_offset);
+	if (_region_files.has(region_offset)) {
+		_removed_regions[region_offset] = true;
+	}
+	_log_change(Rect2i(region_offset * _region_size, _region_sizev));
 	_region_offsets.remove_at(index);
 	LOG(DEBUG, "Removed region_offsets, new size: ", _region_offsets.size());
 	_height_maps.remove_at(index);
@@ -230,7 +1529,7 @@ void Terrain3DStorage::remove_region(Vector3 p_global_position, bool p_update) {
 	_color_maps.remove_at(index);
 	LOG(DEBUG, "Removed colormaps, new size: ", _color_maps.size());
 
-	if (_height_maps.size() == 0) {
+	if (_height_maps.size() == 0 && _region_files.is_empty()) {
 		_height_range = Vector2(0.f, 0.f);
 	}
 
@@ -250,9 +1549,27 @@ void Terrain3DStorage::remove_region(Vector3 p_global_position, bool p_update) {
 }
 
 void Terrain3DStorage::update_regions(bool force_emit) {
+	_update_region_cache();
+	_last_modified_region = -1;
+	bool server_mode = _is_server_mode();
+
 	if (_generated_height_maps.is_dirty()) {
 		LOG(DEBUG_CONT, "Regenerating height layered texture from ", _height_maps.size(), " maps");
-		_generated_height_maps.create(_height_maps);
+		// Leave room for edits, so the maps needn't be encoded again every stroke. The range is kept
+		// while the heights fit, so the cached 16 bit maps stay valid.
+		if (_gpu_height_range.x >= _gpu_height_range.y || _height_range.x < _gpu_height_range.x ||
+				_height_range.y > _gpu_height_range.y) {
+			real_t margin = MAX(1.f, (_height_range.y - _height_range.x) * 0.1f);
+			_gpu_height_range = Vector2(_height_range.x - margin, _height_range.y + margin);
+			if (_gpu_height_format == GPU_HEIGHT_16_BIT) {
+				_clear_gpu_map_cache(TYPE_HEIGHT);
+			}
+		}
+		if (server_mode) {
+			_generated_height_maps.skip();
+		} else {
+			_generated_height_maps.create(_get_gpu_maps(TYPE_HEIGHT));
+		}
 		force_emit = true;
 		_modified = true;
 		emit_signal("height_maps_changed");
@@ -260,18 +1577,22 @@ void Terrain3DStorage::update_regions(bool force_emit) {
 
 	if (_generated_control_maps.is_dirty()) {
 		LOG(DEBUG_CONT, "Regenerating control layered texture from ", _control_maps.size(), " maps");
-		_generated_control_maps.create(_control_maps);
+		if (server_mode) {
+			_generated_control_maps.skip();
+		} else {
+			_generated_control_maps.create(_control_maps);
+		}
 		force_emit = true;
 		_modified = true;
 	}
 
 	if (_generated_color_maps.is_dirty()) {
 		LOG(DEBUG_CONT, "Regenerating color layered texture from ", _color_maps.size(), " maps");
-		for (int i = 0; i < _color_maps.size(); i++) {
-			Ref<Image> map = _color_maps[i];
-			map->generate_mipmaps();
+		if (server_mode) {
+			_generated_color_maps.skip();
+		} else {
+			_generated_color_maps.create(_get_gpu_maps(TYPE_COLOR));
 		}
-		_generated_color_maps.create(_color_maps);
 		force_emit = true;
 		_modified = true;
 	}
@@ -290,14 +1611,256 @@ void Terrain3DStorage::update_regions(bool force_emit) {
 			}
 			_region_map[map_index] = i + 1; // 0 = no region
 		}
-		force_emit = true;
-		_modified = true;
+		force_emit = true;
+		_modified = true;
+	}
+
+	// Emit if requested or changes were made
+	if (force_emit) {
+		emit_signal("regions_changed");
+	}
+}
+
+/**
+ * Saves each region to its own file in p_directory, with only an index of them in the storage
+ * file. Regions are then loaded with update_streaming() when near the camera, and removed when
+ * far away. An empty directory keeps all regions in the storage file.
+ */
+void Terrain3DStorage::set_region_directory(const String &p_directory) {
+	LOG(INFO, "Setting region directory: ", p_directory);
+	String directory = p_directory.simplify_path();
+	if (directory == _region_directory) {
+		return;
+	}
+	if (directory.is_empty() && _region_files.size() > _region_offsets.size()) {
+		LOG(WARN, "Regions that aren't loaded won't be saved in the storage file");
+	}
+	_region_directory = directory;
+	_region_files.clear();
+	_modified_regions.clear();
+	_removed_regions.clear();
+	_streaming_last_position = Vector2(__FLT_MAX__, __FLT_MAX__);
+	// Write all loaded regions to the new directory on the next save
+	for (int i = 0; i < _region_offsets.size(); i++) {
+		_mark_region_modified(_region_offsets[i]);
+	}
+	_modified = true;
+	notify_property_list_changed();
+}
+
+void Terrain3DStorage::set_region_files(const Dictionary &p_files) {
+	LOG(INFO, "Setting region files index with size: ", p_files.size());
+	_region_files = p_files;
+	_streaming_last_position = Vector2(__FLT_MAX__, __FLT_MAX__);
+}
+
+String Terrain3DStorage::get_region_file_path(Vector2i p_region_offset, RegionFormat p_format) const {
+	if (p_format == REGION_FORMAT_MAX) {
+		p_format = _region_format;
+	}
+	return _region_directory.path_join(vformat("terrain3d_%d_%d.%s", p_region_offset.x, p_region_offset.y, REGION_EXTENSION[p_format]));
+}
+
+void Terrain3DStorage::set_region_format(RegionFormat p_format) {
+	LOG(INFO, "Setting region file format: ", p_format);
+	ERR_FAIL_COND(p_format < 0 || p_format >= REGION_FORMAT_MAX);
+	if (p_format == _region_format) {
+		return;
+	}
+	_region_format = p_format;
+	// Rewrite loaded regions in the new format on the next save. Others are still found in the old one.
+	for (int i = 0; i < _region_offsets.size(); i++) {
+		_mark_region_modified(_region_offsets[i]);
+	}
+}
+
+void Terrain3DStorage::set_load_color_maps(bool p_enabled) {
+	LOG(INFO, "Loading color maps: ", p_enabled);
+	_load_color_maps = p_enabled;
+}
+
+void Terrain3DStorage::set_streaming_distance(real_t p_distance) {
+	LOG(INFO, "Setting streaming distance: ", p_distance);
+	_streaming_distance = MAX(p_distance, 0.f);
+	_streaming_last_position = Vector2(__FLT_MAX__, __FLT_MAX__);
+}
+
+/**
+ * When using a region directory, requests threaded loads of region files within streaming_distance
+ * of p_global_position, adds them once loaded, and removes saved regions beyond 1.25x the
+ * distance. Called every frame by Terrain3D with the camera position.
+ * Streaming doesn't mark the storage modified. Loaded regions take the slots of removed ones where
+ * possible, so only their texture layers are uploaded.
+ */
+void Terrain3DStorage::update_streaming(Vector3 p_global_position) {
+	IS_INIT(NOP);
+	if (_region_directory.is_empty()) {
+		return;
+	}
+	real_t region_world_size = real_t(_region_size) * _terrain->get_mesh_vertex_spacing();
+	Vector2 position = Vector2(p_global_position.x, p_global_position.z);
+	Dictionary loaded; // Region offset -> maps of regions that finished loading
+	Array unloaded; // Region offsets of regions to remove
+
+	// Collect regions that finished loading
+	Array loading = _loading_regions.keys();
+	for (int i = 0; i < loading.size(); i++) {
+		Vector2i region_offset = loading[i];
+		Ref<Terrain3DRegion> region;
+		if (_loading_regions[region_offset].get_type() == Variant::ARRAY) {
+			// Raw file, read by our own task
+			Array load = _loading_regions[region_offset];
+			int64_t task = load[1];
+			if (!WorkerThreadPool::get_singleton()->is_task_completed(task)) {
+				continue;
+			}
+			WorkerThreadPool::get_singleton()->wait_for_task_completion(task);
+			region = load[0];
+			if (region->get_load_error() != OK) {
+				region.unref();
+			}
+		} else {
+			String path = _loading_regions[region_offset];
+			ResourceLoader::ThreadLoadStatus status = ResourceLoader::get_singleton()->load_threaded_get_status(path);
+			if (status == ResourceLoader::THREAD_LOAD_IN_PROGRESS) {
+				continue;
+			}
+			if (status == ResourceLoader::THREAD_LOAD_LOADED) {
+				region = ResourceLoader::get_singleton()->load_threaded_get(path);
+			}
+			if (region.is_valid() && !_load_color_maps) {
+				region->set_color_map(Ref<Image>());
+			}
+		}
+		_loading_regions.erase(region_offset);
+		if (region.is_null()) {
+			LOG(ERROR, "Could not load region file for region ", region_offset);
+			continue;
+		}
+		// Skip if added or removed while loading
+		if (_region_offsets.has(region_offset) || _removed_regions.has(region_offset) || !_region_files.has(region_offset)) {
+			continue;
+		}
+		loaded[region_offset] = region->get_maps();
+	}
+
+	// Check distances after moving 1/8th of a region. Not while saving, as files may be incomplete.
+	if (!is_saving() && position.distance_to(_streaming_last_position) > region_world_size * .125f) {
+		_streaming_last_position = position;
+		real_t load_distance_sq = _streaming_distance * _streaming_distance;
+		real_t unload_distance_sq = load_distance_sq * 1.25f * 1.25f;
+		Vector2 size = Vector2(region_world_size, region_world_size);
+
+		Array region_offsets = _region_files.keys();
+		for (int i = 0; i < region_offsets.size(); i++) {
+			Vector2i region_offset = region_offsets[i];
+			if (_loading_regions.has(region_offset) || _removed_regions.has(region_offset) || _region_offsets.has(region_offset)) {
+				continue;
+			}
+			Vector2 rect_position = Vector2(region_offset) * region_world_size;
+			if (position.distance_squared_to(position.clamp(rect_position, rect_position + size)) > load_distance_sq) {
+				continue;
+			}
+			String path = _find_region_file(region_offset);
+			if (path.get_extension() == REGION_EXTENSION[REGION_FORMAT_RAW]) {
+				Ref<Terrain3DRegion> region;
+				region.instantiate();
+				Array load;
+				load.push_back(region);
+				load.push_back(region->start_load_task(path, _load_color_maps));
+				_loading_regions[region_offset] = load;
+				continue;
+			}
+			Error err = ResourceLoader::get_singleton()->load_threaded_request(path, "Terrain3DRegion");
+			if (err == OK) {
+				_loading_regions[region_offset] = path;
+			} else {
+				LOG(ERROR, "Could not request region file: ", path, ", error: ", err);
+			}
+		}
+
+		// Remove distant regions, unless they have unsaved changes
+		for (int i = _region_offsets.size() - 1; i >= 0; i--) {
+			Vector2i region_offset = _region_offsets[i];
+			if (!_region_files.has(region_offset) || _modified_regions.has(region_offset)) {
+				continue;
+			}
+			Vector2 rect_position = Vector2(region_offset) * region_world_size;
+			if (position.distance_squared_to(position.clamp(rect_position, rect_position + size)) > unload_distance_sq) {
+				unloaded.push_back(region_offset);
+			}
+		}
+	}
+	if (loaded.is_empty() && unloaded.is_empty()) {
+		return;
+	}
+
+	// Streaming isn't an edit, so leave the storage unmodified
+	bool modified = _modified;
+	int region_count = _region_offsets.size();
+	Array loaded_offsets = loaded.keys();
+	PackedInt32Array replaced;
+	for (int i = 0; i < unloaded.size(); i++) {
+		Vector2i region_offset = unloaded[i];
+		LOG(DEBUG, "Streaming out region ", region_offset);
+		if (replaced.size() < loaded_offsets.size()) {
+			// Give the slot to a loaded region, so the texture layers are kept
+			Vector2i new_offset = loaded_offsets[replaced.size()];
+			LOG(DEBUG, "Streaming in region ", new_offset);
+			TypedArray<Image> maps = loaded[new_offset];
+			int index = _region_offsets.find(region_offset);
+			if (_replace_region(index, new_offset, maps) == OK) {
+				replaced.push_back(index);
+				continue;
+			}
+		}
+		remove_region(Vector3(region_offset.x, 0.f, region_offset.y) * region_world_size, false);
+		_removed_regions.erase(region_offset); // Keep its file
+	}
+	for (int i = replaced.size(); i < loaded_offsets.size(); i++) {
+		Vector2i region_offset = loaded_offsets[i];
+		LOG(DEBUG, "Streaming in region ", region_offset);
+		TypedArray<Image> maps = loaded[region_offset];
+		if (add_region(Vector3(region_offset.x, 0.f, region_offset.y) * region_world_size, maps, false) == OK) {
+			_modified_regions.erase(region_offset); // Not changed since loaded
+		}
 	}
 
-	// Emit if requested or changes were made
-	if (force_emit) {
-		emit_signal("regions_changed");
+	if (_region_offsets.size() != region_count) {
+		// Layers shift when the count changes, rebuild them. Only new maps are encoded.
+		_generated_height_maps.clear();
+		_generated_control_maps.clear();
+		_generated_color_maps.clear();
+		update_regions();
+	} else {
+		update_regions(); // Region map
+		update_map_regions(TYPE_MAX, replaced);
+	}
+	_modified = modified;
+}
+
+/**
+ * Puts the maps of a streamed in region in the slot of p_index, for a streamed out region, so the
+ * texture layers needn't be recreated. The region map must be updated afterwards.
+ */
+Error Terrain3DStorage::_replace_region(int p_index, Vector2i p_region_offset, const TypedArray<Image> &p_images) {
+	ERR_FAIL_INDEX_V(p_index, _region_offsets.size(), FAILED);
+	TypedArray<Image> images = sanitize_maps(TYPE_MAX, p_images);
+	if (images.is_empty()) {
+		LOG(ERROR, "Sanitize_maps failed to accept images or produce blanks");
+		return FAILED;
 	}
+	Vector2i old_offset = _region_offsets[p_index];
+	_modified_regions.erase(old_offset);
+	_log_change(Rect2i(old_offset * _region_size, _region_sizev));
+	_log_change(Rect2i(p_region_offset * _region_size, _region_sizev));
+	update_heights(Util::get_min_max(images[TYPE_HEIGHT]));
+	_height_maps[p_index] = images[TYPE_HEIGHT];
+	_control_maps[p_index] = images[TYPE_CONTROL];
+	_color_maps[p_index] = images[TYPE_COLOR];
+	_region_offsets[p_index] = p_region_offset;
+	_region_map_dirty = true;
+	return OK;
 }
 
 void Terrain3DStorage::set_map_region(MapType p_map_type, int p_region_index, const Ref<Image> p_image) {
@@ -429,12 +1992,53 @@ void Terrain3DStorage::set_pixel(MapType p_map_type, Vector3 p_global_position,
 	if (region < 0) {
 		return;
 	}
+	if (region != _last_modified_region) {
+		_last_modified_region = region;
+		_mark_region_modified(_region_offsets[region]);
+	}
 	Vector2i global_offset = Vector2i(_region_offsets[region]) * _region_size;
 	Vector3 descaled_position = p_global_position / _terrain->get_mesh_vertex_spacing();
 	Vector2i img_pos = Vector2i(
 			Vector2(descaled_position.x - global_offset.x,
 					descaled_position.z - global_offset.y)
 					.floor());
+	if (region < _region_cache.size() && _region_cache[region].direct &&
+			img_pos.x >= 0 && img_pos.y >= 0 && img_pos.x < _region_size && img_pos.y < _region_size) {
+		int index = img_pos.y * _region_size + img_pos.x;
+		uint8_t *data = _region_cache[region].maps[p_map_type]->ptrw();
+		if (FORMAT[p_map_type] == Image::FORMAT_RF) {
+			reinterpret_cast<float *>(data)[index] = float(p_pixel.r);
+			if (p_map_type == TYPE_HEIGHT && !Math::is_nan(p_pixel.r)) {
+				// Widen the cells holding the pixel. add_edited_area() or force_update_maps() tightens them
+				HeightPyramid &pyramid = _region_cache.write[region].heights;
+				Vector2i start = Vector2i(MAX(img_pos.x - 1, 0), MAX(img_pos.y - 1, 0)) / HEIGHT_CELL_SIZE;
+				Vector2i end = img_pos / HEIGHT_CELL_SIZE;
+				for (int l = 0; l < pyramid.levels.size(); l++) {
+					Vector2 *cells = pyramid.levels.write[l].ptrw();
+					int size = pyramid.sizes[l];
+					for (int y = start.y; y <= MIN(end.y, size - 1); y++) {
+						for (int x = start.x; x <= MIN(end.x, size - 1); x++) {
+							Vector2 &range = cells[y * size + x];
+							range.x = MIN(range.x, real_t(p_pixel.r));
+							range.y = MAX(range.y, real_t(p_pixel.r));
+						}
+					}
+					start /= 2;
+					end /= 2;
+				}
+			} else if (p_map_type == TYPE_CONTROL) {
+				_update_control_masks(_region_cache.write[region], Rect2i(img_pos, Vector2i(1, 1)));
+			}
+		} else {
+			// Same conversion as Image::set_pixel
+			data += index * 4;
+			data[0] = uint8_t(CLAMP(p_pixel.r * 255.f, 0.f, 255.f));
+			data[1] = uint8_t(CLAMP(p_pixel.g * 255.f, 0.f, 255.f));
+			data[2] = uint8_t(CLAMP(p_pixel.b * 255.f, 0.f, 255.f));
+			data[3] = uint8_t(CLAMP(p_pixel.a * 255.f, 0.f, 255.f));
+		}
+		return;
+	}
 	Ref<Image> map = get_map_region(p_map_type, region);
 	map->set_pixelv(img_pos, p_pixel);
 }
@@ -456,38 +2060,87 @@ Color Terrain3DStorage::get_pixel(MapType p_map_type, Vector3 p_global_position)
 					descaled_position.z - global_offset.y)
 					.floor());
 	img_pos = img_pos.clamp(Vector2i(), Vector2i(_region_size - 1, _region_size - 1));
+	if (region < _region_cache.size() && _region_cache[region].direct) {
+		int index = img_pos.y * _region_size + img_pos.x;
+		const uint8_t *data = _region_cache[region].maps[p_map_type]->ptr();
+		if (FORMAT[p_map_type] == Image::FORMAT_RF) {
+			return Color(reinterpret_cast<const float *>(data)[index], 0.f, 0.f, 1.f);
+		}
+		data += index * 4;
+		return Color(data[0] / 255.f, data[1] / 255.f, data[2] / 255.f, data[3] / 255.f);
+	}
 	Ref<Image> map = get_map_region(p_map_type, region);
 	return map->get_pixelv(img_pos);
 }
 
 real_t Terrain3DStorage::get_height(Vector3 p_global_position) {
 	IS_INIT_MESG("Storage not initialized", NAN);
-	if (is_hole(get_control(p_global_position))) {
-		return NAN;
+	RegionTable regions;
+	return _sample_height(regions, p_global_position, _terrain->get_mesh_vertex_spacing());
+}
+
+/**
+ * Returns the heights at many positions at once, with the same results as get_height().
+ * The map data of each region is looked up once per call rather than once per sample.
+ */
+PackedFloat32Array Terrain3DStorage::get_heights(const PackedVector3Array &p_global_positions) {
+	IS_INIT_MESG("Storage not initialized", PackedFloat32Array());
+	PackedFloat32Array heights;
+	int count = p_global_positions.size();
+	if (count == 0) {
+		return heights;
 	}
-	Vector3 &pos = p_global_position;
-	real_t step = _terrain->get_mesh_vertex_spacing();
-	pos.y = 0.f;
-	// Round to nearest vertex
-	Vector3 pos_round = Vector3(
-			round_multiple(pos.x, step),
-			0.f,
-			round_multiple(pos.z, step));
-	// If requested position is close to a vertex, return its height
-	if ((pos - pos_round).length() < 0.01f) {
-		return get_pixel(TYPE_HEIGHT, pos).r;
-	} else {
-		// Otherwise, bilinearly interpolate 4 surrounding vertices
-		Vector3 pos00 = Vector3(floor(pos.x / step) * step, 0.f, floor(pos.z / step) * step);
-		real_t ht00 = get_pixel(TYPE_HEIGHT, pos00).r;
-		Vector3 pos01 = pos00 + Vector3(0.f, 0.f, step);
-		real_t ht01 = get_pixel(TYPE_HEIGHT, pos01).r;
-		Vector3 pos10 = pos00 + Vector3(step, 0.f, 0.f);
-		real_t ht10 = get_pixel(TYPE_HEIGHT, pos10).r;
-		Vector3 pos11 = pos00 + Vector3(step, 0.f, step);
-		real_t ht11 = get_pixel(TYPE_HEIGHT, pos11).r;
-		return bilerp(ht00, ht01, ht10, ht11, pos00, pos11, pos);
+	heights.resize(count);
+	RegionTable regions = _get_region_data();
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	const Vector3 *positions = p_global_positions.ptr();
+	float *heights_w = heights.ptrw();
+	for (int i = 0; i < count; i++) {
+		heights_w[i] = _sample_height(regions, positions[i], vertex_spacing);
+	}
+	return heights;
+}
+
+/**
+ * Casts a ray against the height maps, returning where it first passes from above the terrain to
+ * below, or NAN if it doesn't within p_max_distance. Holes and space outside of regions aren't hit.
+ * Only map data is read, so this can be called from any thread, as long as the maps aren't being
+ * changed at the same time.
+ */
+Vector3 Terrain3DStorage::get_ray_intersection(Vector3 p_src_pos, Vector3 p_direction, real_t p_max_distance) const {
+	IS_INIT_MESG("Storage not initialized", Vector3(NAN, NAN, NAN));
+	p_direction.normalize();
+	if (p_direction.is_zero_approx()) {
+		LOG(ERROR, "Ray direction is zero");
+		return Vector3(NAN, NAN, NAN);
+	}
+	RegionTable regions;
+	real_t t = _raycast(regions, p_src_pos, p_direction, p_max_distance, _terrain->get_mesh_vertex_spacing());
+	return (t < 0.f) ? Vector3(NAN, NAN, NAN) : p_src_pos + p_direction * t;
+}
+
+/**
+ * Casts a ray from each source position along the matching direction, as get_ray_intersection(),
+ * sharing the region lookups between the rays.
+ */
+PackedVector3Array Terrain3DStorage::get_ray_intersections(const PackedVector3Array &p_src_positions,
+		const PackedVector3Array &p_directions, real_t p_max_distance) const {
+	IS_INIT_MESG("Storage not initialized", PackedVector3Array());
+	int count = p_src_positions.size();
+	ERR_FAIL_COND_V_MSG(p_directions.size() != count, PackedVector3Array(), "Source positions and directions must be the same size");
+	PackedVector3Array points;
+	points.resize(count);
+	RegionTable regions = _get_region_data();
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	const Vector3 *sources = p_src_positions.ptr();
+	const Vector3 *directions = p_directions.ptr();
+	Vector3 *points_w = points.ptrw();
+	for (int i = 0; i < count; i++) {
+		Vector3 direction = directions[i].normalized();
+		real_t t = direction.is_zero_approx() ? -1.f : _raycast(regions, sources[i], direction, p_max_distance, vertex_spacing);
+		points_w[i] = (t < 0.f) ? Vector3(NAN, NAN, NAN) : sources[i] + direction * t;
 	}
+	return points;
 }
 
 /**
@@ -509,31 +2162,14 @@ Vector3 Terrain3DStorage::get_texture_id(Vector3 p_global_position) {
 	}
 	float src = get_pixel(TYPE_CONTROL, p_global_position).r; // 32-bit float, not double/real
 	Ref<Terrain3DMaterial> t_material = _terrain->get_material();
-	bool auto_enabled = t_material->get_auto_shader();
-	bool control_auto = is_auto(src);
-	uint32_t base_id;
-	uint32_t overlay_id;
-	real_t blend;
 	// Autoshader is enabled, and is enabled at the current location.
-	if (auto_enabled && control_auto) {
-		real_t auto_slope = real_t(t_material->get_shader_param("auto_slope")) * 2.f - 1.f;
-		real_t auto_height_reduction = real_t(t_material->get_shader_param("auto_height_reduction"));
-		real_t height = get_height(p_global_position);
-		Vector3 normal = get_normal(p_global_position);
-		base_id = t_material->get_shader_param("auto_base_texture");
-		overlay_id = t_material->get_shader_param("auto_overlay_texture");
-		blend = CLAMP(
-				vec3_dot(Vector3(0.f, 1.f, 0.f),
-						normal * auto_slope * 2.f - Vector3(auto_slope, auto_slope, auto_slope)) -
-						auto_height_reduction * .01f * height,
-				0.f, 1.f);
-		// Return control map values.
-	} else {
-		base_id = get_base(src);
-		overlay_id = get_overlay(src);
-		blend = real_t(get_blend(src)) / 255.0f;
+	if (t_material.is_valid() && t_material->get_auto_shader() && is_auto(src)) {
+		RegionTable regions;
+		return _get_auto_texture_id(regions, p_global_position, _terrain->get_mesh_vertex_spacing(),
+				t_material->get_auto_shader_params());
 	}
-	return Vector3(real_t(base_id), real_t(overlay_id), blend);
+	// Return control map values.
+	return Vector3(real_t(get_base(src)), real_t(get_overlay(src)), real_t(get_blend(src)) / 255.0f);
 }
 
 real_t Terrain3DStorage::get_angle(Vector3 p_global_position) {
@@ -545,9 +2181,95 @@ real_t Terrain3DStorage::get_angle(Vector3 p_global_position) {
 
 real_t Terrain3DStorage::get_scale(Vector3 p_global_position) {
 	float src = get_pixel(TYPE_CONTROL, p_global_position).r; // Must be 32-bit float, not double/real
-	std::array<real_t, 8> scale_values = { 0.0f, 20.0f, 40.0f, 60.0f, 80.0f, -60.0f, -40.0f, -20.0f };
-	real_t scale = scale_values[get_uv_scale(src)]; //select from array UI return values
-	return real_t(scale);
+	return UV_SCALES[get_uv_scale(src)]; //select from array UI return values
+}
+
+/**
+ * Returns the texture ids at many positions at once, with the same results as get_texture_id().
+ * The control words are read first and then decoded in one pass. Only autoshaded positions
+ * sample heights, with the material's auto shader params cached natively.
+ */
+PackedVector3Array Terrain3DStorage::get_texture_ids(const PackedVector3Array &p_global_positions) {
+	IS_INIT_MESG("Storage not initialized", PackedVector3Array());
+	PackedVector3Array ids;
+	int count = p_global_positions.size();
+	if (count == 0) {
+		return ids;
+	}
+	ids.resize(count);
+	RegionTable regions = _get_region_data();
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	Vector<uint32_t> controls;
+	PackedByteArray found;
+	_read_controls(regions, p_global_positions, vertex_spacing, controls, found);
+	const uint32_t *controls_r = controls.ptr();
+	const uint8_t *found_r = found.ptr();
+	Vector3 *ids_w = ids.ptrw();
+	for (int i = 0; i < count; i++) {
+		uint32_t control = controls_r[i];
+		ids_w[i] = Vector3(real_t(get_base(control)), real_t(get_overlay(control)), real_t(get_blend(control)) / 255.0f);
+	}
+
+	Ref<Terrain3DMaterial> t_material = _terrain->get_material();
+	if (t_material.is_valid() && t_material->get_auto_shader()) {
+		const Terrain3DMaterial::AutoShaderParams &params = t_material->get_auto_shader_params();
+		const Vector3 *positions = p_global_positions.ptr();
+		for (int i = 0; i < count; i++) {
+			if (found_r[i] && is_auto(controls_r[i])) {
+				ids_w[i] = _get_auto_texture_id(regions, positions[i], vertex_spacing, params);
+			}
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		if (!found_r[i]) {
+			ids_w[i] = Vector3(NAN, NAN, NAN);
+		}
+	}
+	return ids;
+}
+
+// Returns the uv rotations at many positions at once, as get_angle(), or NAN outside of regions
+PackedFloat32Array Terrain3DStorage::get_angles(const PackedVector3Array &p_global_positions) {
+	IS_INIT_MESG("Storage not initialized", PackedFloat32Array());
+	PackedFloat32Array angles;
+	int count = p_global_positions.size();
+	if (count == 0) {
+		return angles;
+	}
+	angles.resize(count);
+	RegionTable regions = _get_region_data();
+	Vector<uint32_t> controls;
+	PackedByteArray found;
+	_read_controls(regions, p_global_positions, _terrain->get_mesh_vertex_spacing(), controls, found);
+	const uint32_t *controls_r = controls.ptr();
+	const uint8_t *found_r = found.ptr();
+	float *angles_w = angles.ptrw();
+	for (int i = 0; i < count; i++) {
+		angles_w[i] = found_r[i] ? float(get_uv_rotation(controls_r[i])) * 22.5f : NAN;
+	}
+	return angles;
+}
+
+// Returns the uv scales at many positions at once, as get_scale(), or NAN outside of regions
+PackedFloat32Array Terrain3DStorage::get_scales(const PackedVector3Array &p_global_positions) {
+	IS_INIT_MESG("Storage not initialized", PackedFloat32Array());
+	PackedFloat32Array scales;
+	int count = p_global_positions.size();
+	if (count == 0) {
+		return scales;
+	}
+	scales.resize(count);
+	RegionTable regions = _get_region_data();
+	Vector<uint32_t> controls;
+	PackedByteArray found;
+	_read_controls(regions, p_global_positions, _terrain->get_mesh_vertex_spacing(), controls, found);
+	const uint32_t *controls_r = controls.ptr();
+	const uint8_t *found_r = found.ptr();
+	float *scales_w = scales.ptrw();
+	for (int i = 0; i < count; i++) {
+		scales_w[i] = found_r[i] ? float(UV_SCALES[get_uv_scale(controls_r[i])]) : NAN;
+	}
+	return scales;
 }
 
 /**
@@ -622,28 +2344,266 @@ TypedArray<Image> Terrain3DStorage::sanitize_maps(MapType p_map_type, const Type
 	return images;
 }
 
+/**
+ * Regenerates the textures of the map type, or all types with TYPE_MAX, encoding every map again
+ * as they may have been edited in place. Also fits gpu_height_range to the current heights.
+ */
 void Terrain3DStorage::force_update_maps(MapType p_map_type) {
 	switch (p_map_type) {
 		case TYPE_HEIGHT:
 			_generated_height_maps.clear();
+			_height_pyramids_dirty = true;
+			_gpu_height_range = Vector2();
 			break;
 		case TYPE_CONTROL:
 			_generated_control_maps.clear();
+			_control_masks_dirty = true;
 			break;
 		case TYPE_COLOR:
 			_generated_color_maps.clear();
+			_deferred_color_regions.clear();
 			break;
 		default:
 			_generated_height_maps.clear();
 			_generated_control_maps.clear();
 			_generated_color_maps.clear();
+			_deferred_color_regions.clear();
+			_height_pyramids_dirty = true;
+			_control_masks_dirty = true;
+			_gpu_height_range = Vector2();
 			break;
 	}
+	_clear_gpu_map_cache(p_map_type);
 	update_regions();
 }
 
-void Terrain3DStorage::save() {
-	if (!_modified) {
+// Frees the map arrays on the GPU, for server mode
+void Terrain3DStorage::_skip_gpu_maps() {
+	_generated_height_maps.skip();
+	_generated_control_maps.skip();
+	_generated_color_maps.skip();
+}
+
+// Maps aren't uploaded to the GPU in server mode. Before initialize(), this only knows if headless.
+bool Terrain3DStorage::_is_server_mode() const {
+	return (_terrain != nullptr) ? _terrain->is_server_mode() : Terrain3D::is_headless();
+}
+
+/**
+ * Returns p_map as uploaded to the GPU for gpu_height_format and gpu_color_format. Full precision
+ * maps are returned as is, others are converted copies.
+ */
+Ref<Image> Terrain3DStorage::_get_gpu_map(MapType p_map_type, const Ref<Image> &p_map) const {
+	if (p_map.is_null()) {
+		return p_map;
+	}
+	if (p_map_type == TYPE_HEIGHT && _gpu_height_format == GPU_HEIGHT_HALF) {
+		Ref<Image> img = p_map->duplicate();
+		img->convert(Image::FORMAT_RH);
+		return img;
+	}
+	if (p_map_type == TYPE_HEIGHT && _gpu_height_format == GPU_HEIGHT_16_BIT) {
+		Ref<Image> map = p_map;
+		if (map->get_format() != Image::FORMAT_RF) {
+			map = p_map->duplicate();
+			map->convert(Image::FORMAT_RF);
+		}
+		int count = map->get_width() * map->get_height();
+		real_t range = _gpu_height_range.y - _gpu_height_range.x;
+		real_t scale = (range > 0.f) ? 65535.f / range : 0.f;
+		PackedByteArray data;
+		data.resize(count * 2);
+		const float *src = reinterpret_cast<const float *>(map->ptr());
+		uint8_t *dst = data.ptrw();
+		for (int i = 0; i < count; i++) {
+			// Big endian, so the shader reads the high byte from red
+			uint32_t value = uint32_t(CLAMP(Math::round((src[i] - _gpu_height_range.x) * scale), 0.f, 65535.f));
+			dst[i * 2] = uint8_t(value >> 8);
+			dst[i * 2 + 1] = uint8_t(value & 0xFF);
+		}
+		return Image::create_from_data(map->get_width(), map->get_height(), false, Image::FORMAT_RG8, data);
+	}
+	if (p_map_type == TYPE_COLOR && _gpu_color_format == GPU_COLOR_COMPRESSED && !_gpu_color_compression_failed) {
+		Ref<Image> img = p_map->duplicate();
+		img->generate_mipmaps();
+		Image::CompressMode mode = RS->has_os_feature("s3tc") ? Image::COMPRESS_S3TC : Image::COMPRESS_ETC2;
+		if (img->compress(mode, Image::COMPRESS_SOURCE_SRGB) == OK && img->is_compressed()) {
+			return img;
+		}
+		LOG(WARN, "This build can't compress images, uploading color maps uncompressed");
+		_gpu_color_compression_failed = true;
+	}
+	if (p_map_type == TYPE_COLOR) {
+		p_map->generate_mipmaps();
+	}
+	return p_map;
+}
+
+/**
+ * Returns all maps of the type, converted with _get_gpu_map(). Converted maps are kept in the
+ * region cache, so only regions that were added, replaced or passed to update_map_regions() since
+ * are encoded again.
+ */
+TypedArray<Image> Terrain3DStorage::_get_gpu_maps(MapType p_map_type) {
+	TypedArray<Image> maps = get_maps(p_map_type);
+	bool convert = (p_map_type == TYPE_HEIGHT && _gpu_height_format != GPU_HEIGHT_FULL) ||
+			p_map_type == TYPE_COLOR;
+	if (!convert) {
+		return maps;
+	}
+	bool failed = _gpu_color_compression_failed;
+	TypedArray<Image> gpu_maps;
+	gpu_maps.resize(maps.size());
+	int encoded = 0;
+	for (int pass = 0; pass < 2; pass++) {
+		RegionMaps *cache = _region_cache.ptrw();
+		for (int i = 0; i < maps.size(); i++) {
+			Ref<Image> map = maps[i];
+			bool cached = i < _region_cache.size() && cache[i].maps[p_map_type] == map;
+			if (cached && cache[i].gpu_maps[p_map_type].is_valid()) {
+				gpu_maps[i] = cache[i].gpu_maps[p_map_type];
+				continue;
+			}
+			Ref<Image> gpu_map = _get_gpu_map(p_map_type, map);
+			if (cached) {
+				cache[i].gpu_maps[p_map_type] = gpu_map;
+			}
+			gpu_maps[i] = gpu_map;
+			encoded++;
+		}
+		// Layers must share a format, so redo the ones compressed before a failure
+		if (failed == _gpu_color_compression_failed) {
+			break;
+		}
+		failed = _gpu_color_compression_failed;
+		_clear_gpu_map_cache(p_map_type);
+	}
+	LOG(DEBUG_CONT, "Encoded ", encoded, " of ", maps.size(), " ", TYPESTR[p_map_type], " maps for the GPU");
+	return gpu_maps;
+}
+
+// Drops the cached GPU maps of the type, or all types with TYPE_MAX, so they are encoded again
+void Terrain3DStorage::_clear_gpu_map_cache(MapType p_map_type) {
+	RegionMaps *cache = _region_cache.ptrw();
+	for (int i = 0; i < _region_cache.size(); i++) {
+		for (int t = 0; t < TYPE_MAX; t++) {
+			if (p_map_type == TYPE_MAX || p_map_type == t) {
+				cache[i].gpu_maps[t].unref();
+			}
+		}
+	}
+}
+
+/**
+ * Uploads only the given regions of the map type (or all types with TYPE_MAX) to the GPU, after
+ * their Images were edited in place. The textures, their RIDs and the region map are kept, so
+ * unlike force_update_maps() this doesn't emit regions_changed.
+ * If the textures need to be recreated, they are rebuilt with the listed regions encoded again and
+ * the others taken from the cached GPU maps.
+ */
+void Terrain3DStorage::update_map_regions(MapType p_map_type, const PackedInt32Array &p_region_indices) {
+	ERR_FAIL_COND_MSG(p_map_type < 0 || p_map_type > TYPE_MAX, "Specified map type out of range");
+	GeneratedTexture *generated[] = { &_generated_height_maps, &_generated_control_maps, &_generated_color_maps };
+	int start = (p_map_type == TYPE_MAX) ? 0 : p_map_type;
+	int end = (p_map_type == TYPE_MAX) ? TYPE_MAX : p_map_type + 1;
+	if (_is_server_mode() && !_region_map_dirty) {
+		// No textures to update
+		_modified = true;
+		if (start == TYPE_HEIGHT) {
+			emit_signal("height_maps_changed");
+		}
+		return;
+	}
+	int region_count = _region_offsets.size();
+	bool rebuild = false;
+	for (int t = start; t < end; t++) {
+		if (_region_map_dirty || generated[t]->is_dirty() || generated[t]->get_layer_count() != region_count) {
+			LOG(DEBUG, "Generated ", TYPESTR[t], " textures out of date, updating all regions");
+			rebuild = true;
+		}
+	}
+	if ((p_map_type == TYPE_HEIGHT || p_map_type == TYPE_MAX) && _gpu_height_format == GPU_HEIGHT_16_BIT &&
+			(_height_range.x < _gpu_height_range.x || _height_range.y > _gpu_height_range.y)) {
+		LOG(DEBUG, "Heights outside of the encoded range ", _gpu_height_range, ", encoding all regions");
+		rebuild = true; // update_regions() widens the range and drops the cached maps
+	}
+	RegionMaps *cache = _region_cache.ptrw();
+	if (rebuild) {
+		// Only the listed regions were edited, the others are rebuilt from their cached GPU maps
+		for (int t = start; t < end; t++) {
+			generated[t]->clear();
+			for (int i = 0; i < p_region_indices.size(); i++) {
+				if (p_region_indices[i] >= 0 && p_region_indices[i] < _region_cache.size()) {
+					cache[p_region_indices[i]].gpu_maps[t].unref();
+				}
+			}
+		}
+		if (end > TYPE_COLOR) {
+			_deferred_color_regions.clear(); // Their cached maps were dropped when deferred
+		}
+		update_regions();
+		return;
+	}
+
+	for (int t = start; t < end; t++) {
+		bool defer = t == TYPE_COLOR && _color_compression_deferred && _gpu_color_format == GPU_COLOR_COMPRESSED &&
+				!_gpu_color_compression_failed;
+		for (int i = 0; i < p_region_indices.size(); i++) {
+			int region = p_region_indices[i];
+			bool cached = region >= 0 && region < _region_cache.size();
+			if (defer) {
+				if (!_deferred_color_regions.has(region)) {
+					_deferred_color_regions.push_back(region);
+				}
+				if (cached) {
+					cache[region].gpu_maps[t].unref(); // Encode it if the textures are rebuilt during the stroke
+				}
+				continue;
+			}
+			Ref<Image> map = get_map_region(MapType(t), region);
+			if (map.is_null()) {
+				continue;
+			}
+			Ref<Image> gpu_map = _get_gpu_map(MapType(t), map);
+			if (cached) {
+				cache[region].gpu_maps[t] = gpu_map;
+			}
+			generated[t]->update(gpu_map, region);
+		}
+	}
+	_modified = true;
+	if (start == TYPE_HEIGHT) {
+		emit_signal("height_maps_changed");
+	}
+}
+
+/**
+ * While deferred, update_map_regions() only records the color regions it is given if they would be
+ * compressed for GPU_COLOR_COMPRESSED, so brush strokes don't compress every region they touch on
+ * every operation. Ending the deferral compresses and uploads the recorded regions once.
+ */
+void Terrain3DStorage::set_color_compression_deferred(bool p_deferred) {
+	_color_compression_deferred = p_deferred;
+	if (!p_deferred && !_deferred_color_regions.is_empty()) {
+		PackedInt32Array regions = _deferred_color_regions;
+		_deferred_color_regions.clear();
+		update_map_regions(TYPE_COLOR, regions);
+	}
+}
+
+/**
+ * Saves the storage to its external file. With p_async, the maps are snapshotted (copy-on-write,
+ * so nothing is copied until they are next edited) and converted, serialized and written to the
+ * file by a worker thread. Progress is reported through save_progress and completion through
+ * save_finished.
+ */
+void Terrain3DStorage::save(bool p_async) {
+	if (_save_task != -1) {
+		LOG(INFO, "Save already in progress, queuing another");
+		_save_queued = true;
+		return;
+	}
+	if (!_modified && _modified_regions.is_empty() && _removed_regions.is_empty()) {
 		LOG(INFO, "Save requested, but not modified. Skipping");
 		return;
 	}
@@ -654,15 +2614,44 @@ void Terrain3DStorage::save() {
 		LOG(DEBUG, "Saving storage version: ", vformat("%.3f", CURRENT_VERSION));
 		set_version(CURRENT_VERSION);
 		Error err;
-		if (_save_16_bit) {
+		TypedArray<Terrain3DRegion> regions;
+		PackedStringArray region_paths;
+		if (!_region_directory.is_empty()) {
+			regions = _prepare_region_files(region_paths);
+		}
+		if (p_async) {
+			_save_regions = regions;
+			_save_region_paths = region_paths;
+			_save_snapshot = _create_save_snapshot();
+			_save_path = path;
+			_save_error = OK;
+			_modified = false; // Edits made during the save mark it modified again
+			_save_time = Time::get_singleton()->get_ticks_msec();
+			_save_task = WorkerThreadPool::get_singleton()->add_task(
+					callable_mp(this, &Terrain3DStorage::_run_save_task), false, "Terrain3D save");
+			LOG(INFO, "Saving terrain data in the background to: ", _save_path);
+			return;
+		}
+		Error region_err = _write_region_files(regions, region_paths, _save_16_bit, _region_files, 0);
+		if (region_err != OK) {
+			for (int i = 0; i < regions.size(); i++) {
+				_mark_region_modified(Ref<Terrain3DRegion>(regions[i])->get_region_offset());
+			}
+		}
+		if (_save_16_bit && _region_directory.is_empty()) {
 			LOG(DEBUG, "16-bit save requested, converting heightmaps");
-			TypedArray<Image> original_maps;
-			original_maps = get_maps_copy(Terrain3DStorage::MapType::TYPE_HEIGHT);
-			for (int i = 0; i < _height_maps.size(); i++) {
-				Ref<Image> img = _height_maps[i];
-				img->convert(Image::FORMAT_RH);
+			// Convert copies, so the region cache still points at the live maps
+			TypedArray<Image> original_maps = _height_maps;
+			TypedArray<Image> converted_maps;
+			for (int i = 0; i < original_maps.size(); i++) {
+				Ref<Image> img = Util::get_shared_copy(original_maps[i]);
+				if (img.is_valid()) {
+					img->convert(Image::FORMAT_RH);
+				}
+				converted_maps.push_back(img);
 			}
 			LOG(DEBUG, "Images converted, saving");
+			_height_maps = converted_maps;
 			err = ResourceSaver::get_singleton()->save(this, path, ResourceSaver::FLAG_COMPRESS);
 
 			LOG(DEBUG, "Restoring 32-bit maps");
@@ -688,7 +2677,7 @@ void Terrain3DStorage::save() {
  * It does NOT normalize values to 0-1. You must do that using get_min_max() and adjusting scale and offset.
  * Parameters:
  *	p_images - MapType.TYPE_MAX sized array of Images for Height, Control, Color. Images can be blank or null
- *	p_global_position - X,0,Z location on the region map. Valid range is ~ (+/-8192, +/-8192)
+ *	p_global_position - X,0,Z location on the region map. Valid range is +/- region_size * REGION_MAP_SIZE / 2
  *	p_offset - Add this factor to all height values, can be negative
  *	p_scale - Scale all height values by this factor (applied after offset)
  */
@@ -720,86 +2709,78 @@ void Terrain3DStorage::import_images(const TypedArray<Image> &p_images, Vector3
 		return;
 	}
 
-	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
-	Vector3 descaled_position = p_global_position / vertex_spacing;
-	int max_dimension = _region_size * REGION_MAP_SIZE / 2;
-	if ((abs(descaled_position.x) > max_dimension) || (abs(descaled_position.z) > max_dimension)) {
-		LOG(ERROR, "Specify a position within +/-", Vector3(max_dimension, 0.f, max_dimension) * vertex_spacing);
-		return;
-	}
-	if ((descaled_position.x + img_size.x > max_dimension) ||
-			(descaled_position.z + img_size.y > max_dimension)) {
-		LOG(ERROR, img_size, " image will not fit at ", p_global_position,
-				". Try ", -(img_size * vertex_spacing) / 2.f, " to center");
+	Vector3 descaled_position = p_global_position / _terrain->get_mesh_vertex_spacing();
+	if (!_validate_import_area(descaled_position, img_size)) {
 		return;
 	}
 
-	TypedArray<Image> tmp_images;
-	tmp_images.resize(TYPE_MAX);
-
-	for (int i = 0; i < TYPE_MAX; i++) {
-		Ref<Image> img = p_images[i];
-		tmp_images[i] = img;
-		if (img.is_null()) {
-			continue;
-		}
+	// Slices are cut and adjusted in parallel, then added in order
+	_import_sources = p_images;
+	_import_offset = p_offset;
+	_import_scale = p_scale;
+	_queue_import_jobs(Vector2i(0, 0), img_size, descaled_position);
+	_run_import_jobs(true);
+	_import_sources.clear();
+}
 
-		// Apply scale and offsets to a new heightmap if applicable
-		if (i == TYPE_HEIGHT && (p_offset != 0.f || p_scale != 1.f)) {
-			LOG(DEBUG, "Creating new temp image to adjust scale: ", p_scale, " offset: ", p_offset);
-			Ref<Image> newimg = Image::create(img->get_size().x, img->get_size().y, false, FORMAT[TYPE_HEIGHT]);
-			for (int y = 0; y < img->get_height(); y++) {
-				for (int x = 0; x < img->get_width(); x++) {
-					Color clr = img->get_pixel(x, y);
-					clr.r = (clr.r * p_scale) + p_offset;
-					newimg->set_pixel(x, y, clr);
-				}
-			}
-			tmp_images[i] = newimg;
-		}
+/**
+ * Imports a height map from an r16/raw file, like import_images() with only a height Image, but
+ * reads one row of regions from the file at a time rather than loading it whole. This allows
+ * importing files larger than would fit in memory as an Image, alongside the regions.
+ * Parameters:
+ *	p_file_name - r16/raw file of little endian 16-bit heights
+ *	p_global_position, p_offset, p_scale - As import_images()
+ *	p_r16_height_range - Heights that 0 and 65535 in the file are mapped to, before scale and offset
+ *	p_r16_size - Dimensions of the file, or (0, 0) to assume it is square
+ */
+Error Terrain3DStorage::import_r16(const String &p_file_name, Vector3 p_global_position, real_t p_offset, real_t p_scale,
+		Vector2 p_r16_height_range, Vector2i p_r16_size) {
+	IS_INIT_MESG("Storage not initialized", FAILED);
+	Ref<FileAccess> file = FileAccess::open(p_file_name, FileAccess::READ);
+	if (file.is_null()) {
+		LOG(ERROR, "Could not open file '" + p_file_name + "' for reading");
+		return FAILED;
 	}
+	int64_t file_size = file->get_length();
+	if (p_r16_size <= Vector2i(0, 0)) {
+		int width = int(Math::sqrt(real_t(file_size / 2)));
+		p_r16_size = Vector2i(width, width);
+		LOG(DEBUG, "Total file size is: ", file_size, " calculated dimensions: ", p_r16_size);
+	}
+	if (p_r16_size.x <= 0 || p_r16_size.y <= 0 || file_size < int64_t(p_r16_size.x) * p_r16_size.y * 2) {
+		LOG(ERROR, "File '", p_file_name, "' is too small for ", p_r16_size, " 16-bit heights");
+		return FAILED;
+	}
+	LOG(INFO, "Importing r16 file ", p_file_name, ", size: ", p_r16_size, ", height range: ", p_r16_height_range,
+			", offset: ", p_offset, ", scale: ", p_scale);
 
-	// Slice up incoming image into segments of region_size^2, and pad any remainder
-	int slices_width = ceil(real_t(img_size.x) / real_t(_region_size));
-	int slices_height = ceil(real_t(img_size.y) / real_t(_region_size));
-	slices_width = CLAMP(slices_width, 1, REGION_MAP_SIZE);
-	slices_height = CLAMP(slices_height, 1, REGION_MAP_SIZE);
-	LOG(DEBUG, "Creating ", Vector2i(slices_width, slices_height), " slices for ", img_size, " images.");
-
-	for (int y = 0; y < slices_height; y++) {
-		for (int x = 0; x < slices_width; x++) {
-			Vector2i start_coords = Vector2i(x * _region_size, y * _region_size);
-			Vector2i end_coords = Vector2i((x + 1) * _region_size, (y + 1) * _region_size);
-			LOG(DEBUG, "Reviewing image section ", start_coords, " to ", end_coords);
+	Vector3 descaled_position = p_global_position / _terrain->get_mesh_vertex_spacing();
+	if (!_validate_import_area(descaled_position, p_r16_size)) {
+		return FAILED;
+	}
 
-			Vector2i size_to_copy;
-			if (end_coords.x <= img_size.x && end_coords.y <= img_size.y) {
-				size_to_copy = _region_sizev;
-			} else {
-				size_to_copy.x = img_size.x - start_coords.x;
-				size_to_copy.y = img_size.y - start_coords.y;
-				LOG(DEBUG, "Uneven end piece. Copying padded slice ", Vector2i(x, y), " size to copy: ", size_to_copy);
-			}
-
-			LOG(DEBUG, "Copying ", size_to_copy, " sized segment");
-			TypedArray<Image> images;
-			images.resize(TYPE_MAX);
-			for (int i = 0; i < TYPE_MAX; i++) {
-				Ref<Image> img = tmp_images[i];
-				Ref<Image> img_slice;
-				if (img.is_valid() && !img->is_empty()) {
-					img_slice = Util::get_filled_image(_region_sizev, COLOR[i], false, img->get_format());
-					img_slice->blit_rect(tmp_images[i], Rect2i(start_coords, size_to_copy), Vector2i(0, 0));
-				} else {
-					img_slice = Util::get_filled_image(_region_sizev, COLOR[i], false, FORMAT[i]);
-				}
-				images[i] = img_slice;
-			}
-			// Add the heightmap slice and only regenerate on the last one
-			Vector3 position = Vector3(descaled_position.x + start_coords.x, 0.f, descaled_position.z + start_coords.y);
-			add_region(position * vertex_spacing, images, (x == slices_width - 1 && y == slices_height - 1));
+	_import_sources.clear();
+	_import_sources.resize(TYPE_MAX);
+	_import_r16_width = p_r16_size.x;
+	_import_r16_range = p_r16_height_range;
+	_import_offset = p_offset;
+	_import_scale = p_scale;
+	for (int y = 0; y < p_r16_size.y; y += _region_size) {
+		int rows = MIN(int(_region_size), p_r16_size.y - y);
+		_import_r16_rows = file->get_buffer(int64_t(rows) * p_r16_size.x * 2);
+		if (_import_r16_rows.size() < int64_t(rows) * p_r16_size.x * 2) {
+			LOG(ERROR, "Could not read rows ", y, " to ", y + rows, " of '", p_file_name, "'");
+			_import_r16_rows.clear();
+			update_regions(true);
+			return ERR_FILE_CORRUPT;
 		}
-	} // for y < slices_height, x < slices_width
+		_queue_import_jobs(Vector2i(0, 0), Vector2i(p_r16_size.x, rows),
+				descaled_position + Vector3(0.f, 0.f, real_t(y)));
+		_run_import_jobs(y + rows >= p_r16_size.y);
+	}
+	_import_r16_rows.clear();
+	_import_sources.clear();
+	return OK;
 }
 
 /** Exports a specified map as one of r16/raw, exr, jpg, png, webp, res, tres
@@ -858,6 +2839,12 @@ Error Terrain3DStorage::export_image(String p_file_name, MapType p_map_type) {
 	}
 	file_ref->close();
 
+	// r16 is written straight from the regions, other formats are encoded from one full sized image
+	String ext = p_file_name.get_extension().to_lower();
+	if (ext == "r16" || ext == "raw") {
+		return _export_r16(p_file_name, p_map_type);
+	}
+
 	// Filename is validated. Begin export image generation
 	Ref<Image> img = layered_to_image(p_map_type);
 	if (img.is_null() || img->is_empty()) {
@@ -865,24 +2852,9 @@ Error Terrain3DStorage::export_image(String p_file_name, MapType p_map_type) {
 		return FAILED;
 	}
 
-	String ext = p_file_name.get_extension().to_lower();
 	LOG(MESG, "Saving ", img->get_size(), " sized ", TYPESTR[p_map_type],
 			" map in format ", img->get_format(), " as ", ext, " to: ", p_file_name);
-	if (ext == "r16" || ext == "raw") {
-		Vector2i minmax = Util::get_min_max(img);
-		Ref<FileAccess> file = FileAccess::open(p_file_name, FileAccess::WRITE);
-		real_t height_min = minmax.x;
-		real_t height_max = minmax.y;
-		real_t hscale = 65535.0 / (height_max - height_min);
-		for (int y = 0; y < img->get_height(); y++) {
-			for (int x = 0; x < img->get_width(); x++) {
-				int h = int((img->get_pixel(x, y).r - height_min) * hscale);
-				h = CLAMP(h, 0, 65535);
-				file->store_16(h);
-			}
-		}
-		return file->get_error();
-	} else if (ext == "exr") {
+	if (ext == "exr") {
 		return img->save_exr(p_file_name, (p_map_type == TYPE_HEIGHT) ? true : false);
 	} else if (ext == "png") {
 		return img->save_png(p_file_name);
@@ -898,6 +2870,83 @@ Error Terrain3DStorage::export_image(String p_file_name, MapType p_map_type) {
 	return FAILED;
 }
 
+/**
+ * Writes the map as 16-bit values across its range, covering the same area as layered_to_image(),
+ * one row of pixels at a time. Only a row is held in memory, rather than an image of the world.
+ */
+Error Terrain3DStorage::_export_r16(const String &p_file_name, MapType p_map_type) const {
+	Vector2i top_left = Vector2i(0, 0);
+	Vector2i bottom_right = Vector2i(0, 0);
+	for (int i = 0; i < _region_offsets.size(); i++) {
+		Vector2i region = _region_offsets[i];
+		top_left = top_left.min(region);
+		bottom_right = bottom_right.max(region);
+	}
+	Vector2i regions = bottom_right - top_left + Vector2i(1, 1);
+	Vector2i img_size = regions * _region_size;
+
+	if (_region_map.size() != REGION_MAP_SIZE * REGION_MAP_SIZE) {
+		LOG(ERROR, "Region map is not up to date. Nothing to export");
+		return FAILED;
+	}
+
+	// Maps in the bounds, or null for empty space, and their range
+	TypedArray<Image> maps = get_maps(p_map_type);
+	TypedArray<Image> grid;
+	grid.resize(regions.x * regions.y);
+	Vector2 range = Vector2(0.f, 0.f);
+	bool has_empty = false;
+	for (int y = 0; y < regions.y; y++) {
+		for (int x = 0; x < regions.x; x++) {
+			Vector2i pos = top_left + Vector2i(x, y) + (REGION_MAP_VSIZE / 2);
+			int region_id = _region_map[pos.y * REGION_MAP_SIZE + pos.x] - 1;
+			Ref<Image> map = (region_id >= 0 && region_id < maps.size()) ? Ref<Image>(maps[region_id]) : Ref<Image>();
+			if (map.is_null() || map->get_size() != _region_sizev) {
+				has_empty = true;
+				continue;
+			}
+			if (map->get_format() != Image::FORMAT_RF || map->has_mipmaps()) {
+				map = map->duplicate();
+				map->clear_mipmaps();
+				map->convert(Image::FORMAT_RF);
+			}
+			Vector2 map_range = Util::get_min_max(map);
+			range = Vector2(MIN(range.x, map_range.x), MAX(range.y, map_range.y));
+			grid[y * regions.x + x] = map;
+		}
+	}
+	if (has_empty) {
+		range = Vector2(MIN(range.x, COLOR[p_map_type].r), MAX(range.y, COLOR[p_map_type].r));
+	}
+	if (range.y <= range.x) {
+		range.y = range.x + 1.f;
+	}
+
+	Ref<FileAccess> file = FileAccess::open(p_file_name, FileAccess::WRITE);
+	if (file.is_null()) {
+		LOG(ERROR, "Could not open file '" + p_file_name + "' for writing");
+		return FAILED;
+	}
+	LOG(MESG, "Saving ", img_size, " sized ", TYPESTR[p_map_type], " map as r16 with height range ", range, " to: ", p_file_name);
+	PackedFloat32Array blank;
+	blank.resize(_region_size);
+	blank.fill(COLOR[p_map_type].r);
+	PackedByteArray row;
+	row.resize(int64_t(img_size.x) * 2);
+	uint8_t *row_w = row.ptrw();
+	for (int ry = 0; ry < regions.y; ry++) {
+		for (int y = 0; y < _region_size; y++) {
+			for (int rx = 0; rx < regions.x; rx++) {
+				Ref<Image> map = grid[ry * regions.x + rx];
+				const float *src = map.is_valid() ? reinterpret_cast<const float *>(map->ptr()) + int64_t(y) * _region_size : blank.ptr();
+				encode_r16(src, _region_size, range, row_w + int64_t(rx) * _region_size * 2);
+			}
+			file->store_buffer(row);
+		}
+	}
+	return file->get_error();
+}
+
 Ref<Image> Terrain3DStorage::layered_to_image(MapType p_map_type) {
 	LOG(INFO, "Generating a full sized image for all regions including empty regions");
 	if (p_map_type >= TYPE_MAX) {
@@ -947,52 +2996,75 @@ Ref<Image> Terrain3DStorage::layered_to_image(MapType p_map_type) {
 Vector3 Terrain3DStorage::get_mesh_vertex(int32_t p_lod, HeightFilter p_filter, Vector3 p_global_position) {
 	IS_INIT_MESG("Storage not initialized", Vector3());
 	LOG(INFO, "Calculating vertex location");
-	int32_t step = 1 << CLAMP(p_lod, 0, 8);
-	real_t height = 0.0f;
+	RegionTable regions;
+	return _get_mesh_vertex(regions, p_lod, p_filter, p_global_position, _terrain->get_mesh_vertex_spacing());
+}
 
-	switch (p_filter) {
-		case HEIGHT_FILTER_NEAREST: {
-			if (is_hole(get_control(p_global_position))) {
-				height = NAN;
-			} else {
-				height = get_height(p_global_position);
-			}
-		} break;
-		case HEIGHT_FILTER_MINIMUM: {
-			height = get_height(p_global_position);
-			for (int32_t dx = -step / 2; dx < step / 2; dx += 1) {
-				for (int32_t dz = -step / 2; dz < step / 2; dz += 1) {
-					Vector3 position = p_global_position + Vector3(dx, 0.f, dz) * _terrain->get_mesh_vertex_spacing();
-					if (is_hole(get_control(position))) {
-						height = NAN;
-						break;
-					}
-					real_t h = get_height(position);
-					if (h < height) {
-						height = h;
-					}
-				}
-			}
-		} break;
+/**
+ * Returns the vertex of each position, in the same order, as get_mesh_vertex() would. Only map data
+ * is read, so this can be called from any thread, as long as the maps aren't being changed.
+ */
+PackedVector3Array Terrain3DStorage::get_mesh_vertices(int32_t p_lod, HeightFilter p_filter, const PackedVector3Array &p_global_positions) const {
+	IS_INIT_MESG("Storage not initialized", PackedVector3Array());
+	PackedVector3Array vertices;
+	int count = p_global_positions.size();
+	vertices.resize(count);
+	RegionTable regions = _get_region_data();
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	const Vector3 *positions = p_global_positions.ptr();
+	Vector3 *vertices_w = vertices.ptrw();
+	for (int i = 0; i < count; i++) {
+		vertices_w[i] = _get_mesh_vertex(regions, p_lod, p_filter, positions[i], vertex_spacing);
 	}
-	return Vector3(p_global_position.x, height, p_global_position.z);
+	return vertices;
 }
 
 Vector3 Terrain3DStorage::get_normal(Vector3 p_global_position) {
 	IS_INIT_MESG("Storage not initialized", Vector3());
-	int region = get_region_index(p_global_position);
-	if (region < 0 || is_hole(get_control(p_global_position))) {
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	RegionTable regions;
+	real_t height = _sample_height(regions, p_global_position, vertex_spacing);
+	if (Math::is_nan(height)) {
 		return Vector3(NAN, NAN, NAN);
 	}
-	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
-	real_t height = get_height(p_global_position);
-	real_t u = height - get_height(p_global_position + Vector3(vertex_spacing, 0.0f, 0.0f));
-	real_t v = height - get_height(p_global_position + Vector3(0.f, 0.f, vertex_spacing));
+	real_t u = height - _sample_height(regions, p_global_position + Vector3(vertex_spacing, 0.f, 0.f), vertex_spacing);
+	real_t v = height - _sample_height(regions, p_global_position + Vector3(0.f, 0.f, vertex_spacing), vertex_spacing);
 	Vector3 normal = Vector3(u, vertex_spacing, v);
 	normal.normalize();
 	return normal;
 }
 
+/**
+ * Returns the normals at many positions at once, with the same results as get_normal().
+ */
+PackedVector3Array Terrain3DStorage::get_normals(const PackedVector3Array &p_global_positions) {
+	IS_INIT_MESG("Storage not initialized", PackedVector3Array());
+	PackedVector3Array normals;
+	int count = p_global_positions.size();
+	if (count == 0) {
+		return normals;
+	}
+	normals.resize(count);
+	RegionTable regions = _get_region_data();
+	real_t vertex_spacing = _terrain->get_mesh_vertex_spacing();
+	const Vector3 *positions = p_global_positions.ptr();
+	Vector3 *normals_w = normals.ptrw();
+	for (int i = 0; i < count; i++) {
+		Vector3 pos = positions[i];
+		real_t height = _sample_height(regions, pos, vertex_spacing);
+		if (Math::is_nan(height)) {
+			normals_w[i] = Vector3(NAN, NAN, NAN);
+			continue;
+		}
+		real_t u = height - _sample_height(regions, pos + Vector3(vertex_spacing, 0.f, 0.f), vertex_spacing);
+		real_t v = height - _sample_height(regions, pos + Vector3(0.f, 0.f, vertex_spacing), vertex_spacing);
+		Vector3 normal = Vector3(u, vertex_spacing, v);
+		normal.normalize();
+		normals_w[i] = normal;
+	}
+	return normals;
+}
+
 void Terrain3DStorage::print_audit_data() {
 	LOG(INFO, "Dumping storage data");
 	LOG(INFO, "_modified: ", _modified);
@@ -1016,32 +3088,65 @@ void Terrain3DStorage::print_audit_data() {
 // Protected Functions
 ///////////////////////////
 
+void Terrain3DStorage::_validate_property(PropertyInfo &p_property) const {
+	// With a region directory, the maps are saved in the region files instead
+	if (!_region_directory.is_empty() && (p_property.name == StringName("region_offsets") ||
+												 p_property.name == StringName("height_maps") ||
+												 p_property.name == StringName("control_maps") ||
+												 p_property.name == StringName("color_maps"))) {
+		p_property.usage &= ~PROPERTY_USAGE_STORAGE;
+	}
+}
+
 void Terrain3DStorage::_bind_methods() {
 	BIND_ENUM_CONSTANT(TYPE_HEIGHT);
 	BIND_ENUM_CONSTANT(TYPE_CONTROL);
 	BIND_ENUM_CONSTANT(TYPE_COLOR);
 	BIND_ENUM_CONSTANT(TYPE_MAX);
 
-	//BIND_ENUM_CONSTANT(SIZE_64);
-	//BIND_ENUM_CONSTANT(SIZE_128);
-	//BIND_ENUM_CONSTANT(SIZE_256);
-	//BIND_ENUM_CONSTANT(SIZE_512);
+	BIND_ENUM_CONSTANT(SIZE_64);
+	BIND_ENUM_CONSTANT(SIZE_128);
+	BIND_ENUM_CONSTANT(SIZE_256);
+	BIND_ENUM_CONSTANT(SIZE_512);
 	BIND_ENUM_CONSTANT(SIZE_1024);
-	//BIND_ENUM_CONSTANT(SIZE_2048);
+	BIND_ENUM_CONSTANT(SIZE_2048);
 
 	BIND_ENUM_CONSTANT(HEIGHT_FILTER_NEAREST);
 	BIND_ENUM_CONSTANT(HEIGHT_FILTER_MINIMUM);
 
+	BIND_ENUM_CONSTANT(GPU_HEIGHT_FULL);
+	BIND_ENUM_CONSTANT(GPU_HEIGHT_HALF);
+	BIND_ENUM_CONSTANT(GPU_HEIGHT_16_BIT);
+
+	BIND_ENUM_CONSTANT(GPU_COLOR_FULL);
+	BIND_ENUM_CONSTANT(GPU_COLOR_COMPRESSED);
+
+	BIND_ENUM_CONSTANT(REGION_FORMAT_RESOURCE);
+	BIND_ENUM_CONSTANT(REGION_FORMAT_RAW);
+	BIND_ENUM_CONSTANT(REGION_FORMAT_MAX);
+
 	BIND_CONSTANT(REGION_MAP_SIZE);
 
 	ClassDB::bind_method(D_METHOD("set_version", "version"), &Terrain3DStorage::set_version);
 	ClassDB::bind_method(D_METHOD("get_version"), &Terrain3DStorage::get_version);
 	ClassDB::bind_method(D_METHOD("set_save_16_bit", "enabled"), &Terrain3DStorage::set_save_16_bit);
 	ClassDB::bind_method(D_METHOD("get_save_16_bit"), &Terrain3DStorage::get_save_16_bit);
+	ClassDB::bind_method(D_METHOD("set_gpu_height_format", "format"), &Terrain3DStorage::set_gpu_height_format);
+	ClassDB::bind_method(D_METHOD("get_gpu_height_format"), &Terrain3DStorage::get_gpu_height_format);
+	ClassDB::bind_method(D_METHOD("get_gpu_height_range"), &Terrain3DStorage::get_gpu_height_range);
+	ClassDB::bind_method(D_METHOD("set_gpu_color_format", "format"), &Terrain3DStorage::set_gpu_color_format);
+	ClassDB::bind_method(D_METHOD("get_gpu_color_format"), &Terrain3DStorage::get_gpu_color_format);
 
 	ClassDB::bind_method(D_METHOD("set_height_range", "range"), &Terrain3DStorage::set_height_range);
 	ClassDB::bind_method(D_METHOD("get_height_range"), &Terrain3DStorage::get_height_range);
 	ClassDB::bind_method(D_METHOD("update_height_range"), &Terrain3DStorage::update_height_range);
+	ClassDB::bind_method(D_METHOD("get_height_range_in_rect", "global_rect", "exact"), &Terrain3DStorage::get_height_range_in_rect, DEFVAL(false));
+	ClassDB::bind_method(D_METHOD("clear_edited_area"), &Terrain3DStorage::clear_edited_area);
+	ClassDB::bind_method(D_METHOD("add_edited_area", "global_aabb"), &Terrain3DStorage::add_edited_area);
+	ClassDB::bind_method(D_METHOD("get_edited_area"), &Terrain3DStorage::get_edited_area);
+	ClassDB::bind_method(D_METHOD("get_change_revision"), &Terrain3DStorage::get_change_revision);
+	ClassDB::bind_method(D_METHOD("get_changed_tiles", "since_revision", "tile_size"), &Terrain3DStorage::get_changed_tiles);
+	ClassDB::bind_method(D_METHOD("clear_change_log", "until_revision"), &Terrain3DStorage::clear_change_log, DEFVAL(-1));
 
 	ClassDB::bind_method(D_METHOD("set_region_size", "size"), &Terrain3DStorage::set_region_size);
 	ClassDB::bind_method(D_METHOD("get_region_size"), &Terrain3DStorage::get_region_size);
@@ -1054,6 +3159,19 @@ void Terrain3DStorage::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("add_region", "global_position", "images", "update"), &Terrain3DStorage::add_region, DEFVAL(TypedArray<Image>()), DEFVAL(true));
 	ClassDB::bind_method(D_METHOD("remove_region", "global_position", "update"), &Terrain3DStorage::remove_region, DEFVAL(true));
 
+	ClassDB::bind_method(D_METHOD("set_region_directory", "directory"), &Terrain3DStorage::set_region_directory);
+	ClassDB::bind_method(D_METHOD("get_region_directory"), &Terrain3DStorage::get_region_directory);
+	ClassDB::bind_method(D_METHOD("set_region_files", "files"), &Terrain3DStorage::set_region_files);
+	ClassDB::bind_method(D_METHOD("get_region_files"), &Terrain3DStorage::get_region_files);
+	ClassDB::bind_method(D_METHOD("get_region_file_path", "region_offset", "format"), &Terrain3DStorage::get_region_file_path, DEFVAL(REGION_FORMAT_MAX));
+	ClassDB::bind_method(D_METHOD("set_region_format", "format"), &Terrain3DStorage::set_region_format);
+	ClassDB::bind_method(D_METHOD("get_region_format"), &Terrain3DStorage::get_region_format);
+	ClassDB::bind_method(D_METHOD("set_load_color_maps", "enabled"), &Terrain3DStorage::set_load_color_maps);
+	ClassDB::bind_method(D_METHOD("get_load_color_maps"), &Terrain3DStorage::get_load_color_maps);
+	ClassDB::bind_method(D_METHOD("set_streaming_distance", "distance"), &Terrain3DStorage::set_streaming_distance);
+	ClassDB::bind_method(D_METHOD("get_streaming_distance"), &Terrain3DStorage::get_streaming_distance);
+	ClassDB::bind_method(D_METHOD("update_streaming", "global_position"), &Terrain3DStorage::update_streaming);
+
 	ClassDB::bind_method(D_METHOD("set_map_region", "map_type", "region_index", "image"), &Terrain3DStorage::set_map_region);
 	ClassDB::bind_method(D_METHOD("get_map_region", "map_type", "region_index"), &Terrain3DStorage::get_map_region);
 	ClassDB::bind_method(D_METHOD("set_maps", "map_type", "maps"), &Terrain3DStorage::set_maps);
@@ -1069,6 +3187,9 @@ void Terrain3DStorage::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("get_pixel", "map_type", "global_position"), &Terrain3DStorage::get_pixel);
 	ClassDB::bind_method(D_METHOD("set_height", "global_position", "height"), &Terrain3DStorage::set_height);
 	ClassDB::bind_method(D_METHOD("get_height", "global_position"), &Terrain3DStorage::get_height);
+	ClassDB::bind_method(D_METHOD("get_heights", "global_positions"), &Terrain3DStorage::get_heights);
+	ClassDB::bind_method(D_METHOD("get_ray_intersection", "src_pos", "direction", "max_distance"), &Terrain3DStorage::get_ray_intersection, DEFVAL(100000.f));
+	ClassDB::bind_method(D_METHOD("get_ray_intersections", "src_positions", "directions", "max_distance"), &Terrain3DStorage::get_ray_intersections, DEFVAL(100000.f));
 	ClassDB::bind_method(D_METHOD("set_color", "global_position", "color"), &Terrain3DStorage::set_color);
 	ClassDB::bind_method(D_METHOD("get_color", "global_position"), &Terrain3DStorage::get_color);
 	ClassDB::bind_method(D_METHOD("set_control", "global_position", "control"), &Terrain3DStorage::set_control);
@@ -1078,22 +3199,38 @@ void Terrain3DStorage::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("get_texture_id", "global_position"), &Terrain3DStorage::get_texture_id);
 	ClassDB::bind_method(D_METHOD("get_angle", "global_position"), &Terrain3DStorage::get_angle);
 	ClassDB::bind_method(D_METHOD("get_scale", "global_position"), &Terrain3DStorage::get_scale);
+	ClassDB::bind_method(D_METHOD("get_texture_ids", "global_positions"), &Terrain3DStorage::get_texture_ids);
+	ClassDB::bind_method(D_METHOD("get_angles", "global_positions"), &Terrain3DStorage::get_angles);
+	ClassDB::bind_method(D_METHOD("get_scales", "global_positions"), &Terrain3DStorage::get_scales);
 	ClassDB::bind_method(D_METHOD("force_update_maps", "map_type"), &Terrain3DStorage::force_update_maps, DEFVAL(TYPE_MAX));
+	ClassDB::bind_method(D_METHOD("update_map_regions", "map_type", "region_indices"), &Terrain3DStorage::update_map_regions);
+	ClassDB::bind_method(D_METHOD("set_color_compression_deferred", "deferred"), &Terrain3DStorage::set_color_compression_deferred);
+	ClassDB::bind_method(D_METHOD("is_color_compression_deferred"), &Terrain3DStorage::is_color_compression_deferred);
 
-	ClassDB::bind_method(D_METHOD("save"), &Terrain3DStorage::save);
+	ClassDB::bind_method(D_METHOD("save", "async"), &Terrain3DStorage::save, DEFVAL(false));
+	ClassDB::bind_method(D_METHOD("is_saving"), &Terrain3DStorage::is_saving);
 	ClassDB::bind_method(D_METHOD("import_images", "images", "global_position", "offset", "scale"), &Terrain3DStorage::import_images, DEFVAL(Vector3(0, 0, 0)), DEFVAL(0.0), DEFVAL(1.0));
+	ClassDB::bind_method(D_METHOD("import_r16", "file_name", "global_position", "offset", "scale", "r16_height_range", "r16_size"), &Terrain3DStorage::import_r16, DEFVAL(Vector3(0, 0, 0)), DEFVAL(0.0), DEFVAL(1.0), DEFVAL(Vector2(0, 255)), DEFVAL(Vector2i(0, 0)));
 	ClassDB::bind_method(D_METHOD("export_image", "file_name", "map_type"), &Terrain3DStorage::export_image);
 	ClassDB::bind_method(D_METHOD("layered_to_image", "map_type"), &Terrain3DStorage::layered_to_image);
 
 	ClassDB::bind_method(D_METHOD("get_mesh_vertex", "lod", "filter", "global_position"), &Terrain3DStorage::get_mesh_vertex);
+	ClassDB::bind_method(D_METHOD("get_mesh_vertices", "lod", "filter", "global_positions"), &Terrain3DStorage::get_mesh_vertices);
 	ClassDB::bind_method(D_METHOD("get_normal", "global_position"), &Terrain3DStorage::get_normal);
+	ClassDB::bind_method(D_METHOD("get_normals", "global_positions"), &Terrain3DStorage::get_normals);
 
 	int ro_flags = PROPERTY_USAGE_STORAGE | PROPERTY_USAGE_EDITOR | PROPERTY_USAGE_READ_ONLY;
 	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "version", PROPERTY_HINT_NONE, "", ro_flags), "set_version", "get_version");
-	//ADD_PROPERTY(PropertyInfo(Variant::INT, "region_size", PROPERTY_HINT_ENUM, "64:64, 128:128, 256:256, 512:512, 1024:1024, 2048:2048"), "set_region_size", "get_region_size");
-	ADD_PROPERTY(PropertyInfo(Variant::INT, "region_size", PROPERTY_HINT_ENUM, "1024:1024"), "set_region_size", "get_region_size");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "region_size", PROPERTY_HINT_ENUM, "64:64,128:128,256:256,512:512,1024:1024,2048:2048"), "set_region_size", "get_region_size");
 	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "save_16_bit", PROPERTY_HINT_NONE), "set_save_16_bit", "get_save_16_bit");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "gpu_height_format", PROPERTY_HINT_ENUM, "Full,Half,16 Bit"), "set_gpu_height_format", "get_gpu_height_format");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "gpu_color_format", PROPERTY_HINT_ENUM, "Full,Compressed"), "set_gpu_color_format", "get_gpu_color_format");
 	ADD_PROPERTY(PropertyInfo(Variant::VECTOR2, "height_range", PROPERTY_HINT_NONE, "", ro_flags), "set_height_range", "get_height_range");
+	ADD_PROPERTY(PropertyInfo(Variant::STRING, "region_directory", PROPERTY_HINT_DIR), "set_region_directory", "get_region_directory");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "region_format", PROPERTY_HINT_ENUM, "Resource,Raw"), "set_region_format", "get_region_format");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "load_color_maps", PROPERTY_HINT_NONE), "set_load_color_maps", "get_load_color_maps");
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "streaming_distance", PROPERTY_HINT_RANGE, "0,16384,1,or_greater"), "set_streaming_distance", "get_streaming_distance");
+	ADD_PROPERTY(PropertyInfo(Variant::DICTIONARY, "region_files", PROPERTY_HINT_NONE, "", ro_flags), "set_region_files", "get_region_files");
 	ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "region_offsets", PROPERTY_HINT_ARRAY_TYPE, vformat("%tex_size/%tex_size:%tex_size", Variant::VECTOR2, PROPERTY_HINT_NONE), ro_flags), "set_region_offsets", "get_region_offsets");
 	ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "height_maps", PROPERTY_HINT_ARRAY_TYPE, vformat("%tex_size/%tex_size:%tex_size", Variant::OBJECT, PROPERTY_HINT_RESOURCE_TYPE, "Image"), ro_flags), "set_height_maps", "get_height_maps");
 	ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "control_maps", PROPERTY_HINT_ARRAY_TYPE, vformat("%tex_size/%tex_size:%tex_size", Variant::OBJECT, PROPERTY_HINT_RESOURCE_TYPE, "Image"), ro_flags), "set_control_maps", "get_control_maps");
@@ -1103,4 +3240,6 @@ void Terrain3DStorage::_bind_methods() {
 	ADD_SIGNAL(MethodInfo("region_size_changed"));
 	ADD_SIGNAL(MethodInfo("regions_changed"));
 	ADD_SIGNAL(MethodInfo("maps_edited", PropertyInfo(Variant::AABB, "edited_area")));
+	ADD_SIGNAL(MethodInfo("save_progress", PropertyInfo(Variant::FLOAT, "progress")));
+	ADD_SIGNAL(MethodInfo("save_finished", PropertyInfo(Variant::INT, "error")));
 }
@@ -8,6 +8,8 @@
 
 #include "constants.h"
 #include "generated_texture.h"
+#include "terrain_3d_material.h"
+#include "terrain_3d_region.h"
 #include "terrain_3d_texture_list.h"
 #include "terrain_3d_util.h"
 
@@ -18,11 +20,14 @@ using namespace godot;
 class Terrain3DStorage : public Resource {
 	GDCLASS(Terrain3DStorage, Resource);
 	CLASS_NAME();
+	friend class Terrain3D;
 
 public: // Constants
 	static inline const real_t CURRENT_VERSION = 0.842f;
-	static inline const int REGION_MAP_SIZE = 16;
+	static inline const int REGION_MAP_SIZE = 32;
 	static inline const Vector2i REGION_MAP_VSIZE = Vector2i(REGION_MAP_SIZE, REGION_MAP_SIZE);
+	// UV scale percentages of the 3 bit control map values, as shown in the editor
+	static inline const real_t UV_SCALES[] = { 0.0f, 20.0f, 40.0f, 60.0f, 80.0f, -60.0f, -40.0f, -20.0f };
 
 	enum MapType {
 		TYPE_HEIGHT,
@@ -53,12 +58,12 @@ public: // Constants
 	};
 
 	enum RegionSize {
-		//SIZE_64 = 64,
-		//SIZE_128 = 128,
-		//SIZE_256 = 256,
-		//SIZE_512 = 512,
+		SIZE_64 = 64,
+		SIZE_128 = 128,
+		SIZE_256 = 256,
+		SIZE_512 = 512,
 		SIZE_1024 = 1024,
-		//SIZE_2048 = 2048,
+		SIZE_2048 = 2048,
 	};
 
 	enum HeightFilter {
@@ -66,6 +71,29 @@ public: // Constants
 		HEIGHT_FILTER_MINIMUM
 	};
 
+	enum GPUHeightFormat {
+		GPU_HEIGHT_FULL, // FORMAT_RF, as stored
+		GPU_HEIGHT_HALF, // FORMAT_RH
+		GPU_HEIGHT_16_BIT, // FORMAT_RG8, a 16 bit integer normalized to get_gpu_height_range()
+	};
+
+	enum GPUColorFormat {
+		GPU_COLOR_FULL, // FORMAT_RGBA8, as stored
+		GPU_COLOR_COMPRESSED, // S3TC or ETC2, whichever the GPU supports
+	};
+
+	enum RegionFormat {
+		REGION_FORMAT_RESOURCE, // Terrain3DRegion resource, compressed
+		REGION_FORMAT_RAW, // Uncompressed, see Terrain3DRegion::save_raw()
+		REGION_FORMAT_MAX,
+	};
+
+	static inline const char *REGION_EXTENSION[] = {
+		"res", // REGION_FORMAT_RESOURCE
+		"t3dr", // REGION_FORMAT_RAW
+		"", // REGION_FORMAT_MAX
+	};
+
 private:
 	Terrain3D *_terrain = nullptr;
 
@@ -73,6 +101,8 @@ private:
 	real_t _version = 0.8f; // Set to ensure Godot always saves this
 	bool _modified = false;
 	bool _save_16_bit = false;
+	GPUHeightFormat _gpu_height_format = GPU_HEIGHT_FULL;
+	GPUColorFormat _gpu_color_format = GPU_COLOR_FULL;
 	RegionSize _region_size = SIZE_1024;
 	Vector2i _region_sizev = Vector2i(_region_size, _region_size);
 
@@ -87,7 +117,7 @@ private:
 	 * texture in generated_*_maps.
 	 */
 	bool _region_map_dirty = true;
-	PackedInt32Array _region_map; // 16x16 Region grid with index into region_offsets (1 based array)
+	PackedInt32Array _region_map; // REGION_MAP_SIZE^2 region grid with index into region_offsets (1 based array)
 	TypedArray<Vector2i> _region_offsets; // Array of active region coordinates
 	TypedArray<Image> _height_maps;
 	TypedArray<Image> _control_maps;
@@ -98,11 +128,152 @@ private:
 	GeneratedTexture _generated_height_maps;
 	GeneratedTexture _generated_control_maps;
 	GeneratedTexture _generated_color_maps;
+	Vector2 _gpu_height_range; // Heights encoded in GPU_HEIGHT_16_BIT, _height_range with a margin
+	mutable bool _gpu_color_compression_failed = false; // No compressor in this build, upload uncompressed
+	bool _color_compression_deferred = false; // Set during strokes, see set_color_compression_deferred()
+	PackedInt32Array _deferred_color_regions; // Edited color regions to compress and upload after the stroke
 
 	uint64_t _last_region_bounds_error = 0;
 
+	// Min and max heights of a region. Level 0 has a cell per HEIGHT_CELL_SIZE pixels, plus the
+	// pixel shared with the next cell. Each following level merges 2x2 cells, down to a single cell.
+	static inline const int HEIGHT_CELL_SIZE = 16;
+	struct HeightPyramid {
+		Vector<int> sizes; // Cells per side of each level
+		Vector<Vector<Vector2>> levels; // Height range of each cell, (__FLT_MAX__, -__FLT_MAX__) if it has no heights
+	};
+
+	// Hole and navigation flags of a control map, kept as bit masks so they can be tested without
+	// decoding the control words, and skipped entirely where a region has none
+	struct ControlMasks {
+		PackedByteArray holes; // See get_mask_bit()
+		PackedByteArray navs;
+		int hole_count = 0;
+		int nav_count = 0;
+	};
+
+	// Native mirror of the map arrays, rebuilt by update_regions()
+	struct RegionMaps {
+		Ref<Image> maps[TYPE_MAX];
+		Ref<Image> gpu_maps[TYPE_MAX]; // maps as last encoded by _get_gpu_map(), kept while the maps are the same
+		bool direct = false; // All maps have the expected format and size, so can be accessed raw
+		HeightPyramid heights; // Only built for direct regions
+		ControlMasks masks; // Only built for direct regions
+	};
+	Vector<RegionMaps> _region_cache;
+	bool _height_pyramids_dirty = false; // Rebuild all pyramids on the next update, not just for new maps
+	bool _control_masks_dirty = false; // Rebuild all control masks on the next update
+	Vector<RegionMaps *> _region_cache_jobs; // Regions missing a pyramid or masks
+
+	// Raw map data of a region for batched lookups. Only valid until the maps are next changed.
+	struct RegionData {
+		const float *heights = nullptr;
+		const float *controls = nullptr;
+		const uint8_t *holes = nullptr; // Null if the region has no holes
+		const uint8_t *navs = nullptr; // Null if the region has no navigable pixels
+		bool loaded = false;
+	};
+	// Lookup of the RegionData a query has touched. Tables from _get_region_data() have an entry per
+	// region, while default constructed ones keep the last few regions inline, so single position
+	// queries don't allocate.
+	struct RegionTable {
+		static inline const int CACHE_SIZE = 4;
+		Vector<RegionData> regions;
+		RegionData cache[CACHE_SIZE];
+		int cache_regions[CACHE_SIZE] = { -1, -1, -1, -1 };
+		int cache_next = 0;
+	};
+
+	// Regions sliced from imported data by a WorkerThreadPool group task, see import_images()
+	struct ImportJob {
+		Vector2i source_position; // Top left pixel in the source
+		Vector2i size; // Pixels to copy, smaller than a region for the padded end pieces
+		Vector3 global_position;
+		TypedArray<Image> maps;
+	};
+	Vector<ImportJob> _import_jobs;
+	TypedArray<Image> _import_sources; // Height, Control, Color Images to slice, each may be null
+	PackedByteArray _import_r16_rows; // Rows of an r16 file read instead of the height Image
+	int _import_r16_width = 0;
+	Vector2 _import_r16_range;
+	real_t _import_offset = 0.f;
+	real_t _import_scale = 1.f;
+
+	// Region files, see set_region_directory()
+	String _region_directory;
+	Dictionary _region_files; // Region offset -> height range, of every region saved in _region_directory
+	RegionFormat _region_format = REGION_FORMAT_RESOURCE;
+	bool _load_color_maps = true;
+	real_t _streaming_distance = 2048.f;
+	Vector2 _streaming_last_position = Vector2(__FLT_MAX__, __FLT_MAX__);
+	Dictionary _loading_regions; // Region offset -> file path of a threaded load, or [ region, task id ] of a raw load
+	Dictionary _modified_regions; // Offsets of loaded regions changed since they were saved
+	Dictionary _removed_regions; // Offsets of regions to delete files for on save
+	int _last_modified_region = -1; // Avoids marking the same region every set_pixel()
+
+	// Change log, see get_changed_tiles(). Cells are CHANGE_CELL_SIZE vertices per side.
+	static inline const int CHANGE_CELL_SIZE = 32;
+	uint64_t _change_revision = 0;
+	Dictionary _change_log; // Cell coordinate -> revision of its last change
+
+	// Background save, see save()
+	Ref<Terrain3DStorage> _save_snapshot; // Owned by the save task while _save_task is valid
+	TypedArray<Terrain3DRegion> _save_regions; // Region files written by the save task
+	PackedStringArray _save_region_paths;
+	String _save_path;
+	Error _save_error = OK;
+	int64_t _save_task = -1;
+	bool _save_queued = false;
+	uint64_t _save_time = 0;
+
 	// Functions
 	void _clear();
+	void _update_region_cache();
+	bool _is_server_mode() const;
+	void _skip_gpu_maps();
+	Ref<Image> _get_gpu_map(MapType p_map_type, const Ref<Image> &p_map) const;
+	TypedArray<Image> _get_gpu_maps(MapType p_map_type);
+	void _clear_gpu_map_cache(MapType p_map_type);
+	RegionTable _get_region_data() const;
+	RegionData _load_region_data(RegionTable &r_regions, int p_region) const;
+	int _get_vertex_region(Vector2i p_vertex, int &r_index) const;
+	void _update_height_pyramid(RegionMaps &r_region, Rect2i p_pixels = Rect2i()) const;
+	void _update_control_masks(RegionMaps &r_region, Rect2i p_pixels = Rect2i()) const;
+	void _build_region_cache(uint32_t p_job);
+	void _merge_height_pyramid(const RegionMaps &p_region, int p_level, Vector2i p_cell,
+			Vector2i p_start, Vector2i p_end, bool p_exact, Vector2 &r_range) const;
+	real_t _read_height(RegionTable &r_regions, Vector2i p_vertex) const;
+	bool _read_nav(RegionTable &r_regions, Vector3 p_global_position, real_t p_vertex_spacing) const;
+	bool _has_nav(Rect2i p_vertices) const;
+	bool _has_hole(Rect2i p_vertices) const;
+	real_t _sample_height(RegionTable &r_regions, Vector3 p_global_position, real_t p_vertex_spacing) const;
+	void _read_controls(RegionTable &r_regions, const PackedVector3Array &p_global_positions, real_t p_vertex_spacing,
+			Vector<uint32_t> &r_controls, PackedByteArray &r_found) const;
+	Vector3 _get_auto_texture_id(RegionTable &r_regions, Vector3 p_global_position, real_t p_vertex_spacing,
+			const Terrain3DMaterial::AutoShaderParams &p_params) const;
+	Vector3 _get_mesh_vertex(RegionTable &r_regions, int32_t p_lod, HeightFilter p_filter, Vector3 p_global_position,
+			real_t p_vertex_spacing) const;
+	real_t _raycast_quad(RegionTable &r_regions, Vector2i p_quad, Vector3 p_src_pos, Vector3 p_direction,
+			real_t p_t_start, real_t p_t_end, real_t p_vertex_spacing) const;
+	real_t _raycast(RegionTable &r_regions, Vector3 p_src_pos, Vector3 p_direction, real_t p_max_distance,
+			real_t p_vertex_spacing) const;
+	void _mark_region_modified(Vector2i p_region_offset);
+	void _log_change(Rect2i p_vertices);
+	void _resize_regions(RegionSize p_size);
+	bool _validate_import_area(Vector3 p_descaled_position, Vector2i p_size) const;
+	void _queue_import_jobs(Vector2i p_source_position, Vector2i p_size, Vector3 p_descaled_position);
+	void _import_slice(uint32_t p_job);
+	void _run_import_jobs(bool p_update);
+	Error _export_r16(const String &p_file_name, MapType p_map_type) const;
+	String _find_region_file(Vector2i p_region_offset) const;
+	Error _replace_region(int p_index, Vector2i p_region_offset, const TypedArray<Image> &p_images);
+	TypedArray<Terrain3DRegion> _prepare_region_files(PackedStringArray &r_paths);
+	Error _write_region_files(const TypedArray<Terrain3DRegion> &p_regions, const PackedStringArray &p_paths,
+			bool p_16_bit, Dictionary &r_files, int p_steps);
+	Ref<Terrain3DStorage> _create_save_snapshot() const;
+	Ref<Terrain3DStorage> _create_read_snapshot(Rect2 p_global_rect) const;
+	void _run_save_task();
+	void _finish_save();
 
 public:
 	Terrain3DStorage() {}
@@ -113,16 +284,25 @@ public:
 	real_t get_version() const { return _version; }
 	void set_save_16_bit(bool p_enabled);
 	bool get_save_16_bit() const { return _save_16_bit; }
+	void set_gpu_height_format(GPUHeightFormat p_format);
+	GPUHeightFormat get_gpu_height_format() const { return _gpu_height_format; }
+	Vector2 get_gpu_height_range() const { return _gpu_height_range; }
+	void set_gpu_color_format(GPUColorFormat p_format);
+	GPUColorFormat get_gpu_color_format() const { return _gpu_color_format; }
 
 	void set_height_range(Vector2 p_range);
 	Vector2 get_height_range() const { return _height_range; }
 	void update_heights(real_t p_height);
 	void update_heights(Vector2 p_heights);
 	void update_height_range();
+	Vector2 get_height_range_in_rect(Rect2 p_global_rect, bool p_exact = false) const;
 
 	void clear_edited_area();
 	void add_edited_area(AABB p_area);
 	AABB get_edited_area() const { return _edited_area; }
+	int64_t get_change_revision() const { return _change_revision; }
+	TypedArray<Vector2i> get_changed_tiles(int64_t p_since_revision, real_t p_tile_size) const;
+	void clear_change_log(int64_t p_until_revision = -1);
 
 	// Regions
 	void set_region_size(RegionSize p_size);
@@ -139,6 +319,20 @@ public:
 	void remove_region(Vector3 p_global_position, bool p_update = true);
 	void update_regions(bool force_emit = false);
 
+	// Region files
+	void set_region_directory(const String &p_directory);
+	String get_region_directory() const { return _region_directory; }
+	void set_region_files(const Dictionary &p_files);
+	Dictionary get_region_files() const { return _region_files; }
+	String get_region_file_path(Vector2i p_region_offset, RegionFormat p_format = REGION_FORMAT_MAX) const;
+	void set_region_format(RegionFormat p_format);
+	RegionFormat get_region_format() const { return _region_format; }
+	void set_load_color_maps(bool p_enabled);
+	bool get_load_color_maps() const { return _load_color_maps; }
+	void set_streaming_distance(real_t p_distance);
+	real_t get_streaming_distance() const { return _streaming_distance; }
+	void update_streaming(Vector3 p_global_position);
+
 	// Maps
 	void set_map_region(MapType p_map_type, int p_region_index, const Ref<Image> p_image);
 	Ref<Image> get_map_region(MapType p_map_type, int p_region_index) const;
@@ -158,6 +352,10 @@ public:
 	Color get_pixel(MapType p_map_type, Vector3 p_global_position);
 	void set_height(Vector3 p_global_position, real_t p_height);
 	real_t get_height(Vector3 p_global_position);
+	PackedFloat32Array get_heights(const PackedVector3Array &p_global_positions);
+	Vector3 get_ray_intersection(Vector3 p_src_pos, Vector3 p_direction, real_t p_max_distance = 100000.f) const;
+	PackedVector3Array get_ray_intersections(const PackedVector3Array &p_src_positions, const PackedVector3Array &p_directions,
+			real_t p_max_distance = 100000.f) const;
 	void set_color(Vector3 p_global_position, Color p_color);
 	Color get_color(Vector3 p_global_position);
 	void set_control(Vector3 p_global_position, uint32_t p_control);
@@ -167,30 +365,46 @@ public:
 	Vector3 get_texture_id(Vector3 p_global_position);
 	real_t get_angle(Vector3 p_global_position);
 	real_t get_scale(Vector3 p_global_position);
+	PackedVector3Array get_texture_ids(const PackedVector3Array &p_global_positions);
+	PackedFloat32Array get_angles(const PackedVector3Array &p_global_positions);
+	PackedFloat32Array get_scales(const PackedVector3Array &p_global_positions);
 	TypedArray<Image> sanitize_maps(MapType p_map_type, const TypedArray<Image> &p_maps);
 	void force_update_maps(MapType p_map = TYPE_MAX);
+	void update_map_regions(MapType p_map_type, const PackedInt32Array &p_region_indices);
+	void set_color_compression_deferred(bool p_deferred);
+	bool is_color_compression_deferred() const { return _color_compression_deferred; }
 
 	// File I/O
-	void save();
+	void save(bool p_async = false);
+	bool is_saving() const { return _save_task != -1; }
 	void clear_modified() { _modified = false; }
 	void set_modified() { _modified = true; }
 	void import_images(const TypedArray<Image> &p_images, Vector3 p_global_position = Vector3(0.f, 0.f, 0.f),
 			real_t p_offset = 0.f, real_t p_scale = 1.f);
+	Error import_r16(const String &p_file_name, Vector3 p_global_position = Vector3(0.f, 0.f, 0.f),
+			real_t p_offset = 0.f, real_t p_scale = 1.f, Vector2 p_r16_height_range = Vector2(0.f, 255.f),
+			Vector2i p_r16_size = Vector2i(0, 0));
 	Error export_image(String p_file_name, MapType p_map_type = TYPE_HEIGHT);
 	Ref<Image> layered_to_image(MapType p_map_type);
 
 	// Utility
 	Vector3 get_mesh_vertex(int32_t p_lod, HeightFilter p_filter, Vector3 p_global_position);
+	PackedVector3Array get_mesh_vertices(int32_t p_lod, HeightFilter p_filter, const PackedVector3Array &p_global_positions) const;
 	Vector3 get_normal(Vector3 global_position);
+	PackedVector3Array get_normals(const PackedVector3Array &p_global_positions);
 	void print_audit_data();
 
 protected:
+	void _validate_property(PropertyInfo &p_property) const;
 	static void _bind_methods();
 };
 
 VARIANT_ENUM_CAST(Terrain3DStorage::MapType);
 VARIANT_ENUM_CAST(Terrain3DStorage::RegionSize);
 VARIANT_ENUM_CAST(Terrain3DStorage::HeightFilter);
+VARIANT_ENUM_CAST(Terrain3DStorage::GPUHeightFormat);
+VARIANT_ENUM_CAST(Terrain3DStorage::GPUColorFormat);
+VARIANT_ENUM_CAST(Terrain3DStorage::RegionFormat);
 
 // Inline Functions
 
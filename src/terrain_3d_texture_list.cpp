@@ -1,6 +1,7 @@
 // Copyright © 2023 Cory Petkovsek, Roope Palmroos, and Contributors.
 
 #include <godot_cpp/classes/image_texture.hpp>
+#include <godot_cpp/classes/os.hpp>
 #include <godot_cpp/classes/resource_saver.hpp>
 
 #include "logger.h"
@@ -35,139 +36,256 @@ void Terrain3DTextureList::_swap_textures(int p_old_id, int p_new_id) {
 	update_list();
 }
 
-void Terrain3DTextureList::_update_texture_files() {
-	LOG(DEBUG, "Received texture_changed signal");
-	_generated_albedo_textures.clear();
-	_generated_normal_textures.clear();
-	if (_textures.is_empty()) {
-		emit_signal("textures_changed");
-		return;
+/**
+ * Checks p_texture of texture set p_id against the size and format of the first texture in
+ * r_layout, setting them if it is the first. Reading the image back is slow, so if this layer was
+ * already built from p_texture, its format is taken from p_built instead.
+ */
+bool Terrain3DTextureList::_validate_texture(int p_id, int p_layer, const Ref<Texture2D> &p_texture, const String &p_type,
+		const ArrayLayout &p_built, ArrayLayout &r_layout) const {
+	if (p_texture.is_null()) {
+		return true;
 	}
+	Vector2i tex_size = p_texture->get_size();
+	if (r_layout.size.length() == 0.0) {
+		r_layout.size = tex_size;
+	} else if (tex_size != r_layout.size) {
+		LOG(ERROR, "Texture ID ", p_id, " ", p_type, " size: ", tex_size, " doesn't match first texture: ", r_layout.size);
+		return false;
+	}
+	Image::Format format = p_built.format;
+	bool mipmaps = p_built.mipmaps;
+	PackedInt64Array offsets = p_built.mipmap_offsets;
+	if (p_layer >= p_built.textures.size() || Ref<Texture2D>(p_built.textures[p_layer]) != p_texture) {
+		Ref<Image> img = p_texture->get_image();
+		format = img->get_format();
+		mipmaps = img->has_mipmaps();
+		offsets.clear();
+		for (int i = 0; i <= img->get_mipmap_count(); i++) {
+			offsets.push_back(img->get_mipmap_offset(i));
+		}
+		offsets.push_back(img->get_data_size());
+	}
+	if (r_layout.format == Image::FORMAT_MAX) {
+		r_layout.format = format;
+		r_layout.mipmaps = mipmaps;
+		r_layout.mipmap_offsets = offsets;
+	} else if (format != r_layout.format) {
+		LOG(ERROR, "Texture ID ", p_id, " ", p_type, " format: ", format, " doesn't match first texture: ", r_layout.format);
+		return false;
+	}
+	return true;
+}
 
-	// Detect image sizes and formats
-
-	LOG(INFO, "Validating texture sizes");
-	Vector2i albedo_size = Vector2i(0, 0);
-	Vector2i normal_size = Vector2i(0, 0);
+/**
+ * Returns how many of the largest mipmaps to leave out of both arrays so that they fit within the
+ * memory budget for this platform. Arrays without mipmaps can't be reduced.
+ */
+int Terrain3DTextureList::_get_mipmap_skip(const ArrayLayout &p_albedo, const ArrayLayout &p_normal, int p_layers) const {
+	int budget = _memory_budget;
+	if (_memory_budget_mobile > 0 && OS::get_singleton()->has_feature("mobile")) {
+		budget = _memory_budget_mobile;
+	}
+	if (budget <= 0) {
+		return 0;
+	}
+	int64_t budget_bytes = int64_t(budget) * 1024 * 1024;
+	const ArrayLayout *layouts[] = { &p_albedo, &p_normal };
+	int skip = 0;
+	while (true) {
+		int64_t bytes = 0;
+		bool can_skip = true;
+		for (const ArrayLayout *layout : layouts) {
+			const PackedInt64Array &offsets = layout->mipmap_offsets;
+			if (offsets.size() < 2) {
+				continue; // No images read, so only placeholders
+			}
+			int level = MIN(skip, offsets.size() - 2);
+			bytes += (offsets[offsets.size() - 1] - offsets[level]) * p_layers;
+			int next_size = MIN(layout->size.x, layout->size.y) >> (skip + 1);
+			can_skip = can_skip && layout->mipmaps && skip + 1 < offsets.size() - 1 && next_size >= MIN_BUDGET_SIZE;
+		}
+		if (bytes <= budget_bytes || !can_skip) {
+			if (bytes > budget_bytes) {
+				LOG(WARN, "Texture arrays use ", bytes / (1024 * 1024), " MB, more than the ", budget, " MB memory budget");
+			}
+			return skip;
+		}
+		skip++;
+	}
+}
 
-	Image::Format albedo_format = Image::FORMAT_MAX;
-	Image::Format normal_format = Image::FORMAT_MAX;
-	bool albedo_mipmaps = true;
-	bool normal_mipmaps = true;
+// Returns p_image without its first p_levels mipmaps
+Ref<Image> Terrain3DTextureList::_skip_mipmaps(const Ref<Image> &p_image, int p_levels) {
+	if (p_levels <= 0 || p_image.is_null() || !p_image->has_mipmaps()) {
+		return p_image;
+	}
+	int levels = MIN(p_levels, p_image->get_mipmap_count());
+	Vector2i size = Vector2i(MAX(p_image->get_width() >> levels, 1), MAX(p_image->get_height() >> levels, 1));
+	PackedByteArray data = p_image->get_data().slice(p_image->get_mipmap_offset(levels));
+	Ref<Image> img = Image::create_from_data(size.x, size.y, true, p_image->get_format(), data);
+	if (img.is_null()) {
+		LOG(ERROR, "Couldn't reduce image of size ", p_image->get_size(), " by ", levels, " mipmaps");
+		return p_image;
+	}
+	return img;
+}
 
+/**
+ * Brings r_array up to date with the texture sets for p_layout. The array is only rebuilt if its
+ * layout or layer count changed, otherwise just layers with a new texture, or one changed in place
+ * (see _on_texture_changed()), are uploaded.
+ */
+void Terrain3DTextureList::_update_texture_array(GeneratedTexture &r_array, ArrayLayout &r_built, ArrayLayout &p_layout, bool p_normal) {
+	String type = p_normal ? "normal" : "albedo";
 	for (int i = 0; i < _textures.size(); i++) {
 		Ref<Terrain3DTexture> texture_set = _textures[i];
 		if (texture_set.is_null()) {
 			continue;
 		}
-		Ref<Texture2D> albedo_tex = texture_set->get_albedo_texture();
-		Ref<Texture2D> normal_tex = texture_set->get_normal_texture();
-
-		// If this is the first texture, set expected size and format for the arrays
-		if (albedo_tex.is_valid()) {
-			Vector2i tex_size = albedo_tex->get_size();
-			if (albedo_size.length() == 0.0) {
-				albedo_size = tex_size;
-			} else if (tex_size != albedo_size) {
-				LOG(ERROR, "Texture ID ", i, " albedo size: ", tex_size, " doesn't match first texture: ", albedo_size);
-				return;
-			}
-			Ref<Image> img = albedo_tex->get_image();
-			Image::Format format = img->get_format();
-			if (albedo_format == Image::FORMAT_MAX) {
-				albedo_format = format;
-				albedo_mipmaps = img->has_mipmaps();
-			} else if (format != albedo_format) {
-				LOG(ERROR, "Texture ID ", i, " albedo format: ", format, " doesn't match first texture: ", albedo_format);
-				return;
+		Ref<Texture2D> tex = p_normal ? texture_set->get_normal_texture() : texture_set->get_albedo_texture();
+		if (tex.is_null()) {
+			Ref<Image> img = Util::get_filled_image(p_layout.size, p_normal ? COLOR_NORMAL : COLOR_CHECKED, p_layout.mipmaps, p_layout.format);
+			LOG(DEBUG, "ID ", i, " ", type, " texture is null. Creating a new one. Format: ", img->get_format());
+			tex = ImageTexture::create_from_image(img);
+			if (p_normal) {
+				texture_set->get_data()->_normal_texture = tex;
+			} else {
+				texture_set->get_data()->_albedo_texture = tex;
 			}
 		}
-		if (normal_tex.is_valid()) {
-			Vector2i tex_size = normal_tex->get_size();
-			if (normal_size.length() == 0.0) {
-				normal_size = tex_size;
-			} else if (tex_size != normal_size) {
-				LOG(ERROR, "Texture ID ", i, " normal size: ", tex_size, " doesn't match first texture: ", normal_size);
-				return;
-			}
-			Ref<Image> img = normal_tex->get_image();
-			Image::Format format = img->get_format();
-			if (normal_format == Image::FORMAT_MAX) {
-				normal_format = format;
-				normal_mipmaps = img->has_mipmaps();
-			} else if (format != normal_format) {
-				LOG(ERROR, "Texture ID ", i, " normal format: ", format, " doesn't match first texture: ", normal_format);
-				return;
+		p_layout.textures.push_back(tex);
+	}
+
+	bool rebuild = !r_array.get_rid().is_valid() || r_array.get_layer_count() != p_layout.textures.size() ||
+			r_built.size != p_layout.size || r_built.format != p_layout.format || r_built.mipmaps != p_layout.mipmaps ||
+			r_built.mipmap_skip != p_layout.mipmap_skip;
+	if (rebuild) {
+		LOG(INFO, "Regenerating ", type, " texture array");
+		Array images;
+		for (int i = 0; i < p_layout.textures.size(); i++) {
+			Ref<Texture2D> tex = p_layout.textures[i];
+			images.push_back(_skip_mipmaps(tex->get_image(), p_layout.mipmap_skip));
+		}
+		r_array.clear();
+		if (!images.is_empty()) {
+			r_array.create(images);
+		}
+	} else {
+		for (int i = 0; i < p_layout.textures.size(); i++) {
+			Ref<Texture2D> tex = p_layout.textures[i];
+			if (Ref<Texture2D>(r_built.textures[i]) != tex) {
+				LOG(INFO, "Updating ", type, " texture array layer ", i);
+				r_array.update(_skip_mipmaps(tex->get_image(), p_layout.mipmap_skip), i);
 			}
 		}
 	}
+	r_built = p_layout;
+}
+
+// Returns the textures of both built arrays
+Array Terrain3DTextureList::_get_layer_textures() const {
+	Array textures = _albedo_layout.textures.duplicate();
+	textures.append_array(_normal_layout.textures);
+	return textures;
+}
 
-	if (normal_size == Vector2i(0, 0)) {
-		normal_size = albedo_size;
-	} else if (albedo_size == Vector2i(0, 0)) {
-		albedo_size = normal_size;
+/**
+ * Keeps _on_texture_changed() connected to the changed signal of each texture in the built arrays,
+ * and disconnected from those in p_old_textures that were left out.
+ */
+void Terrain3DTextureList::_track_layer_textures(const Array &p_old_textures) {
+	Callable callable = callable_mp(this, &Terrain3DTextureList::_on_texture_changed);
+	Array textures = _get_layer_textures();
+	for (int i = 0; i < p_old_textures.size(); i++) {
+		Ref<Texture2D> tex = p_old_textures[i];
+		if (tex.is_valid() && !textures.has(tex) && tex->is_connected("changed", callable)) {
+			tex->disconnect("changed", callable);
+		}
 	}
-	if (albedo_size == Vector2i(0, 0)) {
-		albedo_size = Vector2i(1024, 1024);
-		normal_size = Vector2i(1024, 1024);
+	for (int i = 0; i < textures.size(); i++) {
+		Ref<Texture2D> tex = textures[i];
+		if (tex.is_valid() && !tex->is_connected("changed", callable)) {
+			// Bound by id, as a reference would keep the texture alive through its own signal
+			tex->connect("changed", callable.bind(tex->get_instance_id()));
+		}
 	}
+}
 
-	// Generate TextureArrays and replace nulls with a empty image
-
-	if (_generated_albedo_textures.is_dirty() && albedo_size != Vector2i(0, 0)) {
-		LOG(INFO, "Regenerating albedo texture array");
-		Array albedo_texture_array;
-		for (int i = 0; i < _textures.size(); i++) {
-			Ref<Terrain3DTexture> texture_set = _textures[i];
-			if (texture_set.is_null()) {
-				continue;
-			}
-			Ref<Texture2D> tex = texture_set->get_albedo_texture();
-			Ref<Image> img;
-
-			if (tex.is_null()) {
-				img = Util::get_filled_image(albedo_size, COLOR_CHECKED, albedo_mipmaps, albedo_format);
-				LOG(DEBUG, "ID ", i, " albedo texture is null. Creating a new one. Format: ", img->get_format());
-				texture_set->get_data()->_albedo_texture = ImageTexture::create_from_image(img);
-			} else {
-				img = tex->get_image();
-				LOG(DEBUG, "ID ", i, " albedo texture is valid. Format: ", img->get_format());
+/**
+ * A texture changed in place, eg. when reimported, keeping its reference. Its layers are marked as
+ * built from nothing, so they are uploaded again.
+ */
+void Terrain3DTextureList::_on_texture_changed(uint64_t p_texture_id) {
+	ArrayLayout *layouts[] = { &_albedo_layout, &_normal_layout };
+	bool found = false;
+	for (ArrayLayout *layout : layouts) {
+		for (int i = 0; i < layout->textures.size(); i++) {
+			Ref<Texture2D> tex = layout->textures[i];
+			if (tex.is_valid() && uint64_t(tex->get_instance_id()) == p_texture_id) {
+				layout->textures[i] = Variant();
+				found = true;
 			}
-			albedo_texture_array.push_back(img);
-		}
-		if (!albedo_texture_array.is_empty()) {
-			_generated_albedo_textures.create(albedo_texture_array);
 		}
 	}
+	if (found) {
+		LOG(DEBUG, "Texture ", p_texture_id, " changed, uploading its layers again");
+		_update_texture_files();
+	}
+}
 
-	if (_generated_normal_textures.is_dirty() && normal_size != Vector2i(0, 0)) {
-		LOG(INFO, "Regenerating normal texture arrays");
-
-		Array normal_texture_array;
+void Terrain3DTextureList::_update_texture_files() {
+	LOG(DEBUG, "Received texture_changed signal");
+	Array old_textures = _get_layer_textures();
+	if (_textures.is_empty() || _server_mode) {
+		_generated_albedo_textures.clear();
+		_generated_normal_textures.clear();
+		_albedo_layout = ArrayLayout();
+		_normal_layout = ArrayLayout();
+		_track_layer_textures(old_textures);
+		emit_signal("textures_changed");
+		return;
+	}
 
-		for (int i = 0; i < _textures.size(); i++) {
-			Ref<Terrain3DTexture> texture_set = _textures[i];
-			if (texture_set.is_null()) {
-				continue;
-			}
-			Ref<Texture2D> tex = texture_set->get_normal_texture();
-			Ref<Image> img;
+	// Detect image sizes and formats
 
-			if (tex.is_null()) {
-				img = Util::get_filled_image(normal_size, COLOR_NORMAL, normal_mipmaps, normal_format);
-				LOG(DEBUG, "ID ", i, " normal texture is null. Creating a new one. Format: ", img->get_format());
-				texture_set->get_data()->_normal_texture = ImageTexture::create_from_image(img);
-			} else {
-				img = tex->get_image();
-				LOG(DEBUG, "ID ", i, " Normal texture is valid. Format: ", img->get_format());
-			}
-			normal_texture_array.push_back(img);
+	LOG(INFO, "Validating texture sizes");
+	ArrayLayout albedo;
+	ArrayLayout normal;
+	int layer = 0;
+	for (int i = 0; i < _textures.size(); i++) {
+		Ref<Terrain3DTexture> texture_set = _textures[i];
+		if (texture_set.is_null()) {
+			continue;
 		}
-		if (!normal_texture_array.is_empty()) {
-			_generated_normal_textures.create(normal_texture_array);
+		if (!_validate_texture(i, layer, texture_set->get_albedo_texture(), "albedo", _albedo_layout, albedo) ||
+				!_validate_texture(i, layer, texture_set->get_normal_texture(), "normal", _normal_layout, normal)) {
+			return;
 		}
+		layer++;
 	}
 
+	if (normal.size == Vector2i(0, 0)) {
+		normal.size = albedo.size;
+	} else if (albedo.size == Vector2i(0, 0)) {
+		albedo.size = normal.size;
+	}
+	if (albedo.size == Vector2i(0, 0)) {
+		albedo.size = Vector2i(1024, 1024);
+		normal.size = Vector2i(1024, 1024);
+	}
+	int skip = _get_mipmap_skip(albedo, normal, layer);
+	if (skip > 0) {
+		LOG(INFO, "Leaving out ", skip, " mipmaps to fit the memory budget");
+	}
+	albedo.mipmap_skip = skip;
+	normal.mipmap_skip = skip;
+
+	// Generate TextureArrays and replace nulls with a empty image
+
+	_update_texture_array(_generated_albedo_textures, _albedo_layout, albedo, false);
+	_update_texture_array(_generated_normal_textures, _normal_layout, normal, true);
+	_track_layer_textures(old_textures);
 	emit_signal("textures_changed");
 }
 
@@ -192,11 +310,22 @@ void Terrain3DTextureList::_update_texture_settings() {
 	emit_signal("textures_changed");
 }
 
+// Set by Terrain3D. Nothing is drawn in server mode, so the textures' images are never read.
+void Terrain3DTextureList::_set_server_mode(bool p_enabled) {
+	if (_server_mode != p_enabled) {
+		LOG(INFO, "Setting server mode: ", p_enabled);
+		_server_mode = p_enabled;
+		_update_texture_files();
+	}
+}
+
 ///////////////////////////
 // Public Functions
 ///////////////////////////
 
 Terrain3DTextureList::Terrain3DTextureList() {
+	// Resources load before the terrain enters the tree, so don't wait for it to say so
+	_server_mode = Terrain3D::is_headless();
 }
 
 Terrain3DTextureList::~Terrain3DTextureList() {
@@ -222,8 +351,6 @@ void Terrain3DTextureList::update_list() {
 			texture_set->connect("setting_changed", callable_mp(this, &Terrain3DTextureList::_update_texture_settings));
 		}
 	}
-	_generated_albedo_textures.clear();
-	_generated_normal_textures.clear();
 	_update_texture_files();
 	_update_texture_settings();
 }
@@ -299,6 +426,23 @@ void Terrain3DTextureList::set_textures(const TypedArray<Terrain3DTexture> &p_te
 	update_list();
 }
 
+/**
+ * Caps the memory used by the albedo and normal texture arrays, in MB. The largest mipmaps of all
+ * textures are left out until they fit, down to MIN_BUDGET_SIZE. 0 disables the limit.
+ */
+void Terrain3DTextureList::set_memory_budget(int p_megabytes) {
+	LOG(INFO, "Setting texture memory budget: ", p_megabytes);
+	_memory_budget = MAX(p_megabytes, 0);
+	_update_texture_files();
+}
+
+// As set_memory_budget(), for platforms with the mobile feature. 0 uses memory_budget instead.
+void Terrain3DTextureList::set_memory_budget_mobile(int p_megabytes) {
+	LOG(INFO, "Setting mobile texture memory budget: ", p_megabytes);
+	_memory_budget_mobile = MAX(p_megabytes, 0);
+	_update_texture_files();
+}
+
 void Terrain3DTextureList::save() {
 	String path = get_path();
 	if (path.get_extension() == "tres" || path.get_extension() == "res") {
@@ -321,13 +465,22 @@ void Terrain3DTextureList::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("set_textures", "textures"), &Terrain3DTextureList::set_textures);
 	ClassDB::bind_method(D_METHOD("get_textures"), &Terrain3DTextureList::get_textures);
 	ClassDB::bind_method(D_METHOD("get_texture_count"), &Terrain3DTextureList::get_texture_count);
+	ClassDB::bind_method(D_METHOD("set_memory_budget", "megabytes"), &Terrain3DTextureList::set_memory_budget);
+	ClassDB::bind_method(D_METHOD("get_memory_budget"), &Terrain3DTextureList::get_memory_budget);
+	ClassDB::bind_method(D_METHOD("set_memory_budget_mobile", "megabytes"), &Terrain3DTextureList::set_memory_budget_mobile);
+	ClassDB::bind_method(D_METHOD("get_memory_budget_mobile"), &Terrain3DTextureList::get_memory_budget_mobile);
+	ClassDB::bind_method(D_METHOD("get_mipmap_skip"), &Terrain3DTextureList::get_mipmap_skip);
 
 	ClassDB::bind_method(D_METHOD("save"), &Terrain3DTextureList::save);
 
 	int ro_flags = PROPERTY_USAGE_STORAGE | PROPERTY_USAGE_EDITOR | PROPERTY_USAGE_READ_ONLY;
 	ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "textures", PROPERTY_HINT_ARRAY_TYPE, vformat("%tex_size/%tex_size:%tex_size", Variant::OBJECT, PROPERTY_HINT_RESOURCE_TYPE, "Terrain3DTextureList"), ro_flags), "set_textures", "get_textures");
 
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "memory_budget", PROPERTY_HINT_RANGE, "0,16384,1,or_greater,suffix:MB"), "set_memory_budget", "get_memory_budget");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "memory_budget_mobile", PROPERTY_HINT_RANGE, "0,16384,1,or_greater,suffix:MB"), "set_memory_budget_mobile", "get_memory_budget_mobile");
+
 	BIND_CONSTANT(MAX_TEXTURES);
+	BIND_CONSTANT(MIN_BUDGET_SIZE);
 
 	ADD_SIGNAL(MethodInfo("textures_changed"));
 }
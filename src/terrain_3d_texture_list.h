@@ -9,25 +9,53 @@
 
 using namespace godot;
 
+class Terrain3D;
+
 class Terrain3DTextureList : public Resource {
 	GDCLASS(Terrain3DTextureList, Resource);
 	CLASS_NAME();
+	friend class Terrain3D;
 
 public: // Constants
 	static inline const int MAX_TEXTURES = 32;
+	static inline const int MIN_BUDGET_SIZE = 128; // Smallest array size the memory budget reduces to
 
 private:
+	// Layout of a texture array, and the textures each layer was built from
+	struct ArrayLayout {
+		Vector2i size;
+		Image::Format format = Image::FORMAT_MAX;
+		bool mipmaps = true;
+		PackedInt64Array mipmap_offsets; // Byte offset of each level in a full size layer, then its size
+		int mipmap_skip = 0; // Largest levels left out to fit the memory budget
+		Array textures; // Texture2D of each layer
+	};
+
 	TypedArray<Terrain3DTexture> _textures;
+	int _memory_budget = 0; // MB, 0 for no limit
+	int _memory_budget_mobile = 0;
+	bool _server_mode = false; // Skips loading the images and building the texture arrays
 
 	GeneratedTexture _generated_albedo_textures;
 	GeneratedTexture _generated_normal_textures;
+	ArrayLayout _albedo_layout;
+	ArrayLayout _normal_layout;
 	PackedColorArray _texture_colors;
 	PackedFloat32Array _texture_uv_scales;
 	PackedFloat32Array _texture_uv_rotations;
 
 	void _swap_textures(int p_old_id, int p_new_id);
+	bool _validate_texture(int p_id, int p_layer, const Ref<Texture2D> &p_texture, const String &p_type,
+			const ArrayLayout &p_built, ArrayLayout &r_layout) const;
+	int _get_mipmap_skip(const ArrayLayout &p_albedo, const ArrayLayout &p_normal, int p_layers) const;
+	static Ref<Image> _skip_mipmaps(const Ref<Image> &p_image, int p_levels);
+	void _update_texture_array(GeneratedTexture &r_array, ArrayLayout &r_built, ArrayLayout &p_layout, bool p_normal);
+	Array _get_layer_textures() const;
+	void _track_layer_textures(const Array &p_old_textures);
+	void _on_texture_changed(uint64_t p_texture_id);
 	void _update_texture_files();
 	void _update_texture_settings();
+	void _set_server_mode(bool p_enabled);
 
 public:
 	Terrain3DTextureList();
@@ -41,9 +69,15 @@ public:
 	int get_texture_count() const { return _textures.size(); }
 	RID get_albedo_array_rid() { return _generated_albedo_textures.get_rid(); }
 	RID get_normal_array_rid() { return _generated_normal_textures.get_rid(); }
+	uint64_t get_texture_memory() const { return _generated_albedo_textures.get_memory() + _generated_normal_textures.get_memory(); }
 	PackedColorArray get_texture_colors() { return _texture_colors; }
 	PackedFloat32Array get_texture_uv_scales() { return _texture_uv_scales; }
 	PackedFloat32Array get_texture_uv_rotations() { return _texture_uv_rotations; }
+	void set_memory_budget(int p_megabytes);
+	int get_memory_budget() const { return _memory_budget; }
+	void set_memory_budget_mobile(int p_megabytes);
+	int get_memory_budget_mobile() const { return _memory_budget_mobile; }
+	int get_mipmap_skip() const { return _albedo_layout.mipmap_skip; }
 
 	void save();
 
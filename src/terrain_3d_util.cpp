@@ -45,6 +45,17 @@ Ref<Image> Terrain3DUtil::black_to_alpha(const Ref<Image> p_image) {
 	return img;
 }
 
+/**
+ * Returns a copy of the image that shares its data until either is written to, so can be taken
+ * on the main thread for free and read from another thread
+ */
+Ref<Image> Terrain3DUtil::get_shared_copy(const Ref<Image> p_image) {
+	if (p_image.is_null()) {
+		return Ref<Image>();
+	}
+	return Image::create_from_data(p_image->get_width(), p_image->get_height(), p_image->has_mipmaps(), p_image->get_format(), p_image->get_data());
+}
+
 /**
  * Returns the minimum and maximum values for a heightmap (red channel only)
  */
@@ -59,14 +70,27 @@ Vector2 Terrain3DUtil::get_min_max(const Ref<Image> p_image) {
 
 	Vector2 min_max = Vector2(0.f, 0.f);
 
-	for (int y = 0; y < p_image->get_height(); y++) {
-		for (int x = 0; x < p_image->get_width(); x++) {
-			Color col = p_image->get_pixel(x, y);
-			if (col.r < min_max.x) {
-				min_max.x = col.r;
-			}
-			if (col.r > min_max.y) {
-				min_max.y = col.r;
+	// Height maps are read directly, other formats through get_pixel()
+	if (p_image->get_format() == Image::FORMAT_RF && !p_image->has_mipmaps()) {
+		const float *heights = reinterpret_cast<const float *>(p_image->ptr());
+		int64_t count = int64_t(p_image->get_width()) * p_image->get_height();
+		float hmin = 0.f;
+		float hmax = 0.f;
+		for (int64_t i = 0; i < count; i++) {
+			hmin = MIN(hmin, heights[i]);
+			hmax = MAX(hmax, heights[i]);
+		}
+		min_max = Vector2(hmin, hmax);
+	} else {
+		for (int y = 0; y < p_image->get_height(); y++) {
+			for (int x = 0; x < p_image->get_width(); x++) {
+				Color col = p_image->get_pixel(x, y);
+				if (col.r < min_max.x) {
+					min_max.x = col.r;
+				}
+				if (col.r > min_max.y) {
+					min_max.y = col.r;
+				}
 			}
 		}
 	}
@@ -230,14 +254,16 @@ Ref<Image> Terrain3DUtil::load_image(String p_file_name, int p_cache_mode, Vecto
 			LOG(DEBUG, "Total file size is: ", fsize, " calculated width: ", fwidth, " dimensions: ", p_r16_size);
 			file->seek(0);
 		}
-		img = Image::create(p_r16_size.x, p_r16_size.y, false, Terrain3DStorage::FORMAT[Terrain3DStorage::TYPE_HEIGHT]);
+		// Decode a row at a time into the height data, rather than a pixel at a time
+		PackedFloat32Array heights;
+		heights.resize(int64_t(p_r16_size.x) * p_r16_size.y);
+		float *height = heights.ptrw();
 		for (int y = 0; y < p_r16_size.y; y++) {
-			for (int x = 0; x < p_r16_size.x; x++) {
-				real_t h = real_t(file->get_16()) / 65535.0f;
-				h = h * (p_r16_height_range.y - p_r16_height_range.x) + p_r16_height_range.x;
-				img->set_pixel(x, y, Color(h, 0.f, 0.f));
-			}
+			PackedByteArray row = file->get_buffer(int64_t(p_r16_size.x) * 2);
+			decode_r16(row.ptr(), MIN(int64_t(p_r16_size.x), row.size() / 2), p_r16_height_range, height);
+			height += p_r16_size.x;
 		}
+		img = Image::create_from_data(p_r16_size.x, p_r16_size.y, false, Terrain3DStorage::FORMAT[Terrain3DStorage::TYPE_HEIGHT], heights.to_byte_array());
 
 		// If an Image extension, use Image loader
 	} else if (imgloader_extensions.has(ext)) {
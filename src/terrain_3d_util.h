@@ -23,6 +23,7 @@ public:
 	// Image operations
 	static Ref<Image> black_to_alpha(const Ref<Image> p_image);
 	static Vector2 get_min_max(const Ref<Image> p_image);
+	static Ref<Image> get_shared_copy(const Ref<Image> p_image);
 	static Ref<Image> get_thumbnail(const Ref<Image> p_image, Vector2i p_size = Vector2i(256, 256));
 	static Ref<Image> get_filled_image(Vector2i p_size,
 			Color p_color = COLOR_BLACK,
@@ -79,6 +80,29 @@ inline real_t bilerp(real_t p_v00, real_t p_v01, real_t p_v10, real_t p_v11,
 	return bilerp(p_v00, p_v01, p_v10, p_v11, pos00, pos11, pos);
 }
 
+///////////////////////////
+// R16 Handling
+///////////////////////////
+
+// Decodes p_count little endian 16-bit values to heights across p_height_range
+inline void decode_r16(const uint8_t *p_src, int64_t p_count, Vector2 p_height_range, float *r_heights) {
+	real_t scale = (p_height_range.y - p_height_range.x) / 65535.0f;
+	for (int64_t i = 0; i < p_count; i++) {
+		uint16_t value = uint16_t(p_src[i * 2]) | (uint16_t(p_src[i * 2 + 1]) << 8);
+		r_heights[i] = float(real_t(value) * scale + p_height_range.x);
+	}
+}
+
+// Encodes p_count heights across p_height_range to little endian 16-bit values
+inline void encode_r16(const float *p_heights, int64_t p_count, Vector2 p_height_range, uint8_t *r_dst) {
+	real_t scale = 65535.0f / (p_height_range.y - p_height_range.x);
+	for (int64_t i = 0; i < p_count; i++) {
+		int value = CLAMP(int((real_t(p_heights[i]) - p_height_range.x) * scale), 0, 65535);
+		r_dst[i * 2] = uint8_t(value & 0xFF);
+		r_dst[i * 2 + 1] = uint8_t(value >> 8);
+	}
+}
+
 ///////////////////////////
 // Controlmap Handling
 ///////////////////////////
@@ -120,6 +144,12 @@ inline bool is_auto(uint32_t pixel) { return (pixel & 0x1) == 1; }
 inline bool is_auto(float pixel) { return is_auto(as_uint(pixel)); }
 inline uint32_t enc_auto(bool autosh) { return autosh & 0x1; }
 
+// Bit masks holding a flag per control map pixel, in row order, 8 pixels per byte
+inline bool get_mask_bit(const uint8_t *p_mask, int p_index) { return (p_mask[p_index >> 3] >> (p_index & 7)) & 0x1; }
+inline void set_mask_bit(uint8_t *p_mask, int p_index, bool p_value) {
+	p_mask[p_index >> 3] = (p_mask[p_index >> 3] & ~(1 << (p_index & 7))) | (uint8_t(p_value) << (p_index & 7));
+}
+
 // Aliases for GDScript
 inline uint32_t gd_get_base(uint32_t pixel) { return get_base(pixel); }
 inline uint32_t gd_enc_base(uint32_t base) { return enc_base(base); }